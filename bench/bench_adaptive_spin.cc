@@ -0,0 +1,149 @@
+//
+// bench_adaptive_spin.cc
+// ~~~~~~~~~~~~~~~~~~~~~~
+//
+// Copyright (c) 2020 Casey Bodley (cbodley at redhat dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+// Measure the latency of operations that another thread completes after a
+// short delay, from a coroutine that suspends on each one and from one that
+// spins first with yield.adaptive_spin(). The coroutine runs on an
+// io_context executor without a strand, and the io_context runs on two
+// threads.
+//
+// usage: bench_adaptive_spin [operations] [delay ns]
+
+#include <spawn/spawn.hpp>
+
+#include <boost/asio/bind_executor.hpp>
+#include <boost/asio/dispatch.hpp>
+#include <boost/asio/executor_work_guard.hpp>
+#include <boost/asio/io_context.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+using clock_type = std::chrono::steady_clock;
+
+struct job
+{
+  virtual ~job() {}
+  virtual void complete() = 0;
+};
+
+template <typename Handler>
+struct handler_job : job
+{
+  Handler handler;
+  explicit handler_job(Handler&& h) : handler(std::move(h)) {}
+  void complete() override
+  {
+    auto ex = boost::asio::get_associated_executor(handler);
+    boost::asio::dispatch(ex, std::move(handler));
+  }
+};
+
+// a thread that completes each operation after busy-waiting for the delay,
+// like a reply that arrives on another thread's connection
+class completer
+{
+public:
+  explicit completer(std::chrono::nanoseconds delay)
+    : delay_(delay), thread_([this] { run(); })
+  {
+  }
+  ~completer()
+  {
+    stop_ = true;
+    thread_.join();
+  }
+
+  template <typename CompletionToken>
+  auto async_call(CompletionToken&& token)
+    -> BOOST_ASIO_INITFN_RESULT_TYPE(CompletionToken, void())
+  {
+    boost::asio::async_completion<CompletionToken, void()> init(token);
+    using handler_type = typename std::decay<decltype(init.completion_handler)>::type;
+    job_.store(new handler_job<handler_type>(std::move(init.completion_handler)),
+               std::memory_order_release);
+    return init.result.get();
+  }
+
+private:
+  void run()
+  {
+    while (!stop_) {
+      job* j = job_.exchange(nullptr, std::memory_order_acquire);
+      if (!j) {
+        std::this_thread::yield();
+        continue;
+      }
+      const auto until = clock_type::now() + delay_;
+      while (clock_type::now() < until)
+        ;
+      j->complete();
+      delete j;
+    }
+  }
+
+  const std::chrono::nanoseconds delay_;
+  std::atomic<job*> job_{nullptr};
+  std::atomic<bool> stop_{false};
+  std::thread thread_;
+};
+
+static double percentile(std::vector<double>& v, double p)
+{
+  const std::size_t i = static_cast<std::size_t>(p * (v.size() - 1));
+  std::nth_element(v.begin(), v.begin() + i, v.end());
+  return v[i];
+}
+
+void bench(const char* name, int operations, std::chrono::nanoseconds delay,
+           bool spin)
+{
+  boost::asio::io_context ioc;
+  completer remote(delay);
+  std::vector<double> latencies;
+  latencies.reserve(operations);
+  // the completer holds the handler without counting as work
+  auto work = boost::asio::make_work_guard(ioc);
+
+  spawn::spawn(boost::asio::bind_executor(ioc.get_executor(), [] {}),
+      [&] (spawn::yield_context yield) {
+        const spawn::yield_context token = spin ? yield.adaptive_spin() : yield;
+        for (int i = 0; i < operations; i++) {
+          const auto start = clock_type::now();
+          remote.async_call(token);
+          latencies.push_back(std::chrono::duration<double, std::micro>(
+              clock_type::now() - start).count());
+        }
+        work.reset();
+      });
+  std::thread second([&ioc] { ioc.run(); });
+  ioc.run();
+  second.join();
+
+  std::printf("%-16s %8d ops  p50 %8.2f us  p99 %8.2f us\n", name, operations,
+              percentile(latencies, 0.5), percentile(latencies, 0.99));
+}
+
+int main(int argc, char** argv)
+{
+  const int operations = argc > 1 ? std::atoi(argv[1]) : 20000;
+  const std::chrono::nanoseconds delay(argc > 2 ? std::atol(argv[2]) : 2000);
+  if (!spawn::detail::spin_possible()) {
+    std::printf("single CPU: adaptive_spin() never spins here\n");
+  }
+  bench("suspend", operations, delay, false);
+  bench("adaptive_spin", operations, delay, true);
+  return 0;
+}
@@ -0,0 +1,106 @@
+//
+// bench_batch.cc
+// ~~~~~~~~~~~~~~
+//
+// Copyright (c) 2020 Casey Bodley (cbodley at redhat dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+// Compare the time it takes to launch and run many short coroutines with
+// spawn() in a loop against a single spawn_n().
+//
+// usage: bench_batch [coroutines]
+
+#include <spawn/batch.hpp>
+
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/post.hpp>
+#include <boost/context/fixedsize_stack.hpp>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+using clock_type = std::chrono::steady_clock;
+
+constexpr std::size_t stack_size = 32 * 1024;
+
+struct worker
+{
+  int& count;
+
+  template <typename Handler>
+  void operator()(spawn::basic_yield_context<Handler> yield)
+  {
+    boost::asio::post(yield);
+    ++count;
+  }
+};
+
+void report(const char* name, int coroutines, clock_type::duration elapsed)
+{
+  const auto seconds = std::chrono::duration<double>(elapsed).count();
+  std::printf("%-28s %8.3f s %10.0f coroutines/s\n",
+              name, seconds, coroutines / seconds);
+}
+
+void bench_spawn(int coroutines)
+{
+  boost::asio::io_context ioc;
+  int count = 0;
+  const auto start = clock_type::now();
+  for (int i = 0; i < coroutines; i++) {
+    spawn::spawn(ioc, worker{count}, boost::context::fixedsize_stack(stack_size));
+  }
+  ioc.run();
+  report("spawn() loop", count, clock_type::now() - start);
+}
+
+void bench_spawn_strand(int coroutines)
+{
+  boost::asio::io_context ioc;
+  auto strand = boost::asio::make_strand(ioc);
+  int count = 0;
+  const auto start = clock_type::now();
+  for (int i = 0; i < coroutines; i++) {
+    spawn::spawn(strand, worker{count}, boost::context::fixedsize_stack(stack_size));
+  }
+  ioc.run();
+  report("spawn() loop, shared strand", count, clock_type::now() - start);
+}
+
+void bench_spawn_n(int coroutines)
+{
+  boost::asio::io_context ioc;
+  int count = 0;
+  const auto start = clock_type::now();
+  spawn::spawn_n(ioc.get_executor(), coroutines, worker{count},
+                 boost::context::fixedsize_stack(stack_size));
+  ioc.run();
+  report("spawn_n()", count, clock_type::now() - start);
+}
+
+void bench_spawn_n_strand(int coroutines)
+{
+  boost::asio::io_context ioc;
+  auto strand = boost::asio::make_strand(ioc);
+  int count = 0;
+  const auto start = clock_type::now();
+  spawn::spawn_n(strand, coroutines, worker{count},
+                 boost::context::fixedsize_stack(stack_size));
+  ioc.run();
+  report("spawn_n(), shared strand", count, clock_type::now() - start);
+}
+
+int main(int argc, char** argv)
+{
+  const int coroutines = argc > 1 ? std::atoi(argv[1]) : 100000;
+
+  bench_spawn(coroutines);
+  bench_spawn_strand(coroutines);
+  bench_spawn_n(coroutines);
+  bench_spawn_n_strand(coroutines);
+  return 0;
+}
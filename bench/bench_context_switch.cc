@@ -0,0 +1,66 @@
+//
+// bench_context_switch.cc
+// ~~~~~~~~~~~~~~~~~~~~~~~
+//
+// Copyright (c) 2020 Casey Bodley (cbodley at redhat dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+// Compare the cost of a round trip into a continuation and back with
+// boost::context's continuation against the one that SPAWN_FAST_CONTEXT_SWITCH
+// selects.
+//
+// usage: bench_context_switch [round trips]
+
+#if !defined(SPAWN_FAST_CONTEXT_SWITCH)
+#define SPAWN_FAST_CONTEXT_SWITCH
+#endif
+#include <spawn/detail/fast_context.hpp>
+
+#include <boost/context/fixedsize_stack.hpp>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+using clock_type = std::chrono::steady_clock;
+
+template <typename Continuation, typename Callcc>
+void bench(const char* name, long round_trips, Callcc&& callcc)
+{
+  Continuation c = callcc(std::allocator_arg, boost::context::fixedsize_stack(),
+      [] (Continuation&& caller) {
+        for (;;) {
+          caller = caller.resume();
+        }
+        return std::move(caller);
+      });
+
+  const auto start = clock_type::now();
+  for (long i = 0; i < round_trips; i++) {
+    c = c.resume();
+  }
+  const auto elapsed = clock_type::now() - start;
+  const auto ns = std::chrono::duration<double, std::nano>(elapsed).count();
+  std::printf("%-28s %8.2f ns/round trip\n", name, ns / round_trips);
+}
+
+int main(int argc, char** argv)
+{
+  const long round_trips = argc > 1 ? std::atol(argv[1]) : 10000000;
+
+  bench<boost::context::continuation>("boost::context", round_trips,
+      [] (std::allocator_arg_t a, boost::context::fixedsize_stack s, auto&& f) {
+        return boost::context::callcc(a, s, std::move(f));
+      });
+#if defined(SPAWN_HAS_FAST_CONTEXT_SWITCH)
+  using spawn::detail::fast_context::continuation;
+  bench<continuation>("SPAWN_FAST_CONTEXT_SWITCH", round_trips,
+      [] (std::allocator_arg_t a, boost::context::fixedsize_stack s, auto&& f) {
+        return spawn::detail::fast_context::callcc(a, s, std::move(f));
+      });
+#endif
+  return 0;
+}
@@ -0,0 +1,64 @@
+//
+// bench_coroutine_local.cc
+// ~~~~~~~~~~~~~~~~~~~~~~~~
+//
+// Copyright (c) 2020 Casey Bodley (cbodley at redhat dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+// Compare the cost of reading a coroutine_local from a coroutine against a
+// thread_local and a value passed by reference.
+//
+// usage: bench_coroutine_local [accesses]
+
+#include <spawn/coroutine_local.hpp>
+
+#include <boost/asio/io_context.hpp>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+using clock_type = std::chrono::steady_clock;
+
+static spawn::coroutine_local<long> coro_value;
+static thread_local long thread_value;
+
+// keep the compiler from hoisting the accesses out of the loop
+#define SPAWN_BENCH_NOINLINE __attribute__((noinline))
+
+SPAWN_BENCH_NOINLINE static void touch_argument(long& value) { ++value; }
+SPAWN_BENCH_NOINLINE static void touch_thread_local() { ++thread_value; }
+SPAWN_BENCH_NOINLINE static void touch_coroutine_local() { ++*coro_value; }
+
+template <typename Function>
+void bench(const char* name, long accesses, Function&& f)
+{
+  boost::asio::io_context ioc;
+  double seconds = 0;
+  spawn::spawn(ioc, [&] (spawn::yield_context) {
+      const auto start = clock_type::now();
+      f(accesses);
+      seconds = std::chrono::duration<double>(clock_type::now() - start).count();
+    });
+  ioc.run();
+  std::printf("%-20s %8.2f ns/access\n", name, seconds * 1e9 / accesses);
+}
+
+int main(int argc, char** argv)
+{
+  const long accesses = argc > 1 ? std::atol(argv[1]) : 100000000;
+  bench("argument", accesses, [] (long n) {
+      long value = 0;
+      for (long i = 0; i < n; i++) touch_argument(value);
+    });
+  bench("thread_local", accesses, [] (long n) {
+      for (long i = 0; i < n; i++) touch_thread_local();
+    });
+  bench("coroutine_local", accesses, [] (long n) {
+      for (long i = 0; i < n; i++) touch_coroutine_local();
+    });
+  return 0;
+}
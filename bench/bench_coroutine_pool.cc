@@ -0,0 +1,121 @@
+//
+// bench_coroutine_pool.cc
+// ~~~~~~~~~~~~~~~~~~~~~~~
+//
+// Copyright (c) 2020 Casey Bodley (cbodley at redhat dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+// Compare the rate of micro-tasks run with spawn() against coroutine_pool.
+//
+// usage: bench_coroutine_pool [tasks] [window]
+
+#include <spawn/coroutine_pool.hpp>
+
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/post.hpp>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+
+using clock_type = std::chrono::steady_clock;
+
+template <typename CompletionToken>
+auto async_yield(CompletionToken&& token)
+  -> BOOST_ASIO_INITFN_RESULT_TYPE(CompletionToken, void())
+{
+  boost::asio::async_completion<CompletionToken, void()> init(token);
+  boost::asio::post(std::move(init.completion_handler));
+  return init.result.get();
+}
+
+// Each finished task posts the launch of another until 'tasks' have run,
+// keeping 'window' tasks in flight.
+struct bench
+{
+  boost::asio::io_context ioc;
+  int remaining;
+  std::function<void()> launch;
+
+  void finish()
+  {
+    if (remaining > 0) {
+      --remaining;
+      boost::asio::post(ioc, launch);
+    }
+  }
+
+  void run(const char* name, int tasks, int window)
+  {
+    remaining = tasks;
+    const auto start = clock_type::now();
+    for (int i = 0; i < window; i++) {
+      finish();
+    }
+    ioc.run();
+    const auto elapsed = std::chrono::duration<double>(clock_type::now() - start);
+    std::printf("%-28s %10.0f tasks/s\n", name, tasks / elapsed.count());
+  }
+};
+
+struct noop_task
+{
+  bench& b;
+  void operator()(spawn::yield_context) { b.finish(); }
+};
+
+struct yield_task
+{
+  bench& b;
+  void operator()(spawn::yield_context yield)
+  {
+    async_yield(yield);
+    b.finish();
+  }
+};
+
+template <typename Task>
+void bench_spawn(const char* name, int tasks, int window)
+{
+  bench b;
+  b.launch = [&b] { spawn::spawn(b.ioc, Task{b}); };
+  b.run(name, tasks, window);
+}
+
+template <typename Task>
+void bench_spawn_unstranded(const char* name, int tasks, int window)
+{
+  bench b;
+  b.launch = [&b] {
+    spawn::spawn(bind_executor(b.ioc.get_executor(), [] {}), Task{b});
+  };
+  b.run(name, tasks, window);
+}
+
+template <typename Task>
+void bench_pool(const char* name, int tasks, int window)
+{
+  bench b;
+  spawn::coroutine_pool pool(b.ioc.get_executor(), window);
+  b.launch = [&b, &pool] { pool.submit(Task{b}); };
+  b.run(name, tasks, window);
+}
+
+int main(int argc, char** argv)
+{
+  const int tasks = argc > 1 ? std::atoi(argv[1]) : 1000000;
+  const int window = argc > 2 ? std::atoi(argv[2]) : 16;
+
+  bench_spawn<noop_task>("spawn(strand)", tasks, window);
+  bench_spawn_unstranded<noop_task>("spawn(executor)", tasks, window);
+  bench_pool<noop_task>("coroutine_pool", tasks, window);
+
+  bench_spawn<yield_task>("spawn(strand) + yield", tasks, window);
+  bench_spawn_unstranded<yield_task>("spawn(executor) + yield", tasks, window);
+  bench_pool<yield_task>("coroutine_pool + yield", tasks, window);
+  return 0;
+}
@@ -0,0 +1,135 @@
+//
+// bench_idle_memory.cc
+// ~~~~~~~~~~~~~~~~~~~~
+//
+// Copyright (c) 2020 Casey Bodley (cbodley at redhat dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+// Measure the resident memory of many coroutines that are suspended on a
+// timer with a shallow stack, for each stack allocator.
+//
+// usage: bench_idle_memory <fixedsize|protected|growable|growable-noguard|
+//                           hibernating> [coroutines] [stack size]
+//
+// For hibernating stacks, it also measures the memory after every coroutine
+// has hibernated.
+//
+// Each protected or guarded growable stack takes two memory mappings, so
+// more than about 32000 of them need a higher vm.max_map_count.
+
+#include <spawn/growable_stack.hpp>
+#include <spawn/hibernating_stack.hpp>
+#include <spawn/spawn.hpp>
+
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <boost/context/fixedsize_stack.hpp>
+#include <boost/context/protected_fixedsize_stack.hpp>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <unistd.h>
+
+static std::size_t resident_bytes()
+{
+  long pages = 0, resident = 0;
+  FILE* f = std::fopen("/proc/self/statm", "r");
+  if (f) {
+    if (std::fscanf(f, "%ld %ld", &pages, &resident) != 2) {
+      resident = 0;
+    }
+    std::fclose(f);
+  }
+  return static_cast<std::size_t>(resident) * ::sysconf(_SC_PAGESIZE);
+}
+
+struct idle_session
+{
+  template <typename Handler>
+  void operator()(spawn::basic_yield_context<Handler> yield)
+  {
+    // the io_context links timers into its queue, so keep this one off of
+    // the stack where a hibernating_stack could release it
+    std::unique_ptr<boost::asio::steady_timer> timer(new boost::asio::steady_timer(
+        get_associated_executor(yield.handler_), std::chrono::hours(1)));
+    boost::system::error_code ec;
+    timer->async_wait(yield[ec]);
+  }
+};
+
+static void report(const char* name, int coroutines,
+                   std::size_t before, std::size_t after)
+{
+  std::printf("%-18s %8d coroutines %10.1f MiB %8.0f bytes/coroutine\n",
+              name, coroutines, (after - before) / 1048576.0,
+              double(after - before) / coroutines);
+}
+
+template <typename StackAllocator>
+void bench(const char* name, int coroutines, StackAllocator salloc)
+{
+  std::unique_ptr<boost::asio::io_context> ioc(new boost::asio::io_context);
+  const std::size_t before = resident_bytes();
+  for (int i = 0; i < coroutines; i++) {
+    spawn::spawn(*ioc, idle_session{}, salloc);
+  }
+  ioc->poll();
+  report(name, coroutines, before, resident_bytes());
+  ioc->stop();
+}
+
+void bench_hibernating(int coroutines, spawn::hibernating_stack salloc)
+{
+  std::unique_ptr<boost::asio::io_context> ioc(new boost::asio::io_context);
+  const std::size_t before = resident_bytes();
+  for (int i = 0; i < coroutines; i++) {
+    spawn::spawn(*ioc, idle_session{}, salloc);
+  }
+  ioc->poll();
+  report("hibernating", coroutines, before, resident_bytes());
+
+  using std::chrono::steady_clock;
+  const auto start = steady_clock::now();
+  const std::size_t count = salloc.hibernate_idle(steady_clock::duration::zero());
+  const auto elapsed = steady_clock::now() - start;
+  report("  hibernated", coroutines, before, resident_bytes());
+  std::printf("%-18s %8zu stacks in %.1f ms\n", "  hibernate_idle()", count,
+              std::chrono::duration<double, std::milli>(elapsed).count());
+  ioc->stop();
+}
+
+int main(int argc, char** argv)
+{
+  if (argc < 2) {
+    std::fprintf(stderr, "usage: %s <fixedsize|protected|growable|growable-noguard|"
+                 "hibernating> [coroutines] [stack size]\n", argv[0]);
+    return 1;
+  }
+  const char* name = argv[1];
+  const int coroutines = argc > 2 ? std::atoi(argv[2]) : 30000;
+  const std::size_t size = argc > 3 ? std::atol(argv[3]) : 0;
+
+  if (std::strcmp(name, "fixedsize") == 0) {
+    bench(name, coroutines, boost::context::fixedsize_stack(size ? size : 128 * 1024));
+  } else if (std::strcmp(name, "protected") == 0) {
+    bench(name, coroutines, boost::context::protected_fixedsize_stack(size ? size : 128 * 1024));
+  } else if (std::strcmp(name, "growable") == 0) {
+    bench(name, coroutines, spawn::growable_stack(size ? size : 8 * 1024 * 1024));
+  } else if (std::strcmp(name, "growable-noguard") == 0) {
+    bench(name, coroutines, spawn::growable_stack(size ? size : 8 * 1024 * 1024, false));
+  } else if (std::strcmp(name, "hibernating") == 0) {
+    bench_hibernating(coroutines, spawn::hibernating_stack(size ? size : 8 * 1024 * 1024));
+  } else {
+    std::fprintf(stderr, "unknown allocator %s\n", name);
+    return 1;
+  }
+  // exit without unwinding every coroutine
+  std::fflush(stdout);
+  std::_Exit(0);
+}
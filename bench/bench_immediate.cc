@@ -0,0 +1,85 @@
+//
+// bench_immediate.cc
+// ~~~~~~~~~~~~~~~~~~
+//
+// Copyright (c) 2020 Casey Bodley (cbodley at redhat dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+// Compare the rate of operations that complete synchronously when their
+// handler is posted, against complete_immediately().
+//
+// usage: bench_immediate [operations]
+
+#include <spawn/immediate.hpp>
+
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/post.hpp>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+using clock_type = std::chrono::steady_clock;
+
+template <typename CompletionToken>
+auto async_yield(CompletionToken&& token)
+  -> BOOST_ASIO_INITFN_RESULT_TYPE(CompletionToken, void())
+{
+  boost::asio::async_completion<CompletionToken, void()> init(token);
+  boost::asio::post(std::move(init.completion_handler));
+  return init.result.get();
+}
+
+template <typename CompletionToken>
+auto async_ready(CompletionToken&& token)
+  -> BOOST_ASIO_INITFN_RESULT_TYPE(CompletionToken, void())
+{
+  boost::asio::async_completion<CompletionToken, void()> init(token);
+  spawn::complete_immediately(std::move(init.completion_handler));
+  return init.result.get();
+}
+
+struct post_loop
+{
+  int operations;
+  void operator()(spawn::yield_context yield)
+  {
+    for (int i = 0; i < operations; i++) {
+      async_yield(yield);
+    }
+  }
+};
+
+struct immediate_loop
+{
+  int operations;
+  void operator()(spawn::yield_context yield)
+  {
+    for (int i = 0; i < operations; i++) {
+      async_ready(yield);
+    }
+  }
+};
+
+template <typename Loop>
+void bench(const char* name, int operations)
+{
+  boost::asio::io_context ioc;
+  spawn::spawn(ioc, Loop{operations});
+  const auto start = clock_type::now();
+  ioc.run();
+  const auto elapsed = std::chrono::duration<double>(clock_type::now() - start);
+  std::printf("%-28s %12.0f ops/s\n", name, operations / elapsed.count());
+}
+
+int main(int argc, char** argv)
+{
+  const int operations = argc > 1 ? std::atoi(argv[1]) : 10000000;
+
+  bench<post_loop>("post", operations);
+  bench<immediate_loop>("complete_immediately", operations);
+  return 0;
+}
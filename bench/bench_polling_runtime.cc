@@ -0,0 +1,133 @@
+//
+// bench_polling_runtime.cc
+// ~~~~~~~~~~~~~~~~~~~~~~~~
+//
+// Copyright (c) 2020 Casey Bodley (cbodley at redhat dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+// Measure loopback TCP round trips to an echo coroutine that runs on an
+// io_context::run() thread, and to one that runs on a polling_runtime. The
+// client is a separate thread with a blocking socket, so the server is idle
+// whenever a request arrives and each round trip includes its wakeup.
+//
+// usage: bench_polling_runtime [round trips] [message bytes] [server cpu]
+//
+// With a server cpu, both servers' threads are pinned to it. The client
+// should have a CPU of its own, for example with taskset on the rest.
+
+#include <spawn/polling_runtime.hpp>
+#include <spawn/spawn.hpp>
+
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/asio/read.hpp>
+#include <boost/asio/write.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+namespace asio = boost::asio;
+using tcp = asio::ip::tcp;
+using clock_type = std::chrono::steady_clock;
+
+// echo each message back until the client disconnects
+void echo(tcp::acceptor& acceptor, std::size_t bytes, spawn::yield_context yield)
+{
+  tcp::socket socket(yield.handler_.get_executor());
+  acceptor.async_accept(socket, yield);
+  socket.set_option(tcp::no_delay(true));
+  std::vector<char> buffer(bytes);
+  boost::system::error_code ec;
+  while (asio::async_read(socket, asio::buffer(buffer), yield[ec])) {
+    asio::async_write(socket, asio::buffer(buffer), yield);
+  }
+}
+
+// return the round trip latencies in microseconds
+std::vector<double> client(const tcp::endpoint& endpoint, int round_trips,
+                           std::size_t bytes)
+{
+  asio::io_context ioc;
+  tcp::socket socket(ioc);
+  socket.connect(endpoint);
+  socket.set_option(tcp::no_delay(true));
+  std::vector<char> buffer(bytes, 'x');
+  std::vector<double> latencies;
+  latencies.reserve(round_trips);
+  for (int i = 0; i < round_trips; i++) {
+    const auto start = clock_type::now();
+    asio::write(socket, asio::buffer(buffer));
+    asio::read(socket, asio::buffer(buffer));
+    latencies.push_back(std::chrono::duration<double, std::micro>(
+        clock_type::now() - start).count());
+  }
+  return latencies;
+}
+
+static double percentile(std::vector<double>& v, double p)
+{
+  const std::size_t i = static_cast<std::size_t>(p * (v.size() - 1));
+  std::nth_element(v.begin(), v.begin() + i, v.end());
+  return v[i];
+}
+
+void report(const char* name, std::vector<double> latencies)
+{
+  std::printf("%-16s %8zu round trips  p50 %7.2f  p90 %7.2f  p99 %7.2f"
+              "  p99.9 %7.2f us\n", name, latencies.size(),
+              percentile(latencies, 0.5), percentile(latencies, 0.9),
+              percentile(latencies, 0.99), percentile(latencies, 0.999));
+}
+
+void bench_run(int round_trips, std::size_t bytes, int cpu)
+{
+  asio::io_context ioc(1);
+  tcp::acceptor acceptor(ioc, {asio::ip::address_v4::loopback(), 0});
+  spawn::spawn(ioc, [&] (spawn::yield_context yield) {
+      echo(acceptor, bytes, yield);
+    });
+  std::thread server([&ioc] { ioc.run(); });
+  if (cpu >= 0) {
+    spawn::detail::pin_thread(server, cpu);
+  }
+  report("io_context::run",
+         client(acceptor.local_endpoint(), round_trips, bytes));
+  server.join();
+}
+
+void bench_polling(int round_trips, std::size_t bytes, int cpu)
+{
+  spawn::polling_options options;
+  if (cpu >= 0) {
+    options.cpus = {cpu};
+  }
+  spawn::polling_runtime runtime(options);
+  tcp::acceptor acceptor(runtime.shard(0),
+                         {asio::ip::address_v4::loopback(), 0});
+  spawn::spawn(runtime, [&] (spawn::yield_context yield) {
+      echo(acceptor, bytes, yield);
+    });
+  report("polling_runtime",
+         client(acceptor.local_endpoint(), round_trips, bytes));
+  runtime.join();
+}
+
+int main(int argc, char** argv)
+{
+  const int round_trips = argc > 1 ? std::atoi(argv[1]) : 100000;
+  const std::size_t bytes = argc > 2 ? std::atoi(argv[2]) : 64;
+  const int cpu = argc > 3 ? std::atoi(argv[3]) : -1;
+  if (std::thread::hardware_concurrency() < 2) {
+    std::printf("single CPU: the polling server and the client share it\n");
+  }
+  bench_run(round_trips, bytes, cpu);
+  bench_polling(round_trips, bytes, cpu);
+  return 0;
+}
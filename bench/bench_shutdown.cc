@@ -0,0 +1,113 @@
+//
+// bench_shutdown.cc
+// ~~~~~~~~~~~~~~~~~
+//
+// Copyright (c) 2020 Casey Bodley (cbodley at redhat dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+// Compare the time it takes to get rid of many suspended coroutines by
+// destroying their io_context against a shutdown_group.
+//
+// usage: bench_shutdown [coroutines] [threads]
+
+#include <spawn/shutdown.hpp>
+
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <boost/context/fixedsize_stack.hpp>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <thread>
+#include <vector>
+
+using clock_type = std::chrono::steady_clock;
+
+constexpr std::size_t stack_size = 32 * 1024;
+
+struct waiter
+{
+  template <typename Handler>
+  void operator()(spawn::basic_yield_context<Handler> yield)
+  {
+    boost::asio::steady_timer timer(get_associated_executor(yield.handler_),
+                                    std::chrono::hours(1));
+    timer.async_wait(yield);
+  }
+
+  template <typename Handler>
+  void operator()(spawn::basic_yield_context<Handler> yield,
+                  spawn::shutdown_signal& signal)
+  {
+    boost::asio::steady_timer timer(get_associated_executor(yield.handler_),
+                                    std::chrono::hours(1));
+    signal.on_shutdown([&timer] { timer.cancel(); });
+    boost::system::error_code ec;
+    if (!signal.requested())
+      timer.async_wait(yield[ec]);
+  }
+};
+
+void report(const char* name, int coroutines, clock_type::duration elapsed)
+{
+  const auto seconds = std::chrono::duration<double>(elapsed).count();
+  std::printf("%-28s %8.3f s %10.0f coroutines/s\n",
+              name, seconds, coroutines / seconds);
+}
+
+void bench_destroy(int coroutines)
+{
+  std::unique_ptr<boost::asio::io_context> ioc(new boost::asio::io_context);
+  for (int i = 0; i < coroutines; i++) {
+    spawn::spawn(*ioc, waiter{}, boost::context::fixedsize_stack(stack_size));
+  }
+  ioc->poll();
+
+  const auto start = clock_type::now();
+  ioc.reset(); // unwinds each coroutine with forced_unwind
+  report("~io_context", coroutines, clock_type::now() - start);
+}
+
+void bench_shutdown(int coroutines, int threads)
+{
+  boost::asio::io_context ioc;
+  spawn::shutdown_group group(ioc.get_executor());
+  for (int i = 0; i < coroutines; i++) {
+    group.spawn(ioc, waiter{}, boost::context::fixedsize_stack(stack_size));
+  }
+  ioc.poll();
+  ioc.restart();
+
+  const auto start = clock_type::now();
+  group.async_shutdown([] {});
+  std::vector<std::thread> workers;
+  for (int i = 1; i < threads; i++) {
+    workers.emplace_back([&ioc] { ioc.run(); });
+  }
+  ioc.run();
+  for (auto& t : workers) {
+    t.join();
+  }
+  char name[64];
+  std::snprintf(name, sizeof(name), "shutdown_group (%d threads)", threads);
+  report(name, coroutines, clock_type::now() - start);
+}
+
+int main(int argc, char** argv)
+{
+  const int coroutines = argc > 1 ? std::atoi(argv[1]) : 100000;
+  const int threads = argc > 2 ? std::atoi(argv[2])
+                               : std::max(1u, std::thread::hardware_concurrency());
+
+  bench_destroy(coroutines);
+  bench_shutdown(coroutines, 1);
+  if (threads > 1) {
+    bench_shutdown(coroutines, threads);
+  }
+  return 0;
+}
@@ -0,0 +1,73 @@
+//
+// bench_trace.cc
+// ~~~~~~~~~~~~~~
+//
+// Copyright (c) 2020 Casey Bodley (cbodley at redhat dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+// Measure the cost of recording a trace event, and of a context switch
+// round trip with SPAWN_TRACING defined, which records two events each way.
+// Compare the latter with bench_context_switch. Most of an event is the
+// time stamp, which costs far more under a hypervisor that traps rdtsc, so
+// that is measured on its own too.
+//
+// usage: bench_trace [iterations]
+
+#ifndef SPAWN_TRACING
+#define SPAWN_TRACING
+#endif
+#include <spawn/spawn.hpp>
+#include <spawn/trace.hpp>
+
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/post.hpp>
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+
+using clock_type = std::chrono::steady_clock;
+
+static double ns_per(clock_type::duration elapsed, long iterations)
+{
+  return std::chrono::duration<double, std::nano>(elapsed).count() / iterations;
+}
+
+int main(int argc, char** argv)
+{
+  const long iterations = argc > 1 ? std::atol(argv[1]) : 10000000;
+
+  volatile std::uint64_t ticks = 0;
+  auto start = clock_type::now();
+  for (long i = 0; i < iterations; i++) {
+    ticks = ticks + spawn::detail::trace_clock();
+  }
+  std::printf("trace_clock: %.1f ns/read\n",
+              ns_per(clock_type::now() - start, iterations));
+
+  int coroutine = 0;
+  start = clock_type::now();
+  for (long i = 0; i < iterations; i++) {
+    spawn::detail::trace_record(spawn::detail::trace_type::resume,
+                                &coroutine, "label", nullptr);
+  }
+  std::printf("trace_record: %.1f ns/event\n",
+              ns_per(clock_type::now() - start, iterations));
+
+  boost::asio::io_context ioc;
+  const long posts = iterations / 10;
+  start = clock_type::now();
+  spawn::spawn(ioc, [posts] (spawn::yield_context yield) {
+      for (long i = 0; i < posts; i++) {
+        boost::asio::post(yield);
+      }
+    });
+  ioc.run();
+  std::printf("traced post(yield): %.1f ns/round trip\n",
+              ns_per(clock_type::now() - start, posts));
+  return 0;
+}
@@ -0,0 +1,105 @@
+//
+// bench_virtual_time.cc
+// ~~~~~~~~~~~~~~~~~~~~~
+//
+// Copyright (c) 2020 Casey Bodley (cbodley at redhat dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+// Replay a synthetic trace of coroutines on a virtual_time_context. Each
+// coroutine arrives at a random time within a minute, then alternates
+// between yielding and waiting out a random service time. The virtual
+// latencies and the order of completion depend only on the seed, so two
+// builds given the same arguments must print the same results except for
+// the wall time.
+//
+// usage: bench_virtual_time [coroutines] [steps] [seed]
+
+#include <spawn/latency.hpp>
+#include <spawn/spawn.hpp>
+#include <spawn/virtual_time.hpp>
+
+#include <boost/asio/post.hpp>
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+
+using clock_type = std::chrono::steady_clock;
+
+struct trace_entry
+{
+  std::chrono::nanoseconds arrival;
+  std::uint64_t seed;
+};
+
+struct replay
+{
+  spawn::virtual_time_context& ctx;
+  trace_entry entry;
+  int steps;
+  spawn::latency_histogram& latency;
+  std::uint64_t& checksum;
+  std::uint64_t& completed;
+
+  void operator()(spawn::yield_context yield)
+  {
+    spawn::virtual_timer timer(ctx);
+    timer.expires_at(spawn::virtual_time_context::time_point(entry.arrival));
+    timer.async_wait(yield);
+    const auto start = ctx.now();
+
+    std::mt19937_64 rng(entry.seed);
+    for (int i = 0; i < steps; i++) {
+      boost::asio::post(yield);
+      timer.expires_after(std::chrono::microseconds(rng() % 10000));
+      timer.async_wait(yield);
+    }
+    latency.record((ctx.now() - start).count());
+    // fold the order of completion into the checksum
+    checksum = (checksum ^ entry.seed) * 0x100000001b3ull;
+    ++completed;
+  }
+};
+
+int main(int argc, char** argv)
+{
+  const int coroutines = argc > 1 ? std::atoi(argv[1]) : 100000;
+  const int steps = argc > 2 ? std::atoi(argv[2]) : 10;
+  const std::uint64_t seed = argc > 3 ? std::strtoull(argv[3], nullptr, 0) : 1;
+
+  spawn::virtual_time_context ctx(seed);
+  spawn::latency_histogram latency;
+  std::uint64_t checksum = 0xcbf29ce484222325ull;
+  std::uint64_t completed = 0;
+
+  std::mt19937_64 rng(seed);
+  for (int i = 0; i < coroutines; i++) {
+    trace_entry entry{std::chrono::nanoseconds(rng() % 60000000000ull), rng()};
+    spawn::spawn(ctx, replay{ctx, entry, steps, latency, checksum, completed},
+                 boost::context::fixedsize_stack(16384));
+  }
+
+  const auto start = clock_type::now();
+  const std::size_t handlers = ctx.run();
+  const auto elapsed = std::chrono::duration<double>(clock_type::now() - start);
+
+  const auto virtual_elapsed = std::chrono::duration<double>(
+      ctx.now().time_since_epoch());
+  std::printf("%-20s %12llu\n", "coroutines", (unsigned long long)completed);
+  std::printf("%-20s %12zu\n", "handlers", handlers);
+  std::printf("%-20s %12.3f s\n", "virtual time", virtual_elapsed.count());
+  std::printf("%-20s %12.3f s\n", "wall time", elapsed.count());
+  std::printf("%-20s %12llu ns\n", "latency p50",
+              (unsigned long long)latency.percentile(50));
+  std::printf("%-20s %12llu ns\n", "latency p99",
+              (unsigned long long)latency.percentile(99));
+  std::printf("%-20s %12llu ns\n", "latency max",
+              (unsigned long long)latency.max());
+  std::printf("%-20s %016llx\n", "order checksum", (unsigned long long)checksum);
+  return 0;
+}
@@ -0,0 +1,385 @@
+//
+// spawn_loadtest.cc
+// ~~~~~~~~~~~~~~~~~
+//
+// Copyright (c) 2020 Casey Bodley (cbodley at redhat dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+// A loopback TCP load test with a coroutine per connection on both sides.
+// Each client connection sends a request, waits for the whole response and
+// records the round trip, until the duration is up. Every combination of the
+// given options runs in turn, each with a fresh server and client, and
+// prints its throughput and latency percentiles.
+//
+// usage: spawn_loadtest [options]
+//   --mode=echo,reqresp        echo streams back what it reads; reqresp
+//                              reads a whole request and writes a response
+//   --connections=N[,N...]     concurrent client connections (default 64)
+//   --threads=N[,N...]         threads for each of server and client (1)
+//   --stack=NAME[,NAME...]     fixedsize, protected or growable (fixedsize)
+//   --strand=NAME[,NAME...]    per-connection, shared or none
+//                              (per-connection)
+//   --request=BYTES            request size (64)
+//   --response=BYTES           reqresp response size (64)
+//   --duration=SECONDS         measured time per run (2)
+//   --warmup=SECONDS           unmeasured time before each run (0.2)
+//
+// For example, to compare a change to impl/spawn.hpp against its baseline:
+//   spawn_loadtest --connections=1,64,1024 --threads=1,4 --stack=fixedsize,growable
+
+#include <spawn/growable_stack.hpp>
+#include <spawn/spawn.hpp>
+
+#include <boost/asio/bind_executor.hpp>
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/asio/read.hpp>
+#include <boost/asio/strand.hpp>
+#include <boost/asio/write.hpp>
+#include <boost/context/fixedsize_stack.hpp>
+#include <boost/context/protected_fixedsize_stack.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace asio = boost::asio;
+using tcp = asio::ip::tcp;
+using clock_type = std::chrono::steady_clock;
+
+constexpr std::size_t stack_size = 64 * 1024;
+
+// Picks one of the stack allocators at runtime.
+class stack_allocator
+{
+public:
+  explicit stack_allocator(const std::string& name) : name_(name) {}
+
+  boost::context::stack_context allocate()
+  {
+    if (name_ == "protected")
+      return boost::context::protected_fixedsize_stack(stack_size).allocate();
+    if (name_ == "growable")
+      return spawn::growable_stack(8 * 1024 * 1024).allocate();
+    return boost::context::fixedsize_stack(stack_size).allocate();
+  }
+
+  void deallocate(boost::context::stack_context& sctx)
+  {
+    if (name_ == "protected")
+      boost::context::protected_fixedsize_stack(stack_size).deallocate(sctx);
+    else if (name_ == "growable")
+      spawn::growable_stack(8 * 1024 * 1024).deallocate(sctx);
+    else
+      boost::context::fixedsize_stack(stack_size).deallocate(sctx);
+  }
+
+  static bool valid(const std::string& name)
+  {
+    return name == "fixedsize" || name == "protected" || name == "growable";
+  }
+
+private:
+  std::string name_;
+};
+
+struct config
+{
+  std::string mode;
+  int connections;
+  int threads;
+  std::string stack;
+  std::string strand;
+  std::size_t request;
+  std::size_t response;
+  double duration;
+  double warmup;
+};
+
+void noop_handler() {}
+
+// Start a coroutine on the executor the strand mode asks for.
+template <typename Function>
+void start(const config& cfg, asio::io_context& ioc,
+           asio::strand<asio::io_context::executor_type>& shared,
+           Function&& function)
+{
+  if (cfg.strand == "shared") {
+    spawn::spawn(shared, std::forward<Function>(function),
+                 stack_allocator(cfg.stack));
+  } else if (cfg.strand == "none") {
+    spawn::spawn(asio::bind_executor(ioc.get_executor(), &noop_handler),
+                 std::forward<Function>(function), stack_allocator(cfg.stack));
+  } else {
+    spawn::spawn(ioc.get_executor(), std::forward<Function>(function),
+                 stack_allocator(cfg.stack));
+  }
+}
+
+struct session
+{
+  std::shared_ptr<tcp::socket> socket;
+  const config* cfg;
+
+  template <typename Handler>
+  void operator()(spawn::basic_yield_context<Handler> yield)
+  {
+    boost::system::error_code ec;
+    socket->set_option(tcp::no_delay(true), ec);
+    std::vector<char> request(cfg->request);
+    std::vector<char> response(cfg->response);
+    for (;;) {
+      if (cfg->mode == "echo") {
+        const std::size_t n = socket->async_read_some(
+            asio::buffer(request), yield[ec]);
+        if (ec) break;
+        asio::async_write(*socket, asio::buffer(request.data(), n), yield[ec]);
+      } else {
+        asio::async_read(*socket, asio::buffer(request), yield[ec]);
+        if (ec) break;
+        asio::async_write(*socket, asio::buffer(response), yield[ec]);
+      }
+      if (ec) break;
+    }
+  }
+};
+
+struct acceptor_loop
+{
+  tcp::acceptor* acceptor;
+  const config* cfg;
+  asio::io_context* ioc;
+  asio::strand<asio::io_context::executor_type>* shared;
+
+  template <typename Handler>
+  void operator()(spawn::basic_yield_context<Handler> yield)
+  {
+    for (;;) {
+      boost::system::error_code ec;
+      auto socket = std::make_shared<tcp::socket>(*ioc);
+      acceptor->async_accept(*socket, yield[ec]);
+      if (ec) break;
+      start(*cfg, *ioc, *shared, session{std::move(socket), cfg});
+    }
+  }
+};
+
+struct client
+{
+  const config* cfg;
+  tcp::endpoint endpoint;
+  asio::io_context* ioc;
+  clock_type::time_point measure_start;
+  clock_type::time_point deadline;
+  std::vector<std::uint64_t>* results;
+  std::mutex* mutex;
+  std::atomic<int>* errors;
+
+  template <typename Handler>
+  void operator()(spawn::basic_yield_context<Handler> yield)
+  {
+    boost::system::error_code ec;
+    tcp::socket socket(*ioc);
+    socket.async_connect(endpoint, yield[ec]);
+    if (ec) {
+      ++*errors;
+      return;
+    }
+    socket.set_option(tcp::no_delay(true), ec);
+
+    const std::size_t reply = cfg->mode == "echo" ? cfg->request : cfg->response;
+    std::vector<char> request(cfg->request, 'x');
+    std::vector<char> response(reply);
+    std::vector<std::uint64_t> latencies;
+    latencies.reserve(4096);
+    for (;;) {
+      const auto start = clock_type::now();
+      if (start >= deadline) break;
+      asio::async_write(socket, asio::buffer(request), yield[ec]);
+      if (ec) break;
+      asio::async_read(socket, asio::buffer(response), yield[ec]);
+      if (ec) break;
+      if (start >= measure_start) {
+        latencies.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                clock_type::now() - start).count());
+      }
+    }
+    if (ec) {
+      ++*errors;
+    }
+    socket.close(ec);
+    std::lock_guard<std::mutex> lock(*mutex);
+    results->insert(results->end(), latencies.begin(), latencies.end());
+  }
+};
+
+void run_threads(asio::io_context& ioc, int count, std::vector<std::thread>& threads)
+{
+  for (int i = 0; i < count; i++) {
+    threads.emplace_back([&ioc] { ioc.run(); });
+  }
+}
+
+void run(const config& cfg)
+{
+  asio::io_context server_ioc(cfg.threads);
+  asio::io_context client_ioc(cfg.threads);
+  auto server_strand = asio::make_strand(server_ioc);
+  auto client_strand = asio::make_strand(client_ioc);
+
+  tcp::acceptor acceptor(server_ioc, tcp::endpoint(asio::ip::address_v4::loopback(), 0));
+  acceptor.listen(asio::socket_base::max_listen_connections);
+  const tcp::endpoint endpoint = acceptor.local_endpoint();
+  start(cfg, server_ioc, server_strand,
+        acceptor_loop{&acceptor, &cfg, &server_ioc, &server_strand});
+
+  std::vector<std::uint64_t> results;
+  std::mutex mutex;
+  std::atomic<int> errors{0};
+  const auto begin = clock_type::now();
+  const auto measure_start = begin + std::chrono::duration_cast<clock_type::duration>(
+      std::chrono::duration<double>(cfg.warmup));
+  const auto deadline = measure_start + std::chrono::duration_cast<clock_type::duration>(
+      std::chrono::duration<double>(cfg.duration));
+  for (int i = 0; i < cfg.connections; i++) {
+    start(cfg, client_ioc, client_strand,
+          client{&cfg, endpoint, &client_ioc, measure_start, deadline,
+                 &results, &mutex, &errors});
+  }
+
+  std::vector<std::thread> threads;
+  run_threads(server_ioc, cfg.threads, threads);
+  std::vector<std::thread> client_threads;
+  run_threads(client_ioc, cfg.threads - 1, client_threads);
+  client_ioc.run();
+  for (auto& t : client_threads) {
+    t.join();
+  }
+  const auto end = clock_type::now();
+
+  // the server's sessions end when their clients disconnect
+  asio::post(server_ioc, [&acceptor] { acceptor.close(); });
+  for (auto& t : threads) {
+    t.join();
+  }
+
+  std::sort(results.begin(), results.end());
+  auto percentile = [&results] (double p) {
+    if (results.empty()) return 0.0;
+    const std::size_t i = std::min(results.size() - 1,
+        static_cast<std::size_t>(p * results.size()));
+    return results[i] / 1000.0;
+  };
+  const double measured = std::chrono::duration<double>(
+      std::min(end, deadline) - std::min(std::max(begin, measure_start), end)).count();
+  std::printf("%-8s %6d %4d %-10s %-15s %12.0f %9.1f %9.1f %9.1f %6d\n",
+              cfg.mode.c_str(), cfg.connections, cfg.threads,
+              cfg.stack.c_str(), cfg.strand.c_str(),
+              measured > 0 ? results.size() / measured : 0.0,
+              percentile(0.5), percentile(0.99), percentile(0.999),
+              errors.load());
+  std::fflush(stdout);
+}
+
+std::vector<std::string> split(const std::string& value)
+{
+  std::vector<std::string> result;
+  std::size_t pos = 0;
+  for (;;) {
+    const std::size_t comma = value.find(',', pos);
+    result.push_back(value.substr(pos, comma - pos));
+    if (comma == std::string::npos) break;
+    pos = comma + 1;
+  }
+  return result;
+}
+
+int usage(const char* name)
+{
+  std::fprintf(stderr, "usage: %s [--mode=echo,reqresp] [--connections=N,...]"
+               " [--threads=N,...] [--stack=fixedsize,protected,growable]"
+               " [--strand=per-connection,shared,none] [--request=BYTES]"
+               " [--response=BYTES] [--duration=SECONDS] [--warmup=SECONDS]\n",
+               name);
+  return 1;
+}
+
+int main(int argc, char** argv)
+{
+  std::vector<std::string> modes{"echo"};
+  std::vector<std::string> connections{"64"};
+  std::vector<std::string> threads{"1"};
+  std::vector<std::string> stacks{"fixedsize"};
+  std::vector<std::string> strands{"per-connection"};
+  config base{};
+  base.request = 64;
+  base.response = 64;
+  base.duration = 2.0;
+  base.warmup = 0.2;
+
+  for (int i = 1; i < argc; i++) {
+    const std::string arg = argv[i];
+    const std::size_t eq = arg.find('=');
+    if (arg.compare(0, 2, "--") != 0 || eq == std::string::npos) {
+      return usage(argv[0]);
+    }
+    const std::string key = arg.substr(2, eq - 2);
+    const std::string value = arg.substr(eq + 1);
+    if (key == "mode") modes = split(value);
+    else if (key == "connections") connections = split(value);
+    else if (key == "threads") threads = split(value);
+    else if (key == "stack") stacks = split(value);
+    else if (key == "strand") strands = split(value);
+    else if (key == "request") base.request = std::atol(value.c_str());
+    else if (key == "response") base.response = std::atol(value.c_str());
+    else if (key == "duration") base.duration = std::atof(value.c_str());
+    else if (key == "warmup") base.warmup = std::atof(value.c_str());
+    else return usage(argv[0]);
+  }
+  for (auto& m : modes) {
+    if (m != "echo" && m != "reqresp") return usage(argv[0]);
+  }
+  for (auto& s : stacks) {
+    if (!stack_allocator::valid(s)) return usage(argv[0]);
+  }
+  for (auto& s : strands) {
+    if (s != "per-connection" && s != "shared" && s != "none") return usage(argv[0]);
+  }
+  if (base.request == 0 || base.response == 0) {
+    return usage(argv[0]);
+  }
+
+  std::printf("%-8s %6s %4s %-10s %-15s %12s %9s %9s %9s %6s\n",
+              "mode", "conns", "thr", "stack", "strand", "requests/s",
+              "p50(us)", "p99(us)", "p999(us)", "errors");
+  for (auto& mode : modes) {
+    for (auto& c : connections) {
+      for (auto& t : threads) {
+        for (auto& stack : stacks) {
+          for (auto& strand : strands) {
+            config cfg = base;
+            cfg.mode = mode;
+            cfg.connections = std::max(1, std::atoi(c.c_str()));
+            cfg.threads = std::max(1, std::atoi(t.c_str()));
+            cfg.stack = stack;
+            cfg.strand = strand;
+            run(cfg);
+          }
+        }
+      }
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,267 @@
+//
+// arena.hpp
+// ~~~~~~~~~
+//
+// Copyright (c) 2019 Casey Bodley (cbodley at redhat dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <type_traits>
+#include <utility>
+
+#if __cplusplus >= 201703L && defined(__has_include)
+#if __has_include(<memory_resource>)
+#include <memory_resource>
+#define SPAWN_HAS_MEMORY_RESOURCE
+#endif
+#endif
+
+#include <spawn/detail/operation_slot.hpp>
+
+#if !defined(SPAWN_ARENA_CHUNK_SIZE)
+#define SPAWN_ARENA_CHUNK_SIZE 16384
+#endif
+
+namespace spawn {
+
+template <typename Handler>
+class basic_yield_context;
+
+namespace detail {
+
+  struct arena_chunk;
+  class arena_ref;
+
+  template <typename Function>
+  struct arena_function;
+
+} // namespace detail
+
+/// A monotonic memory resource that belongs to one coroutine.
+/**
+ * Memory is handed out by bumping a pointer through chunks of
+ * SPAWN_ARENA_CHUNK_SIZE bytes that are taken from a process-wide pool.
+ * Deallocation does nothing. Instead, all of the chunks go back to the pool
+ * at once when the coroutine returns and no arena_allocator refers to the
+ * arena anymore. Requests that do not fit in a chunk get a block of their
+ * own, which is freed at the same time.
+ *
+ * Coroutines started with spawn::with_arena() reach their arena through
+ * basic_yield_context::arena(). When compiled as C++17, monotonic_arena is a
+ * std::pmr::memory_resource:
+ *
+ * @code void handle(spawn::yield_context yield)
+ * {
+ *   std::pmr::vector<header> headers(yield.arena());
+ *   // ...
+ * } @endcode
+ *
+ * Since nothing is freed before the coroutine returns, an arena suits
+ * short-lived coroutines, such as one that handles a single request. A
+ * long-lived coroutine, such as a connection's read loop, that allocates
+ * from its arena on every iteration grows it without bound. The operation
+ * state of the coroutine's asynchronous operations never comes from its
+ * arena, only the memory that it allocates there explicitly.
+ *
+ * An arena is not thread-safe. It must only be used from its coroutine, or
+ * from handlers that run on the coroutine's strand.
+ */
+class monotonic_arena
+#if defined(SPAWN_HAS_MEMORY_RESOURCE)
+  : public std::pmr::memory_resource
+#endif
+{
+public:
+  monotonic_arena(const monotonic_arena&) = delete;
+  monotonic_arena& operator=(const monotonic_arena&) = delete;
+
+#if !defined(SPAWN_HAS_MEMORY_RESOURCE)
+  /// Allocate memory that is released along with the arena.
+  void* allocate(std::size_t bytes,
+                 std::size_t alignment = alignof(std::max_align_t))
+  {
+    return allocate_bytes(bytes, alignment);
+  }
+
+  /// Does nothing. Memory is only released along with the arena.
+  void deallocate(void*, std::size_t,
+                  std::size_t = alignof(std::max_align_t)) noexcept
+  {
+  }
+#endif
+
+  /// Return the number of bytes handed out by the arena.
+  std::size_t bytes_allocated() const noexcept { return allocated_; }
+
+  /// Return the number of chunks the arena has taken from the pool.
+  std::size_t chunk_count() const noexcept { return chunk_count_; }
+
+#if !defined(GENERATING_DOCUMENTATION)
+  void* allocate_bytes(std::size_t bytes, std::size_t alignment);
+
+  void add_ref() noexcept
+  {
+    refs_.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  void release() noexcept;
+#endif // !defined(GENERATING_DOCUMENTATION)
+
+private:
+  friend class detail::arena_ref;
+
+  explicit monotonic_arena(detail::arena_chunk* first);
+#if defined(SPAWN_HAS_MEMORY_RESOURCE)
+  ~monotonic_arena() override = default;
+
+  void* do_allocate(std::size_t bytes, std::size_t alignment) override
+  {
+    return allocate_bytes(bytes, alignment);
+  }
+
+  void do_deallocate(void*, std::size_t, std::size_t) override
+  {
+  }
+
+  bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override
+  {
+    return this == &other;
+  }
+#else
+  ~monotonic_arena() = default;
+#endif
+
+  static monotonic_arena* create();
+
+  std::atomic<long> refs_;
+  detail::arena_chunk* chunks_;
+  char* ptr_;
+  char* end_;
+  std::size_t allocated_;
+  std::size_t chunk_count_;
+};
+
+/// An allocator that allocates from a monotonic_arena.
+/**
+ * Each copy of the allocator keeps the arena alive. Without an arena, memory
+ * comes from the same per-thread recycling cache that Asio uses for handlers
+ * by default.
+ *
+ * The completion handlers of a basic_yield_context report an
+ * arena_allocator<void> without an arena as their associated allocator,
+ * unless the coroutine's own handler has an allocator of its own. The
+ * operation state of asynchronous operations started by the coroutine then
+ * comes from a single-slot cache in the coroutine's control block, so that
+ * a coroutine waiting on one operation at a time reuses the same block
+ * instead of going to the heap, whether or not it has an arena.
+ */
+template <typename T>
+class arena_allocator
+{
+public:
+  using value_type = T;
+
+  template <typename U>
+  struct rebind
+  {
+    using other = arena_allocator<U>;
+  };
+
+  /// Construct an allocator for the given arena, if any.
+  explicit arena_allocator(monotonic_arena* arena = nullptr) noexcept
+    : arena_allocator(arena, nullptr)
+  {
+  }
+
+#if !defined(GENERATING_DOCUMENTATION)
+  arena_allocator(monotonic_arena* arena, detail::operation_slot* slot) noexcept
+    : arena_(arena),
+      slot_(slot)
+  {
+    if (arena_) arena_->add_ref();
+  }
+#endif // !defined(GENERATING_DOCUMENTATION)
+
+  arena_allocator(const arena_allocator& other) noexcept
+    : arena_allocator(other.arena_, other.slot_)
+  {
+  }
+
+  template <typename U>
+  arena_allocator(const arena_allocator<U>& other) noexcept
+    : arena_allocator(other.arena(), other.slot())
+  {
+  }
+
+  arena_allocator& operator=(const arena_allocator& other) noexcept
+  {
+    arena_allocator tmp(other);
+    std::swap(arena_, tmp.arena_);
+    std::swap(slot_, tmp.slot_);
+    return *this;
+  }
+
+  ~arena_allocator()
+  {
+    if (arena_) arena_->release();
+  }
+
+  T* allocate(std::size_t n);
+
+  void deallocate(T* p, std::size_t n);
+
+  /// Return the allocator's arena, or nullptr.
+  monotonic_arena* arena() const noexcept { return arena_; }
+
+#if !defined(GENERATING_DOCUMENTATION)
+  detail::operation_slot* slot() const noexcept { return slot_; }
+#endif // !defined(GENERATING_DOCUMENTATION)
+
+  template <typename U>
+  friend bool operator==(const arena_allocator& lhs,
+                         const arena_allocator<U>& rhs) noexcept
+  {
+    return lhs.arena_ == rhs.arena() && lhs.slot_ == rhs.slot();
+  }
+
+  template <typename U>
+  friend bool operator!=(const arena_allocator& lhs,
+                         const arena_allocator<U>& rhs) noexcept
+  {
+    return !(lhs == rhs);
+  }
+
+private:
+  monotonic_arena* arena_;
+  detail::operation_slot* slot_;
+};
+
+/// Wrap a coroutine function so that its coroutine gets a monotonic_arena.
+/**
+ * @code spawn::spawn(ioc, spawn::with_arena(
+ *     [] (spawn::yield_context yield) {
+ *       auto buffer = yield.arena()->allocate(4096);
+ *       // ...
+ *     })); @endcode
+ *
+ * The arena is created when the coroutine starts and released when the
+ * function returns or throws, unless an arena_allocator still refers to it.
+ * The arena is then released along with the last such allocator.
+ */
+template <typename Function>
+auto with_arena(Function&& function)
+#if defined(GENERATING_DOCUMENTATION)
+  -> unspecified;
+#else
+  -> detail::arena_function<typename std::decay<Function>::type>;
+#endif
+
+} // namespace spawn
+
+#include <spawn/impl/arena.hpp>
@@ -0,0 +1,117 @@
+//
+// awaitable.hpp
+// ~~~~~~~~~~~~~
+//
+// Copyright (c) 2019 Casey Bodley (cbodley at redhat dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#pragma once
+
+#include <spawn/spawn.hpp>
+
+#if defined(BOOST_ASIO_HAS_CO_AWAIT) || defined(GENERATING_DOCUMENTATION)
+
+#include <exception>
+
+#include <boost/asio/async_result.hpp>
+#include <boost/asio/awaitable.hpp>
+
+namespace spawn {
+namespace detail {
+
+  template <typename Executor, typename Function>
+  struct async_spawn_signature;
+
+  template <typename Executor, typename Function, typename CompletionToken>
+  using async_spawn_result = typename boost::asio::async_result<
+      typename std::decay<CompletionToken>::type,
+      typename async_spawn_signature<Executor, Function>::type>::return_type;
+
+} // namespace detail
+
+/// Wait for a C++20 awaitable from a stackful coroutine.
+/**
+ * The awaitable starts running right away, on the calling thread, as a new
+ * thread of execution on the coroutine's executor. Its completion is
+ * dispatched to the coroutine, so that it resumes without another trip
+ * through the executor when both already run on the same thread. By
+ * comparison, passing the yield context to boost::asio::co_spawn() posts
+ * the awaitable before it can start.
+ *
+ * Starting it inline relies on an Asio implementation detail, which is
+ * only used with Boost 1.74 through 1.76. With other versions, await()
+ * goes through co_spawn() too.
+ *
+ * @code void session(spawn::yield_context yield)
+ * {
+ *   std::size_t n = spawn::await(read_header(socket), yield);
+ *   // ...
+ * } @endcode
+ *
+ * @param a The awaitable to run.
+ *
+ * @param yield The yield context of the calling coroutine. The coroutine's
+ * executor must be convertible to the awaitable's executor type.
+ *
+ * @returns The awaitable's result. An exception thrown by the awaitable is
+ * rethrown in the coroutine.
+ */
+template <typename T, typename Executor, typename Handler>
+T await(boost::asio::awaitable<T, Executor> a,
+        basic_yield_context<Handler> yield);
+
+/// Start a stackful coroutine as an asynchronous operation.
+/**
+ * The function runs in a new coroutine on a strand of the given executor,
+ * like with spawn(). What the function returns, or the exception it throws,
+ * completes the operation. With boost::asio::use_awaitable, this lets a
+ * C++20 coroutine co_await a call chain that needs a stack of its own:
+ *
+ * @code boost::asio::awaitable<void> handle(tcp::socket socket)
+ * {
+ *   auto ex = co_await boost::asio::this_coro::executor;
+ *   int status = co_await spawn::async_spawn(ex,
+ *       [&] (spawn::yield_context yield) { return legacy_handle(socket, yield); },
+ *       boost::asio::use_awaitable);
+ *   // ...
+ * } @endcode
+ *
+ * The coroutine is entered with dispatch(), and its completion is
+ * dispatched to the handler's associated executor, so neither direction
+ * goes through the executor's queue when it doesn't have to.
+ *
+ * @param ex The executor that runs the coroutine. The coroutine is given its
+ * own strand within this executor.
+ *
+ * @param function The coroutine function. The function must have the
+ * signature:
+ * @code R function(basic_yield_context<Handler> yield); @endcode
+ *
+ * @param token The completion token. The completion handler must have the
+ * signature:
+ * @code void handler(std::exception_ptr e, R result); @endcode
+ * or, when the function returns void:
+ * @code void handler(std::exception_ptr e); @endcode
+ *
+ * @param salloc The stack allocator, as for spawn().
+ */
+template <typename Executor, typename Function, typename CompletionToken,
+          typename StackAllocator = boost::context::default_stack>
+auto async_spawn(const Executor& ex, Function&& function,
+                 CompletionToken&& token,
+                 StackAllocator&& salloc = StackAllocator())
+#if defined(GENERATING_DOCUMENTATION)
+  -> unspecified;
+#else
+  -> typename std::enable_if<detail::net::is_executor<Executor>::value,
+       detail::async_spawn_result<Executor, Function, CompletionToken>>::type;
+#endif
+
+} // namespace spawn
+
+#include <spawn/impl/awaitable.hpp>
+
+#endif // defined(BOOST_ASIO_HAS_CO_AWAIT)
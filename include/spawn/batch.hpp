@@ -0,0 +1,133 @@
+//
+// batch.hpp
+// ~~~~~~~~~
+//
+// Copyright (c) 2019 Casey Bodley (cbodley at redhat dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#pragma once
+
+#include <cstddef>
+
+#include <spawn/spawn.hpp>
+
+namespace spawn {
+
+/**
+ * @defgroup spawn_many spawn::spawn_many
+ *
+ * @brief Start a batch of execution contexts with one scheduler operation.
+ *
+ * Calling spawn() in a loop allocates each coroutine's bookkeeping and
+ * dispatches it once per coroutine. spawn_many() and spawn_n() allocate the
+ * bookkeeping for the whole batch in one block, and post a single operation
+ * that enters each coroutine in turn until it first suspends. For example:
+ *
+ * @code spawn::spawn_n(ioc.get_executor(), 100,
+ *     [&] (spawn::yield_context yield) { fetch(yield); },
+ *     [] { std::cout << "all done\n"; }); @endcode
+ *
+ * As with spawn(), each coroutine gets a strand of its own over the given
+ * executor. Pass a strand instead to have the whole batch share it, which
+ * also saves creating a strand per coroutine.
+ *
+ * The optional join handler is posted to its associated executor once every
+ * coroutine in the batch has exited. A coroutine that exits with an
+ * exception propagates it from the executor, as with spawn(), and still
+ * counts towards the join.
+ *
+ * The batch's memory is released together once its last coroutine exits.
+ */
+/*@{*/
+
+/// Start one execution context for each function in a range.
+/**
+ * @param ex The executor that runs the coroutines, each on a strand of its
+ * own, or a strand that they share.
+ *
+ * @param functions A range of coroutine functions, which are copied, or moved
+ * if the range is an rvalue. Each function must have the signature:
+ * @code void function(basic_yield_context<Handler> yield); @endcode
+ *
+ * @param salloc The stack allocator, copied for each coroutine.
+ */
+template <typename Executor, typename Range,
+          typename StackAllocator = boost::context::default_stack>
+auto spawn_many(const Executor& ex, Range&& functions,
+                StackAllocator&& salloc = StackAllocator())
+  -> typename std::enable_if<detail::net::is_executor<Executor>::value &&
+       detail::is_stack_allocator<typename std::decay<StackAllocator>::type>::value>::type;
+
+/// Start one execution context for each function in a range, and call a
+/// handler once they have all exited.
+/**
+ * @param ex The executor that runs the coroutines, each on a strand of its
+ * own, or a strand that they share.
+ *
+ * @param functions A range of coroutine functions, which are copied, or moved
+ * if the range is an rvalue.
+ *
+ * @param join The handler to post once every coroutine has exited. The
+ * handler must have the signature:
+ * @code void handler(); @endcode
+ *
+ * @param salloc The stack allocator, copied for each coroutine.
+ */
+template <typename Executor, typename Range, typename JoinHandler,
+          typename StackAllocator = boost::context::default_stack>
+auto spawn_many(const Executor& ex, Range&& functions, JoinHandler&& join,
+                StackAllocator&& salloc = StackAllocator())
+  -> typename std::enable_if<detail::net::is_executor<Executor>::value &&
+       !detail::is_stack_allocator<typename std::decay<JoinHandler>::type>::value &&
+       detail::is_stack_allocator<typename std::decay<StackAllocator>::type>::value>::type;
+
+/// Start n execution contexts that each run a copy of the same function.
+/**
+ * @param ex The executor that runs the coroutines, each on a strand of its
+ * own, or a strand that they share.
+ *
+ * @param n The number of coroutines to start.
+ *
+ * @param function The coroutine function, copied for each coroutine.
+ *
+ * @param salloc The stack allocator, copied for each coroutine.
+ */
+template <typename Executor, typename Function,
+          typename StackAllocator = boost::context::default_stack>
+auto spawn_n(const Executor& ex, std::size_t n, Function&& function,
+             StackAllocator&& salloc = StackAllocator())
+  -> typename std::enable_if<detail::net::is_executor<Executor>::value &&
+       detail::is_stack_allocator<typename std::decay<StackAllocator>::type>::value>::type;
+
+/// Start n execution contexts that each run a copy of the same function, and
+/// call a handler once they have all exited.
+/**
+ * @param ex The executor that runs the coroutines, each on a strand of its
+ * own, or a strand that they share.
+ *
+ * @param n The number of coroutines to start.
+ *
+ * @param function The coroutine function, copied for each coroutine.
+ *
+ * @param join The handler to post once every coroutine has exited. The
+ * handler must have the signature:
+ * @code void handler(); @endcode
+ *
+ * @param salloc The stack allocator, copied for each coroutine.
+ */
+template <typename Executor, typename Function, typename JoinHandler,
+          typename StackAllocator = boost::context::default_stack>
+auto spawn_n(const Executor& ex, std::size_t n, Function&& function,
+             JoinHandler&& join, StackAllocator&& salloc = StackAllocator())
+  -> typename std::enable_if<detail::net::is_executor<Executor>::value &&
+       !detail::is_stack_allocator<typename std::decay<JoinHandler>::type>::value &&
+       detail::is_stack_allocator<typename std::decay<StackAllocator>::type>::value>::type;
+
+/*@}*/
+
+} // namespace spawn
+
+#include <spawn/impl/batch.hpp>
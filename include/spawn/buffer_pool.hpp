@@ -0,0 +1,206 @@
+//
+// buffer_pool.hpp
+// ~~~~~~~~~~~~~~~
+//
+// Copyright (c) 2019 Casey Bodley (cbodley at redhat dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include <boost/asio/basic_stream_socket.hpp>
+#include <boost/asio/buffer.hpp>
+
+#include <spawn/spawn.hpp>
+
+namespace spawn {
+
+class buffer_pool;
+
+/// A buffer that returns to its buffer_pool when destroyed.
+/**
+ * A default-constructed or moved-from pooled_buffer holds no memory.
+ */
+class pooled_buffer
+{
+public:
+  pooled_buffer() noexcept = default;
+
+  pooled_buffer(pooled_buffer&& other) noexcept
+    : pool_(other.pool_), data_(other.data_),
+      size_(other.size_), capacity_(other.capacity_)
+  {
+    other.pool_ = nullptr;
+    other.data_ = nullptr;
+    other.size_ = other.capacity_ = 0;
+  }
+
+  pooled_buffer& operator=(pooled_buffer&& other) noexcept
+  {
+    pooled_buffer tmp(std::move(other));
+    swap(tmp);
+    return *this;
+  }
+
+  /// Return the memory to the pool.
+  ~pooled_buffer() { reset(); }
+
+  /// Return the memory to the pool now.
+  void reset() noexcept;
+
+  /// Return a pointer to the memory.
+  char* data() const noexcept { return data_; }
+
+  /// Return the number of bytes in use, such as the bytes that were read.
+  std::size_t size() const noexcept { return size_; }
+
+  /// Set the number of bytes in use, up to capacity().
+  void resize(std::size_t size) noexcept
+  {
+    size_ = size < capacity_ ? size : capacity_;
+  }
+
+  /// Return the size of the memory, which is its pool's size class.
+  std::size_t capacity() const noexcept { return capacity_; }
+
+  bool empty() const noexcept { return size_ == 0; }
+
+  /// Return the bytes in use.
+  boost::asio::mutable_buffer buffer() const noexcept
+  {
+    return boost::asio::mutable_buffer(data_, size_);
+  }
+
+  /// Return all of the memory, for reading into.
+  boost::asio::mutable_buffer prepare() const noexcept
+  {
+    return boost::asio::mutable_buffer(data_, capacity_);
+  }
+
+  void swap(pooled_buffer& other) noexcept
+  {
+    std::swap(pool_, other.pool_);
+    std::swap(data_, other.data_);
+    std::swap(size_, other.size_);
+    std::swap(capacity_, other.capacity_);
+  }
+
+private:
+  friend class buffer_pool;
+
+  pooled_buffer(buffer_pool* pool, char* data, std::size_t capacity) noexcept
+    : pool_(pool), data_(data), capacity_(capacity)
+  {
+  }
+
+  buffer_pool* pool_ = nullptr;
+  char* data_ = nullptr;
+  std::size_t size_ = 0;
+  std::size_t capacity_ = 0;
+};
+
+/// A thread-safe pool of buffers in power-of-two size classes.
+/**
+ * Buffers that are returned to the pool are kept for reuse, up to
+ * max_cached bytes in each size class, and freed beyond that. The pool must
+ * outlive the buffers that it hands out.
+ */
+class buffer_pool
+{
+public:
+  /// Construct a pool with size classes from min_size to max_size.
+  /**
+   * Both sizes are rounded up to powers of two.
+   */
+  explicit buffer_pool(std::size_t min_size = 512,
+                       std::size_t max_size = 65536,
+                       std::size_t max_cached = 4 * 1024 * 1024);
+
+  buffer_pool(const buffer_pool&) = delete;
+  buffer_pool& operator=(const buffer_pool&) = delete;
+
+  /// Free the cached buffers.
+  ~buffer_pool();
+
+  /// Return a buffer of the smallest size class that holds size bytes.
+  /**
+   * Sizes above max_size() get a buffer of max_size() bytes. The buffer's
+   * size() starts at zero.
+   */
+  pooled_buffer allocate(std::size_t size);
+
+  std::size_t min_size() const noexcept { return min_size_; }
+  std::size_t max_size() const noexcept
+  {
+    return min_size_ << (classes_.size() - 1);
+  }
+
+  /// Return the number of bytes in buffers that are handed out.
+  std::size_t bytes_in_use() const noexcept
+  {
+    return in_use_.load(std::memory_order_relaxed);
+  }
+
+  /// Return the number of bytes in buffers cached for reuse.
+  std::size_t bytes_cached() const noexcept
+  {
+    return cached_.load(std::memory_order_relaxed);
+  }
+
+private:
+  friend class pooled_buffer;
+
+  struct size_class
+  {
+    std::mutex mutex;
+    std::vector<char*> free;
+  };
+
+  std::size_t class_index(std::size_t size) const noexcept;
+  void release(char* data, std::size_t capacity) noexcept;
+
+  const std::size_t min_size_;
+  const std::size_t max_cached_;
+  std::vector<std::unique_ptr<size_class>> classes_;
+  std::atomic<std::size_t> in_use_{0};
+  std::atomic<std::size_t> cached_{0};
+};
+
+/// Read from a socket into a buffer that is only taken once data arrives.
+/**
+ * A coroutine that reads with async_read_some() keeps its buffer for as
+ * long as it waits, so idle connections hold as much memory as busy ones.
+ * read_some_pooled() instead waits for the socket to become readable, then
+ * takes a buffer from the pool that fits the bytes available, up to the
+ * pool's max_size(), and reads them without blocking. Memory then grows
+ * with the connections that have traffic rather than with all of them:
+ *
+ * @code for (;;) {
+ *   spawn::pooled_buffer buffer = spawn::read_some_pooled(socket, pool, yield);
+ *   process(buffer.data(), buffer.size());
+ * } @endcode
+ *
+ * Errors are reported like those of async_read_some(), including eof when
+ * the peer has closed the connection: they are thrown as system_error, or
+ * stored in the error_code given with yield[ec], in which case the returned
+ * buffer is empty.
+ *
+ * The socket must only be read by one coroutine at a time.
+ */
+template <typename Protocol, typename Executor, typename Handler>
+pooled_buffer read_some_pooled(
+    boost::asio::basic_stream_socket<Protocol, Executor>& socket,
+    buffer_pool& pool, basic_yield_context<Handler> yield);
+
+} // namespace spawn
+
+#include <spawn/impl/buffer_pool.hpp>
@@ -0,0 +1,92 @@
+//
+// coroutine_local.hpp
+// ~~~~~~~~~~~~~~~~~~~
+//
+// Copyright (c) 2019 Casey Bodley (cbodley at redhat dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#pragma once
+
+#include <cstddef>
+
+#include <spawn/spawn.hpp>
+
+namespace spawn {
+
+/// A variable with a separate value in each coroutine.
+/**
+ * A thread_local variable is the wrong home for per-request context once a
+ * coroutine can resume on a different thread than the one it suspended on.
+ * A coroutine_local follows the coroutine instead:
+ *
+ * @code spawn::coroutine_local<std::string> trace_id;
+ *
+ * void log(const char* message)
+ * {
+ *   std::printf("[%s] %s\n", trace_id->c_str(), message);
+ * }
+ *
+ * void session(spawn::yield_context yield)
+ * {
+ *   *trace_id = read_trace_id(yield);
+ *   log("started");
+ *   // ...
+ * } @endcode
+ *
+ * Each coroutine's value is default-constructed the first time that
+ * coroutine calls get(), and is destroyed when the coroutine's function
+ * returns, in the reverse order of the coroutine_locals' indices.
+ * Values live in an array in the coroutine's control block, indexed by the
+ * coroutine_local, so access costs a call to find the current coroutine and
+ * an index into that array.
+ *
+ * Each coroutine_local takes the lowest free index, and gives it back when
+ * it is destroyed, so a coroutine's array grows only to the number of
+ * coroutine_locals alive at once. Indices are handed out in order, so the
+ * values of coroutine_locals with static storage duration are destroyed in
+ * the reverse order of their construction. A coroutine that still holds a
+ * value for a destroyed coroutine_local keeps it until the coroutine returns
+ * or another coroutine_local takes over the index and gets its own value.
+ *
+ * Code that runs inside a generator's producer sees the values of the
+ * coroutine that iterates over the generator.
+ */
+template <typename T>
+class coroutine_local
+{
+public:
+  coroutine_local();
+  ~coroutine_local();
+
+  coroutine_local(const coroutine_local&) = delete;
+  coroutine_local& operator=(const coroutine_local&) = delete;
+
+  /// Return the calling coroutine's value, constructing it on first use.
+  /**
+   * @throws std::logic_error if not called from a coroutine.
+   */
+  T& get();
+
+  T& operator*() { return get(); }
+  T* operator->() { return &get(); }
+
+  /// Return the calling coroutine's value if it has one, or nullptr.
+  /**
+   * Unlike get(), this may be called from outside a coroutine, where it
+   * returns nullptr.
+   */
+  T* get_if() const noexcept;
+
+  /// Destroy the calling coroutine's value, if it has one.
+  void reset() noexcept;
+
+private:
+  const detail::coroutine_local_key key_;
+};
+
+} // namespace spawn
+
+#include <spawn/impl/coroutine_local.hpp>
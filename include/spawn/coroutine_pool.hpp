@@ -0,0 +1,109 @@
+//
+// coroutine_pool.hpp
+// ~~~~~~~~~~~~~~~~~~
+//
+// Copyright (c) 2019 Casey Bodley (cbodley at redhat dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <limits>
+#include <memory>
+
+#include <spawn/spawn.hpp>
+
+namespace spawn {
+namespace detail {
+
+  class pool_state;
+
+} // namespace detail
+
+/// A pool of coroutines that are reused to run short tasks.
+/**
+ * Each spawn() allocates a stack, enters it with callcc() and tears it down
+ * again when the function returns. For tasks that only run for a few
+ * microseconds, that overhead dominates. A coroutine_pool instead keeps
+ * finished coroutines parked in a loop, and submit() resumes one of them
+ * directly with the next task:
+ *
+ * @code spawn::coroutine_pool pool(ioc.get_executor());
+ * pool.submit([&] (spawn::yield_context yield) {
+ *   timer.async_wait(yield);
+ * }); @endcode
+ *
+ * The pool grows when a task is submitted and no coroutine is idle, up to
+ * max_size coroutines, after which tasks wait in a queue. It shrinks when a
+ * coroutine finishes its task while max_idle coroutines are already parked.
+ *
+ * Like spawn(), each of the pool's coroutines runs on a strand of its own
+ * over the pool's executor, so the tasks it runs one after another never
+ * run concurrently with their own completion handlers. Tasks on different
+ * coroutines may run in parallel if the executor has several threads.
+ *
+ * Destroying the pool wakes its idle coroutines so that they return. Queued
+ * tasks that have not started are discarded.
+ */
+class coroutine_pool
+{
+public:
+  using executor_type = detail::net::any_io_executor;
+  using task_type = std::function<void(yield_context)>;
+
+  /// Construct a pool that runs tasks on the given executor.
+  /**
+   * @param ex The executor that runs the pool's coroutines.
+   *
+   * @param max_idle The number of parked coroutines to keep for reuse.
+   *
+   * @param max_size The maximum number of coroutines to run at once.
+   *
+   * @param salloc The stack allocator for new coroutines.
+   */
+  template <typename StackAllocator = boost::context::default_stack,
+            typename = typename std::enable_if<detail::is_stack_allocator<
+                typename std::decay<StackAllocator>::type>::value>::type>
+  explicit coroutine_pool(const executor_type& ex,
+                          std::size_t max_idle = 64,
+                          std::size_t max_size = std::numeric_limits<std::size_t>::max(),
+                          StackAllocator&& salloc = StackAllocator());
+
+  coroutine_pool(const coroutine_pool&) = delete;
+  coroutine_pool& operator=(const coroutine_pool&) = delete;
+
+  ~coroutine_pool();
+
+  /// Run the given task on an idle coroutine.
+  /**
+   * If a coroutine is idle, it is resumed with the task through dispatch()
+   * on its strand, so a submit() from a thread running the executor starts
+   * the task before returning.
+   *
+   * @param task The task function. The function must have the signature:
+   * @code void task(yield_context yield); @endcode
+   */
+  void submit(task_type task);
+
+  /// Return the number of coroutines in the pool, both busy and idle.
+  std::size_t size() const;
+
+  /// Return the number of idle coroutines.
+  std::size_t idle() const;
+
+  /// Return the number of tasks waiting for a coroutine.
+  std::size_t queued() const;
+
+  executor_type get_executor() const;
+
+private:
+  std::shared_ptr<detail::pool_state> state_;
+};
+
+} // namespace spawn
+
+#include <spawn/impl/coroutine_pool.hpp>
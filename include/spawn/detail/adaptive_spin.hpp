@@ -0,0 +1,191 @@
+//
+// detail/adaptive_spin.hpp
+// ~~~~~~~~~~~~~~~~~~~~~~~~
+//
+// Copyright (c) 2019 Casey Bodley (cbodley at redhat dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <thread>
+#include <typeinfo>
+
+#include <boost/asio/execution/context_as.hpp>
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/query.hpp>
+#include <boost/config.hpp>
+
+#include <spawn/detail/net.hpp>
+
+// the longest that basic_yield_context::adaptive_spin() spins, in nanoseconds
+#if !defined(SPAWN_SPIN_LIMIT_NS)
+#define SPAWN_SPIN_LIMIT_NS 20000
+#endif
+
+namespace spawn {
+namespace detail {
+
+  inline void spin_pause() noexcept
+  {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    __asm__ __volatile__("yield");
+#endif
+  }
+
+  // Spinning waits for another thread, so it is pointless with only one CPU.
+  inline bool spin_possible() noexcept
+  {
+    static const bool possible = std::thread::hardware_concurrency() > 1;
+    return possible;
+  }
+
+  // A coroutine on a strand holds the strand while it spins, so a completion
+  // that is dispatched through the strand would wait behind it.
+  template <typename Executor>
+  bool is_strand_executor(const Executor&) noexcept
+  {
+    return false;
+  }
+
+  template <typename Executor>
+  bool is_strand_executor(const net::strand<Executor>&) noexcept
+  {
+    return true;
+  }
+
+  // any_io_executor::target() doesn't check the type, so compare it here.
+  // without typeid, assume the worst
+  inline bool is_strand_executor(const net::any_io_executor& ex) noexcept
+  {
+#if !defined(BOOST_ASIO_NO_TYPEID)
+    using io_executor = boost::asio::io_context::executor_type;
+    return ex.target_type() == typeid(net::strand<io_executor>) ||
+        ex.target_type() == typeid(net::strand<net::any_io_executor>);
+#else
+    return true;
+#endif
+  }
+
+  // The execution context that only the calling thread runs, such as a
+  // polling_runtime shard's, or nullptr. Out of line for the same reason as
+  // current_continuation().
+  BOOST_NOINLINE inline const net::execution_context*& serial_context() noexcept
+  {
+    static thread_local const net::execution_context* context = nullptr;
+    return context;
+  }
+
+  // Marks the calling thread as the only one that runs the context.
+  class serial_context_guard
+  {
+  public:
+    explicit serial_context_guard(const net::execution_context& context) noexcept
+      : prev_(serial_context())
+    {
+      serial_context() = &context;
+    }
+    ~serial_context_guard() { serial_context() = prev_; }
+
+    serial_context_guard(const serial_context_guard&) = delete;
+    serial_context_guard& operator=(const serial_context_guard&) = delete;
+
+  private:
+    const net::execution_context* prev_;
+  };
+
+  // A coroutine on a context that only its own thread runs is serial like
+  // one on a strand: the completion is queued behind the spinning thread.
+  template <typename Executor>
+  bool runs_serially(const Executor&) noexcept
+  {
+    return false;
+  }
+
+  inline bool runs_serially(
+      const boost::asio::io_context::executor_type& ex) noexcept
+  {
+    const net::execution_context* serial = serial_context();
+    return serial && serial == &ex.context();
+  }
+
+  inline bool runs_serially(const net::any_io_executor& ex) noexcept
+  {
+    const net::execution_context* serial = serial_context();
+    return serial && ex && serial == &boost::asio::query(ex,
+        boost::asio::execution::context_as_t<net::execution_context&>());
+  }
+
+  // Whether a coroutine whose completions run on the executor may spin.
+  template <typename Executor>
+  bool may_spin(const Executor& ex) noexcept
+  {
+    return spin_possible() && !is_strand_executor(ex) && !runs_serially(ex);
+  }
+
+  // How long a coroutine's operations have recently taken to complete, and so
+  // how long it is worth spinning for the next one. Only the coroutine itself
+  // touches it.
+  class adaptive_spin
+  {
+  public:
+    using clock = std::chrono::steady_clock;
+
+    static std::int64_t since(clock::time_point start) noexcept
+    {
+      return std::chrono::duration_cast<std::chrono::nanoseconds>(
+          clock::now() - start).count();
+    }
+
+    // Spin until ready() returns true or the budget runs out.
+    template <typename Ready>
+    bool spin(clock::time_point start, Ready&& ready) const noexcept
+    {
+      const std::int64_t budget = budget_ns();
+      if (budget == 0)
+        return false;
+      for (unsigned i = 1; !ready(); i++)
+      {
+        if (i % 32 == 0 && since(start) > budget)
+          return false;
+        spin_pause();
+      }
+      return true;
+    }
+
+    // Record how long an operation took to complete, whether it was caught
+    // by spinning or only after the coroutine suspended.
+    void record(std::int64_t ns) noexcept
+    {
+      // an exponentially weighted moving average that favors recent
+      // operations
+      average_ns_ += (ns - average_ns_) / 8;
+    }
+
+    // Spin for twice the average, if that is within SPAWN_SPIN_LIMIT_NS. An
+    // operation that completes while the coroutine is suspended costs it a
+    // switch in each direction on top of its latency, so waits that could
+    // not be caught push the average up until spinning stops.
+    std::int64_t budget_ns() const noexcept
+    {
+      const std::int64_t budget = 2 * average_ns_;
+      if (!spin_possible() || budget > SPAWN_SPIN_LIMIT_NS)
+        return 0;
+      return budget;
+    }
+
+    std::int64_t average_ns() const noexcept { return average_ns_; }
+
+  private:
+    // start out willing to spin for half the limit
+    std::int64_t average_ns_ = SPAWN_SPIN_LIMIT_NS / 4;
+  };
+
+} // namespace detail
+} // namespace spawn
@@ -0,0 +1,205 @@
+//
+// detail/coroutine_locals.hpp
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~
+//
+// Copyright (c) 2019 Casey Bodley (cbodley at redhat dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <vector>
+
+#include <boost/config.hpp>
+
+namespace spawn {
+namespace detail {
+
+  class continuation_context;
+
+  // The coroutine that is running on this thread, or nullptr. Its accessors
+  // are out of line so that every call reads the thread's own pointer: a
+  // coroutine can suspend on one thread and resume on another, and within
+  // a single function the compiler is free to reuse a thread-local address
+  // that it computed before the switch.
+  inline continuation_context*& current_continuation_storage() noexcept
+  {
+    static thread_local continuation_context* current = nullptr;
+    return current;
+  }
+
+  BOOST_NOINLINE inline continuation_context* current_continuation() noexcept
+  {
+    return current_continuation_storage();
+  }
+
+  BOOST_NOINLINE inline continuation_context*
+  exchange_current_continuation(continuation_context* c) noexcept
+  {
+    continuation_context*& current = current_continuation_storage();
+    continuation_context* prev = current;
+    current = c;
+    return prev;
+  }
+
+  // Marks a coroutine as current while it is entered for the first time.
+  class current_continuation_guard
+  {
+  public:
+    explicit current_continuation_guard(continuation_context* c) noexcept
+      : prev_(exchange_current_continuation(c))
+    {
+    }
+    ~current_continuation_guard() { exchange_current_continuation(prev_); }
+
+    current_continuation_guard(const current_continuation_guard&) = delete;
+    current_continuation_guard& operator=(const current_continuation_guard&) = delete;
+
+  private:
+    continuation_context* prev_;
+  };
+
+  // Identifies a coroutine_local. The index is recycled when the
+  // coroutine_local is destroyed, but the id is never reused, so a coroutine
+  // that still holds a value from the index's previous owner can tell it
+  // apart from a value of the new one.
+  struct coroutine_local_key
+  {
+    std::size_t index;
+    std::size_t id;
+  };
+
+  // Hands out the lowest free index, so that coroutines' arrays stay as
+  // small as the number of coroutine_locals alive at once.
+  class coroutine_local_indices
+  {
+  public:
+    static coroutine_local_indices& instance()
+    {
+      static coroutine_local_indices indices;
+      return indices;
+    }
+
+    coroutine_local_key acquire()
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      std::size_t index = next_;
+      if (free_.empty())
+        ++next_;
+      else
+      {
+        std::pop_heap(free_.begin(), free_.end(), std::greater<std::size_t>());
+        index = free_.back();
+        free_.pop_back();
+      }
+      return coroutine_local_key{index, ++last_id_};
+    }
+
+    void release(std::size_t index) noexcept
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      try
+      {
+        free_.push_back(index);
+        std::push_heap(free_.begin(), free_.end(), std::greater<std::size_t>());
+      }
+      catch (const std::bad_alloc&)
+      {
+        // the index is lost, which only costs memory
+      }
+    }
+
+  private:
+    std::mutex mutex_;
+    std::vector<std::size_t> free_; // min-heap
+    std::size_t next_ = 0;
+    std::size_t last_id_ = 0;
+  };
+
+  struct coroutine_local_slot
+  {
+    void* value = nullptr;
+    void (*destroy)(void*) = nullptr;
+    std::size_t id = 0;
+  };
+
+  // The values of a coroutine's coroutine_locals, indexed by their index.
+  // Empty until the coroutine constructs its first value.
+  class coroutine_locals
+  {
+  public:
+    coroutine_locals() noexcept = default;
+    ~coroutine_locals() { clear(); }
+
+    coroutine_locals(const coroutine_locals&) = delete;
+    coroutine_locals& operator=(const coroutine_locals&) = delete;
+
+    void* get(const coroutine_local_key& key) const noexcept
+    {
+      if (key.index >= size_ || slots_[key.index].id != key.id)
+        return nullptr;
+      return slots_[key.index].value;
+    }
+
+    // the slot must not hold a value for this key. a value left behind by
+    // the index's previous owner is destroyed
+    void set(const coroutine_local_key& key, void* value, void (*destroy)(void*))
+    {
+      if (key.index >= size_)
+      {
+        const std::size_t size = std::max(key.index + 1, size_ * 2);
+        std::unique_ptr<coroutine_local_slot[]> slots(new coroutine_local_slot[size]);
+        std::copy(slots_.get(), slots_.get() + size_, slots.get());
+        slots_ = std::move(slots);
+        size_ = size;
+      }
+      coroutine_local_slot stale = slots_[key.index];
+      slots_[key.index].value = value;
+      slots_[key.index].destroy = destroy;
+      slots_[key.index].id = key.id;
+      if (stale.value)
+        stale.destroy(stale.value);
+    }
+
+    void reset(const coroutine_local_key& key) noexcept
+    {
+      if (key.index >= size_ || slots_[key.index].id != key.id ||
+          !slots_[key.index].value)
+        return;
+      coroutine_local_slot slot = slots_[key.index];
+      slots_[key.index] = coroutine_local_slot();
+      slot.destroy(slot.value);
+    }
+
+    // Destroy the values in reverse order of index. A destructor may touch
+    // other coroutine_locals, so repeat until nothing is left.
+    void clear() noexcept
+    {
+      while (size_)
+      {
+        std::unique_ptr<coroutine_local_slot[]> slots = std::move(slots_);
+        std::size_t i = size_;
+        size_ = 0;
+        while (i-- > 0)
+        {
+          if (slots[i].value)
+            slots[i].destroy(slots[i].value);
+        }
+      }
+    }
+
+  private:
+    std::unique_ptr<coroutine_local_slot[]> slots_;
+    std::size_t size_ = 0;
+  };
+
+} // namespace detail
+} // namespace spawn
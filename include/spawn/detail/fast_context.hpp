@@ -0,0 +1,308 @@
+//
+// detail/fast_context.hpp
+// ~~~~~~~~~~~~~~~~~~~~~~~
+//
+// Copyright (c) 2019 Casey Bodley (cbodley at redhat dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <utility>
+
+#include <boost/context/continuation.hpp>
+
+// A continuation whose context switch saves only the callee-saved integer
+// registers. boost::context's jump_fcontext also saves and restores MXCSR and
+// the x87 control word on every switch, so that a coroutine could change its
+// floating-point modes without affecting its caller. That is only worth its
+// cost for code that does change them, so this is opt-in with
+// SPAWN_FAST_CONTEXT_SWITCH. A coroutine that changes its rounding mode or
+// exception mask under this option leaks the change to whichever thread
+// resumes it.
+//
+// Only x86-64 ELF targets have an implementation. On aarch64, the AAPCS64
+// callee-saved d8-d15 must be saved anyway and jump_fcontext saves nothing
+// else, so other targets keep using boost::context::continuation.
+#if defined(SPAWN_FAST_CONTEXT_SWITCH) && defined(__x86_64__) && \
+    defined(__ELF__) && !defined(_WIN32)
+#define SPAWN_HAS_FAST_CONTEXT_SWITCH
+#endif
+
+#if defined(SPAWN_HAS_FAST_CONTEXT_SWITCH)
+
+// The layout of a suspended context, from the saved stack pointer up:
+// r12, r13, r14, r15, rbx, rbp and the return address. The functions are
+// emitted into comdat sections, so every translation unit that includes this
+// header shares one copy.
+asm(
+".pushsection .text.spawn_jump_fcontext,\"axG\",@progbits,spawn_jump_fcontext,comdat\n"
+".weak spawn_jump_fcontext\n"
+".hidden spawn_jump_fcontext\n"
+".type spawn_jump_fcontext,@function\n"
+".align 16\n"
+"spawn_jump_fcontext:\n"
+"    leaq  -0x30(%rsp), %rsp\n"
+"    movq  %r12, 0x00(%rsp)\n"
+"    movq  %r13, 0x08(%rsp)\n"
+"    movq  %r14, 0x10(%rsp)\n"
+"    movq  %r15, 0x18(%rsp)\n"
+"    movq  %rbx, 0x20(%rsp)\n"
+"    movq  %rbp, 0x28(%rsp)\n"
+"    movq  %rsp, %rax\n"
+"    movq  %rdi, %rsp\n"
+"    movq  0x30(%rsp), %r8\n"
+"    movq  0x00(%rsp), %r12\n"
+"    movq  0x08(%rsp), %r13\n"
+"    movq  0x10(%rsp), %r14\n"
+"    movq  0x18(%rsp), %r15\n"
+"    movq  0x20(%rsp), %rbx\n"
+"    movq  0x28(%rsp), %rbp\n"
+"    leaq  0x38(%rsp), %rsp\n"
+// return transfer_t{rax, rdx}, which is also the first argument of a
+// context's entry function
+"    movq  %rsi, %rdx\n"
+"    movq  %rax, %rdi\n"
+"    jmp   *%r8\n"
+".size spawn_jump_fcontext,.-spawn_jump_fcontext\n"
+".popsection\n"
+
+".pushsection .text.spawn_ontop_fcontext,\"axG\",@progbits,spawn_ontop_fcontext,comdat\n"
+".weak spawn_ontop_fcontext\n"
+".hidden spawn_ontop_fcontext\n"
+".type spawn_ontop_fcontext,@function\n"
+".align 16\n"
+"spawn_ontop_fcontext:\n"
+"    movq  %rdx, %r8\n"
+"    leaq  -0x30(%rsp), %rsp\n"
+"    movq  %r12, 0x00(%rsp)\n"
+"    movq  %r13, 0x08(%rsp)\n"
+"    movq  %r14, 0x10(%rsp)\n"
+"    movq  %r15, 0x18(%rsp)\n"
+"    movq  %rbx, 0x20(%rsp)\n"
+"    movq  %rbp, 0x28(%rsp)\n"
+"    movq  %rsp, %rax\n"
+"    movq  %rdi, %rsp\n"
+"    movq  0x00(%rsp), %r12\n"
+"    movq  0x08(%rsp), %r13\n"
+"    movq  0x10(%rsp), %r14\n"
+"    movq  0x18(%rsp), %r15\n"
+"    movq  0x20(%rsp), %rbx\n"
+"    movq  0x28(%rsp), %rbp\n"
+// leave the return address on the stack, so that the function returns its
+// transfer_t to the suspended context
+"    leaq  0x30(%rsp), %rsp\n"
+"    movq  %rsi, %rdx\n"
+"    movq  %rax, %rdi\n"
+"    jmp   *%r8\n"
+".size spawn_ontop_fcontext,.-spawn_ontop_fcontext\n"
+".popsection\n"
+
+".pushsection .text.spawn_make_fcontext,\"axG\",@progbits,spawn_make_fcontext,comdat\n"
+".weak spawn_make_fcontext\n"
+".hidden spawn_make_fcontext\n"
+".type spawn_make_fcontext,@function\n"
+".align 16\n"
+"spawn_make_fcontext:\n"
+"    movq  %rdi, %rax\n"
+"    andq  $-16, %rax\n"
+"    leaq  -0x38(%rax), %rax\n"
+// the entry function goes in rbx, and rbp holds the address that the entry
+// function would return to
+"    movq  %rdx, 0x20(%rax)\n"
+"    leaq  .Lspawn_fcontext_finish(%rip), %rcx\n"
+"    movq  %rcx, 0x28(%rax)\n"
+"    leaq  .Lspawn_fcontext_trampoline(%rip), %rcx\n"
+"    movq  %rcx, 0x30(%rax)\n"
+"    ret\n"
+".Lspawn_fcontext_trampoline:\n"
+"    push  %rbp\n"
+"    jmp   *%rbx\n"
+".Lspawn_fcontext_finish:\n"
+"    xorq  %rdi, %rdi\n"
+"    call  _exit@PLT\n"
+"    hlt\n"
+".size spawn_make_fcontext,.-spawn_make_fcontext\n"
+".popsection\n"
+);
+
+extern "C" {
+
+boost::context::detail::transfer_t spawn_jump_fcontext(
+    boost::context::detail::fcontext_t const to, void* vp);
+
+boost::context::detail::fcontext_t spawn_make_fcontext(
+    void* sp, std::size_t size, void (*fn)(boost::context::detail::transfer_t));
+
+boost::context::detail::transfer_t spawn_ontop_fcontext(
+    boost::context::detail::fcontext_t const to, void* vp,
+    boost::context::detail::transfer_t (*fn)(boost::context::detail::transfer_t));
+
+} // extern "C"
+
+namespace spawn {
+namespace detail {
+namespace fast_context {
+
+  using boost::context::detail::fcontext_t;
+  using boost::context::detail::transfer_t;
+  // reuse boost's unwind exception, so that code which catches it to let it
+  // propagate works with either continuation
+  using boost::context::detail::forced_unwind;
+
+  inline transfer_t context_unwind(transfer_t t)
+  {
+    throw forced_unwind(t.fctx);
+  }
+
+  template <typename Record>
+  transfer_t context_exit(transfer_t t) noexcept
+  {
+    static_cast<Record*>(t.data)->deallocate();
+    return {nullptr, nullptr};
+  }
+
+  template <typename Record>
+  void context_entry(transfer_t t) noexcept
+  {
+    Record* record = static_cast<Record*>(t.data);
+    try
+    {
+      // return to create_context() until the first resume
+      t = spawn_jump_fcontext(t.fctx, nullptr);
+      t.fctx = record->run(t.fctx);
+    }
+    catch (const forced_unwind& e)
+    {
+      t = {e.fctx, nullptr};
+#if !defined(BOOST_ASSERT_IS_VOID)
+      const_cast<forced_unwind&>(e).caught = true;
+#endif
+    }
+    // free this context's stack from the context we return to
+    spawn_ontop_fcontext(t.fctx, record, context_exit<Record>);
+  }
+
+  class continuation;
+
+  template <typename StackAllocator, typename Function>
+  class record
+  {
+  public:
+    record(boost::context::stack_context sctx, StackAllocator&& salloc,
+           Function&& function)
+      : sctx_(sctx),
+        salloc_(std::move(salloc)),
+        function_(std::move(function))
+    {
+    }
+    record(const record&) = delete;
+    record& operator=(const record&) = delete;
+
+    void deallocate() noexcept
+    {
+      StackAllocator salloc = std::move(salloc_);
+      boost::context::stack_context sctx = sctx_;
+      this->~record();
+      salloc.deallocate(sctx);
+    }
+
+    fcontext_t run(fcontext_t fctx);
+
+  private:
+    boost::context::stack_context sctx_;
+    StackAllocator salloc_;
+    Function function_;
+  };
+
+  class continuation
+  {
+  public:
+    continuation() noexcept = default;
+
+    explicit continuation(fcontext_t fctx) noexcept : fctx_(fctx) {}
+
+    ~continuation()
+    {
+      if (fctx_)
+        spawn_ontop_fcontext(release(), nullptr, context_unwind);
+    }
+
+    continuation(continuation&& other) noexcept : fctx_(other.release()) {}
+
+    continuation& operator=(continuation&& other) noexcept
+    {
+      if (this != &other)
+      {
+        continuation tmp = std::move(other);
+        std::swap(fctx_, tmp.fctx_);
+      }
+      return *this;
+    }
+
+    continuation resume() &
+    {
+      return std::move(*this).resume();
+    }
+
+    continuation resume() &&
+    {
+      return continuation(spawn_jump_fcontext(release(), nullptr).fctx);
+    }
+
+    explicit operator bool() const noexcept { return fctx_ != nullptr; }
+
+    bool operator!() const noexcept { return fctx_ == nullptr; }
+
+    fcontext_t release() noexcept
+    {
+      fcontext_t fctx = fctx_;
+      fctx_ = nullptr;
+      return fctx;
+    }
+
+  private:
+    fcontext_t fctx_ = nullptr;
+  };
+
+  template <typename StackAllocator, typename Function>
+  fcontext_t record<StackAllocator, Function>::run(fcontext_t fctx)
+  {
+    continuation c = function_(continuation(fctx));
+    return c.release();
+  }
+
+  template <typename StackAllocator, typename Function>
+  continuation callcc(std::allocator_arg_t, StackAllocator&& salloc,
+                      Function&& function)
+  {
+    using salloc_type = typename std::decay<StackAllocator>::type;
+    using function_type = typename std::decay<Function>::type;
+    using record_type = record<salloc_type, function_type>;
+
+    salloc_type a(std::forward<StackAllocator>(salloc));
+    boost::context::stack_context sctx = a.allocate();
+    // the record lives at the top of the stack, like boost::context's does
+    void* storage = reinterpret_cast<void*>(
+        (reinterpret_cast<std::uintptr_t>(sctx.sp) - sizeof(record_type)) &
+        ~static_cast<std::uintptr_t>(0xff));
+    record_type* r = new (storage) record_type(sctx, std::move(a),
+                                               function_type(std::forward<Function>(function)));
+    void* top = static_cast<char*>(storage) - 64;
+    void* bottom = static_cast<char*>(sctx.sp) - sctx.size;
+    const std::size_t size = static_cast<char*>(top) - static_cast<char*>(bottom);
+    fcontext_t fctx = spawn_make_fcontext(top, size, &context_entry<record_type>);
+    fctx = spawn_jump_fcontext(fctx, r).fctx;
+    return continuation(fctx).resume();
+  }
+
+} // namespace fast_context
+} // namespace detail
+} // namespace spawn
+
+#endif // defined(SPAWN_HAS_FAST_CONTEXT_SWITCH)
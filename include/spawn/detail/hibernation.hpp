@@ -0,0 +1,204 @@
+//
+// detail/hibernation.hpp
+// ~~~~~~~~~~~~~~~~~~~~~~
+//
+// Copyright (c) 2019 Casey Bodley (cbodley at redhat dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <thread>
+#include <utility>
+
+#include <sys/mman.h>
+
+#if !defined(NDEBUG) && !defined(SPAWN_HIBERNATION_CHECKS)
+#define SPAWN_HIBERNATION_CHECKS
+#endif
+
+#if defined(__has_feature)
+#if __has_feature(address_sanitizer)
+#define SPAWN_HIBERNATION_ASAN
+#endif
+#elif defined(__SANITIZE_ADDRESS__)
+#define SPAWN_HIBERNATION_ASAN
+#endif
+
+namespace spawn {
+namespace detail {
+
+  class continuation_context;
+
+  // AddressSanitizer poisons the redzones around a frame's locals, and its
+  // memcpy() checks them, so copy a stack under it one byte at a time.
+#if defined(SPAWN_HIBERNATION_ASAN)
+  __attribute__((no_sanitize_address))
+  inline void hibernation_copy(char* dst, const char* src, std::size_t n) noexcept
+  {
+    volatile char* d = dst;
+    const volatile char* s = src;
+    for (std::size_t i = 0; i < n; i++)
+      d[i] = s[i];
+  }
+#else
+  inline void hibernation_copy(char* dst, const char* src, std::size_t n) noexcept
+  {
+    std::memcpy(dst, src, n);
+  }
+#endif
+
+  // The hibernation state of one stack from a hibernating_stack. The thread
+  // that resumes a coroutine calls wake() before it switches to the stack,
+  // and sleep() once the coroutine has switched away. hibernate() may run
+  // on any thread in between.
+  class hibernation_record
+  {
+  public:
+    enum : int { running, suspended, hibernating, hibernated, restoring };
+
+    hibernation_record(char* bottom, char* top) noexcept
+      : bottom_(bottom), top_(top)
+    {
+    }
+
+    // sp is the suspended context's saved stack pointer. everything the
+    // coroutine still needs lies between it and the top of the stack
+    void sleep(void* sp, std::int64_t now) noexcept
+    {
+      sp_ = static_cast<char*>(sp);
+      suspended_at_.store(now, std::memory_order_relaxed);
+      state_.store(suspended, std::memory_order_release);
+    }
+
+    void wake() noexcept
+    {
+      int s = state_.load(std::memory_order_acquire);
+      for (;;)
+      {
+        if (s == running)
+          return;
+        if (s == suspended)
+        {
+          if (state_.compare_exchange_weak(s, running, std::memory_order_acq_rel))
+            return;
+        }
+        else if (s == hibernated)
+        {
+          if (state_.compare_exchange_weak(s, restoring, std::memory_order_acq_rel))
+          {
+            restore();
+            state_.store(running, std::memory_order_release);
+            return;
+          }
+        }
+        else
+        {
+          // another thread is in the middle of hibernating the stack
+          std::this_thread::yield();
+          s = state_.load(std::memory_order_acquire);
+        }
+      }
+    }
+
+    // Copy the live part of the stack aside and release its pages, if it
+    // has been suspended since before idle_since.
+    bool hibernate(std::int64_t idle_since) noexcept
+    {
+      if (state_.load(std::memory_order_relaxed) != suspended ||
+          suspended_at_.load(std::memory_order_relaxed) > idle_since)
+        return false;
+      int s = suspended;
+      if (!state_.compare_exchange_strong(s, hibernating, std::memory_order_acquire))
+        return false;
+      saved_size_ = static_cast<std::size_t>(top_ - sp_);
+      saved_.reset(new (std::nothrow) char[saved_size_]);
+      if (!saved_)
+      {
+        state_.store(suspended, std::memory_order_release);
+        return false;
+      }
+      hibernation_copy(saved_.get(), sp_, saved_size_);
+      ::madvise(bottom_, top_ - bottom_, MADV_DONTNEED);
+#if defined(SPAWN_HIBERNATION_CHECKS)
+      // anything that reads or writes the stack while it hibernates faults
+      // here, instead of losing its write when the stack is restored
+      ::mprotect(bottom_, top_ - bottom_, PROT_NONE);
+#endif
+      state_.store(hibernated, std::memory_order_release);
+      return true;
+    }
+
+    bool is_hibernated() const noexcept
+    {
+      return state_.load(std::memory_order_relaxed) == hibernated;
+    }
+
+    std::size_t saved_size() const noexcept
+    {
+      return is_hibernated() ? saved_size_ : 0;
+    }
+
+    // links in the hibernation_pool's list, guarded by its mutex
+    hibernation_record* prev_ = nullptr;
+    hibernation_record* next_ = nullptr;
+
+  private:
+    void restore() noexcept
+    {
+#if defined(SPAWN_HIBERNATION_CHECKS)
+      ::mprotect(bottom_, top_ - bottom_, PROT_READ | PROT_WRITE);
+#endif
+      hibernation_copy(sp_, saved_.get(), saved_size_);
+      saved_.reset();
+    }
+
+    char* const bottom_;
+    char* const top_;
+    char* sp_ = nullptr;
+    std::atomic<int> state_{running};
+    std::atomic<std::int64_t> suspended_at_{0};
+    std::unique_ptr<char[]> saved_;
+    std::size_t saved_size_ = 0;
+  };
+
+  // Only stacks from a hibernating_stack carry a hibernation_record. It
+  // binds itself to the coroutine with bind(), while other allocators go
+  // to callcc() as they are.
+  template <typename StackAllocator>
+  auto bind_stack_allocator(StackAllocator&& salloc, continuation_context& c, int)
+    -> decltype(salloc.bind(c))
+  {
+    return salloc.bind(c);
+  }
+
+  template <typename StackAllocator>
+  StackAllocator&& bind_stack_allocator(StackAllocator&& salloc,
+                                        continuation_context&, long) noexcept
+  {
+    return std::forward<StackAllocator>(salloc);
+  }
+
+  // Return the saved stack pointer of a suspended continuation. Both
+  // boost::context::continuation and fast_context::continuation hold
+  // nothing but the fcontext_t.
+  template <typename Continuation>
+  void* continuation_stack_pointer(const Continuation& c) noexcept
+  {
+    static_assert(sizeof(Continuation) == sizeof(void*),
+                  "continuation holds a single fcontext_t");
+    void* sp;
+    std::memcpy(&sp, &c, sizeof(sp));
+    return sp;
+  }
+
+} // namespace detail
+} // namespace spawn
@@ -0,0 +1,74 @@
+//
+// detail/operation_slot.hpp
+// ~~~~~~~~~~~~~~~~~~~~~~~~~
+//
+// Copyright (c) 2019 Casey Bodley (cbodley at redhat dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <new>
+
+namespace spawn {
+namespace detail {
+
+// Caches the memory of one asynchronous operation for reuse by the next. A
+// coroutine usually waits on one operation at a time, so in steady state each
+// operation reuses the block freed by the previous one. Each block remembers
+// its capacity in a header, so that an operation with smaller state, like a
+// wait, does not shrink the block that the next, larger, operation needs.
+//
+// Operations free their memory on whichever thread completes them, before
+// their handler is dispatched to the coroutine's strand, so the slot is a
+// single atomic pointer.
+class operation_slot
+{
+public:
+  operation_slot() = default;
+  operation_slot(const operation_slot&) = delete;
+  operation_slot& operator=(const operation_slot&) = delete;
+
+  ~operation_slot()
+  {
+    ::operator delete(block_.load(std::memory_order_relaxed));
+  }
+
+  void* allocate(std::size_t size)
+  {
+    header* h = block_.exchange(nullptr, std::memory_order_acquire);
+    if (h && h->capacity < size)
+    {
+      ::operator delete(h);
+      h = nullptr;
+    }
+    if (!h)
+    {
+      h = static_cast<header*>(::operator new(sizeof(header) + size));
+      h->capacity = size;
+    }
+    return h + 1;
+  }
+
+  void deallocate(void* p, std::size_t)
+  {
+    header* h = static_cast<header*>(p) - 1;
+    h = block_.exchange(h, std::memory_order_release);
+    ::operator delete(h);
+  }
+
+private:
+  struct alignas(std::max_align_t) header
+  {
+    std::size_t capacity;
+  };
+
+  std::atomic<header*> block_{nullptr};
+};
+
+} // namespace detail
+} // namespace spawn
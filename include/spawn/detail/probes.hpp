@@ -0,0 +1,76 @@
+//
+// detail/probes.hpp
+// ~~~~~~~~~~~~~~~~~
+//
+// Copyright (c) 2019 Casey Bodley (cbodley at redhat dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#pragma once
+
+// Static tracepoints in the life of each coroutine, for bpftrace, perf and
+// other tools that read SystemTap SDT notes. They are compiled in whenever
+// <sys/sdt.h> is available, unless SPAWN_DISABLE_PROBES is defined. Until a
+// tool attaches to it, each probe is a single nop.
+//
+// Every probe in the "spawn" provider takes the same first three arguments:
+//   arg0  the coroutine's id, unique among the coroutines that are alive
+//   arg1  the size of its stack in bytes
+//   arg2  its label: the name of its function's type, from typeid(), or
+//         NULL without RTTI
+//
+// spawn:create     its stack has been allocated
+// spawn:start      it runs for the first time
+// spawn:suspend    it waits for an asynchronous operation. arg3 is the tag
+//                  given by basic_yield_context::tag(), or NULL
+// spawn:resume     it returns from that wait, with the same arg3
+// spawn:exception  its function exited with an exception
+// spawn:finish     its function has returned, and it is about to exit
+//
+// See tools/ for bpftrace scripts that use them.
+
+#if !defined(SPAWN_DISABLE_PROBES) && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define SPAWN_HAS_PROBES
+#endif
+#endif
+
+#if defined(SPAWN_HAS_PROBES)
+
+#define SPAWN_PROBE(name, ctx) \
+  STAP_PROBE3(spawn, name, (ctx), (ctx)->stack_size_, (ctx)->label_)
+#define SPAWN_PROBE_TAG(name, ctx, tag) \
+  STAP_PROBE4(spawn, name, (ctx), (ctx)->stack_size_, (ctx)->label_, (tag))
+
+#else // !defined(SPAWN_HAS_PROBES)
+
+#define SPAWN_PROBE(name, ctx) ((void)0)
+#define SPAWN_PROBE_TAG(name, ctx, tag) ((void)0)
+
+#endif // !defined(SPAWN_HAS_PROBES)
+
+#include <boost/config.hpp>
+#if !defined(BOOST_NO_TYPEID)
+#include <typeinfo>
+#endif
+
+namespace spawn {
+namespace detail {
+
+  // The label of a coroutine, for its tracepoints and for the samples of
+  // spawn::sampling_profiler.
+  template <typename Function>
+  const char* probe_label() noexcept
+  {
+#if !defined(BOOST_NO_TYPEID)
+    return typeid(Function).name();
+#else
+    return nullptr;
+#endif
+  }
+
+} // namespace detail
+} // namespace spawn
@@ -0,0 +1,182 @@
+//
+// detail/trace.hpp
+// ~~~~~~~~~~~~~~~~
+//
+// Copyright (c) 2019 Casey Bodley (cbodley at redhat dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#pragma once
+
+// The scheduling events of coroutines, recorded when SPAWN_TRACING is
+// defined and written out by spawn::write_chrome_trace(). Each thread
+// records into a ring buffer of its own without locking.
+//
+// SPAWN_TRACE(spawn, ctx)        the coroutine was created
+// SPAWN_TRACE(resume, ctx)       it starts or continues running
+// SPAWN_TRACE_SUSPEND(ctx, tag, signature)
+//                                it waits for an operation, with the tag
+//                                from basic_yield_context::tag() or else the
+//                                typeid name of its completion signature
+// SPAWN_TRACE(finish, ctx)       its function has returned
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <boost/config.hpp>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+// the number of events that each thread keeps, a power of two
+#if !defined(SPAWN_TRACE_EVENTS)
+#define SPAWN_TRACE_EVENTS 16384
+#endif
+
+namespace spawn {
+namespace detail {
+
+  enum class trace_type : std::uint8_t
+  {
+    spawn,
+    resume,
+    suspend,        // detail is the mangled name of a completion signature
+    suspend_tagged, // detail is a tag
+    finish,
+  };
+
+  // The fields are relaxed atomics so that write_chrome_trace() can copy a
+  // buffer while its thread writes to it. Events that were overwritten in
+  // the meantime are discarded by their index.
+  struct trace_event
+  {
+    std::atomic<std::uint64_t> time{0};
+    std::atomic<const void*> coroutine{nullptr};
+    std::atomic<const char*> label{nullptr};
+    std::atomic<const char*> detail{nullptr};
+    std::atomic<trace_type> type{trace_type::spawn};
+  };
+
+  struct trace_buffer
+  {
+    static constexpr std::uint64_t capacity = SPAWN_TRACE_EVENTS;
+    static_assert((capacity & (capacity - 1)) == 0,
+                  "SPAWN_TRACE_EVENTS must be a power of two");
+
+    const unsigned tid;
+    // the index of the next event, written only by the owning thread
+    std::atomic<std::uint64_t> head{0};
+    // events before this index were discarded by trace_reset()
+    std::atomic<std::uint64_t> tail{0};
+    trace_event events[capacity];
+
+    explicit trace_buffer(unsigned tid) noexcept : tid(tid) {}
+  };
+
+  // The time stamp counter where there is one, which is cheaper to read than
+  // steady_clock. write_chrome_trace() converts it to steady_clock time.
+  inline std::uint64_t trace_clock() noexcept
+  {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+  }
+
+  // Owns the buffer of every thread that recorded an event. Buffers are
+  // never freed, so that a thread's events outlive it.
+  class trace_registry
+  {
+  public:
+    static trace_registry& instance()
+    {
+      static trace_registry registry;
+      return registry;
+    }
+
+    trace_buffer& add()
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      const unsigned tid = static_cast<unsigned>(buffers_.size()) + 1;
+      buffers_.emplace_back(new trace_buffer(tid));
+      return *buffers_.back();
+    }
+
+    // Call f for each buffer while holding the lock.
+    template <typename Function>
+    void for_each(Function&& f)
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      for (auto& b : buffers_)
+        f(*b);
+    }
+
+    // The clocks at the first event, to calibrate trace_clock() against.
+    const std::uint64_t base_ticks = trace_clock();
+    const std::chrono::steady_clock::time_point base_time =
+        std::chrono::steady_clock::now();
+
+  private:
+    std::mutex mutex_;
+    std::vector<std::unique_ptr<trace_buffer>> buffers_;
+  };
+
+  // Out of line for the same reason as current_continuation(): a coroutine
+  // that records an event, suspends and resumes on another thread must find
+  // that thread's buffer.
+  BOOST_NOINLINE inline trace_buffer& local_trace_buffer()
+  {
+    static thread_local trace_buffer* buffer = nullptr;
+    if (!buffer)
+      buffer = &trace_registry::instance().add();
+    return *buffer;
+  }
+
+  inline void trace_record(trace_type type, const void* coroutine,
+                           const char* label, const char* detail) noexcept
+  {
+    trace_buffer& b = local_trace_buffer();
+    const std::uint64_t head = b.head.load(std::memory_order_relaxed);
+    // order the previous event's head.store() before this event's fields,
+    // so that a copy which reads any of them also sees that head, and
+    // discards the slot being overwritten
+    std::atomic_thread_fence(std::memory_order_release);
+    trace_event& e = b.events[head & (trace_buffer::capacity - 1)];
+    e.time.store(trace_clock(), std::memory_order_relaxed);
+    e.coroutine.store(coroutine, std::memory_order_relaxed);
+    e.label.store(label, std::memory_order_relaxed);
+    e.detail.store(detail, std::memory_order_relaxed);
+    e.type.store(type, std::memory_order_relaxed);
+    b.head.store(head + 1, std::memory_order_release);
+  }
+
+} // namespace detail
+} // namespace spawn
+
+#if defined(SPAWN_TRACING)
+
+#define SPAWN_TRACE(type, ctx) \
+  ::spawn::detail::trace_record(::spawn::detail::trace_type::type, \
+                                (ctx), (ctx)->label_, nullptr)
+#define SPAWN_TRACE_SUSPEND(ctx, tag, signature) \
+  ::spawn::detail::trace_record((tag) ? \
+        ::spawn::detail::trace_type::suspend_tagged : \
+        ::spawn::detail::trace_type::suspend, \
+      (ctx), (ctx)->label_, (tag) ? (tag) : (signature))
+
+#else // !defined(SPAWN_TRACING)
+
+#define SPAWN_TRACE(type, ctx) ((void)0)
+#define SPAWN_TRACE_SUSPEND(ctx, tag, signature) ((void)0)
+
+#endif // !defined(SPAWN_TRACING)
@@ -0,0 +1,227 @@
+//
+// file_ring.hpp
+// ~~~~~~~~~~~~~
+//
+// Copyright (c) 2019 Casey Bodley (cbodley at redhat dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#pragma once
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+// IORING_OP_READ and IORING_OP_WRITE arrived in linux 5.6, along with this
+#if defined(IORING_FEAT_CUR_PERSONALITY)
+#define SPAWN_HAS_FILE_RING
+#endif
+#endif
+#endif
+
+#if defined(SPAWN_HAS_FILE_RING) || defined(GENERATING_DOCUMENTATION)
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+#include <boost/asio/async_result.hpp>
+#include <boost/asio/buffer.hpp>
+#include <boost/asio/io_context.hpp>
+#include <boost/system/error_code.hpp>
+
+namespace spawn {
+namespace detail {
+
+  class file_ring_state;
+
+} // namespace detail
+
+/// Asynchronous file I/O through a dedicated io_uring.
+/**
+ * Regular files are always readable as far as epoll is concerned, so a
+ * coroutine that wants to read one without blocking its thread has nowhere
+ * to wait. A file_ring submits reads, writes and fsyncs to its own
+ * io_uring and completes them on an io_context, so that a coroutine can
+ * wait for them like any other operation:
+ *
+ * @code spawn::file_ring ring(ioc);
+ * spawn::spawn(ioc, [&] (spawn::yield_context yield) {
+ *     char buf[4096];
+ *     std::size_t n = ring.async_read_some_at(fd, 0,
+ *         boost::asio::buffer(buf), yield);
+ *     // ...
+ *   }); @endcode
+ *
+ * Operations are not submitted one at a time. The first operation started
+ * on a ring posts a flush to the io_context, and every operation that
+ * starts before it runs joins the same io_uring_enter() call. When many
+ * coroutines issue small reads in the same turn of the io_context, they
+ * cost one system call between them. The ring's eventfd is watched with
+ * the io_context's reactor only while operations are in flight, so an idle
+ * ring does not keep run() from returning.
+ *
+ * A ring may also register fixed buffers with the kernel. The kernel then
+ * does not have to map the buffer's pages on every operation. See
+ * acquire_buffer().
+ *
+ * Completion handlers are dispatched to their associated executor, with
+ * the io_context's executor as the default. For a basic_yield_context,
+ * that resumes the coroutine through its strand like any other operation.
+ * If io_uring_enter() refuses a submission, for example with EAGAIN or
+ * EBUSY when the kernel is short of resources, the operations in that
+ * batch complete with its error_code.
+ *
+ * Operations may be started from any thread. The ring must be destroyed
+ * before its io_context. Its destructor waits for the operations in flight
+ * and destroys their handlers without invoking them.
+ *
+ * Requires linux 5.6 or later. Where the kernel or a seccomp policy does
+ * not allow io_uring, the constructor throws std::system_error.
+ */
+class file_ring
+{
+public:
+  class fixed_buffer;
+
+  using executor_type = boost::asio::io_context::executor_type;
+
+  /// Create a ring that completes its operations on the given io_context.
+  /**
+   * @param ioc The io_context that runs completion handlers.
+   *
+   * @param entries The size of the submission queue. More operations than
+   * this may be started at once. Operations beyond twice this number wait
+   * for others to complete before they are submitted.
+   *
+   * @param buffer_count The number of fixed buffers to register.
+   *
+   * @param buffer_size The size of each fixed buffer.
+   */
+  explicit file_ring(boost::asio::io_context& ioc, unsigned entries = 256,
+                     std::size_t buffer_count = 0,
+                     std::size_t buffer_size = 64 * 1024);
+
+  /// Wait for the operations in flight and close the ring.
+  ~file_ring();
+
+  file_ring(const file_ring&) = delete;
+  file_ring& operator=(const file_ring&) = delete;
+
+  executor_type get_executor() const noexcept;
+
+  /// Take a fixed buffer from the ring.
+  /**
+   * The buffer goes back to the ring when the returned object is
+   * destroyed. If all of the ring's buffers are taken, the returned object
+   * is empty, and the caller can fall back to a buffer of its own.
+   */
+  fixed_buffer acquire_buffer();
+
+  /// Read from the file at the given offset.
+  /**
+   * The handler must have the signature:
+   * @code void handler(boost::system::error_code ec, std::size_t bytes); @endcode
+   * Reading at the end of the file fails with boost::asio::error::eof.
+   */
+  template <typename ReadHandler>
+  BOOST_ASIO_INITFN_RESULT_TYPE(ReadHandler,
+      void(boost::system::error_code, std::size_t))
+  async_read_some_at(int fd, std::uint64_t offset,
+                     const boost::asio::mutable_buffer& buffer,
+                     ReadHandler&& handler);
+
+  /// Read from the file into the first size bytes of a fixed buffer.
+  template <typename ReadHandler>
+  BOOST_ASIO_INITFN_RESULT_TYPE(ReadHandler,
+      void(boost::system::error_code, std::size_t))
+  async_read_some_at(int fd, std::uint64_t offset, fixed_buffer& buffer,
+                     std::size_t size, ReadHandler&& handler);
+
+  /// Write to the file at the given offset.
+  /**
+   * The handler must have the signature:
+   * @code void handler(boost::system::error_code ec, std::size_t bytes); @endcode
+   */
+  template <typename WriteHandler>
+  BOOST_ASIO_INITFN_RESULT_TYPE(WriteHandler,
+      void(boost::system::error_code, std::size_t))
+  async_write_some_at(int fd, std::uint64_t offset,
+                      const boost::asio::const_buffer& buffer,
+                      WriteHandler&& handler);
+
+  /// Write the first size bytes of a fixed buffer to the file.
+  template <typename WriteHandler>
+  BOOST_ASIO_INITFN_RESULT_TYPE(WriteHandler,
+      void(boost::system::error_code, std::size_t))
+  async_write_some_at(int fd, std::uint64_t offset, const fixed_buffer& buffer,
+                      std::size_t size, WriteHandler&& handler);
+
+  /// Flush the file's data and metadata to its storage device.
+  /**
+   * The handler must have the signature:
+   * @code void handler(boost::system::error_code ec); @endcode
+   */
+  template <typename FsyncHandler>
+  BOOST_ASIO_INITFN_RESULT_TYPE(FsyncHandler, void(boost::system::error_code))
+  async_fsync(int fd, FsyncHandler&& handler);
+
+  /// Return the number of io_uring_enter() calls that submitted operations.
+  std::uint64_t submit_calls() const noexcept;
+
+private:
+  std::shared_ptr<detail::file_ring_state> state_;
+};
+
+/// A buffer registered with a file_ring.
+/**
+ * A fixed buffer may be used with the ring's operations like any other
+ * buffer, but only the ring it came from can use it as a fixed buffer.
+ */
+class file_ring::fixed_buffer
+{
+public:
+  /// Construct an empty buffer.
+  fixed_buffer() noexcept = default;
+
+  /// Return the buffer to its ring.
+  ~fixed_buffer();
+
+  fixed_buffer(fixed_buffer&& other) noexcept;
+  fixed_buffer& operator=(fixed_buffer&& other) noexcept;
+
+  void* data() const noexcept { return data_; }
+  std::size_t size() const noexcept { return size_; }
+
+  /// Return the whole buffer as a mutable_buffer.
+  boost::asio::mutable_buffer buffer() const noexcept
+  {
+    return boost::asio::mutable_buffer(data_, size_);
+  }
+
+  /// Return true if the buffer came from a ring.
+  explicit operator bool() const noexcept { return data_ != nullptr; }
+
+private:
+  friend class file_ring;
+
+  fixed_buffer(std::shared_ptr<detail::file_ring_state> state,
+               unsigned index, void* data, std::size_t size) noexcept
+    : state_(std::move(state)), index_(index), data_(data), size_(size)
+  {
+  }
+
+  void release() noexcept;
+
+  std::shared_ptr<detail::file_ring_state> state_;
+  unsigned index_ = 0;
+  void* data_ = nullptr;
+  std::size_t size_ = 0;
+};
+
+} // namespace spawn
+
+#include <spawn/impl/file_ring.hpp>
+
+#endif // defined(SPAWN_HAS_FILE_RING)
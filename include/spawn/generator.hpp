@@ -0,0 +1,170 @@
+//
+// generator.hpp
+// ~~~~~~~~~~~~~
+//
+// Copyright (c) 2019 Casey Bodley (cbodley at redhat dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#pragma once
+
+#include <exception>
+#include <iterator>
+#include <memory>
+#include <type_traits>
+
+#include <boost/context/continuation.hpp>
+#include <boost/context/fixedsize_stack.hpp>
+
+#include <spawn/detail/is_stack_allocator.hpp>
+
+namespace spawn {
+namespace detail {
+
+  template <typename T>
+  struct generator_state;
+
+  template <typename T, typename Function>
+  struct generator_entry;
+
+} // namespace detail
+
+/// A lazy sequence of values produced by a function running on its own stack.
+/**
+ * The producer function runs on a separate stack and pushes values to the
+ * consumer one at a time. Each call to next() switches directly to the
+ * producer's stack and back, without going through an executor. Values are
+ * passed by reference, so the consumer sees the producer's own object rather
+ * than a copy. For example:
+ *
+ * @code spawn::generator<record> records(
+ *     [&] (spawn::generator<record>::push_type& push) {
+ *       record r;
+ *       while (parse_next(input, r))
+ *         push(r); // suspends until the consumer asks for the next value
+ *     });
+ *
+ * for (record& r : records)
+ * {
+ *   // ...
+ * } @endcode
+ *
+ * The producer does not start until the first call to next(). An exception
+ * thrown by the producer is rethrown by next(). Destroying the generator
+ * before the producer returns unwinds the producer's stack.
+ *
+ * When the generator is consumed from a coroutine, the producer may suspend
+ * on the consumer's basic_yield_context to wait for asynchronous operations.
+ * The producer then resumes on the consumer's executor, as if the consumer
+ * had made the call itself. The execution context must not be destroyed while
+ * the producer is suspended that way: only the producer's stack would be
+ * unwound, and the consumer's stack would leak.
+ */
+template <typename T>
+class generator
+{
+public:
+  using value_type = typename std::remove_cv<T>::type;
+  using reference = T&;
+
+  /// The callable passed to the producer function for pushing values.
+  class push_type
+  {
+  public:
+    /// Yield a reference to the given value to the consumer.
+    /**
+     * The producer is suspended until the consumer asks for the next value,
+     * so the value stays valid for as long as the consumer may use it.
+     */
+    void operator()(T& value);
+
+    /// Yield a temporary to the consumer.
+    void operator()(typename std::remove_reference<T>::type&& value)
+    {
+      (*this)(static_cast<T&>(value));
+    }
+
+  private:
+    template <typename, typename> friend struct detail::generator_entry;
+    explicit push_type(detail::generator_state<T>& state) : state_(state) {}
+    detail::generator_state<T>& state_;
+  };
+
+  /// Create a generator that runs the given producer function.
+  /**
+   * @param function The producer function. The function must have the
+   * signature:
+   * @code void function(spawn::generator<T>::push_type& push); @endcode
+   *
+   * @param salloc The stack allocator for the producer's stack.
+   */
+  template <typename Function,
+            typename StackAllocator = boost::context::default_stack,
+            typename = typename std::enable_if<detail::is_stack_allocator<
+                typename std::decay<StackAllocator>::type>::value>::type>
+  explicit generator(Function&& function,
+                     StackAllocator&& salloc = StackAllocator());
+
+  generator(generator&& other) noexcept = default;
+  generator& operator=(generator&& other) noexcept = default;
+
+  /// Resume the producer until it pushes another value.
+  /**
+   * @returns A pointer to the producer's value, valid until the next call to
+   * next(), or nullptr once the producer has returned.
+   */
+  T* next();
+
+  /// An input iterator over the remaining values.
+  class iterator
+  {
+  public:
+    using iterator_category = std::input_iterator_tag;
+    using value_type = typename generator::value_type;
+    using difference_type = std::ptrdiff_t;
+    using pointer = T*;
+    using reference = T&;
+
+    iterator() : gen_(nullptr), value_(nullptr) {}
+
+    reference operator*() const { return *value_; }
+    pointer operator->() const { return value_; }
+
+    iterator& operator++()
+    {
+      value_ = gen_->next();
+      return *this;
+    }
+    void operator++(int) { ++*this; }
+
+    friend bool operator==(const iterator& lhs, const iterator& rhs)
+    {
+      return lhs.value_ == rhs.value_;
+    }
+    friend bool operator!=(const iterator& lhs, const iterator& rhs)
+    {
+      return lhs.value_ != rhs.value_;
+    }
+
+  private:
+    friend class generator;
+    iterator(generator* gen, T* value) : gen_(gen), value_(value) {}
+    generator* gen_;
+    T* value_;
+  };
+
+  /// Resume the producer for its next value and return an iterator to it.
+  iterator begin() { return iterator(this, next()); }
+
+  /// Return the iterator that compares equal once the producer has returned.
+  iterator end() { return iterator(); }
+
+private:
+  std::unique_ptr<detail::generator_state<T>> state_;
+};
+
+} // namespace spawn
+
+#include <spawn/impl/generator.hpp>
@@ -0,0 +1,116 @@
+//
+// growable_stack.hpp
+// ~~~~~~~~~~~~~~~~~~
+//
+// Copyright (c) 2019 Casey Bodley (cbodley at redhat dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#pragma once
+
+#include <cstddef>
+#include <new>
+
+#include <sys/mman.h>
+
+#include <boost/context/stack_context.hpp>
+#include <boost/context/stack_traits.hpp>
+
+namespace spawn {
+
+/// A stack allocator whose stacks only use memory for the pages they touch.
+/**
+ * Each stack reserves max_size bytes of address space, but no memory. The
+ * kernel backs a page the first time the coroutine touches it, so a
+ * coroutine that spends its life suspended in a shallow read costs only the
+ * few pages it has used, while one that occasionally needs a deep stack for
+ * TLS or parsing can still grow to max_size:
+ *
+ * @code spawn::spawn(ioc, session,
+ *     spawn::growable_stack(8 * 1024 * 1024)); @endcode
+ *
+ * Pages stay with the stack once touched, until the coroutine returns and
+ * the stack is unmapped.
+ *
+ * boost::context::protected_fixedsize_stack maps its stacks the same lazy
+ * way, with a guard page, and under the default overcommit policy the two
+ * use the same memory; prefer it there. growable_stack exists for the two
+ * things it cannot be configured to do, since it picks its own mmap()
+ * flags and always adds a guard page:
+ *
+ * @li Stacks are mapped with MAP_NORESERVE where available, so that under
+ * strict overcommit (vm.overcommit_memory=2) each stack's max_size is not
+ * charged against the commit limit up front. Otherwise a million 1MiB
+ * stacks need a terabyte of commit before a single page is touched.
+ *
+ * @li The guard page below each stack, which turns an overflow into a
+ * fault, is optional. It makes the stack two mappings, and Linux limits a
+ * process to vm.max_map_count mappings (65530 by default), so a million
+ * coroutines with guard pages take a higher limit. Without guard pages,
+ * adjacent stacks merge into one mapping.
+ *
+ * When the program is built with -fsplit-stack and BOOST_USE_SEGMENTED_STACKS,
+ * boost::context::segmented_stack grows stacks in segments instead, and can
+ * also be passed to spawn().
+ */
+class growable_stack
+{
+public:
+  using traits_type = boost::context::stack_traits;
+
+  /// Construct an allocator for stacks that can grow to max_size bytes.
+  explicit growable_stack(std::size_t max_size = 1024 * 1024,
+                          bool guard_page = true) noexcept
+    : size_(round_up(max_size)),
+      guard_(guard_page ? traits_type::page_size() : 0)
+  {
+  }
+
+  /// Return the size that each stack can grow to.
+  std::size_t max_size() const noexcept { return size_; }
+
+  boost::context::stack_context allocate()
+  {
+    const std::size_t size = size_ + guard_;
+    int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+#if defined(MAP_NORESERVE)
+    flags |= MAP_NORESERVE;
+#endif
+#if defined(MAP_STACK)
+    flags |= MAP_STACK;
+#endif
+    void* vp = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, flags, -1, 0);
+    if (vp == MAP_FAILED)
+      throw std::bad_alloc();
+    if (guard_ && ::mprotect(vp, guard_, PROT_NONE) != 0)
+    {
+      ::munmap(vp, size);
+      throw std::bad_alloc();
+    }
+    boost::context::stack_context sctx;
+    sctx.size = size;
+    sctx.sp = static_cast<char*>(vp) + size;
+    return sctx;
+  }
+
+  void deallocate(boost::context::stack_context& sctx) noexcept
+  {
+    ::munmap(static_cast<char*>(sctx.sp) - sctx.size, sctx.size);
+  }
+
+private:
+  static std::size_t round_up(std::size_t size) noexcept
+  {
+    const std::size_t page = traits_type::page_size();
+    if (size < traits_type::minimum_size())
+      size = traits_type::minimum_size();
+    return (size + page - 1) / page * page;
+  }
+
+  std::size_t size_;
+  std::size_t guard_;
+};
+
+} // namespace spawn
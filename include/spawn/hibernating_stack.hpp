@@ -0,0 +1,225 @@
+//
+// hibernating_stack.hpp
+// ~~~~~~~~~~~~~~~~~~~~~
+//
+// Copyright (c) 2019 Casey Bodley (cbodley at redhat dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <new>
+
+#include <boost/context/stack_context.hpp>
+
+#include <spawn/detail/hibernation.hpp>
+#include <spawn/growable_stack.hpp>
+#include <spawn/spawn.hpp>
+
+namespace spawn {
+namespace detail {
+
+  // The stacks of every coroutine spawned with copies of one
+  // hibernating_stack.
+  class hibernation_pool
+  {
+  public:
+    void insert(hibernation_record* r) noexcept
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      r->prev_ = nullptr;
+      r->next_ = head_;
+      if (head_)
+        head_->prev_ = r;
+      head_ = r;
+    }
+
+    void erase(hibernation_record* r) noexcept
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (r->prev_)
+        r->prev_->next_ = r->next_;
+      else
+        head_ = r->next_;
+      if (r->next_)
+        r->next_->prev_ = r->prev_;
+      r->prev_ = r->next_ = nullptr;
+    }
+
+    std::size_t hibernate(std::chrono::steady_clock::time_point idle_since) noexcept
+    {
+      const auto since = idle_since.time_since_epoch().count();
+      std::size_t count = 0;
+      std::lock_guard<std::mutex> lock(mutex_);
+      for (hibernation_record* r = head_; r; r = r->next_)
+      {
+        if (r->hibernate(since))
+          ++count;
+      }
+      return count;
+    }
+
+    std::size_t hibernated() noexcept
+    {
+      std::size_t count = 0;
+      std::lock_guard<std::mutex> lock(mutex_);
+      for (hibernation_record* r = head_; r; r = r->next_)
+      {
+        if (r->is_hibernated())
+          ++count;
+      }
+      return count;
+    }
+
+  private:
+    std::mutex mutex_;
+    hibernation_record* head_ = nullptr;
+  };
+
+  // The allocator that spawn() hands to callcc() for a hibernating_stack. It
+  // gives the coroutine's continuation_context a hibernation_record for the
+  // life of the stack.
+  class bound_hibernating_stack
+  {
+  public:
+    bound_hibernating_stack(const growable_stack& stacks,
+                            std::shared_ptr<hibernation_pool> pool,
+                            continuation_context& ctx) noexcept
+      : stacks_(stacks), pool_(std::move(pool)), ctx_(&ctx)
+    {
+    }
+
+    boost::context::stack_context allocate()
+    {
+      boost::context::stack_context sctx = stacks_.allocate();
+      char* top = static_cast<char*>(sctx.sp);
+      record_ = new (std::nothrow) hibernation_record(
+          top - stacks_.max_size(), top);
+      if (!record_)
+      {
+        stacks_.deallocate(sctx);
+        throw std::bad_alloc();
+      }
+      pool_->insert(record_);
+      ctx_->stack_ = record_;
+      return sctx;
+    }
+
+    void deallocate(boost::context::stack_context& sctx) noexcept
+    {
+      pool_->erase(record_);
+      ctx_->stack_ = nullptr;
+      delete record_;
+      stacks_.deallocate(sctx);
+    }
+
+  private:
+    growable_stack stacks_;
+    std::shared_ptr<hibernation_pool> pool_;
+    continuation_context* ctx_;
+    hibernation_record* record_ = nullptr;
+  };
+
+} // namespace detail
+
+/// A stack allocator whose idle stacks can give their memory back.
+/**
+ * Stacks are reserved like those of growable_stack. While a coroutine on
+ * one of them is suspended, hibernate_idle() may copy the part of its stack
+ * that is in use, usually a few hundred bytes for a coroutine that waits in
+ * a read, into a buffer of that size and return all of the stack's pages to
+ * the kernel. The coroutine's stack is copied back into place before it
+ * resumes, so the thread that resumes it pays for one copy, and a page fault
+ * for each page that it touches afterwards.
+ *
+ * Nothing hibernates on its own. The program decides how often to look for
+ * idle coroutines and how long they must have been suspended:
+ *
+ * @code spawn::hibernating_stack stacks;
+ * for (auto& socket : accepted) {
+ *   spawn::spawn(ioc, session{std::move(socket)}, stacks);
+ * }
+ * // then, from a timer that fires every minute:
+ * stacks.hibernate_idle(std::chrono::minutes(5)); @endcode
+ *
+ * Copies of a hibernating_stack share their bookkeeping, so hibernate_idle()
+ * covers the coroutines spawned with any copy. It is thread-safe, and may be
+ * called from any thread, including from a coroutine.
+ *
+ * Stacks hibernate without the coroutine's knowledge, so a suspended
+ * coroutine must not have given out pointers into its stack: nothing but the
+ * coroutine itself may read or write its stack while it waits. The results
+ * of the coroutine's own asynchronous operation are restored before they are
+ * written, but the buffer that an async_read_some() reads into, or an object
+ * such as a timer that the io_context links into its own lists, must live
+ * on the heap rather than on the coroutine's stack. Sockets themselves keep
+ * their reactor state on the heap and may stay on the stack.
+ *
+ * Unless NDEBUG is defined, or whenever SPAWN_HIBERNATION_CHECKS is, a
+ * hibernated stack is also made inaccessible, so that code which breaks
+ * this rule faults at the access instead of having its write lost when the
+ * stack is restored.
+ */
+class hibernating_stack
+{
+public:
+  using traits_type = growable_stack::traits_type;
+
+  /// Construct an allocator for stacks that can grow to max_size bytes.
+  explicit hibernating_stack(std::size_t max_size = 1024 * 1024,
+                             bool guard_page = true)
+    : stacks_(max_size, guard_page),
+      pool_(std::make_shared<detail::hibernation_pool>())
+  {
+  }
+
+  /// Return the size that each stack can grow to.
+  std::size_t max_size() const noexcept { return stacks_.max_size(); }
+
+  /// Hibernate the stacks of coroutines that have been suspended for at
+  /// least the given duration.
+  /**
+   * @returns The number of stacks that were hibernated by this call.
+   */
+  std::size_t hibernate_idle(std::chrono::steady_clock::duration idle)
+  {
+    return pool_->hibernate(std::chrono::steady_clock::now() - idle);
+  }
+
+  /// Return the number of stacks that are hibernated.
+  std::size_t hibernated() const
+  {
+    return pool_->hibernated();
+  }
+
+  // Stacks that are allocated directly, rather than by spawn(), never
+  // hibernate.
+  boost::context::stack_context allocate()
+  {
+    return stacks_.allocate();
+  }
+
+  void deallocate(boost::context::stack_context& sctx) noexcept
+  {
+    stacks_.deallocate(sctx);
+  }
+
+  // spawn() allocates through bind(), which registers the stack with the
+  // coroutine that runs on it.
+  detail::bound_hibernating_stack bind(detail::continuation_context& ctx) const
+  {
+    return detail::bound_hibernating_stack(stacks_, pool_, ctx);
+  }
+
+private:
+  growable_stack stacks_;
+  std::shared_ptr<detail::hibernation_pool> pool_;
+};
+
+} // namespace spawn
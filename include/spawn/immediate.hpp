@@ -0,0 +1,60 @@
+//
+// immediate.hpp
+// ~~~~~~~~~~~~~
+//
+// Copyright (c) 2019 Casey Bodley (cbodley at redhat dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#pragma once
+
+#include <spawn/spawn.hpp>
+
+namespace spawn {
+
+/// Complete an asynchronous operation from within its initiating function.
+/**
+ * An initiating function must not invoke its completion handler before it
+ * returns, so operations that can finish synchronously, such as a read from
+ * data that is already buffered, normally post their handler. A coroutine
+ * waiting on such an operation suspends in get() and resumes on the next
+ * turn of the executor.
+ *
+ * complete_immediately() lets an initiating function skip that round trip
+ * for handlers created from a basic_yield_context: the results are stored
+ * and get() returns without suspending. Any other handler is posted to its
+ * associated executor with the given arguments, as if by post(). For
+ * example:
+ *
+ * @code template <typename CompletionToken>
+ * auto async_read_some(CompletionToken&& token)
+ *   -> BOOST_ASIO_INITFN_RESULT_TYPE(CompletionToken,
+ *        void(boost::system::error_code, std::size_t))
+ * {
+ *   boost::asio::async_completion<CompletionToken,
+ *       void(boost::system::error_code, std::size_t)> init(token);
+ *   if (buffered_ > 0)
+ *     spawn::complete_immediately(std::move(init.completion_handler),
+ *                                 boost::system::error_code{}, consume());
+ *   else
+ *     start_read(std::move(init.completion_handler));
+ *   return init.result.get();
+ * } @endcode
+ *
+ * A coroutine whose operations keep completing immediately would never give
+ * other handlers a chance to run. After SPAWN_IMMEDIATE_COMPLETION_LIMIT
+ * (64 by default) immediate completions in a row, the next completion is
+ * posted and the coroutine suspends as usual.
+ *
+ * @param handler The completion handler, moved from the async_completion.
+ *
+ * @param args The arguments to invoke the handler with.
+ */
+template <typename Handler, typename ...Args>
+void complete_immediately(Handler&& handler, Args&&... args);
+
+} // namespace spawn
+
+#include <spawn/impl/immediate.hpp>
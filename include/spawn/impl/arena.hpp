@@ -0,0 +1,262 @@
+//
+// impl/arena.hpp
+// ~~~~~~~~~~~~~~
+//
+// Copyright (c) 2019 Casey Bodley (cbodley at redhat dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#pragma once
+
+#include <cstdint>
+#include <mutex>
+#include <new>
+#include <vector>
+
+#include <boost/asio/detail/recycling_allocator.hpp>
+
+namespace spawn {
+namespace detail {
+
+  struct arena_chunk
+  {
+    arena_chunk* next;
+    std::size_t size; // including this header
+  };
+
+  // Chunks of SPAWN_ARENA_CHUNK_SIZE bytes. Each thread keeps a few of them
+  // to itself before falling back to a shared list.
+  class arena_pool
+  {
+  public:
+    static constexpr std::size_t chunk_size = SPAWN_ARENA_CHUNK_SIZE;
+    static constexpr std::size_t max_cached = 16;
+    static constexpr std::size_t max_shared = 1024;
+
+    static arena_chunk* acquire()
+    {
+      thread_cache& cache = local();
+      if (!cache.chunks.empty())
+      {
+        arena_chunk* c = cache.chunks.back();
+        cache.chunks.pop_back();
+        return c;
+      }
+      {
+        shared_list& shared = global();
+        std::lock_guard<std::mutex> lock(shared.mutex);
+        if (!shared.chunks.empty())
+        {
+          arena_chunk* c = shared.chunks.back();
+          shared.chunks.pop_back();
+          return c;
+        }
+      }
+      auto c = static_cast<arena_chunk*>(::operator new(chunk_size));
+      c->size = chunk_size;
+      return c;
+    }
+
+    static void release(arena_chunk* c)
+    {
+      thread_cache& cache = local();
+      if (cache.chunks.size() < max_cached)
+      {
+        cache.chunks.push_back(c);
+        return;
+      }
+      give(c);
+    }
+
+  private:
+    static void give(arena_chunk* c)
+    {
+      {
+        shared_list& shared = global();
+        std::lock_guard<std::mutex> lock(shared.mutex);
+        if (shared.chunks.size() < max_shared)
+        {
+          shared.chunks.push_back(c);
+          return;
+        }
+      }
+      ::operator delete(c);
+    }
+
+    struct shared_list
+    {
+      std::mutex mutex;
+      std::vector<arena_chunk*> chunks;
+
+      ~shared_list()
+      {
+        for (auto c : chunks)
+          ::operator delete(c);
+      }
+    };
+
+    struct thread_cache
+    {
+      std::vector<arena_chunk*> chunks;
+
+      thread_cache() { chunks.reserve(max_cached); }
+      ~thread_cache()
+      {
+        for (auto c : chunks)
+          give(c);
+      }
+    };
+
+    static shared_list& global()
+    {
+      static shared_list shared;
+      return shared;
+    }
+
+    static thread_cache& local()
+    {
+      static thread_local thread_cache cache;
+      return cache;
+    }
+  };
+
+  // Owns one reference to an arena.
+  class arena_ref
+  {
+  public:
+    arena_ref() : arena_(monotonic_arena::create()) {}
+    arena_ref(const arena_ref&) = delete;
+    arena_ref& operator=(const arena_ref&) = delete;
+    ~arena_ref() { arena_->release(); }
+
+    monotonic_arena* get() const { return arena_; }
+
+  private:
+    monotonic_arena* arena_;
+  };
+
+  template <typename Function>
+  struct arena_function
+  {
+    Function function_;
+
+    template <typename Handler>
+    void operator()(basic_yield_context<Handler> yield)
+    {
+      arena_ref arena;
+      yield.arena_ = arena.get();
+      function_(yield);
+    }
+  };
+
+  inline char* arena_align(char* p, std::size_t alignment)
+  {
+    auto n = reinterpret_cast<std::uintptr_t>(p);
+    n = (n + alignment - 1) & ~static_cast<std::uintptr_t>(alignment - 1);
+    return reinterpret_cast<char*>(n);
+  }
+
+} // namespace detail
+
+// The arena lives at the start of its first chunk.
+inline monotonic_arena::monotonic_arena(detail::arena_chunk* first)
+  : refs_(1),
+    chunks_(first),
+    ptr_(reinterpret_cast<char*>(this + 1)),
+    end_(reinterpret_cast<char*>(first) + first->size),
+    allocated_(0),
+    chunk_count_(1)
+{
+  first->next = nullptr;
+}
+
+inline monotonic_arena* monotonic_arena::create()
+{
+  detail::arena_chunk* first = detail::arena_pool::acquire();
+  void* p = detail::arena_align(reinterpret_cast<char*>(first + 1),
+                                alignof(monotonic_arena));
+  return new (p) monotonic_arena(first);
+}
+
+inline void* monotonic_arena::allocate_bytes(std::size_t bytes,
+                                             std::size_t alignment)
+{
+  char* p = detail::arena_align(ptr_, alignment);
+  if (p + bytes > end_ || p < ptr_)
+  {
+    const std::size_t header = sizeof(detail::arena_chunk);
+    const std::size_t needed = header + alignment + bytes;
+    detail::arena_chunk* c;
+    if (needed > detail::arena_pool::chunk_size)
+    {
+      // a block of its own, kept behind the current chunk so that the rest
+      // of the current chunk is still used
+      c = static_cast<detail::arena_chunk*>(::operator new(needed));
+      c->size = needed;
+      c->next = chunks_->next;
+      chunks_->next = c;
+      p = detail::arena_align(reinterpret_cast<char*>(c + 1), alignment);
+      allocated_ += bytes;
+      return p;
+    }
+    c = detail::arena_pool::acquire();
+    c->next = chunks_;
+    chunks_ = c;
+    ++chunk_count_;
+    end_ = reinterpret_cast<char*>(c) + c->size;
+    p = detail::arena_align(reinterpret_cast<char*>(c + 1), alignment);
+  }
+  ptr_ = p + bytes;
+  allocated_ += bytes;
+  return p;
+}
+
+inline void monotonic_arena::release() noexcept
+{
+  if (refs_.fetch_sub(1, std::memory_order_acq_rel) != 1)
+    return;
+
+  detail::arena_chunk* c = chunks_;
+  this->~monotonic_arena();
+  while (c)
+  {
+    detail::arena_chunk* next = c->next;
+    if (c->size == detail::arena_pool::chunk_size)
+      detail::arena_pool::release(c);
+    else
+      ::operator delete(c);
+    c = next;
+  }
+}
+
+template <typename T>
+T* arena_allocator<T>::allocate(std::size_t n)
+{
+  if (arena_)
+    return static_cast<T*>(arena_->allocate_bytes(n * sizeof(T), alignof(T)));
+  if (slot_)
+    return static_cast<T*>(slot_->allocate(n * sizeof(T)));
+  return boost::asio::detail::recycling_allocator<T>().allocate(n);
+}
+
+template <typename T>
+void arena_allocator<T>::deallocate(T* p, std::size_t n)
+{
+  if (arena_)
+    return;
+  if (slot_)
+    slot_->deallocate(p, n * sizeof(T));
+  else
+    boost::asio::detail::recycling_allocator<T>().deallocate(p, n);
+}
+
+template <typename Function>
+auto with_arena(Function&& function)
+  -> detail::arena_function<typename std::decay<Function>::type>
+{
+  return {std::forward<Function>(function)};
+}
+
+} // namespace spawn
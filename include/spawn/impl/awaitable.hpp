@@ -0,0 +1,249 @@
+//
+// impl/awaitable.hpp
+// ~~~~~~~~~~~~~~~~~~
+//
+// Copyright (c) 2019 Casey Bodley (cbodley at redhat dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#pragma once
+
+#include <tuple>
+#include <utility>
+
+#include <boost/asio/dispatch.hpp>
+#include <boost/asio/strand.hpp>
+#include <boost/version.hpp>
+
+#if BOOST_VERSION >= 107400 && BOOST_VERSION < 107700
+#define SPAWN_AWAIT_INLINE_LAUNCH
+#else
+#include <boost/asio/co_spawn.hpp>
+#include <boost/asio/detached.hpp>
+#endif
+
+namespace spawn {
+namespace detail {
+
+  template <typename T>
+  struct async_spawn_completion
+  {
+    using type = void(std::exception_ptr, T);
+  };
+
+  template <>
+  struct async_spawn_completion<void>
+  {
+    using type = void(std::exception_ptr);
+  };
+
+  template <typename Executor, typename Function>
+  struct async_spawn_signature
+  {
+    using handler_type = net::executor_binder<void(*)(), net::strand<Executor>>;
+    using result_type = decltype(std::declval<typename std::decay<Function>::type&>()(
+          std::declval<basic_yield_context<handler_type>>()));
+    using type = typename async_spawn_completion<result_type>::type;
+  };
+
+  // The entry point of the awaitable's thread of execution. Like the one
+  // co_spawn() uses, but without the initial post(). Exceptions from the
+  // completion are not the awaitable's, so they propagate from the executor.
+  template <typename T, typename Executor, typename Handler>
+  boost::asio::awaitable<void, Executor> await_entry(
+      boost::asio::awaitable<T, Executor> a, Handler handler)
+  {
+    auto ex = net::get_associated_executor(handler);
+    bool done = false;
+    try
+    {
+      T result = co_await std::move(a);
+      done = true;
+      boost::asio::dispatch(ex,
+          [handler = std::move(handler), result = std::move(result)] () mutable {
+            handler(std::exception_ptr(), std::move(result));
+          });
+    }
+    catch (...)
+    {
+      if (done)
+        throw;
+      boost::asio::dispatch(ex,
+          [handler = std::move(handler), e = std::current_exception()] () mutable {
+            handler(e, T());
+          });
+    }
+  }
+
+  template <typename Executor, typename Handler>
+  boost::asio::awaitable<void, Executor> await_entry(
+      boost::asio::awaitable<void, Executor> a, Handler handler)
+  {
+    auto ex = net::get_associated_executor(handler);
+    std::exception_ptr e;
+    try
+    {
+      co_await std::move(a);
+    }
+    catch (...)
+    {
+      e = std::current_exception();
+    }
+    boost::asio::dispatch(ex,
+        [handler = std::move(handler), e] () mutable { handler(e); });
+  }
+
+  // Start the awaitable's thread of execution on the calling thread, without
+  // the initial post() that co_spawn() makes. That takes Asio's internal
+  // awaitable_thread, whose constructor changed in Boost 1.77, so only the
+  // versions known to match use it. Others start it through co_spawn().
+  template <typename Executor>
+  void launch_awaitable(boost::asio::awaitable<void, Executor> a,
+                        const Executor& ex)
+  {
+#if defined(SPAWN_AWAIT_INLINE_LAUNCH)
+    boost::asio::detail::awaitable_thread<Executor>(std::move(a), ex).launch();
+#else
+    boost::asio::co_spawn(ex, std::move(a), boost::asio::detached);
+#endif
+  }
+
+  // Runs the function and completes the operation with its result, from the
+  // coroutine's stack.
+  template <typename Function, typename Handler>
+  struct async_spawn_function
+  {
+    Function function_;
+    Handler handler_;
+
+    template <typename H>
+    void operator()(basic_yield_context<H> yield)
+    {
+      using result_type = decltype(function_(yield));
+      invoke(yield, std::is_void<result_type>());
+    }
+
+    template <typename H>
+    void invoke(basic_yield_context<H>& yield, std::false_type)
+    {
+      auto ex = net::get_associated_executor(handler_,
+          net::get_associated_executor(yield.handler_));
+      bool done = false;
+      try
+      {
+        auto result = function_(yield);
+        done = true;
+        boost::asio::dispatch(ex,
+            [handler = std::move(handler_), result = std::move(result)] () mutable {
+              handler(std::exception_ptr(), std::move(result));
+            });
+      }
+      catch (const boost::context::detail::forced_unwind&)
+      {
+        throw; // must allow forced_unwind to propagate
+      }
+      catch (...)
+      {
+        if (done)
+          throw;
+        using result_type = decltype(function_(yield));
+        boost::asio::dispatch(ex,
+            [handler = std::move(handler_), e = std::current_exception()] () mutable {
+              handler(e, result_type());
+            });
+      }
+    }
+
+    template <typename H>
+    void invoke(basic_yield_context<H>& yield, std::true_type)
+    {
+      auto ex = net::get_associated_executor(handler_,
+          net::get_associated_executor(yield.handler_));
+      std::exception_ptr e;
+      try
+      {
+        function_(yield);
+      }
+      catch (const boost::context::detail::forced_unwind&)
+      {
+        throw; // must allow forced_unwind to propagate
+      }
+      catch (...)
+      {
+        e = std::current_exception();
+      }
+      boost::asio::dispatch(ex,
+          [handler = std::move(handler_), e] () mutable { handler(e); });
+    }
+  };
+
+  template <typename Executor, typename StackAllocator>
+  struct initiate_async_spawn
+  {
+    Executor ex_;
+    StackAllocator salloc_;
+
+    template <typename Handler, typename Function>
+    void operator()(Handler&& handler, Function&& function)
+    {
+      using function_type = async_spawn_function<
+          typename std::decay<Function>::type,
+          typename std::decay<Handler>::type>;
+      spawn::spawn(net::make_strand(ex_),
+          function_type{std::forward<Function>(function),
+                        std::forward<Handler>(handler)},
+          std::move(salloc_));
+    }
+  };
+
+} // namespace detail
+
+template <typename T, typename Executor, typename Handler>
+T await(boost::asio::awaitable<T, Executor> a,
+        basic_yield_context<Handler> yield)
+{
+  boost::asio::async_completion<basic_yield_context<Handler>,
+      void(std::exception_ptr, T)> init(yield);
+  Executor ex(detail::net::get_associated_executor(init.completion_handler));
+  detail::launch_awaitable(
+      detail::await_entry(std::move(a), std::move(init.completion_handler)),
+      ex);
+  auto result = init.result.get();
+  if (std::get<0>(result))
+    std::rethrow_exception(std::get<0>(result));
+  return std::move(std::get<1>(result));
+}
+
+template <typename Executor, typename Handler>
+void await(boost::asio::awaitable<void, Executor> a,
+           basic_yield_context<Handler> yield)
+{
+  boost::asio::async_completion<basic_yield_context<Handler>,
+      void(std::exception_ptr)> init(yield);
+  Executor ex(detail::net::get_associated_executor(init.completion_handler));
+  detail::launch_awaitable(
+      detail::await_entry(std::move(a), std::move(init.completion_handler)),
+      ex);
+  std::exception_ptr e = init.result.get();
+  if (e)
+    std::rethrow_exception(e);
+}
+
+template <typename Executor, typename Function, typename CompletionToken,
+          typename StackAllocator>
+auto async_spawn(const Executor& ex, Function&& function,
+                 CompletionToken&& token, StackAllocator&& salloc)
+  -> typename std::enable_if<detail::net::is_executor<Executor>::value,
+       detail::async_spawn_result<Executor, Function, CompletionToken>>::type
+{
+  using signature = typename detail::async_spawn_signature<Executor, Function>::type;
+  using salloc_type = typename std::decay<StackAllocator>::type;
+  return boost::asio::async_initiate<CompletionToken, signature>(
+      detail::initiate_async_spawn<Executor, salloc_type>{
+        ex, std::forward<StackAllocator>(salloc)},
+      token, std::forward<Function>(function));
+}
+
+} // namespace spawn
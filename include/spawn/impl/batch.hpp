@@ -0,0 +1,295 @@
+//
+// impl/batch.hpp
+// ~~~~~~~~~~~~~~
+//
+// Copyright (c) 2019 Casey Bodley (cbodley at redhat dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#pragma once
+
+#include <atomic>
+#include <iterator>
+#include <memory>
+#include <new>
+
+#include <boost/asio/bind_executor.hpp>
+#include <boost/asio/dispatch.hpp>
+#include <boost/asio/post.hpp>
+#include <boost/asio/strand.hpp>
+
+namespace spawn {
+namespace detail {
+
+  // Stands in for the join handler when the caller didn't pass one.
+  struct no_join
+  {
+    void operator()() {}
+  };
+
+  template <typename Executor, typename Function, typename StackAllocator,
+            typename JoinHandler>
+  class spawn_batch;
+
+  // Wraps each coroutine function so that the batch can count its exit,
+  // whether it returns or throws. A coroutine whose stack is unwound because
+  // its execution context was destroyed is not counted.
+  template <typename Batch, typename Function>
+  struct batch_function
+  {
+    Batch* batch_;
+    Function function_;
+
+    template <typename Handler>
+    void operator()(basic_yield_context<Handler> yield)
+    {
+      try
+      {
+        function_(yield);
+      }
+      catch (const boost::context::detail::forced_unwind&)
+      {
+        throw;
+      }
+      catch (...)
+      {
+        batch_->finished();
+        throw;
+      }
+      batch_->finished();
+    }
+  };
+
+  // Like spawn(), give each coroutine a strand of its own, unless the batch
+  // was started on a strand that they share.
+  template <typename Executor>
+  struct batch_strand
+  {
+    using type = net::strand<Executor>;
+    static type make(const Executor& ex) { return net::make_strand(ex); }
+  };
+
+  template <typename Executor>
+  struct batch_strand<net::strand<Executor>>
+  {
+    using type = net::strand<Executor>;
+    static type make(const type& ex) { return ex; }
+  };
+
+  // The bookkeeping for a whole batch: the shared state and one spawn_data
+  // per coroutine, in a single array. Each coroutine holds an aliasing
+  // shared_ptr to its entry, so the batch is freed after the last one exits.
+  template <typename Executor, typename Function, typename StackAllocator,
+            typename JoinHandler>
+  class spawn_batch : public std::enable_shared_from_this<
+      spawn_batch<Executor, Function, StackAllocator, JoinHandler>>
+  {
+  public:
+    using strand_type = typename batch_strand<Executor>::type;
+    using handler_type = net::executor_binder<void(*)(), strand_type>;
+    using function_type = batch_function<spawn_batch, Function>;
+    using data_type = spawn_data<handler_type, function_type, StackAllocator>;
+
+    template <typename Join>
+    spawn_batch(const Executor& ex, std::size_t n, Join&& join)
+      : ex_(ex),
+        size_(n),
+        remaining_(n),
+        entries_(static_cast<data_type*>(
+            ::operator new(n * sizeof(data_type)))),
+        join_(std::forward<Join>(join))
+    {
+    }
+    spawn_batch(const spawn_batch&) = delete;
+    spawn_batch& operator=(const spawn_batch&) = delete;
+
+    ~spawn_batch()
+    {
+      for (std::size_t i = 0; i < constructed_; ++i)
+        entries_[i].~data_type();
+      ::operator delete(entries_);
+    }
+
+    template <typename Func>
+    void emplace(Func&& function, const StackAllocator& salloc)
+    {
+      new (&entries_[constructed_]) data_type(
+          boost::asio::bind_executor(batch_strand<Executor>::make(ex_),
+                                     &default_spawn_handler), false,
+          function_type{this, std::forward<Func>(function)}, salloc);
+      ++constructed_;
+    }
+
+    // Post the operation that enters each coroutine, or the join handler if
+    // the batch is empty.
+    void start()
+    {
+      if (size_ == 0)
+        join();
+      else
+        boost::asio::post(ex_, launch_op{this->shared_from_this(), 0});
+    }
+
+    void finished()
+    {
+      if (remaining_.fetch_sub(1, std::memory_order_acq_rel) == 1)
+        join();
+    }
+
+  private:
+    // Enters the coroutines in order on the batch's executor, each through
+    // its strand. A strand that nothing else uses yet is entered inline. If
+    // one throws, the rest are posted again before the exception
+    // propagates.
+    struct launch_op
+    {
+      std::shared_ptr<spawn_batch> batch;
+      std::size_t next;
+
+      void operator()()
+      {
+        const std::size_t last = batch->size_ - 1;
+        for (; next < last; ++next)
+        {
+          spawn_helper<handler_type, function_type, StackAllocator> helper;
+          helper.data_ = std::shared_ptr<data_type>(batch, &batch->entries_[next]);
+          try
+          {
+            boost::asio::dispatch(std::move(helper));
+          }
+          catch (...)
+          {
+            ++next;
+            auto ex = batch->ex_;
+            boost::asio::post(ex, std::move(*this));
+            throw;
+          }
+        }
+        // the last coroutine takes over this reference to the batch
+        spawn_helper<handler_type, function_type, StackAllocator> helper;
+        helper.data_ = std::shared_ptr<data_type>(batch, &batch->entries_[last]);
+        batch.reset();
+        boost::asio::dispatch(std::move(helper));
+      }
+    };
+
+    void join()
+    {
+      join_dispatch(std::is_same<JoinHandler, no_join>());
+    }
+
+    void join_dispatch(std::true_type)
+    {
+    }
+
+    void join_dispatch(std::false_type)
+    {
+      auto ex = net::get_associated_executor(join_, ex_);
+      boost::asio::post(ex, std::move(join_));
+    }
+
+    const Executor ex_;
+    const std::size_t size_;
+    std::atomic<std::size_t> remaining_;
+    std::size_t constructed_ = 0;
+    data_type* entries_;
+    JoinHandler join_;
+  };
+
+  template <typename Range, typename Element>
+  auto forward_element(Element& element)
+    -> typename std::conditional<std::is_lvalue_reference<Range>::value,
+         Element&, Element&&>::type
+  {
+    return static_cast<typename std::conditional<
+        std::is_lvalue_reference<Range>::value,
+        Element&, Element&&>::type>(element);
+  }
+
+  template <typename Executor, typename Range, typename JoinHandler,
+            typename StackAllocator>
+  void spawn_many(const Executor& ex, Range&& functions, JoinHandler&& join,
+                  StackAllocator&& salloc)
+  {
+    using std::begin;
+    using std::end;
+    using function_type = typename std::decay<decltype(*begin(functions))>::type;
+    using batch_type = spawn_batch<Executor, function_type,
+          typename std::decay<StackAllocator>::type,
+          typename std::decay<JoinHandler>::type>;
+
+    const std::size_t n = std::distance(begin(functions), end(functions));
+    auto batch = std::make_shared<batch_type>(ex, n,
+                                              std::forward<JoinHandler>(join));
+    for (auto& function : functions)
+      batch->emplace(forward_element<Range>(function), salloc);
+    batch->start();
+  }
+
+  template <typename Executor, typename Function, typename JoinHandler,
+            typename StackAllocator>
+  void spawn_n(const Executor& ex, std::size_t n, Function&& function,
+               JoinHandler&& join, StackAllocator&& salloc)
+  {
+    using batch_type = spawn_batch<Executor,
+          typename std::decay<Function>::type,
+          typename std::decay<StackAllocator>::type,
+          typename std::decay<JoinHandler>::type>;
+
+    auto batch = std::make_shared<batch_type>(ex, n,
+                                              std::forward<JoinHandler>(join));
+    for (std::size_t i = 0; i < n; ++i)
+      batch->emplace(function, salloc);
+    batch->start();
+  }
+
+} // namespace detail
+
+template <typename Executor, typename Range, typename StackAllocator>
+auto spawn_many(const Executor& ex, Range&& functions, StackAllocator&& salloc)
+  -> typename std::enable_if<detail::net::is_executor<Executor>::value &&
+       detail::is_stack_allocator<typename std::decay<StackAllocator>::type>::value>::type
+{
+  detail::spawn_many(ex, std::forward<Range>(functions), detail::no_join{},
+                     std::forward<StackAllocator>(salloc));
+}
+
+template <typename Executor, typename Range, typename JoinHandler,
+          typename StackAllocator>
+auto spawn_many(const Executor& ex, Range&& functions, JoinHandler&& join,
+                StackAllocator&& salloc)
+  -> typename std::enable_if<detail::net::is_executor<Executor>::value &&
+       !detail::is_stack_allocator<typename std::decay<JoinHandler>::type>::value &&
+       detail::is_stack_allocator<typename std::decay<StackAllocator>::type>::value>::type
+{
+  detail::spawn_many(ex, std::forward<Range>(functions),
+                     std::forward<JoinHandler>(join),
+                     std::forward<StackAllocator>(salloc));
+}
+
+template <typename Executor, typename Function, typename StackAllocator>
+auto spawn_n(const Executor& ex, std::size_t n, Function&& function,
+             StackAllocator&& salloc)
+  -> typename std::enable_if<detail::net::is_executor<Executor>::value &&
+       detail::is_stack_allocator<typename std::decay<StackAllocator>::type>::value>::type
+{
+  detail::spawn_n(ex, n, std::forward<Function>(function), detail::no_join{},
+                  std::forward<StackAllocator>(salloc));
+}
+
+template <typename Executor, typename Function, typename JoinHandler,
+          typename StackAllocator>
+auto spawn_n(const Executor& ex, std::size_t n, Function&& function,
+             JoinHandler&& join, StackAllocator&& salloc)
+  -> typename std::enable_if<detail::net::is_executor<Executor>::value &&
+       !detail::is_stack_allocator<typename std::decay<JoinHandler>::type>::value &&
+       detail::is_stack_allocator<typename std::decay<StackAllocator>::type>::value>::type
+{
+  detail::spawn_n(ex, n, std::forward<Function>(function),
+                  std::forward<JoinHandler>(join),
+                  std::forward<StackAllocator>(salloc));
+}
+
+} // namespace spawn
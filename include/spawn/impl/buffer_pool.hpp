@@ -0,0 +1,197 @@
+//
+// impl/buffer_pool.hpp
+// ~~~~~~~~~~~~~~~~~~~~
+//
+// Copyright (c) 2019 Casey Bodley (cbodley at redhat dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#pragma once
+
+#include <algorithm>
+#include <cerrno>
+#include <new>
+
+#include <boost/asio/error.hpp>
+#include <boost/system/system_error.hpp>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/socket.h>
+#endif
+
+namespace spawn {
+namespace detail {
+
+  inline std::size_t round_up_pow2(std::size_t n) noexcept
+  {
+    std::size_t p = 1;
+    while (p < n)
+      p <<= 1;
+    return p;
+  }
+
+  // Read without blocking, whether or not the socket is in non-blocking mode.
+  template <typename Protocol, typename Executor>
+  std::size_t read_some_nonblocking(
+      boost::asio::basic_stream_socket<Protocol, Executor>& socket,
+      const boost::asio::mutable_buffer& buffer,
+      boost::system::error_code& ec)
+  {
+#if defined(MSG_DONTWAIT)
+    if (!socket.non_blocking())
+    {
+      // asio's synchronous reads poll until the socket is readable, so go
+      // around them rather than toggling the socket's mode for each read
+      const auto n = ::recv(socket.native_handle(), buffer.data(),
+                            buffer.size(), MSG_DONTWAIT);
+      if (n > 0)
+      {
+        ec.clear();
+        return static_cast<std::size_t>(n);
+      }
+      if (n == 0)
+        ec = boost::asio::error::eof;
+      else
+        ec.assign(errno, boost::system::system_category());
+      return 0;
+    }
+#else
+    if (!socket.non_blocking())
+    {
+      socket.non_blocking(true, ec);
+      if (ec)
+        return 0;
+      const std::size_t n = socket.read_some(buffer, ec);
+      boost::system::error_code ignored;
+      socket.non_blocking(false, ignored);
+      return n;
+    }
+#endif
+    return socket.read_some(buffer, ec);
+  }
+
+} // namespace detail
+
+inline void pooled_buffer::reset() noexcept
+{
+  if (pool_)
+  {
+    pool_->release(data_, capacity_);
+    pool_ = nullptr;
+    data_ = nullptr;
+    size_ = capacity_ = 0;
+  }
+}
+
+inline buffer_pool::buffer_pool(std::size_t min_size, std::size_t max_size,
+                                std::size_t max_cached)
+  : min_size_(detail::round_up_pow2(min_size ? min_size : 1)),
+    max_cached_(max_cached)
+{
+  max_size = std::max(detail::round_up_pow2(max_size), min_size_);
+  for (std::size_t size = min_size_; size <= max_size; size <<= 1)
+    classes_.emplace_back(new size_class);
+}
+
+inline buffer_pool::~buffer_pool()
+{
+  for (auto& c : classes_)
+    for (char* data : c->free)
+      ::operator delete(data);
+}
+
+inline std::size_t buffer_pool::class_index(std::size_t size) const noexcept
+{
+  std::size_t index = 0;
+  std::size_t s = min_size_;
+  while (s < size && index + 1 < classes_.size())
+  {
+    s <<= 1;
+    ++index;
+  }
+  return index;
+}
+
+inline pooled_buffer buffer_pool::allocate(std::size_t size)
+{
+  const std::size_t index = class_index(size);
+  const std::size_t capacity = min_size_ << index;
+  char* data = nullptr;
+  {
+    size_class& c = *classes_[index];
+    std::lock_guard<std::mutex> lock(c.mutex);
+    if (!c.free.empty())
+    {
+      data = c.free.back();
+      c.free.pop_back();
+      cached_.fetch_sub(capacity, std::memory_order_relaxed);
+    }
+  }
+  if (!data)
+    data = static_cast<char*>(::operator new(capacity));
+  in_use_.fetch_add(capacity, std::memory_order_relaxed);
+  return pooled_buffer(this, data, capacity);
+}
+
+inline void buffer_pool::release(char* data, std::size_t capacity) noexcept
+{
+  in_use_.fetch_sub(capacity, std::memory_order_relaxed);
+  {
+    size_class& c = *classes_[class_index(capacity)];
+    std::lock_guard<std::mutex> lock(c.mutex);
+    if ((c.free.size() + 1) * capacity <= max_cached_)
+    {
+      try
+      {
+        c.free.push_back(data);
+        cached_.fetch_add(capacity, std::memory_order_relaxed);
+        return;
+      }
+      catch (const std::bad_alloc&)
+      {
+      }
+    }
+  }
+  ::operator delete(data);
+}
+
+template <typename Protocol, typename Executor, typename Handler>
+pooled_buffer read_some_pooled(
+    boost::asio::basic_stream_socket<Protocol, Executor>& socket,
+    buffer_pool& pool, basic_yield_context<Handler> yield)
+{
+  using socket_type = boost::asio::basic_stream_socket<Protocol, Executor>;
+  boost::system::error_code ec;
+  for (;;)
+  {
+    socket.async_wait(socket_type::wait_read, yield[ec]);
+    if (ec)
+      break;
+    // with nothing available, a small buffer is enough to read the eof or
+    // error that made the socket readable
+    const std::size_t available = socket.available(ec);
+    if (ec)
+      break;
+    pooled_buffer buffer = pool.allocate(available);
+    const std::size_t n = detail::read_some_nonblocking(socket,
+                                                        buffer.prepare(), ec);
+    if (ec == boost::asio::error::would_block ||
+        ec == boost::asio::error::try_again ||
+        ec == boost::asio::error::interrupted)
+      continue; // spurious wakeup, so give the buffer back and wait again
+    if (ec)
+      break;
+    buffer.resize(n);
+    if (yield.ec_)
+      yield.ec_->clear();
+    return buffer;
+  }
+  if (!yield.ec_)
+    throw boost::system::system_error(ec);
+  *yield.ec_ = ec;
+  return pooled_buffer();
+}
+
+} // namespace spawn
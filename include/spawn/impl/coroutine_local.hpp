@@ -0,0 +1,67 @@
+//
+// impl/coroutine_local.hpp
+// ~~~~~~~~~~~~~~~~~~~~~~~~
+//
+// Copyright (c) 2019 Casey Bodley (cbodley at redhat dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#pragma once
+
+#include <memory>
+#include <stdexcept>
+
+namespace spawn {
+namespace detail {
+
+  template <typename T>
+  void destroy_coroutine_local(void* p)
+  {
+    delete static_cast<T*>(p);
+  }
+
+} // namespace detail
+
+template <typename T>
+coroutine_local<T>::coroutine_local()
+  : key_(detail::coroutine_local_indices::instance().acquire())
+{
+}
+
+template <typename T>
+coroutine_local<T>::~coroutine_local()
+{
+  detail::coroutine_local_indices::instance().release(key_.index);
+}
+
+template <typename T>
+T& coroutine_local<T>::get()
+{
+  detail::continuation_context* c = detail::current_continuation();
+  if (!c)
+    throw std::logic_error("coroutine_local used outside of a coroutine");
+  if (void* p = c->locals_.get(key_))
+    return *static_cast<T*>(p);
+
+  std::unique_ptr<T> value(new T());
+  c->locals_.set(key_, value.get(), &detail::destroy_coroutine_local<T>);
+  return *value.release();
+}
+
+template <typename T>
+T* coroutine_local<T>::get_if() const noexcept
+{
+  detail::continuation_context* c = detail::current_continuation();
+  return c ? static_cast<T*>(c->locals_.get(key_)) : nullptr;
+}
+
+template <typename T>
+void coroutine_local<T>::reset() noexcept
+{
+  if (detail::continuation_context* c = detail::current_continuation())
+    c->locals_.reset(key_);
+}
+
+} // namespace spawn
@@ -0,0 +1,241 @@
+//
+// impl/coroutine_pool.hpp
+// ~~~~~~~~~~~~~~~~~~~~~~~
+//
+// Copyright (c) 2019 Casey Bodley (cbodley at redhat dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#pragma once
+
+#include <deque>
+#include <mutex>
+#include <vector>
+
+#include <boost/asio/dispatch.hpp>
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/strand.hpp>
+
+namespace spawn {
+namespace detail {
+
+  class pool_state : public std::enable_shared_from_this<pool_state>
+  {
+  public:
+    using executor_type = coroutine_pool::executor_type;
+    using task_type = coroutine_pool::task_type;
+    using handler_type = net::executor_binder<void(*)(), executor_type>;
+    using waiter_type = coro_handler<handler_type, task_type>;
+
+    template <typename StackAllocator>
+    pool_state(const executor_type& ex, std::size_t max_idle,
+               std::size_t max_size, StackAllocator salloc)
+      : ex_(ex),
+        max_idle_(max_idle),
+        max_size_(max_size),
+        spawn_worker_(
+          [salloc] (std::shared_ptr<pool_state> state, task_type task)
+          {
+            executor_type ex = state->make_strand();
+            spawn::spawn(bind_executor(ex, &default_spawn_handler),
+                         worker{std::move(state), std::move(task)},
+                         StackAllocator(salloc));
+          })
+    {
+    }
+
+    void submit(task_type task)
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      if (!idle_.empty())
+      {
+        waiter_type waiter = std::move(idle_.back());
+        idle_.pop_back();
+        lock.unlock();
+        wake(std::move(waiter), std::move(task));
+      }
+      else if (live_ < max_size_)
+      {
+        ++live_;
+        lock.unlock();
+        spawn_worker_(shared_from_this(), std::move(task));
+      }
+      else
+      {
+        queue_.push_back(std::move(task));
+      }
+    }
+
+    // Wake all idle coroutines with an empty task so that they return.
+    void stop()
+    {
+      std::vector<waiter_type> idle;
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopped_ = true;
+        queue_.clear();
+        idle.swap(idle_);
+      }
+      for (auto& waiter : idle)
+        wake(std::move(waiter), task_type());
+    }
+
+    std::size_t size() const
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      return live_;
+    }
+
+    std::size_t idle() const
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      return idle_.size();
+    }
+
+    std::size_t queued() const
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      return queue_.size();
+    }
+
+    const executor_type& get_executor() const
+    {
+      return ex_;
+    }
+
+  private:
+    // Each coroutine gets a strand of its own, as with spawn(). Wrap the
+    // common io_context executor directly, rather than through another
+    // layer of type erasure.
+    executor_type make_strand() const
+    {
+      using io_executor = boost::asio::io_context::executor_type;
+      if (auto ioc_ex = ex_.target<io_executor>())
+        return net::make_strand(*ioc_ex);
+      return net::make_strand(ex_);
+    }
+
+    struct resume_waiter
+    {
+      waiter_type waiter;
+      task_type task;
+      void operator()() { waiter(std::move(task)); }
+    };
+
+    void wake(waiter_type&& waiter, task_type&& task)
+    {
+      // dispatch() through the coroutine's strand resumes it inline when
+      // called from a thread that is running the pool's executor, unless
+      // the strand is busy
+      auto ex = net::get_associated_executor(waiter);
+      using io_strand = net::strand<boost::asio::io_context::executor_type>;
+      if (auto strand = ex.target<io_strand>())
+      {
+        boost::asio::dispatch(bind_executor(*strand,
+              resume_waiter{std::move(waiter), std::move(task)}));
+        return;
+      }
+      boost::asio::dispatch(bind_executor(ex,
+            resume_waiter{std::move(waiter), std::move(task)}));
+    }
+
+    // Return the next task for a coroutine that finished its last one. An
+    // empty task tells the coroutine to return.
+    task_type next(yield_context yield)
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      if (!queue_.empty())
+      {
+        task_type task = std::move(queue_.front());
+        queue_.pop_front();
+        return task;
+      }
+      if (stopped_ || idle_.size() >= max_idle_)
+        return task_type();
+
+      // park until submit() hands us a task
+      boost::asio::async_completion<yield_context, void(task_type)> init(yield);
+      idle_.push_back(std::move(init.completion_handler));
+      lock.unlock();
+      return init.result.get();
+    }
+
+    struct worker
+    {
+      std::shared_ptr<pool_state> state;
+      task_type task;
+
+      void operator()(yield_context yield)
+      {
+        struct live_guard
+        {
+          pool_state& state;
+          ~live_guard()
+          {
+            std::lock_guard<std::mutex> lock(state.mutex_);
+            --state.live_;
+          }
+        } guard{*state};
+
+        while (task)
+        {
+          task(yield);
+          task = state->next(yield);
+        }
+      }
+    };
+
+    mutable std::mutex mutex_;
+    std::deque<task_type> queue_;
+    std::vector<waiter_type> idle_;
+    std::size_t live_ = 0;
+    bool stopped_ = false;
+    const executor_type ex_;
+    const std::size_t max_idle_;
+    const std::size_t max_size_;
+    const std::function<void(std::shared_ptr<pool_state>, task_type)> spawn_worker_;
+  };
+
+} // namespace detail
+
+template <typename StackAllocator, typename>
+coroutine_pool::coroutine_pool(const executor_type& ex, std::size_t max_idle,
+                               std::size_t max_size, StackAllocator&& salloc)
+  : state_(std::make_shared<detail::pool_state>(ex, max_idle, max_size,
+        std::forward<StackAllocator>(salloc)))
+{
+}
+
+inline coroutine_pool::~coroutine_pool()
+{
+  state_->stop();
+}
+
+inline void coroutine_pool::submit(task_type task)
+{
+  state_->submit(std::move(task));
+}
+
+inline std::size_t coroutine_pool::size() const
+{
+  return state_->size();
+}
+
+inline std::size_t coroutine_pool::idle() const
+{
+  return state_->idle();
+}
+
+inline std::size_t coroutine_pool::queued() const
+{
+  return state_->queued();
+}
+
+inline coroutine_pool::executor_type coroutine_pool::get_executor() const
+{
+  return state_->get_executor();
+}
+
+} // namespace spawn
@@ -0,0 +1,677 @@
+//
+// impl/file_ring.hpp
+// ~~~~~~~~~~~~~~~~~~
+//
+// Copyright (c) 2019 Casey Bodley (cbodley at redhat dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <system_error>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <boost/asio/associated_executor.hpp>
+#include <boost/asio/dispatch.hpp>
+#include <boost/asio/error.hpp>
+#include <boost/asio/posix/stream_descriptor.hpp>
+#include <boost/asio/post.hpp>
+
+namespace spawn {
+namespace detail {
+
+  struct file_ring_op
+  {
+    io_uring_sqe sqe;
+
+    file_ring_op() { std::memset(&sqe, 0, sizeof(sqe)); }
+    virtual ~file_ring_op() {}
+
+    // called with the cqe's result, and deletes the op
+    virtual void complete(int result) = 0;
+  };
+
+  template <typename Handler>
+  struct file_ring_binder1
+  {
+    Handler handler_;
+    boost::system::error_code ec_;
+
+    void operator()() { handler_(ec_); }
+  };
+
+  template <typename Handler>
+  struct file_ring_binder2
+  {
+    Handler handler_;
+    boost::system::error_code ec_;
+    std::size_t bytes_;
+
+    void operator()() { handler_(ec_, bytes_); }
+  };
+
+  template <typename Handler>
+  struct file_ring_rw_op : file_ring_op
+  {
+    Handler handler_;
+    boost::asio::io_context::executor_type ex_;
+
+    file_ring_rw_op(Handler&& handler,
+                    const boost::asio::io_context::executor_type& ex)
+      : handler_(std::move(handler)), ex_(ex)
+    {
+    }
+
+    void complete(int result) override
+    {
+      boost::system::error_code ec;
+      std::size_t bytes = 0;
+      if (result < 0)
+        ec.assign(-result, boost::system::system_category());
+      else if (result == 0 && sqe.len > 0 &&
+               (sqe.opcode == IORING_OP_READ ||
+                sqe.opcode == IORING_OP_READ_FIXED))
+        ec = boost::asio::error::eof;
+      else
+        bytes = static_cast<std::size_t>(result);
+
+      auto ex = boost::asio::get_associated_executor(handler_, ex_);
+      file_ring_binder2<Handler> b{std::move(handler_), ec, bytes};
+      delete this; // free the op before invoking the handler
+      boost::asio::dispatch(ex, std::move(b));
+    }
+  };
+
+  template <typename Handler>
+  struct file_ring_fsync_op : file_ring_op
+  {
+    Handler handler_;
+    boost::asio::io_context::executor_type ex_;
+
+    file_ring_fsync_op(Handler&& handler,
+                       const boost::asio::io_context::executor_type& ex)
+      : handler_(std::move(handler)), ex_(ex)
+    {
+    }
+
+    void complete(int result) override
+    {
+      boost::system::error_code ec;
+      if (result < 0)
+        ec.assign(-result, boost::system::system_category());
+
+      auto ex = boost::asio::get_associated_executor(handler_, ex_);
+      file_ring_binder1<Handler> b{std::move(handler_), ec};
+      delete this;
+      boost::asio::dispatch(ex, std::move(b));
+    }
+  };
+
+  inline void file_ring_throw(const char* what)
+  {
+    throw std::system_error(errno, std::system_category(), what);
+  }
+
+  // The ring and everything that completions need. Handlers that the ring
+  // posts to the io_context hold a reference, so that the state outlives a
+  // file_ring that is destroyed while they are queued.
+  class file_ring_state : public std::enable_shared_from_this<file_ring_state>
+  {
+  public:
+    file_ring_state(boost::asio::io_context& ioc, unsigned entries,
+                    std::size_t buffer_count, std::size_t buffer_size)
+      : ex_(ioc.get_executor()), event_(ioc), buffer_size_(buffer_size)
+    {
+      try
+      {
+        setup(entries);
+        if (buffer_count)
+          register_buffers(buffer_count);
+      }
+      catch (...)
+      {
+        close();
+        throw;
+      }
+    }
+
+    ~file_ring_state() { close(); }
+
+    boost::asio::io_context::executor_type get_executor() const noexcept
+    {
+      return ex_;
+    }
+
+    std::uint64_t submit_calls() const noexcept
+    {
+      return submit_calls_.load(std::memory_order_relaxed);
+    }
+
+    bool acquire(unsigned& index, void*& data)
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (free_.empty())
+        return false;
+      index = free_.back();
+      free_.pop_back();
+      data = static_cast<char*>(buffers_) + index * buffer_size_;
+      return true;
+    }
+
+    void release(unsigned index)
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      free_.push_back(index);
+    }
+
+    std::size_t buffer_size() const noexcept { return buffer_size_; }
+
+    void start(std::unique_ptr<file_ring_op> op)
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      op->sqe.user_data = reinterpret_cast<std::uintptr_t>(op.get());
+      if (queued_ + inflight_ >= cq_entries_)
+      {
+        // don't let completions overflow the cq
+        backlog_.push_back(op.get());
+        op.release();
+      }
+      else
+      {
+        std::vector<std::pair<file_ring_op*, int>> failed;
+        push(std::move(op), failed);
+        // ops that a full sq couldn't submit must not complete inside the
+        // initiating function
+        auto self = shared_from_this();
+        for (auto& f : failed)
+          boost::asio::post(ex_, [self, f] { f.first->complete(f.second); });
+      }
+
+      if (!flush_posted_)
+      {
+        // submit everything that starts before this runs with one syscall
+        flush_posted_ = true;
+        auto self = shared_from_this();
+        boost::asio::post(ex_, [self] { self->flush(); });
+      }
+    }
+
+    // wait for the operations in flight, and destroy their handlers
+    void shutdown()
+    {
+      std::vector<file_ring_op*> ops;
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        shutdown_ = true;
+        boost::system::error_code ec;
+        event_.cancel(ec);
+        ops.assign(backlog_.begin(), backlog_.end());
+        backlog_.clear();
+        // entries that fail to submit die with the ring, and so do their ops
+        std::vector<std::pair<file_ring_op*, int>> done;
+        submit(done);
+        while (inflight_ > 0)
+        {
+          const int ret = static_cast<int>(::syscall(__NR_io_uring_enter,
+                ring_fd_, 0, inflight_, IORING_ENTER_GETEVENTS, nullptr, 0));
+          if (ret < 0 && errno != EINTR)
+            break; // the kernel cancels what's left when the ring closes
+          reap(done);
+        }
+        for (auto& d : done)
+          ops.push_back(d.first);
+      }
+      for (auto op : ops)
+        delete op;
+    }
+
+  private:
+    void setup(unsigned entries)
+    {
+      io_uring_params params;
+      std::memset(&params, 0, sizeof(params));
+      ring_fd_ = static_cast<int>(::syscall(__NR_io_uring_setup, entries, &params));
+      if (ring_fd_ < 0)
+        file_ring_throw("io_uring_setup");
+
+      sq_ring_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+      cq_ring_size_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+      const bool single = params.features & IORING_FEAT_SINGLE_MMAP;
+      if (single)
+        sq_ring_size_ = cq_ring_size_ = std::max(sq_ring_size_, cq_ring_size_);
+
+      sq_ring_ = map(sq_ring_size_, IORING_OFF_SQ_RING);
+      if (single)
+        cq_ring_ = sq_ring_;
+      else
+        cq_ring_ = map(cq_ring_size_, IORING_OFF_CQ_RING);
+      sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+      sqes_ = static_cast<io_uring_sqe*>(map(sqes_size_, IORING_OFF_SQES));
+
+      char* sq = static_cast<char*>(sq_ring_);
+      sq_tail_ = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+      sq_mask_ = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+      sq_array_ = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+      sq_entries_ = params.sq_entries;
+      sq_tail_value_ = *sq_tail_;
+
+      char* cq = static_cast<char*>(cq_ring_);
+      cq_head_ = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+      cq_tail_ = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+      cq_mask_ = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+      cqes_ = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+      cq_entries_ = params.cq_entries;
+
+      int efd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+      if (efd < 0)
+        file_ring_throw("eventfd");
+      event_.assign(efd);
+      if (::syscall(__NR_io_uring_register, ring_fd_,
+                    IORING_REGISTER_EVENTFD, &efd, 1) < 0)
+        file_ring_throw("io_uring_register");
+    }
+
+    void* map(std::size_t size, off_t offset)
+    {
+      void* p = ::mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                       MAP_SHARED | MAP_POPULATE, ring_fd_, offset);
+      if (p == MAP_FAILED)
+        file_ring_throw("mmap");
+      return p;
+    }
+
+    void register_buffers(std::size_t count)
+    {
+      buffers_size_ = count * buffer_size_;
+      buffers_ = ::mmap(nullptr, buffers_size_, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+      if (buffers_ == MAP_FAILED)
+      {
+        buffers_ = nullptr;
+        file_ring_throw("mmap");
+      }
+      std::vector<iovec> iov(count);
+      for (std::size_t i = 0; i < count; i++)
+      {
+        iov[i].iov_base = static_cast<char*>(buffers_) + i * buffer_size_;
+        iov[i].iov_len = buffer_size_;
+      }
+      if (::syscall(__NR_io_uring_register, ring_fd_, IORING_REGISTER_BUFFERS,
+                    iov.data(), static_cast<unsigned>(count)) < 0)
+        file_ring_throw("io_uring_register");
+      free_.reserve(count);
+      for (std::size_t i = count; i > 0; i--)
+        free_.push_back(static_cast<unsigned>(i - 1));
+    }
+
+    void close() noexcept
+    {
+      boost::system::error_code ec;
+      event_.close(ec);
+      if (sqes_)
+        ::munmap(sqes_, sqes_size_);
+      if (cq_ring_ && cq_ring_ != sq_ring_)
+        ::munmap(cq_ring_, cq_ring_size_);
+      if (sq_ring_)
+        ::munmap(sq_ring_, sq_ring_size_);
+      if (ring_fd_ >= 0)
+        ::close(ring_fd_);
+      if (buffers_)
+        ::munmap(buffers_, buffers_size_);
+      sqes_ = nullptr;
+      sq_ring_ = cq_ring_ = buffers_ = nullptr;
+      ring_fd_ = -1;
+    }
+
+    // requires mutex_
+    void push(std::unique_ptr<file_ring_op> op,
+              std::vector<std::pair<file_ring_op*, int>>& failed)
+    {
+      if (queued_ == sq_entries_)
+        submit(failed);
+      const unsigned index = sq_tail_value_ & sq_mask_;
+      sqes_[index] = op->sqe;
+      sq_array_[index] = index;
+      __atomic_store_n(sq_tail_, ++sq_tail_value_, __ATOMIC_RELEASE);
+      ++queued_;
+      op.release(); // owned by the ring until its cqe is reaped
+    }
+
+    // requires mutex_. this runs from handlers, where an exception would
+    // escape io_context::run() and strand the queued ops, so entries that
+    // io_uring_enter() refuses are taken back and their ops added to failed
+    // with the error, for the caller to complete once it drops the mutex
+    void submit(std::vector<std::pair<file_ring_op*, int>>& failed)
+    {
+      while (queued_ > 0)
+      {
+        const int ret = static_cast<int>(::syscall(__NR_io_uring_enter,
+              ring_fd_, queued_, 0, 0, nullptr, 0));
+        if (ret < 0)
+        {
+          if (errno == EINTR)
+            continue;
+          unqueue(-errno, failed);
+          break;
+        }
+        submit_calls_.store(submit_calls_.load(std::memory_order_relaxed) + 1,
+                            std::memory_order_relaxed);
+        queued_ -= ret;
+        inflight_ += ret;
+        if (ret == 0)
+          break;
+      }
+    }
+
+    // requires mutex_. the kernel only reads the sq during io_uring_enter(),
+    // so the entries it hasn't consumed can be withdrawn by moving the tail
+    void unqueue(int result, std::vector<std::pair<file_ring_op*, int>>& failed)
+    {
+      for (unsigned i = sq_tail_value_ - queued_; i != sq_tail_value_; ++i)
+      {
+        const io_uring_sqe& sqe = sqes_[sq_array_[i & sq_mask_]];
+        failed.emplace_back(reinterpret_cast<file_ring_op*>(sqe.user_data), result);
+      }
+      sq_tail_value_ -= queued_;
+      __atomic_store_n(sq_tail_, sq_tail_value_, __ATOMIC_RELEASE);
+      queued_ = 0;
+    }
+
+    // requires mutex_
+    void reap(std::vector<std::pair<file_ring_op*, int>>& done)
+    {
+      unsigned head = *cq_head_;
+      const unsigned tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+      for (; head != tail; ++head)
+      {
+        const io_uring_cqe& cqe = cqes_[head & cq_mask_];
+        done.emplace_back(reinterpret_cast<file_ring_op*>(cqe.user_data), cqe.res);
+        --inflight_;
+      }
+      __atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+    }
+
+    // requires mutex_. watch the eventfd only while there is something to
+    // wait for, so that an idle ring doesn't keep the io_context running
+    void arm()
+    {
+      if (waiting_ || inflight_ == 0)
+        return;
+      waiting_ = true;
+      auto self = shared_from_this();
+      event_.async_wait(boost::asio::posix::stream_descriptor::wait_read,
+          [self] (boost::system::error_code) { self->on_event(); });
+    }
+
+    void flush()
+    {
+      std::vector<std::pair<file_ring_op*, int>> failed;
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        flush_posted_ = false;
+        if (shutdown_)
+          return;
+        submit(failed);
+        arm();
+      }
+      for (auto& f : failed)
+        f.first->complete(f.second);
+    }
+
+    void on_event()
+    {
+      std::vector<std::pair<file_ring_op*, int>> done;
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        waiting_ = false;
+        if (shutdown_)
+          return;
+        // reset the eventfd before reaping, so that a completion that
+        // arrives after the cq is drained wakes the next wait
+        std::uint64_t value;
+        const ssize_t r = ::read(event_.native_handle(), &value, sizeof(value));
+        (void) r;
+        reap(done);
+        while (!backlog_.empty() && queued_ + inflight_ < cq_entries_)
+        {
+          push(std::unique_ptr<file_ring_op>(backlog_.front()), done);
+          backlog_.pop_front();
+        }
+        submit(done);
+        arm();
+      }
+      for (auto& d : done)
+        d.first->complete(d.second);
+    }
+
+    boost::asio::io_context::executor_type ex_;
+    boost::asio::posix::stream_descriptor event_;
+    std::atomic<std::uint64_t> submit_calls_{0};
+
+    std::mutex mutex_;
+    bool shutdown_ = false;
+    bool flush_posted_ = false;
+    bool waiting_ = false;
+    unsigned queued_ = 0;
+    unsigned inflight_ = 0;
+    std::deque<file_ring_op*> backlog_;
+
+    int ring_fd_ = -1;
+    void* sq_ring_ = nullptr;
+    std::size_t sq_ring_size_ = 0;
+    void* cq_ring_ = nullptr;
+    std::size_t cq_ring_size_ = 0;
+    io_uring_sqe* sqes_ = nullptr;
+    std::size_t sqes_size_ = 0;
+
+    unsigned* sq_tail_ = nullptr;
+    unsigned* sq_array_ = nullptr;
+    unsigned sq_mask_ = 0;
+    unsigned sq_entries_ = 0;
+    unsigned sq_tail_value_ = 0;
+
+    unsigned* cq_head_ = nullptr;
+    unsigned* cq_tail_ = nullptr;
+    unsigned cq_mask_ = 0;
+    unsigned cq_entries_ = 0;
+    io_uring_cqe* cqes_ = nullptr;
+
+    void* buffers_ = nullptr;
+    std::size_t buffers_size_ = 0;
+    std::size_t buffer_size_;
+    std::vector<unsigned> free_;
+  };
+
+} // namespace detail
+
+inline file_ring::file_ring(boost::asio::io_context& ioc, unsigned entries,
+                            std::size_t buffer_count, std::size_t buffer_size)
+  : state_(std::make_shared<detail::file_ring_state>(
+          ioc, entries, buffer_count, buffer_size))
+{
+}
+
+inline file_ring::~file_ring()
+{
+  state_->shutdown();
+}
+
+inline auto file_ring::get_executor() const noexcept -> executor_type
+{
+  return state_->get_executor();
+}
+
+inline auto file_ring::acquire_buffer() -> fixed_buffer
+{
+  unsigned index = 0;
+  void* data = nullptr;
+  if (!state_->acquire(index, data))
+    return fixed_buffer();
+  return fixed_buffer(state_, index, data, state_->buffer_size());
+}
+
+inline std::uint64_t file_ring::submit_calls() const noexcept
+{
+  return state_->submit_calls();
+}
+
+template <typename ReadHandler>
+BOOST_ASIO_INITFN_RESULT_TYPE(ReadHandler,
+    void(boost::system::error_code, std::size_t))
+file_ring::async_read_some_at(int fd, std::uint64_t offset,
+                              const boost::asio::mutable_buffer& buffer,
+                              ReadHandler&& handler)
+{
+  boost::asio::async_completion<ReadHandler,
+      void(boost::system::error_code, std::size_t)> init(handler);
+  using handler_type = typename std::decay<decltype(init.completion_handler)>::type;
+  std::unique_ptr<detail::file_ring_op> op(new detail::file_ring_rw_op<handler_type>(
+          std::move(init.completion_handler), get_executor()));
+  op->sqe.opcode = IORING_OP_READ;
+  op->sqe.fd = fd;
+  op->sqe.off = offset;
+  op->sqe.addr = reinterpret_cast<std::uintptr_t>(buffer.data());
+  op->sqe.len = static_cast<std::uint32_t>(buffer.size());
+  state_->start(std::move(op));
+  return init.result.get();
+}
+
+template <typename ReadHandler>
+BOOST_ASIO_INITFN_RESULT_TYPE(ReadHandler,
+    void(boost::system::error_code, std::size_t))
+file_ring::async_read_some_at(int fd, std::uint64_t offset,
+                              fixed_buffer& buffer, std::size_t size,
+                              ReadHandler&& handler)
+{
+  boost::asio::async_completion<ReadHandler,
+      void(boost::system::error_code, std::size_t)> init(handler);
+  using handler_type = typename std::decay<decltype(init.completion_handler)>::type;
+  std::unique_ptr<detail::file_ring_op> op(new detail::file_ring_rw_op<handler_type>(
+          std::move(init.completion_handler), get_executor()));
+  const bool fixed = buffer.state_ == state_;
+  op->sqe.opcode = fixed ? IORING_OP_READ_FIXED : IORING_OP_READ;
+  op->sqe.fd = fd;
+  op->sqe.off = offset;
+  op->sqe.addr = reinterpret_cast<std::uintptr_t>(buffer.data());
+  op->sqe.len = static_cast<std::uint32_t>(std::min(size, buffer.size()));
+  op->sqe.buf_index = fixed ? static_cast<std::uint16_t>(buffer.index_) : 0;
+  state_->start(std::move(op));
+  return init.result.get();
+}
+
+template <typename WriteHandler>
+BOOST_ASIO_INITFN_RESULT_TYPE(WriteHandler,
+    void(boost::system::error_code, std::size_t))
+file_ring::async_write_some_at(int fd, std::uint64_t offset,
+                               const boost::asio::const_buffer& buffer,
+                               WriteHandler&& handler)
+{
+  boost::asio::async_completion<WriteHandler,
+      void(boost::system::error_code, std::size_t)> init(handler);
+  using handler_type = typename std::decay<decltype(init.completion_handler)>::type;
+  std::unique_ptr<detail::file_ring_op> op(new detail::file_ring_rw_op<handler_type>(
+          std::move(init.completion_handler), get_executor()));
+  op->sqe.opcode = IORING_OP_WRITE;
+  op->sqe.fd = fd;
+  op->sqe.off = offset;
+  op->sqe.addr = reinterpret_cast<std::uintptr_t>(buffer.data());
+  op->sqe.len = static_cast<std::uint32_t>(buffer.size());
+  state_->start(std::move(op));
+  return init.result.get();
+}
+
+template <typename WriteHandler>
+BOOST_ASIO_INITFN_RESULT_TYPE(WriteHandler,
+    void(boost::system::error_code, std::size_t))
+file_ring::async_write_some_at(int fd, std::uint64_t offset,
+                               const fixed_buffer& buffer, std::size_t size,
+                               WriteHandler&& handler)
+{
+  boost::asio::async_completion<WriteHandler,
+      void(boost::system::error_code, std::size_t)> init(handler);
+  using handler_type = typename std::decay<decltype(init.completion_handler)>::type;
+  std::unique_ptr<detail::file_ring_op> op(new detail::file_ring_rw_op<handler_type>(
+          std::move(init.completion_handler), get_executor()));
+  const bool fixed = buffer.state_ == state_;
+  op->sqe.opcode = fixed ? IORING_OP_WRITE_FIXED : IORING_OP_WRITE;
+  op->sqe.fd = fd;
+  op->sqe.off = offset;
+  op->sqe.addr = reinterpret_cast<std::uintptr_t>(buffer.data());
+  op->sqe.len = static_cast<std::uint32_t>(std::min(size, buffer.size()));
+  op->sqe.buf_index = fixed ? static_cast<std::uint16_t>(buffer.index_) : 0;
+  state_->start(std::move(op));
+  return init.result.get();
+}
+
+template <typename FsyncHandler>
+BOOST_ASIO_INITFN_RESULT_TYPE(FsyncHandler, void(boost::system::error_code))
+file_ring::async_fsync(int fd, FsyncHandler&& handler)
+{
+  boost::asio::async_completion<FsyncHandler,
+      void(boost::system::error_code)> init(handler);
+  using handler_type = typename std::decay<decltype(init.completion_handler)>::type;
+  std::unique_ptr<detail::file_ring_op> op(new detail::file_ring_fsync_op<handler_type>(
+          std::move(init.completion_handler), get_executor()));
+  op->sqe.opcode = IORING_OP_FSYNC;
+  op->sqe.fd = fd;
+  state_->start(std::move(op));
+  return init.result.get();
+}
+
+inline file_ring::fixed_buffer::~fixed_buffer()
+{
+  release();
+}
+
+inline file_ring::fixed_buffer::fixed_buffer(fixed_buffer&& other) noexcept
+  : state_(std::move(other.state_)), index_(other.index_),
+    data_(other.data_), size_(other.size_)
+{
+  other.data_ = nullptr;
+  other.size_ = 0;
+}
+
+inline auto file_ring::fixed_buffer::operator=(fixed_buffer&& other) noexcept
+  -> fixed_buffer&
+{
+  if (this != &other)
+  {
+    release();
+    state_ = std::move(other.state_);
+    index_ = other.index_;
+    data_ = other.data_;
+    size_ = other.size_;
+    other.data_ = nullptr;
+    other.size_ = 0;
+  }
+  return *this;
+}
+
+inline void file_ring::fixed_buffer::release() noexcept
+{
+  if (state_)
+  {
+    state_->release(index_);
+    state_.reset();
+  }
+  data_ = nullptr;
+  size_ = 0;
+}
+
+} // namespace spawn
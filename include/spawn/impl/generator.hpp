@@ -0,0 +1,94 @@
+//
+// impl/generator.hpp
+// ~~~~~~~~~~~~~~~~~~
+//
+// Copyright (c) 2019 Casey Bodley (cbodley at redhat dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#pragma once
+
+#include <utility>
+
+namespace spawn {
+namespace detail {
+
+  template <typename T>
+  struct generator_state
+  {
+    boost::context::continuation producer_;
+    boost::context::continuation consumer_;
+    T* value_ = nullptr;
+    std::exception_ptr eptr_;
+  };
+
+  template <typename T, typename Function>
+  struct generator_entry
+  {
+    boost::context::continuation operator()(boost::context::continuation&& c)
+    {
+      // return to the constructor, the producer starts on the first next()
+      c = c.resume();
+      state_->consumer_ = std::move(c);
+      try
+      {
+        typename generator<T>::push_type push(*state_);
+        function_(push);
+      }
+      catch (const boost::context::detail::forced_unwind&)
+      {
+        throw; // must allow forced_unwind to propagate
+      }
+      catch (...)
+      {
+        state_->eptr_ = std::current_exception();
+      }
+      state_->value_ = nullptr;
+      return std::move(state_->consumer_);
+    }
+
+    generator_state<T>* state_;
+    Function function_;
+  };
+
+} // namespace detail
+
+template <typename T>
+void generator<T>::push_type::operator()(T& value)
+{
+  state_.value_ = std::addressof(value);
+  state_.consumer_ = state_.consumer_.resume();
+}
+
+template <typename T>
+template <typename Function, typename StackAllocator, typename>
+generator<T>::generator(Function&& function, StackAllocator&& salloc)
+  : state_(new detail::generator_state<T>())
+{
+  using function_type = typename std::decay<Function>::type;
+  state_->producer_ = boost::context::callcc(
+      std::allocator_arg, std::forward<StackAllocator>(salloc),
+      detail::generator_entry<T, function_type>{
+        state_.get(), std::forward<Function>(function)});
+}
+
+template <typename T>
+T* generator<T>::next()
+{
+  detail::generator_state<T>& state = *state_;
+  if (!state.producer_)
+    return nullptr;
+  state.value_ = nullptr;
+  state.producer_ = std::move(state.producer_).resume();
+  if (state.eptr_)
+  {
+    std::exception_ptr eptr = std::move(state.eptr_);
+    state.eptr_ = nullptr;
+    std::rethrow_exception(eptr);
+  }
+  return state.value_;
+}
+
+} // namespace spawn
@@ -0,0 +1,77 @@
+//
+// impl/immediate.hpp
+// ~~~~~~~~~~~~~~~~~~
+//
+// Copyright (c) 2019 Casey Bodley (cbodley at redhat dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#pragma once
+
+#include <tuple>
+#include <utility>
+
+#include <boost/asio/post.hpp>
+#include <boost/mp11/integer_sequence.hpp>
+
+namespace spawn {
+namespace detail {
+
+  // Invokes the handler with its stored arguments.
+  template <typename Handler, typename ...Args>
+  struct immediate_binder
+  {
+    Handler handler_;
+    std::tuple<Args...> args_;
+
+    void operator()()
+    {
+      invoke(boost::mp11::index_sequence_for<Args...>());
+    }
+
+    template <std::size_t ...I>
+    void invoke(boost::mp11::index_sequence<I...>)
+    {
+      std::move(handler_)(std::get<I>(std::move(args_))...);
+    }
+  };
+
+  template <typename Handler>
+  struct immediate_completion
+  {
+    template <typename ...Args>
+    static void complete(Handler&& handler, Args&&... args)
+    {
+      auto ex = net::get_associated_executor(handler);
+      boost::asio::post(ex, immediate_binder<Handler,
+          typename std::decay<Args>::type...>{
+            std::move(handler), std::make_tuple(std::forward<Args>(args)...)});
+    }
+  };
+
+  template <typename Handler, typename ...Ts>
+  struct immediate_completion<coro_handler<Handler, Ts...>>
+  {
+    template <typename ...Args>
+    static void complete(coro_handler<Handler, Ts...>&& handler, Args&&... args)
+    {
+      coro_handler<Handler, Ts...> h(std::move(handler));
+      h.immediate_ = true;
+      h(std::forward<Args>(args)...);
+    }
+  };
+
+} // namespace detail
+
+template <typename Handler, typename ...Args>
+void complete_immediately(Handler&& handler, Args&&... args)
+{
+  using handler_type = typename std::decay<Handler>::type;
+  detail::immediate_completion<handler_type>::complete(
+      handler_type(std::forward<Handler>(handler)),
+      std::forward<Args>(args)...);
+}
+
+} // namespace spawn
@@ -0,0 +1,290 @@
+//
+// impl/latency.hpp
+// ~~~~~~~~~~~~~~~~
+//
+// Copyright (c) 2019 Casey Bodley (cbodley at redhat dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <typeinfo>
+#include <utility>
+#include <vector>
+
+#include <boost/core/demangle.hpp>
+
+namespace spawn {
+namespace detail {
+
+  inline unsigned latency_log2(std::uint64_t value) noexcept
+  {
+#if defined(__GNUC__) || defined(__clang__)
+    return 63 - __builtin_clzll(value);
+#else
+    unsigned result = 0;
+    while (value >>= 1)
+      ++result;
+    return result;
+#endif
+  }
+
+  // Counters have a single writer, so a relaxed load and store is enough.
+  inline void latency_add(std::atomic<std::uint64_t>& counter,
+                          std::uint64_t value) noexcept
+  {
+    counter.store(counter.load(std::memory_order_relaxed) + value,
+                  std::memory_order_relaxed);
+  }
+
+} // namespace detail
+
+inline latency_histogram::latency_histogram() noexcept
+{
+  reset();
+}
+
+inline latency_histogram::latency_histogram(const latency_histogram& other) noexcept
+{
+  reset();
+  merge(other);
+}
+
+inline latency_histogram& latency_histogram::operator=(const latency_histogram& other) noexcept
+{
+  if (this != &other)
+  {
+    reset();
+    merge(other);
+  }
+  return *this;
+}
+
+inline std::size_t latency_histogram::bucket_index(std::uint64_t ns) noexcept
+{
+  if (ns < sub_bucket_count)
+    return static_cast<std::size_t>(ns);
+  const unsigned shift = detail::latency_log2(ns) - sub_bucket_bits;
+  return (shift + 1) * sub_bucket_count +
+      static_cast<std::size_t>((ns >> shift) - sub_bucket_count);
+}
+
+inline std::uint64_t latency_histogram::bucket_upper_bound(std::size_t index) noexcept
+{
+  if (index < sub_bucket_count)
+    return index;
+  const unsigned shift = static_cast<unsigned>(index / sub_bucket_count) - 1;
+  const std::uint64_t lower =
+      (sub_bucket_count + index % sub_bucket_count) << shift;
+  return lower + ((std::uint64_t(1) << shift) - 1);
+}
+
+inline void latency_histogram::record(std::uint64_t ns) noexcept
+{
+  detail::latency_add(counts_[bucket_index(ns)], 1);
+  detail::latency_add(total_, 1);
+  detail::latency_add(sum_, ns);
+  if (ns < min_.load(std::memory_order_relaxed))
+    min_.store(ns, std::memory_order_relaxed);
+  if (ns > max_.load(std::memory_order_relaxed))
+    max_.store(ns, std::memory_order_relaxed);
+}
+
+inline void latency_histogram::merge(const latency_histogram& other) noexcept
+{
+  for (std::size_t i = 0; i < bucket_count; i++)
+    detail::latency_add(counts_[i], other.counts_[i].load(std::memory_order_relaxed));
+  detail::latency_add(total_, other.total_.load(std::memory_order_relaxed));
+  detail::latency_add(sum_, other.sum_.load(std::memory_order_relaxed));
+  min_.store(std::min(min_.load(std::memory_order_relaxed),
+                      other.min_.load(std::memory_order_relaxed)),
+             std::memory_order_relaxed);
+  max_.store(std::max(max_.load(std::memory_order_relaxed),
+                      other.max_.load(std::memory_order_relaxed)),
+             std::memory_order_relaxed);
+}
+
+inline void latency_histogram::reset() noexcept
+{
+  for (std::size_t i = 0; i < bucket_count; i++)
+    counts_[i].store(0, std::memory_order_relaxed);
+  total_.store(0, std::memory_order_relaxed);
+  sum_.store(0, std::memory_order_relaxed);
+  min_.store(std::numeric_limits<std::uint64_t>::max(), std::memory_order_relaxed);
+  max_.store(0, std::memory_order_relaxed);
+}
+
+inline std::uint64_t latency_histogram::count() const noexcept
+{
+  return total_.load(std::memory_order_relaxed);
+}
+
+inline std::uint64_t latency_histogram::min() const noexcept
+{
+  return count() ? min_.load(std::memory_order_relaxed) : 0;
+}
+
+inline std::uint64_t latency_histogram::max() const noexcept
+{
+  return max_.load(std::memory_order_relaxed);
+}
+
+inline double latency_histogram::mean() const noexcept
+{
+  const std::uint64_t n = count();
+  return n ? static_cast<double>(sum_.load(std::memory_order_relaxed)) / n : 0.0;
+}
+
+inline std::uint64_t latency_histogram::percentile(double p) const noexcept
+{
+  const std::uint64_t n = count();
+  if (n == 0)
+    return 0;
+  std::uint64_t rank = static_cast<std::uint64_t>(p / 100.0 * n + 0.5);
+  rank = std::max<std::uint64_t>(1, std::min(rank, n));
+  std::uint64_t seen = 0;
+  for (std::size_t i = 0; i < bucket_count; i++)
+  {
+    seen += counts_[i].load(std::memory_order_relaxed);
+    if (seen >= rank)
+      return std::min(bucket_upper_bound(i), max());
+  }
+  return max();
+}
+
+namespace detail {
+
+  // Owns the histograms of every thread. Entries are never freed, so threads
+  // may cache pointers to their own entries and record without locking.
+  class latency_registry
+  {
+    struct entry
+    {
+      const char* tag;
+      const std::type_info* signature;
+      latency_stats stats;
+    };
+    std::mutex mutex_;
+    std::vector<std::unique_ptr<entry>> entries_;
+
+    latency_stats& add(const char* tag, const std::type_info& signature)
+    {
+      std::unique_ptr<entry> e(new entry);
+      e->tag = tag;
+      e->signature = &signature;
+      latency_stats& stats = e->stats;
+      std::lock_guard<std::mutex> lock(mutex_);
+      entries_.push_back(std::move(e));
+      return stats;
+    }
+
+  public:
+    static latency_registry& instance()
+    {
+      static latency_registry registry;
+      return registry;
+    }
+
+    // Return the calling thread's statistics for the given key.
+    latency_stats& local(const char* tag, const std::type_info& signature)
+    {
+      struct cached
+      {
+        const char* tag;
+        const std::type_info* signature;
+        latency_stats* stats;
+      };
+      static thread_local std::vector<cached> cache;
+      for (auto& c : cache)
+        if (c.tag == tag && (tag || *c.signature == signature))
+          return *c.stats;
+      latency_stats& stats = add(tag, signature);
+      cache.push_back(cached{tag, &signature, &stats});
+      return stats;
+    }
+
+    std::map<std::string, latency_stats> snapshot()
+    {
+      std::map<std::string, latency_stats> result;
+      std::lock_guard<std::mutex> lock(mutex_);
+      for (auto& e : entries_)
+      {
+        latency_stats& stats = result[e->tag ? std::string(e->tag)
+            : boost::core::demangle(e->signature->name())];
+        stats.operation.merge(e->stats.operation);
+        stats.resume.merge(e->stats.resume);
+      }
+      return result;
+    }
+
+    void reset()
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      for (auto& e : entries_)
+      {
+        e->stats.operation.reset();
+        e->stats.resume.reset();
+      }
+    }
+  };
+
+  // Timestamps a single asynchronous operation awaited by coro_async_result.
+  class latency_probe
+  {
+    using clock = std::chrono::steady_clock;
+
+    static std::uint64_t elapsed(clock::time_point from, clock::time_point to)
+    {
+      return std::chrono::duration_cast<std::chrono::nanoseconds>(to - from).count();
+    }
+
+  public:
+    latency_probe(const char* tag, const std::type_info& signature)
+      : tag_(tag),
+        signature_(signature),
+        started_(clock::now())
+    {
+    }
+
+    // Called by coro_handler before it releases the coroutine.
+    void completed()
+    {
+      completed_ = clock::now();
+    }
+
+    // Called by coro_async_result once the coroutine is running again.
+    void resumed()
+    {
+      const clock::time_point now = clock::now();
+      latency_stats& stats = latency_registry::instance().local(tag_, signature_);
+      stats.operation.record(elapsed(started_, completed_));
+      stats.resume.record(elapsed(completed_, now));
+    }
+
+  private:
+    const char* tag_;
+    const std::type_info& signature_;
+    clock::time_point started_;
+    clock::time_point completed_;
+  };
+
+} // namespace detail
+
+inline std::map<std::string, latency_stats> latency_snapshot()
+{
+  return detail::latency_registry::instance().snapshot();
+}
+
+inline void latency_reset()
+{
+  detail::latency_registry::instance().reset();
+}
+
+} // namespace spawn
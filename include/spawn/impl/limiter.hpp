@@ -0,0 +1,280 @@
+//
+// impl/limiter.hpp
+// ~~~~~~~~~~~~~~~~
+//
+// Copyright (c) 2019 Casey Bodley (cbodley at redhat dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#pragma once
+
+#include <algorithm>
+#include <deque>
+#include <mutex>
+
+#include <boost/asio/post.hpp>
+
+namespace spawn {
+namespace detail {
+
+  using limiter_clock = std::chrono::steady_clock;
+
+  // Owns one of the limiter's slots, and releases it on destruction.
+  class limiter_slot
+  {
+  public:
+    explicit limiter_slot(std::shared_ptr<limiter_state> state)
+      : state_(std::move(state))
+    {
+    }
+    limiter_slot(limiter_slot&&) = default;
+    ~limiter_slot();
+
+  private:
+    std::shared_ptr<limiter_state> state_;
+  };
+
+  // Wraps the coroutine function so that its slot is released when the
+  // function returns, or with spawn_data if it never runs.
+  template <typename Function>
+  struct limited_function
+  {
+    limiter_slot slot_;
+    Function function_;
+
+    template <typename Handler>
+    void operator()(basic_yield_context<Handler> yield)
+    {
+      limiter_slot slot = std::move(slot_);
+      function_(yield);
+    }
+  };
+
+  // A spawn request waiting for a slot.
+  class limiter_pending
+  {
+  public:
+    explicit limiter_pending(limiter_clock::time_point enqueued)
+      : enqueued_(enqueued)
+    {
+    }
+    virtual ~limiter_pending() {}
+
+    // Post the request to its executor, where it spawns with the given slot.
+    virtual void post(std::unique_ptr<limiter_pending> self, limiter_slot slot) = 0;
+
+    const limiter_clock::time_point enqueued_;
+  };
+
+  template <typename Executor>
+  auto limiter_executor(const Executor& ex)
+    -> typename std::enable_if<net::is_executor<Executor>::value, Executor>::type
+  {
+    return ex;
+  }
+
+  template <typename Handler>
+  auto limiter_executor(const basic_yield_context<Handler>& yield)
+    -> net::associated_executor_t<Handler>
+  {
+    return net::get_associated_executor(yield.handler_);
+  }
+
+  template <typename Handler>
+  auto limiter_executor(const Handler& handler)
+    -> typename std::enable_if<!net::is_executor<Handler>::value,
+         net::associated_executor_t<Handler>>::type
+  {
+    return net::get_associated_executor(handler);
+  }
+
+  // Execution contexts are queued as their executor, like spawn() does.
+  template <typename ExecutionContext>
+  auto limiter_target(ExecutionContext& ctx)
+    -> typename std::enable_if<std::is_convertible<
+         ExecutionContext&, net::execution_context&>::value,
+         decltype(ctx.get_executor())>::type
+  {
+    return ctx.get_executor();
+  }
+
+  template <typename Target>
+  auto limiter_target(Target&& target)
+    -> typename std::enable_if<!std::is_convertible<
+         Target&, net::execution_context&>::value,
+         typename std::decay<Target>::type>::type
+  {
+    return std::forward<Target>(target);
+  }
+
+  template <typename Target, typename Function, typename StackAllocator>
+  class limiter_pending_impl : public limiter_pending
+  {
+    struct launch_op
+    {
+      std::unique_ptr<limiter_pending_impl> pending;
+      limiter_slot slot;
+
+      void operator()()
+      {
+        limiter_pending_impl& p = *pending;
+        spawn::spawn(std::move(p.target_),
+            limited_function<Function>{std::move(slot), std::move(p.function_)},
+            std::move(p.salloc_));
+      }
+    };
+
+  public:
+    template <typename T, typename F, typename S>
+    limiter_pending_impl(limiter_clock::time_point enqueued,
+                         T&& target, F&& function, S&& salloc)
+      : limiter_pending(enqueued),
+        target_(std::forward<T>(target)),
+        function_(std::forward<F>(function)),
+        salloc_(std::forward<S>(salloc))
+    {
+    }
+
+    void post(std::unique_ptr<limiter_pending> self, limiter_slot slot) override
+    {
+      auto ex = limiter_executor(target_);
+      std::unique_ptr<limiter_pending_impl> pending(
+          static_cast<limiter_pending_impl*>(self.release()));
+      boost::asio::post(ex, launch_op{std::move(pending), std::move(slot)});
+    }
+
+  private:
+    Target target_;
+    Function function_;
+    StackAllocator salloc_;
+  };
+
+  class limiter_state : public std::enable_shared_from_this<limiter_state>
+  {
+  public:
+    limiter_state(std::size_t max_live, std::size_t max_queue,
+                  limiter::overflow_policy policy)
+      : max_live_(max_live),
+        max_queue_(max_queue),
+        policy_(policy)
+    {
+    }
+
+    template <typename Target, typename Function, typename StackAllocator>
+    bool spawn(Target&& target, Function&& function, StackAllocator&& salloc)
+    {
+      using target_type = typename std::decay<Target>::type;
+      using function_type = typename std::decay<Function>::type;
+      using salloc_type = typename std::decay<StackAllocator>::type;
+
+      std::unique_lock<std::mutex> lock(mutex_);
+      if (live_ < max_live_)
+      {
+        ++live_;
+        ++stats_.spawned;
+        lock.unlock();
+        spawn::spawn(std::forward<Target>(target),
+            limited_function<function_type>{
+              limiter_slot(shared_from_this()), std::forward<Function>(function)},
+            std::forward<StackAllocator>(salloc));
+        return true;
+      }
+      if (policy_ == limiter::overflow_policy::reject ||
+          queue_.size() >= max_queue_)
+      {
+        ++stats_.rejected;
+        return false;
+      }
+      queue_.emplace_back(new limiter_pending_impl<target_type,
+            function_type, salloc_type>(limiter_clock::now(),
+              std::forward<Target>(target), std::forward<Function>(function),
+              std::forward<StackAllocator>(salloc)));
+      stats_.max_queued = std::max(stats_.max_queued, queue_.size());
+      return true;
+    }
+
+    // Hand a released slot to the next queued request, if any.
+    void release()
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      if (queue_.empty())
+      {
+        --live_;
+        return;
+      }
+      std::unique_ptr<limiter_pending> pending = std::move(queue_.front());
+      queue_.pop_front();
+      const auto wait = limiter_clock::now() - pending->enqueued_;
+      ++stats_.spawned;
+      ++stats_.waited;
+      stats_.total_wait += wait;
+      stats_.max_wait = std::max<std::chrono::nanoseconds>(stats_.max_wait, wait);
+      lock.unlock();
+
+      limiter_pending& p = *pending;
+      p.post(std::move(pending), limiter_slot(shared_from_this()));
+    }
+
+    void clear()
+    {
+      std::deque<std::unique_ptr<limiter_pending>> queue;
+      std::lock_guard<std::mutex> lock(mutex_);
+      queue.swap(queue_);
+    }
+
+    limiter::stats get_stats() const
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      limiter::stats s = stats_;
+      s.live = live_;
+      s.queued = queue_.size();
+      return s;
+    }
+
+  private:
+    mutable std::mutex mutex_;
+    const std::size_t max_live_;
+    const std::size_t max_queue_;
+    const limiter::overflow_policy policy_;
+    std::size_t live_ = 0;
+    std::deque<std::unique_ptr<limiter_pending>> queue_;
+    limiter::stats stats_ = {};
+  };
+
+  inline limiter_slot::~limiter_slot()
+  {
+    if (state_)
+      state_->release();
+  }
+
+} // namespace detail
+
+inline limiter::limiter(std::size_t max_live, std::size_t max_queue,
+                        overflow_policy policy)
+  : state_(std::make_shared<detail::limiter_state>(max_live, max_queue, policy))
+{
+}
+
+inline limiter::~limiter()
+{
+  state_->clear();
+}
+
+template <typename Target, typename Function, typename StackAllocator>
+auto limiter::spawn(Target&& target, Function&& function, StackAllocator&& salloc)
+  -> typename std::enable_if<detail::is_stack_allocator<
+       typename std::decay<StackAllocator>::type>::value, bool>::type
+{
+  return state_->spawn(detail::limiter_target(std::forward<Target>(target)),
+                       std::forward<Function>(function),
+                       std::forward<StackAllocator>(salloc));
+}
+
+inline limiter::stats limiter::get_stats() const
+{
+  return state_->get_stats();
+}
+
+} // namespace spawn
@@ -0,0 +1,171 @@
+//
+// impl/polling_runtime.hpp
+// ~~~~~~~~~~~~~~~~~~~~~~~~
+//
+// Copyright (c) 2019 Casey Bodley (cbodley at redhat dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#pragma once
+
+#include <system_error>
+#include <utility>
+
+#include <boost/asio/bind_executor.hpp>
+
+#include <spawn/detail/adaptive_spin.hpp>
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace spawn {
+namespace detail {
+
+  inline void pin_thread(std::thread& thread, int cpu)
+  {
+#if defined(__linux__)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    int r = ::pthread_setaffinity_np(thread.native_handle(), sizeof(set), &set);
+    if (r != 0)
+      throw std::system_error(r, std::system_category(), "pthread_setaffinity_np");
+#else
+    (void)thread;
+    (void)cpu;
+    throw std::system_error(std::make_error_code(std::errc::not_supported),
+                            "pin_thread");
+#endif
+  }
+
+} // namespace detail
+
+inline polling_runtime::polling_runtime(const polling_options& options)
+{
+  shards_.reserve(options.shards);
+  for (std::size_t i = 0; i < options.shards; i++)
+    shards_.emplace_back(new shard_state);
+
+  try
+  {
+    for (std::size_t i = 0; i < shards_.size(); i++)
+    {
+      shard_state& shard = *shards_[i];
+      const std::chrono::nanoseconds spin_duration = options.spin_duration;
+      shard.thread = std::thread([&shard, spin_duration] {
+          poll(shard, spin_duration);
+        });
+      if (!options.cpus.empty())
+        detail::pin_thread(shard.thread, options.cpus[i % options.cpus.size()]);
+    }
+  }
+  catch (...)
+  {
+    stop();
+    join();
+    throw;
+  }
+}
+
+inline polling_runtime::~polling_runtime()
+{
+  stop();
+  join();
+}
+
+inline std::uint64_t polling_runtime::sleeps() const noexcept
+{
+  std::uint64_t count = 0;
+  for (auto& shard : shards_)
+    count += shard->sleeps.load(std::memory_order_relaxed);
+  return count;
+}
+
+inline void polling_runtime::stop()
+{
+  for (auto& shard : shards_)
+    shard->context.stop();
+}
+
+inline void polling_runtime::join()
+{
+  for (auto& shard : shards_)
+    shard->work.reset();
+  for (auto& shard : shards_)
+    if (shard->thread.joinable())
+      shard->thread.join();
+}
+
+inline boost::asio::io_context& polling_runtime::next_shard() noexcept
+{
+  const std::size_t i = next_.fetch_add(1, std::memory_order_relaxed);
+  return shards_[i % shards_.size()]->context;
+}
+
+inline void polling_runtime::poll(shard_state& shard,
+                                  std::chrono::nanoseconds spin_duration)
+{
+  using clock = std::chrono::steady_clock;
+  boost::asio::io_context& context = shard.context;
+  // coroutines on the shard must not spin, or they would hold up the
+  // completions that they spin on
+  const detail::serial_context_guard serial(context);
+  auto last_work = clock::now();
+  for (;;)
+  {
+    // poll() runs the reactor with a zero timeout whenever the handler
+    // queue is empty, and stops the context once its work runs out
+    if (context.poll() > 0)
+    {
+      last_work = clock::now();
+      continue;
+    }
+    if (context.stopped())
+      break;
+    if (clock::now() - last_work < spin_duration)
+    {
+      // with a single CPU, let the threads that complete our operations run
+      if (detail::spin_possible())
+        detail::spin_pause();
+      else
+        std::this_thread::yield();
+      continue;
+    }
+    shard.sleeps.fetch_add(1, std::memory_order_relaxed);
+    if (context.run_one() == 0)
+      break;
+    last_work = clock::now();
+  }
+}
+
+template <typename Function, typename StackAllocator>
+auto spawn(polling_runtime& runtime, Function&& function,
+           StackAllocator&& salloc)
+  -> typename std::enable_if<detail::is_stack_allocator<
+       typename std::decay<StackAllocator>::type>::value>::type
+{
+  // each shard has only one thread, so the coroutine needs no strand
+  const detail::net::any_io_executor ex = runtime.get_executor();
+  spawn(boost::asio::bind_executor(ex, &detail::default_spawn_handler),
+      std::forward<Function>(function),
+      std::forward<StackAllocator>(salloc));
+}
+
+template <typename Handler, typename Function, typename StackAllocator>
+auto spawn(polling_runtime& runtime, Handler&& handler, Function&& function,
+           StackAllocator&& salloc)
+  -> typename std::enable_if<
+       !detail::is_stack_allocator<typename std::decay<Function>::type>::value &&
+       detail::is_stack_allocator<typename std::decay<StackAllocator>::type>::value>::type
+{
+  const detail::net::any_io_executor ex = runtime.get_executor();
+  spawn(boost::asio::bind_executor(ex, std::forward<Handler>(handler)),
+      std::forward<Function>(function),
+      std::forward<StackAllocator>(salloc));
+}
+
+} // namespace spawn
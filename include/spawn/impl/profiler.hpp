@@ -0,0 +1,301 @@
+//
+// impl/profiler.hpp
+// ~~~~~~~~~~~~~~~~~
+//
+// Copyright (c) 2019 Casey Bodley (cbodley at redhat dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#pragma once
+
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+#include <system_error>
+#include <thread>
+
+#include <cxxabi.h>
+#include <dlfcn.h>
+#include <signal.h>
+#include <sys/time.h>
+#include <ucontext.h>
+
+namespace spawn {
+namespace detail {
+
+  inline std::atomic<sampling_profiler*>& active_profiler() noexcept
+  {
+    static std::atomic<sampling_profiler*> active{nullptr};
+    return active;
+  }
+
+  // signal handlers that may still be using the active profiler
+  inline std::atomic<int>& profiler_handlers() noexcept
+  {
+    static std::atomic<int> count{0};
+    return count;
+  }
+
+  inline void profiler_signal(int, siginfo_t*, void* ucontext)
+  {
+    const int saved_errno = errno;
+    profiler_handlers().fetch_add(1);
+    if (sampling_profiler* profiler = active_profiler().load())
+      profiler->record(ucontext);
+    profiler_handlers().fetch_sub(1);
+    errno = saved_errno;
+  }
+
+  struct profiler_registers
+  {
+    std::uintptr_t pc = 0;
+    std::uintptr_t sp = 0;
+    std::uintptr_t fp = 0;
+  };
+
+  inline profiler_registers read_registers(void* ucontext) noexcept
+  {
+    profiler_registers r;
+#if defined(__linux__) && defined(__x86_64__)
+    auto& mc = static_cast<ucontext_t*>(ucontext)->uc_mcontext;
+    r.pc = mc.gregs[REG_RIP];
+    r.sp = mc.gregs[REG_RSP];
+    r.fp = mc.gregs[REG_RBP];
+#elif defined(__linux__) && defined(__aarch64__)
+    auto& mc = static_cast<ucontext_t*>(ucontext)->uc_mcontext;
+    r.pc = mc.pc;
+    r.sp = mc.sp;
+    r.fp = mc.regs[29];
+#else
+    (void)ucontext;
+#endif
+    return r;
+  }
+
+  // Follow the chain of saved frame pointers. Each frame must lie above the
+  // last, within [sp, top), so a frame without one ends the walk rather
+  // than leading it off the stack.
+  inline unsigned walk_frames(const profiler_registers& r, std::uintptr_t top,
+                              const void** frames, unsigned max) noexcept
+  {
+    unsigned depth = 0;
+    if (!r.pc)
+      return depth;
+    frames[depth++] = reinterpret_cast<const void*>(r.pc);
+    std::uintptr_t fp = r.fp;
+    while (depth < max && fp >= r.sp && fp + 2 * sizeof(void*) <= top &&
+           fp % sizeof(void*) == 0)
+    {
+      auto frame = reinterpret_cast<const std::uintptr_t*>(fp);
+      const std::uintptr_t next = frame[0];
+      const std::uintptr_t ret = frame[1];
+      if (!ret)
+        break;
+      frames[depth++] = reinterpret_cast<const void*>(ret);
+      if (next <= fp)
+        break;
+      fp = next;
+    }
+    return depth;
+  }
+
+  inline std::string demangle(const char* name)
+  {
+    int status = 0;
+    char* demangled = abi::__cxa_demangle(name, nullptr, nullptr, &status);
+    if (!demangled)
+      return name;
+    std::string result = demangled;
+    std::free(demangled);
+    return result;
+  }
+
+  // Name a frame for the collapsed output, where ';' separates frames.
+  inline std::string frame_name(const void* addr)
+  {
+    std::string name;
+    Dl_info info;
+    std::memset(&info, 0, sizeof(info));
+    const bool found = ::dladdr(addr, &info) != 0;
+    if (found && info.dli_sname)
+    {
+      name = demangle(info.dli_sname);
+    }
+    else if (found && info.dli_fname && info.dli_fname[0])
+    {
+      const char* base = std::strrchr(info.dli_fname, '/');
+      char offset[32];
+      std::snprintf(offset, sizeof(offset), "+0x%zx",
+                    static_cast<std::size_t>(static_cast<const char*>(addr) -
+                        static_cast<const char*>(info.dli_fbase)));
+      name = std::string(base ? base + 1 : info.dli_fname) + offset;
+    }
+    else
+    {
+      char buf[32];
+      std::snprintf(buf, sizeof(buf), "%p", addr);
+      name = buf;
+    }
+    for (char& c : name)
+      if (c == ';')
+        c = ':';
+    return name;
+  }
+
+} // namespace detail
+
+inline sampling_profiler::sampling_profiler(std::size_t capacity)
+  : capacity_(capacity),
+    samples_(new detail::profiler_sample[capacity])
+{
+}
+
+inline sampling_profiler::~sampling_profiler()
+{
+  stop();
+}
+
+inline void sampling_profiler::start(unsigned hz)
+{
+  sampling_profiler* expected = nullptr;
+  if (!detail::active_profiler().compare_exchange_strong(expected, this))
+    throw std::system_error(std::make_error_code(
+            std::errc::device_or_resource_busy), "sampling_profiler");
+
+  struct sigaction sa;
+  std::memset(&sa, 0, sizeof(sa));
+  sa.sa_sigaction = detail::profiler_signal;
+  sa.sa_flags = SA_SIGINFO | SA_RESTART;
+  sigemptyset(&sa.sa_mask);
+  if (::sigaction(SIGPROF, &sa, nullptr) < 0)
+  {
+    const int error = errno;
+    detail::active_profiler().store(nullptr);
+    throw std::system_error(error, std::system_category(), "sigaction");
+  }
+
+  const long usec = 1000000 / (hz ? hz : 1);
+  struct itimerval timer;
+  timer.it_interval.tv_sec = usec / 1000000;
+  timer.it_interval.tv_usec = usec % 1000000;
+  timer.it_value = timer.it_interval;
+  if (::setitimer(ITIMER_PROF, &timer, nullptr) < 0)
+  {
+    const int error = errno;
+    detail::active_profiler().store(nullptr);
+    throw std::system_error(error, std::system_category(), "setitimer");
+  }
+  started_ = true;
+}
+
+inline void sampling_profiler::stop()
+{
+  if (!started_)
+    return;
+  started_ = false;
+  struct itimerval timer;
+  std::memset(&timer, 0, sizeof(timer));
+  ::setitimer(ITIMER_PROF, &timer, nullptr);
+  detail::active_profiler().store(nullptr);
+  while (detail::profiler_handlers().load() != 0)
+    std::this_thread::yield();
+}
+
+inline std::size_t sampling_profiler::samples() const noexcept
+{
+  const std::size_t n = next_.load(std::memory_order_relaxed);
+  return n < capacity_ ? n : capacity_;
+}
+
+inline std::size_t sampling_profiler::dropped() const noexcept
+{
+  const std::size_t n = next_.load(std::memory_order_relaxed);
+  return n > capacity_ ? n - capacity_ : 0;
+}
+
+inline void sampling_profiler::clear() noexcept
+{
+  for (std::size_t i = 0; i < capacity_; i++)
+    samples_[i].ready.store(false, std::memory_order_relaxed);
+  next_.store(0, std::memory_order_relaxed);
+}
+
+inline void sampling_profiler::record(void* ucontext) noexcept
+{
+  const std::size_t i = next_.fetch_add(1, std::memory_order_relaxed);
+  if (i >= capacity_)
+    return;
+  detail::profiler_sample& sample = samples_[i];
+  const detail::profiler_registers r = detail::read_registers(ucontext);
+
+  // the running coroutine is tracked across every resume(), but the thread
+  // may be just about to switch into it or just back out of it, so only
+  // trust it when the interrupted stack pointer lies on its stack
+  const detail::continuation_context* c = detail::current_continuation_storage();
+  const auto top = c ? reinterpret_cast<std::uintptr_t>(c->stack_top_) : 0;
+  if (top && r.sp < top && r.sp >= top - c->stack_size_)
+  {
+    sample.coroutine = true;
+    sample.label = c->label_;
+    sample.depth = detail::walk_frames(r, top, sample.frames,
+                                       SPAWN_PROFILER_MAX_DEPTH);
+  }
+  else
+  {
+    sample.coroutine = false;
+    sample.label = nullptr;
+    sample.depth = 0;
+    if (r.pc)
+      sample.frames[sample.depth++] = reinterpret_cast<const void*>(r.pc);
+  }
+  sample.ready.store(true, std::memory_order_release);
+}
+
+inline void sampling_profiler::write_collapsed(std::ostream& out) const
+{
+  std::map<const void*, std::string> names;
+  auto name = [&names] (const void* addr) -> const std::string& {
+    auto i = names.find(addr);
+    if (i == names.end())
+      i = names.emplace(addr, detail::frame_name(addr)).first;
+    return i->second;
+  };
+
+  std::map<std::string, std::size_t> stacks;
+  const std::size_t count = samples();
+  for (std::size_t i = 0; i < count; i++)
+  {
+    const detail::profiler_sample& sample = samples_[i];
+    if (!sample.ready.load(std::memory_order_acquire))
+      continue;
+    std::string stack;
+    if (!sample.coroutine)
+      stack = "[no coroutine]";
+    else if (sample.label)
+      stack = detail::demangle(sample.label);
+    else
+      stack = "[coroutine]";
+    for (char& c : stack)
+      if (c == ';')
+        c = ':';
+    // root first. return addresses point past their call, so look up the
+    // byte before them to stay within the calling function
+    for (unsigned j = sample.depth; j > 0; j--)
+    {
+      const char* addr = static_cast<const char*>(sample.frames[j - 1]);
+      stack += ';';
+      stack += name(j > 1 ? addr - 1 : addr);
+    }
+    ++stacks[stack];
+  }
+  for (auto& s : stacks)
+    out << s.first << ' ' << s.second << '\n';
+}
+
+} // namespace spawn
@@ -0,0 +1,349 @@
+//
+// impl/shutdown.hpp
+// ~~~~~~~~~~~~~~~~~
+//
+// Copyright (c) 2019 Casey Bodley (cbodley at redhat dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#pragma once
+
+#include <algorithm>
+#include <list>
+#include <mutex>
+#include <vector>
+
+#include <boost/asio/dispatch.hpp>
+#include <boost/asio/post.hpp>
+
+namespace spawn {
+namespace detail {
+
+  // The registration of one running coroutine.
+  class shutdown_member
+  {
+  public:
+    explicit shutdown_member(const net::any_io_executor& ex)
+      : ex_(ex)
+    {
+    }
+
+    bool requested() const
+    {
+      return requested_.load(std::memory_order_acquire);
+    }
+
+    void on_shutdown(std::function<void()> hook)
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      if (!requested())
+      {
+        hook_ = std::move(hook);
+        return;
+      }
+      lock.unlock();
+      if (hook)
+        hook();
+    }
+
+    // Called on the coroutine's executor.
+    void request()
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      requested_.store(true, std::memory_order_release);
+      std::function<void()> hook = std::move(hook_);
+      hook_ = nullptr;
+      lock.unlock();
+      if (hook)
+        hook();
+    }
+
+    const net::any_io_executor ex_;
+    std::mutex mutex_;
+    std::atomic<bool> requested_{false};
+    std::function<void()> hook_;
+    bool registered_ = false;
+    std::list<std::shared_ptr<shutdown_member>>::iterator pos_;
+  };
+
+  // Waits for the group to drain.
+  class shutdown_waiter
+  {
+  public:
+    virtual ~shutdown_waiter() {}
+    virtual void complete(std::unique_ptr<shutdown_waiter> self) = 0;
+  };
+
+  template <typename Handler>
+  class shutdown_waiter_impl : public shutdown_waiter
+  {
+  public:
+    shutdown_waiter_impl(Handler&& handler, const net::any_io_executor& ex)
+      : handler_(std::move(handler)), ex_(ex)
+    {
+    }
+
+    void complete(std::unique_ptr<shutdown_waiter> self) override
+    {
+      Handler handler = std::move(handler_);
+      net::any_io_executor ex = std::move(ex_);
+      self.reset();
+      // runs on the handler's associated executor, or else the group's
+      boost::asio::post(ex, std::move(handler));
+    }
+
+  private:
+    Handler handler_;
+    net::any_io_executor ex_;
+  };
+
+  // Counts a coroutine from spawn() until its function object is destroyed,
+  // whether or not the coroutine ever ran.
+  class shutdown_slot
+  {
+  public:
+    explicit shutdown_slot(std::shared_ptr<shutdown_state> state)
+      : state_(std::move(state))
+    {
+    }
+    shutdown_slot(shutdown_slot&&) = default;
+    ~shutdown_slot();
+
+    shutdown_state& state() const { return *state_; }
+
+  private:
+    std::shared_ptr<shutdown_state> state_;
+  };
+
+  template <typename Function>
+  struct shutdown_function
+  {
+    shutdown_slot slot_;
+    Function function_;
+
+    template <typename Handler>
+    void operator()(basic_yield_context<Handler> yield);
+  };
+
+  class shutdown_state : public std::enable_shared_from_this<shutdown_state>
+  {
+  public:
+    shutdown_state(const net::any_io_executor& ex, std::size_t batch_size)
+      : ex_(ex), batch_size_(std::max<std::size_t>(batch_size, 1))
+    {
+    }
+
+    const net::any_io_executor& get_executor() const
+    {
+      return ex_;
+    }
+
+    shutdown_slot acquire()
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      ++live_;
+      return shutdown_slot(shared_from_this());
+    }
+
+    void release()
+    {
+      std::vector<std::unique_ptr<shutdown_waiter>> waiters;
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (--live_ == 0 && stopped_)
+          waiters.swap(waiters_);
+      }
+      for (auto& waiter : waiters)
+      {
+        shutdown_waiter& w = *waiter;
+        w.complete(std::move(waiter));
+      }
+    }
+
+    void add(const std::shared_ptr<shutdown_member>& member)
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (stopped_)
+      {
+        member->requested_ = true;
+        return;
+      }
+      member->pos_ = members_.insert(members_.end(), member);
+      member->registered_ = true;
+    }
+
+    void remove(shutdown_member& member)
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (member.registered_)
+        members_.erase(member.pos_);
+    }
+
+    template <typename Handler>
+    void shutdown(Handler&& handler)
+    {
+      net::any_io_executor ex = net::get_associated_executor(handler, ex_);
+      std::unique_ptr<shutdown_waiter> waiter(
+          new shutdown_waiter_impl<Handler>(std::move(handler), ex));
+
+      std::unique_lock<std::mutex> lock(mutex_);
+      const bool first = !stopped_;
+      stopped_ = true;
+      if (live_ == 0)
+      {
+        lock.unlock();
+        shutdown_waiter& w = *waiter;
+        w.complete(std::move(waiter));
+        return;
+      }
+      waiters_.push_back(std::move(waiter));
+      if (!first)
+        return;
+
+      // take the members that must be signaled. they stay registered until
+      // they return, but nothing is added once stopped_ is set
+      pending_.reserve(members_.size());
+      for (auto& member : members_)
+        pending_.push_back(member);
+      lock.unlock();
+
+      boost::asio::post(ex, batch_op{shared_from_this(), ex, 0});
+    }
+
+    std::size_t size() const
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      return live_;
+    }
+
+  private:
+    struct request_op
+    {
+      std::shared_ptr<shutdown_member> member;
+      void operator()() { member->request(); }
+    };
+
+    // Signals the next batch of members, then posts itself for the rest.
+    struct batch_op
+    {
+      std::shared_ptr<shutdown_state> state;
+      net::any_io_executor ex;
+      std::size_t next;
+
+      void operator()()
+      {
+        auto& pending = state->pending_;
+        const std::size_t end = std::min(pending.size(),
+                                         next + state->batch_size_);
+        for (; next < end; ++next)
+        {
+          std::shared_ptr<shutdown_member> member = std::move(pending[next]);
+          auto member_ex = member->ex_;
+          boost::asio::dispatch(member_ex, request_op{std::move(member)});
+        }
+        if (next < pending.size())
+        {
+          auto e = ex;
+          boost::asio::post(e, std::move(*this));
+        }
+        else
+        {
+          pending.clear();
+          pending.shrink_to_fit();
+        }
+      }
+    };
+
+    const net::any_io_executor ex_;
+    mutable std::mutex mutex_;
+    const std::size_t batch_size_;
+    std::size_t live_ = 0;
+    bool stopped_ = false;
+    std::list<std::shared_ptr<shutdown_member>> members_;
+    std::vector<std::unique_ptr<shutdown_waiter>> waiters_;
+    // only touched by the chain of batch_ops once stopped_ is set
+    std::vector<std::shared_ptr<shutdown_member>> pending_;
+  };
+
+  inline shutdown_slot::~shutdown_slot()
+  {
+    if (state_)
+      state_->release();
+  }
+
+  template <typename Function>
+  template <typename Handler>
+  void shutdown_function<Function>::operator()(basic_yield_context<Handler> yield)
+  {
+    // release the slot when the function returns, rather than when
+    // spawn_data is destroyed
+    shutdown_slot slot = std::move(slot_);
+
+    auto member = std::make_shared<shutdown_member>(
+        net::any_io_executor(net::get_associated_executor(yield.handler_)));
+    slot.state().add(member);
+
+    struct member_guard
+    {
+      shutdown_state& state;
+      shutdown_member& member;
+      ~member_guard() { state.remove(member); }
+    } guard{slot.state(), *member};
+
+    shutdown_signal signal(*member);
+    function_(yield, signal);
+  }
+
+} // namespace detail
+
+inline bool shutdown_signal::requested() const
+{
+  return member_.requested();
+}
+
+inline void shutdown_signal::on_shutdown(std::function<void()> hook)
+{
+  member_.on_shutdown(std::move(hook));
+}
+
+inline shutdown_group::shutdown_group(const executor_type& ex,
+                                      std::size_t batch_size)
+  : state_(std::make_shared<detail::shutdown_state>(ex, batch_size))
+{
+}
+
+template <typename Target, typename Function, typename StackAllocator>
+auto shutdown_group::spawn(Target&& target, Function&& function,
+                           StackAllocator&& salloc)
+  -> typename std::enable_if<detail::is_stack_allocator<
+       typename std::decay<StackAllocator>::type>::value>::type
+{
+  using function_type = typename std::decay<Function>::type;
+  spawn::spawn(std::forward<Target>(target),
+      detail::shutdown_function<function_type>{
+        state_->acquire(), std::forward<Function>(function)},
+      std::forward<StackAllocator>(salloc));
+}
+
+template <typename CompletionToken>
+auto shutdown_group::async_shutdown(CompletionToken&& token)
+  -> BOOST_ASIO_INITFN_RESULT_TYPE(CompletionToken, void())
+{
+  boost::asio::async_completion<CompletionToken, void()> init(token);
+  state_->shutdown(std::move(init.completion_handler));
+  return init.result.get();
+}
+
+inline std::size_t shutdown_group::size() const
+{
+  return state_->size();
+}
+
+inline shutdown_group::executor_type shutdown_group::get_executor() const
+{
+  return state_->get_executor();
+}
+
+} // namespace spawn
@@ -13,256 +13,588 @@
 #pragma once
 
 #include <atomic>
+#include <chrono>
 #include <memory>
 #include <tuple>
 
+#include <boost/asio/post.hpp>
 #include <boost/system/system_error.hpp>
 #include <boost/context/continuation.hpp>
 #include <boost/optional.hpp>
 
+#include <spawn/detail/adaptive_spin.hpp>
+#include <spawn/detail/coroutine_locals.hpp>
+#include <spawn/detail/fast_context.hpp>
+#include <spawn/detail/hibernation.hpp>
 #include <spawn/detail/net.hpp>
 #include <spawn/detail/is_stack_allocator.hpp>
+#include <spawn/detail/probes.hpp>
+#include <spawn/detail/trace.hpp>
+#include <spawn/result.hpp>
+#if defined(SPAWN_LATENCY_HISTOGRAMS)
+#include <spawn/latency.hpp>
+#endif
+
+#if !defined(SPAWN_IMMEDIATE_COMPLETION_LIMIT)
+#define SPAWN_IMMEDIATE_COMPLETION_LIMIT 64
+#endif
 
 namespace spawn {
 namespace detail {
 
+#if defined(SPAWN_HAS_FAST_CONTEXT_SWITCH)
+  using fast_context::continuation;
+  using fast_context::callcc;
+#else
+  using boost::context::continuation;
+  using boost::context::callcc;
+#endif
+
   class continuation_context
   {
   public:
-    boost::context::continuation context_;
+    continuation context_;
     std::exception_ptr eptr_;
+    // operations completed in a row by complete_immediately()
+    unsigned immediate_completions_ = 0;
+    // reused by the coroutine's asynchronous operations
+    operation_slot slot_;
+    // the values of its coroutine_locals
+    coroutine_locals locals_;
+    // the completion latencies of operations started with adaptive_spin()
+    adaptive_spin spin_;
+    // set while the coroutine runs on a stack from a hibernating_stack
+    hibernation_record* stack_ = nullptr;
+    // see begin_switch()
+    enum : int { idle, switching, resume_requested };
+    std::atomic<int> handoff_{idle};
+#if defined(SPAWN_HAS_PROBES) || defined(SPAWN_PROFILER) || defined(SPAWN_TRACING)
+    // the arguments of its tracepoints, see detail/probes.hpp
+    const char* label_ = nullptr;
+    std::size_t stack_size_ = 0;
+#endif
+#if defined(SPAWN_PROFILER)
+    // the highest address of its stack, which bounds the profiler's walk
+    const void* stack_top_ = nullptr;
+#endif
+
+    continuation_context() = default;
+
+    ~continuation_context()
+    {
+      // a hibernated stack must be restored before it can be unwound. do
+      // that here, while the allocator can still reach stack_
+      wake_stack();
+      context_ = continuation();
+    }
 
     void resume()
     {
-      context_ = context_.resume();
+      // if the coroutine is still switching away, leave it to that thread
+      int expected = switching;
+      if (handoff_.compare_exchange_strong(expected, resume_requested,
+                                           std::memory_order_acq_rel))
+        return;
+      do
+      {
+        wake_stack();
+        // track the running coroutine for coroutine_local. when a coroutine
+        // suspends, this marks its caller as current for the moment before
+        // the switch, and the thread that resumes it later sets it back
+        continuation_context* prev = exchange_current_continuation(this);
+        context_ = context_.resume();
+        exchange_current_continuation(prev);
+        sleep_stack();
+      }
+      while (finish_switch());
 
       if (eptr_)
         std::rethrow_exception(std::move(eptr_));
     }
+
+    // A handler on another thread may complete the coroutine's operation
+    // and resume it while it is still switching away, before context_ holds
+    // its continuation. So the coroutine calls begin_switch() before the
+    // decrement that lets a handler resume it, and cancel_switch() if that
+    // turns out to be the last one. The thread that it switches back to
+    // calls finish_switch(), and resumes it again if a handler asked to.
+    void begin_switch() noexcept
+    {
+      handoff_.store(switching, std::memory_order_relaxed);
+    }
+
+    void cancel_switch() noexcept
+    {
+      handoff_.store(idle, std::memory_order_relaxed);
+    }
+
+    bool finish_switch() noexcept
+    {
+      int expected = switching;
+      if (handoff_.compare_exchange_strong(expected, idle,
+                                           std::memory_order_acq_rel))
+        return false;
+      if (expected == idle)
+        return false; // the coroutine finished
+      handoff_.store(idle, std::memory_order_relaxed);
+      return true;
+    }
+
+    // Restore the coroutine's stack if it hibernated while suspended.
+    void wake_stack() noexcept
+    {
+      if (stack_ && context_)
+        stack_->wake();
+    }
+
+    // Mark the stack as suspended once the coroutine has switched away.
+    void sleep_stack() noexcept
+    {
+      if (stack_ && context_)
+        stack_->sleep(continuation_stack_pointer(context_),
+                      std::chrono::steady_clock::now().time_since_epoch().count());
+    }
   };
 
-  template <typename Handler, typename ...Ts>
-  class coro_handler
+  template <typename Handler>
+  class coro_handler_base
   {
   public:
-    coro_handler(basic_yield_context<Handler> ctx)
+    coro_handler_base(basic_yield_context<Handler> ctx)
       : callee_(ctx.callee_.lock()),
         caller_(ctx.caller_),
         handler_(ctx.handler_),
         ready_(0),
         ec_(ctx.ec_),
-        value_(0)
+        immediate_(false),
+        slot_(callee_ ? &callee_->slot_ : nullptr),
+        spin_(ctx.spin_ && callee_ &&
+              may_spin(net::get_associated_executor(handler_))
+            ? &callee_->spin_ : nullptr)
+#if defined(SPAWN_LATENCY_HISTOGRAMS) || defined(SPAWN_HAS_PROBES) || \
+    defined(SPAWN_TRACING)
+        , tag_(ctx.tag_)
+#endif
+#if defined(SPAWN_LATENCY_HISTOGRAMS)
+        , probe_(0)
+#endif
     {
     }
 
-    void operator()(Ts... values)
+    // Called before the handler writes its results into the coroutine's
+    // stack, in case the stack hibernated while the coroutine waited.
+    void wake()
     {
-      *ec_ = boost::system::error_code();
-      *value_ = std::forward_as_tuple(std::move(values)...);
-      if (--*ready_ == 0)
-        callee_->resume();
+      callee_->wake_stack();
     }
 
-    void operator()(boost::system::error_code ec, Ts... values)
+    // Resume the coroutine if it has already suspended in get().
+    void complete()
     {
-      *ec_ = ec;
-      *value_ = std::forward_as_tuple(std::move(values)...);
+#if defined(SPAWN_LATENCY_HISTOGRAMS)
+      probe_->completed();
+#endif
+      if (immediate_)
+      {
+        complete_immediately();
+        return;
+      }
+      callee_->immediate_completions_ = 0;
       if (--*ready_ == 0)
         callee_->resume();
     }
 
+    struct resume_op
+    {
+      std::shared_ptr<continuation_context> callee_;
+      std::atomic<long>* ready_;
+
+      void operator()()
+      {
+        callee_->wake_stack();
+        if (--*ready_ == 0)
+          callee_->resume();
+      }
+    };
+
+    // Called from the initiating function. Leave the count for get() to
+    // finish, so that it returns without suspending. If the coroutine has
+    // already suspended, or has completed too many operations in a row this
+    // way, post the completion instead so that it yields to the executor.
+    void complete_immediately()
+    {
+      long expected = 2;
+      if (callee_->immediate_completions_ < SPAWN_IMMEDIATE_COMPLETION_LIMIT &&
+          ready_->compare_exchange_strong(expected, 1))
+      {
+        ++callee_->immediate_completions_;
+        return;
+      }
+      callee_->immediate_completions_ = 0;
+      auto ex = net::get_associated_executor(handler_);
+      boost::asio::post(ex, resume_op{std::move(callee_), ready_});
+    }
+
   //private:
     std::shared_ptr<continuation_context> callee_;
     continuation_context& caller_;
     Handler handler_;
     std::atomic<long>* ready_;
     boost::system::error_code* ec_;
+    bool immediate_;
+    // a raw pointer, so that a moved-from handler still deallocates into
+    // the slot that its allocator allocated from
+    operation_slot* slot_;
+    // set if the coroutine may spin on this operation's completion
+    adaptive_spin* spin_;
+#if defined(SPAWN_LATENCY_HISTOGRAMS) || defined(SPAWN_HAS_PROBES) || \
+    defined(SPAWN_TRACING)
+    const char* tag_;
+#endif
+#if defined(SPAWN_LATENCY_HISTOGRAMS)
+    latency_probe* probe_;
+#endif
+  };
+
+  template <typename Handler, typename ...Ts>
+  class coro_handler : public coro_handler_base<Handler>
+  {
+  public:
+    coro_handler(basic_yield_context<Handler> ctx)
+      : coro_handler_base<Handler>(ctx),
+        value_(0)
+    {
+    }
+
+    coro_handler(as_result_t<Handler> token)
+      : coro_handler(token.yield_)
+    {
+    }
+
+    void operator()(Ts... values)
+    {
+      this->wake();
+      *this->ec_ = boost::system::error_code();
+      *value_ = std::forward_as_tuple(std::move(values)...);
+      this->complete();
+    }
+
+    void operator()(boost::system::error_code ec, Ts... values)
+    {
+      this->wake();
+      *this->ec_ = ec;
+      *value_ = std::forward_as_tuple(std::move(values)...);
+      this->complete();
+    }
+
+  //private:
     boost::optional<std::tuple<Ts...>>* value_;
   };
 
   template <typename Handler, typename T>
-  class coro_handler<Handler, T>
+  class coro_handler<Handler, T> : public coro_handler_base<Handler>
   {
   public:
     coro_handler(basic_yield_context<Handler> ctx)
-      : callee_(ctx.callee_.lock()),
-        caller_(ctx.caller_),
-        handler_(ctx.handler_),
-        ready_(0),
-        ec_(ctx.ec_),
+      : coro_handler_base<Handler>(ctx),
         value_(0)
     {
     }
 
+    coro_handler(as_result_t<Handler> token)
+      : coro_handler(token.yield_)
+    {
+    }
+
     void operator()(T value)
     {
-      *ec_ = boost::system::error_code();
+      this->wake();
+      *this->ec_ = boost::system::error_code();
       *value_ = std::move(value);
-      if (--*ready_ == 0)
-        callee_->resume();
+      this->complete();
     }
 
     void operator()(boost::system::error_code ec, T value)
     {
-      *ec_ = ec;
+      this->wake();
+      *this->ec_ = ec;
       *value_ = std::move(value);
-      if (--*ready_ == 0)
-        callee_->resume();
+      this->complete();
     }
 
   //private:
-    std::shared_ptr<continuation_context> callee_;
-    continuation_context& caller_;
-    Handler handler_;
-    std::atomic<long>* ready_;
-    boost::system::error_code* ec_;
     boost::optional<T>* value_;
   };
 
   template <typename Handler>
-  class coro_handler<Handler, void>
+  class coro_handler<Handler, void> : public coro_handler_base<Handler>
   {
   public:
     coro_handler(basic_yield_context<Handler> ctx)
-      : callee_(ctx.callee_.lock()),
-        caller_(ctx.caller_),
-        handler_(ctx.handler_),
-        ready_(0),
-        ec_(ctx.ec_)
+      : coro_handler_base<Handler>(ctx)
+    {
+    }
+
+    coro_handler(as_result_t<Handler> token)
+      : coro_handler(token.yield_)
     {
     }
 
     void operator()()
     {
-      *ec_ = boost::system::error_code();
-      if (--*ready_ == 0)
-        callee_->resume();
+      this->wake();
+      *this->ec_ = boost::system::error_code();
+      this->complete();
     }
 
     void operator()(boost::system::error_code ec)
     {
-      *ec_ = ec;
-      if (--*ready_ == 0)
-        callee_->resume();
+      this->wake();
+      *this->ec_ = ec;
+      this->complete();
     }
-
-  //private:
-    std::shared_ptr<continuation_context> callee_;
-    continuation_context& caller_;
-    Handler handler_;
-    std::atomic<long>* ready_;
-    boost::system::error_code* ec_;
   };
 
-  template <typename Handler, typename ...Ts>
-  class coro_async_result
+  template <typename Handler>
+  class coro_async_result_base
   {
   public:
-    using completion_handler_type = coro_handler<Handler, Ts...>;
-    using return_type = std::tuple<Ts...>;
-
-    explicit coro_async_result(completion_handler_type& h)
+    // With return_error, errors are left for the caller to read with
+    // error() instead of being thrown or written to the yield[ec] target.
+    template <typename Signature>
+    coro_async_result_base(coro_handler_base<Handler>& h, Signature*,
+                           bool return_error = false)
       : handler_(h),
+        self_(h.callee_.get()),
         caller_(h.caller_),
-        ready_(2)
+        ready_(2),
+        spin_(h.spin_)
+#if defined(SPAWN_LATENCY_HISTOGRAMS)
+        , probe_(h.tag_, typeid(Signature))
+#endif
+#if defined(SPAWN_HAS_PROBES) || defined(SPAWN_TRACING)
+        , tag_(h.tag_)
+#endif
+#if defined(SPAWN_TRACING)
+        , signature_(probe_label<Signature>())
+#endif
     {
       h.ready_ = &ready_;
-      out_ec_ = h.ec_;
-      if (!out_ec_) h.ec_ = &ec_;
-      h.value_ = &value_;
+      if (return_error)
+      {
+        out_ec_ = h.ec_ = &ec_;
+      }
+      else
+      {
+        out_ec_ = h.ec_;
+        if (!out_ec_) h.ec_ = &ec_;
+      }
+#if defined(SPAWN_LATENCY_HISTOGRAMS)
+      h.probe_ = &probe_;
+#endif
     }
 
-    return_type get()
+    // Suspend until the handler is invoked, then throw its error unless the
+    // caller asked for it with yield[ec].
+    void suspend()
     {
       // Must not hold shared_ptr while suspended.
       handler_.callee_.reset();
 
+      adaptive_spin::clock::time_point start;
+      if (spin_ && ready_.load(std::memory_order_relaxed) != 2)
+        spin_ = nullptr; // completed immediately
+      if (spin_)
+      {
+        start = adaptive_spin::clock::now();
+        // the handler leaves ready_ at 1 if it runs while this spins
+        if (spin_->spin(start, [this] {
+              return ready_.load(std::memory_order_acquire) != 2;
+            }))
+        {
+          spin_->record(adaptive_spin::since(start));
+          spin_ = nullptr;
+        }
+      }
+      self_->begin_switch();
       if (--ready_ != 0)
+      {
+        SPAWN_PROBE_TAG(suspend, self_, tag_);
+        SPAWN_TRACE_SUSPEND(self_, tag_, signature_);
         caller_.resume(); // suspend caller
+        SPAWN_PROBE_TAG(resume, self_, tag_);
+        SPAWN_TRACE(resume, self_);
+      }
+      else
+      {
+        self_->cancel_switch();
+      }
+      if (spin_)
+        spin_->record(adaptive_spin::since(start));
+#if defined(SPAWN_LATENCY_HISTOGRAMS)
+      probe_.resumed();
+#endif
       if (!out_ec_ && ec_) throw boost::system::system_error(ec_);
-      return std::move(*value_);
+    }
+
+    const boost::system::error_code& error() const
+    {
+      return ec_;
     }
 
   private:
-    completion_handler_type& handler_;
+    coro_handler_base<Handler>& handler_;
+    // the handler may have been moved from by the time it suspends
+    continuation_context* self_;
     continuation_context& caller_;
     std::atomic<long> ready_;
+    adaptive_spin* spin_;
     boost::system::error_code* out_ec_;
     boost::system::error_code ec_;
+#if defined(SPAWN_LATENCY_HISTOGRAMS)
+    latency_probe probe_;
+#endif
+#if defined(SPAWN_HAS_PROBES) || defined(SPAWN_TRACING)
+    const char* tag_;
+#endif
+#if defined(SPAWN_TRACING)
+    const char* signature_;
+#endif
+  };
+
+  template <typename Handler, typename ...Ts>
+  class coro_async_result : public coro_async_result_base<Handler>
+  {
+  public:
+    using completion_handler_type = coro_handler<Handler, Ts...>;
+    using return_type = std::tuple<Ts...>;
+
+    explicit coro_async_result(completion_handler_type& h)
+      : coro_async_result_base<Handler>(h,
+          static_cast<void(*)(Ts...)>(nullptr))
+    {
+      h.value_ = &value_;
+    }
+
+    return_type get()
+    {
+      this->suspend();
+      return std::move(*value_);
+    }
+
+  private:
     boost::optional<return_type> value_;
   };
 
   template <typename Handler, typename T>
-  class coro_async_result<Handler, T>
+  class coro_async_result<Handler, T> : public coro_async_result_base<Handler>
   {
   public:
     using completion_handler_type = coro_handler<Handler, T>;
     using return_type = T;
 
     explicit coro_async_result(completion_handler_type& h)
-      : handler_(h),
-        caller_(h.caller_),
-        ready_(2)
+      : coro_async_result_base<Handler>(h,
+          static_cast<void(*)(T)>(nullptr))
     {
-      h.ready_ = &ready_;
-      out_ec_ = h.ec_;
-      if (!out_ec_) h.ec_ = &ec_;
       h.value_ = &value_;
     }
 
     return_type get()
     {
-      // Must not hold shared_ptr while suspended.
-      handler_.callee_.reset();
-
-      if (--ready_ != 0)
-        caller_.resume(); // suspend caller
-      if (!out_ec_ && ec_) throw boost::system::system_error(ec_);
+      this->suspend();
       return std::move(*value_);
     }
 
   private:
-    completion_handler_type& handler_;
-    continuation_context& caller_;
-    std::atomic<long> ready_;
-    boost::system::error_code* out_ec_;
-    boost::system::error_code ec_;
     boost::optional<return_type> value_;
   };
 
   template <typename Handler>
-  class coro_async_result<Handler, void>
+  class coro_async_result<Handler, void> : public coro_async_result_base<Handler>
   {
   public:
     using completion_handler_type = coro_handler<Handler, void>;
     using return_type = void;
 
     explicit coro_async_result(completion_handler_type& h)
-      : handler_(h),
-        caller_(h.caller_),
-        ready_(2)
+      : coro_async_result_base<Handler>(h,
+          static_cast<void(*)()>(nullptr))
     {
-      h.ready_ = &ready_;
-      out_ec_ = h.ec_;
-      if (!out_ec_) h.ec_ = &ec_;
     }
 
     void get()
     {
-      // Must not hold shared_ptr while suspended.
-      handler_.callee_.reset();
+      this->suspend();
+    }
+  };
 
-      if (--ready_ != 0)
-        caller_.resume(); // suspend caller
-      if (!out_ec_ && ec_) throw boost::system::system_error(ec_);
+  template <typename Handler, typename ...Ts>
+  class coro_result_async_result : public coro_async_result_base<Handler>
+  {
+  public:
+    using completion_handler_type = coro_handler<Handler, Ts...>;
+    using return_type = result<std::tuple<Ts...>>;
+
+    explicit coro_result_async_result(completion_handler_type& h)
+      : coro_async_result_base<Handler>(h,
+          static_cast<void(*)(Ts...)>(nullptr), true)
+    {
+      h.value_ = &value_;
+    }
+
+    return_type get()
+    {
+      this->suspend();
+      return return_type(this->error(), std::move(*value_));
     }
 
   private:
-    completion_handler_type& handler_;
-    continuation_context& caller_;
-    std::atomic<long> ready_;
-    boost::system::error_code* out_ec_;
-    boost::system::error_code ec_;
+    boost::optional<std::tuple<Ts...>> value_;
+  };
+
+  template <typename Handler, typename T>
+  class coro_result_async_result<Handler, T> : public coro_async_result_base<Handler>
+  {
+  public:
+    using completion_handler_type = coro_handler<Handler, T>;
+    using return_type = result<T>;
+
+    explicit coro_result_async_result(completion_handler_type& h)
+      : coro_async_result_base<Handler>(h,
+          static_cast<void(*)(T)>(nullptr), true)
+    {
+      h.value_ = &value_;
+    }
+
+    return_type get()
+    {
+      this->suspend();
+      return return_type(this->error(), std::move(*value_));
+    }
+
+  private:
+    boost::optional<T> value_;
+  };
+
+  template <typename Handler>
+  class coro_result_async_result<Handler, void> : public coro_async_result_base<Handler>
+  {
+  public:
+    using completion_handler_type = coro_handler<Handler, void>;
+    using return_type = result<void>;
+
+    explicit coro_result_async_result(completion_handler_type& h)
+      : coro_async_result_base<Handler>(h,
+          static_cast<void(*)()>(nullptr), true)
+    {
+    }
+
+    return_type get()
+    {
+      this->suspend();
+      return return_type(this->error());
+    }
   };
 
 } // namespace detail
@@ -324,15 +656,104 @@ public:
   }
 };
 
+template <typename Handler, typename ReturnType>
+class SPAWN_NET_NAMESPACE::async_result<spawn::as_result_t<Handler>, ReturnType()>
+  : public spawn::detail::coro_result_async_result<Handler, void>
+{
+public:
+  explicit async_result(
+    typename spawn::detail::coro_result_async_result<Handler,
+      void>::completion_handler_type& h)
+    : spawn::detail::coro_result_async_result<Handler, void>(h)
+  {
+  }
+};
+
+template <typename Handler, typename ReturnType, typename ...Args>
+class SPAWN_NET_NAMESPACE::async_result<spawn::as_result_t<Handler>, ReturnType(Args...)>
+  : public spawn::detail::coro_result_async_result<Handler, typename std::decay<Args>::type...>
+{
+public:
+  explicit async_result(
+    typename spawn::detail::coro_result_async_result<Handler,
+      typename std::decay<Args>::type...>::completion_handler_type& h)
+    : spawn::detail::coro_result_async_result<Handler, typename std::decay<Args>::type...>(h)
+  {
+  }
+};
+
+template <typename Handler, typename ReturnType>
+class SPAWN_NET_NAMESPACE::async_result<spawn::as_result_t<Handler>,
+    ReturnType(boost::system::error_code)>
+  : public spawn::detail::coro_result_async_result<Handler, void>
+{
+public:
+  explicit async_result(
+    typename spawn::detail::coro_result_async_result<Handler,
+      void>::completion_handler_type& h)
+    : spawn::detail::coro_result_async_result<Handler, void>(h)
+  {
+  }
+};
+
+template <typename Handler, typename ReturnType, typename ...Args>
+class SPAWN_NET_NAMESPACE::async_result<spawn::as_result_t<Handler>,
+    ReturnType(boost::system::error_code, Args...)>
+  : public spawn::detail::coro_result_async_result<Handler, typename std::decay<Args>::type...>
+{
+public:
+  explicit async_result(
+    typename spawn::detail::coro_result_async_result<Handler,
+      typename std::decay<Args>::type...>::completion_handler_type& h)
+    : spawn::detail::coro_result_async_result<Handler, typename std::decay<Args>::type...>(h)
+  {
+  }
+};
+
+namespace spawn {
+namespace detail {
+
+  // Operations started from a coroutine allocate from its operation_slot,
+  // unless the coroutine's handler brings its own allocator. Not from its
+  // arena, which would grow by one operation state per call and never
+  // shrink for as long as the coroutine runs.
+  template <typename Handler, typename Allocator,
+            bool UseArena = std::is_same<
+              net::associated_allocator_t<Handler, Allocator>,
+              std::allocator<void>>::value>
+  struct coro_handler_allocator
+  {
+    using type = arena_allocator<void>;
+
+    static type get(const coro_handler_base<Handler>& h, const Allocator&)
+    {
+      return type(nullptr, h.slot_);
+    }
+  };
+
+  template <typename Handler, typename Allocator>
+  struct coro_handler_allocator<Handler, Allocator, false>
+  {
+    using type = net::associated_allocator_t<Handler, Allocator>;
+
+    static type get(const coro_handler_base<Handler>& h, const Allocator& a)
+    {
+      return net::get_associated_allocator(h.handler_, a);
+    }
+  };
+
+} // namespace detail
+} // namespace spawn
+
 template <typename Handler, typename Allocator, typename ...Ts>
 struct SPAWN_NET_NAMESPACE::associated_allocator<spawn::detail::coro_handler<Handler, Ts...>, Allocator>
 {
-  using type = associated_allocator_t<Handler, Allocator>;
+  using type = typename spawn::detail::coro_handler_allocator<Handler, Allocator>::type;
 
   static type get(const spawn::detail::coro_handler<Handler, Ts...>& h,
       const Allocator& a = Allocator()) noexcept
   {
-    return associated_allocator<Handler, Allocator>::get(h.handler_, a);
+    return spawn::detail::coro_handler_allocator<Handler, Allocator>::get(h, a);
   }
 };
 
@@ -351,6 +772,54 @@ struct SPAWN_NET_NAMESPACE::associated_executor<spawn::detail::coro_handler<Hand
 namespace spawn {
 namespace detail {
 
+#if defined(SPAWN_HAS_PROBES) || defined(SPAWN_PROFILER)
+  // Records the size of the coroutine's stack and fires spawn:create once it
+  // has been allocated.
+  template <typename StackAllocator>
+  class probe_stack_allocator
+  {
+  public:
+    probe_stack_allocator(StackAllocator&& salloc, continuation_context& ctx)
+      : salloc_(std::move(salloc)), ctx_(&ctx)
+    {
+    }
+
+    boost::context::stack_context allocate()
+    {
+      boost::context::stack_context sctx = salloc_.allocate();
+      ctx_->stack_size_ = sctx.size;
+#if defined(SPAWN_PROFILER)
+      ctx_->stack_top_ = sctx.sp;
+#endif
+      SPAWN_PROBE(create, ctx_);
+      return sctx;
+    }
+
+    void deallocate(boost::context::stack_context& sctx) noexcept
+    {
+      salloc_.deallocate(sctx);
+    }
+
+  private:
+    StackAllocator salloc_;
+    continuation_context* ctx_;
+  };
+
+  template <typename StackAllocator>
+  probe_stack_allocator<typename std::decay<StackAllocator>::type>
+  probe_stack(StackAllocator&& salloc, continuation_context& ctx)
+  {
+    using type = typename std::decay<StackAllocator>::type;
+    return probe_stack_allocator<type>(type(std::forward<StackAllocator>(salloc)), ctx);
+  }
+#else
+  template <typename StackAllocator>
+  StackAllocator&& probe_stack(StackAllocator&& salloc, continuation_context&) noexcept
+  {
+    return std::forward<StackAllocator>(salloc);
+  }
+#endif
+
   template <typename Handler, typename Function, typename StackAllocator>
   struct spawn_data
   {
@@ -378,10 +847,19 @@ namespace detail {
     void operator()()
     {
       callee_.reset(new continuation_context());
-      callee_->context_ = boost::context::callcc(
-          std::allocator_arg, std::move(data_->salloc_),
-          [this] (boost::context::continuation&& c)
+#if defined(SPAWN_HAS_PROBES) || defined(SPAWN_PROFILER) || defined(SPAWN_TRACING)
+      callee_->label_ = probe_label<Function>();
+#endif
+      SPAWN_TRACE(spawn, callee_.get());
+      const current_continuation_guard current(callee_.get());
+      callee_->context_ = detail::callcc(
+          std::allocator_arg,
+          probe_stack(bind_stack_allocator(std::move(data_->salloc_), *callee_, 0),
+                      *callee_),
+          [this] (continuation&& c)
           {
+            SPAWN_PROBE(start, callee_.get());
+            SPAWN_TRACE(resume, callee_.get());
             std::shared_ptr<spawn_data<Handler, Function, StackAllocator> > data = data_;
             data->caller_.context_ = std::move(c);
             const basic_yield_context<Handler> yh(callee_, data->caller_, data->handler_);
@@ -401,13 +879,26 @@ namespace detail {
             {
               auto callee = yh.callee_.lock();
               if (callee)
+              {
+                SPAWN_PROBE(exception, callee.get());
                 callee->eptr_ = std::current_exception();
+              }
+            }
+            // coroutine_locals die with the coroutine, on its own stack
+            if (auto callee = yh.callee_.lock())
+            {
+              callee->locals_.clear();
+              SPAWN_PROBE(finish, callee.get());
+              SPAWN_TRACE(finish, callee.get());
             }
-            boost::context::continuation caller = std::move(data->caller_.context_);
+            continuation caller = std::move(data->caller_.context_);
             data.reset();
             return caller;
           });
-      if (callee_->eptr_)
+      callee_->sleep_stack();
+      if (callee_->finish_switch())
+        callee_->resume();
+      else if (callee_->eptr_)
         std::rethrow_exception(std::move(callee_->eptr_));
     }
 
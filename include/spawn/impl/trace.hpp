@@ -0,0 +1,201 @@
+//
+// impl/trace.hpp
+// ~~~~~~~~~~~~~~
+//
+// Copyright (c) 2019 Casey Bodley (cbodley at redhat dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#pragma once
+
+#include <algorithm>
+#include <cstdio>
+#include <map>
+#include <string>
+#include <thread>
+
+#include <boost/core/demangle.hpp>
+
+namespace spawn {
+namespace detail {
+
+  struct trace_copy
+  {
+    std::uint64_t time;
+    const void* coroutine;
+    const char* label;
+    const char* detail;
+    trace_type type;
+  };
+
+  // Copy the events that are still in the buffer, dropping any that its
+  // thread may have overwritten during the copy.
+  inline std::vector<trace_copy> copy_trace(const trace_buffer& b)
+  {
+    constexpr std::uint64_t capacity = trace_buffer::capacity;
+    const std::uint64_t head = b.head.load(std::memory_order_acquire);
+    std::uint64_t first = head > capacity ? head - capacity : 0;
+    first = std::max(first, b.tail.load(std::memory_order_relaxed));
+
+    std::vector<trace_copy> events;
+    events.reserve(head > first ? head - first : 0);
+    for (std::uint64_t i = first; i < head; i++)
+    {
+      const trace_event& e = b.events[i & (capacity - 1)];
+      events.push_back(trace_copy{
+          e.time.load(std::memory_order_relaxed),
+          e.coroutine.load(std::memory_order_relaxed),
+          e.label.load(std::memory_order_relaxed),
+          e.detail.load(std::memory_order_relaxed),
+          e.type.load(std::memory_order_relaxed)});
+    }
+
+    // the thread writes the event at index 'now' before publishing it, so
+    // the slot of now - capacity may have been changing during the copy
+    std::atomic_thread_fence(std::memory_order_acquire);
+    const std::uint64_t now = b.head.load(std::memory_order_relaxed);
+    const std::uint64_t valid = now >= capacity ? now - capacity + 1 : 0;
+    if (valid > first)
+      events.erase(events.begin(), events.begin() +
+                   std::min<std::uint64_t>(valid - first, events.size()));
+    return events;
+  }
+
+  inline void write_json_string(std::ostream& out, const std::string& s)
+  {
+    out << '"';
+    for (char c : s)
+    {
+      if (c == '"' || c == '\\')
+        out << '\\' << c;
+      else if (static_cast<unsigned char>(c) < 0x20)
+        out << ' ';
+      else
+        out << c;
+    }
+    out << '"';
+  }
+
+  // Return the length of a trace_clock() tick in nanoseconds.
+  inline double trace_tick_ns(const trace_registry& registry)
+  {
+#if defined(__x86_64__) || defined(__i386__)
+    using clock = std::chrono::steady_clock;
+    // a short interval would make for a poor estimate
+    const auto minimum = std::chrono::milliseconds(10);
+    if (clock::now() - registry.base_time < minimum)
+      std::this_thread::sleep_until(registry.base_time + minimum);
+    const std::uint64_t ticks = trace_clock() - registry.base_ticks;
+    const auto elapsed = clock::now() - registry.base_time;
+    const double ns = std::chrono::duration<double, std::nano>(elapsed).count();
+    return ticks ? ns / ticks : 1.0;
+#else
+    (void)registry;
+    return 1.0;
+#endif
+  }
+
+} // namespace detail
+
+inline void write_chrome_trace(std::ostream& out)
+{
+  auto& registry = detail::trace_registry::instance();
+  const double tick_ns = detail::trace_tick_ns(registry);
+
+  std::map<const char*, std::string> names;
+  auto name = [&names] (const char* mangled, const char* fallback) {
+    if (!mangled)
+      return std::string(fallback);
+    auto i = names.find(mangled);
+    if (i == names.end())
+      i = names.emplace(mangled, boost::core::demangle(mangled)).first;
+    return i->second;
+  };
+
+  bool first = true;
+  auto begin_event = [&] (const char* ph, unsigned tid, double ts) {
+    char buf[128];
+    std::snprintf(buf, sizeof(buf),
+                  "%s\n{\"ph\":\"%s\",\"pid\":1,\"tid\":%u,\"ts\":%.3f",
+                  first ? "" : ",", ph, tid, ts);
+    first = false;
+    out << buf;
+  };
+  auto coroutine_id = [] (const void* coroutine) {
+    char buf[32];
+    std::snprintf(buf, sizeof(buf), "%p", coroutine);
+    return std::string(buf);
+  };
+
+  out << "{\"traceEvents\":[";
+  registry.for_each([&] (detail::trace_buffer& b) {
+      const std::vector<detail::trace_copy> events = detail::copy_trace(b);
+      if (events.empty())
+        return;
+      char buf[96];
+      std::snprintf(buf, sizeof(buf), "%s\n{\"ph\":\"M\",\"pid\":1,\"tid\":%u,"
+                    "\"name\":\"thread_name\",\"args\":{\"name\":\"thread %u\"}}",
+                    first ? "" : ",", b.tid, b.tid);
+      first = false;
+      out << buf;
+
+      // slices must nest, so skip ends whose beginnings were overwritten
+      unsigned depth = 0;
+      for (auto& e : events)
+      {
+        const double ts = e.time > registry.base_ticks
+            ? (e.time - registry.base_ticks) * tick_ns / 1000.0 : 0.0;
+        switch (e.type)
+        {
+        case detail::trace_type::spawn:
+          begin_event("i", b.tid, ts);
+          out << ",\"s\":\"t\",\"name\":\"spawn\",\"args\":{\"coroutine\":\""
+              << coroutine_id(e.coroutine) << "\",\"function\":";
+          detail::write_json_string(out, name(e.label, "coroutine"));
+          out << "}}";
+          break;
+        case detail::trace_type::resume:
+          ++depth;
+          begin_event("B", b.tid, ts);
+          out << ",\"name\":";
+          detail::write_json_string(out, name(e.label, "coroutine"));
+          out << ",\"args\":{\"coroutine\":\"" << coroutine_id(e.coroutine)
+              << "\"}}";
+          break;
+        case detail::trace_type::suspend:
+        case detail::trace_type::suspend_tagged:
+          if (depth == 0)
+            break;
+          --depth;
+          begin_event("E", b.tid, ts);
+          out << ",\"args\":{\"suspend\":";
+          if (e.type == detail::trace_type::suspend)
+            detail::write_json_string(out, name(e.detail, "unknown"));
+          else
+            detail::write_json_string(out, e.detail);
+          out << "}}";
+          break;
+        case detail::trace_type::finish:
+          if (depth == 0)
+            break;
+          --depth;
+          begin_event("E", b.tid, ts);
+          out << ",\"args\":{\"finish\":true}}";
+          break;
+        }
+      }
+    });
+  out << "\n],\"displayTimeUnit\":\"ns\"}\n";
+}
+
+inline void trace_reset()
+{
+  detail::trace_registry::instance().for_each([] (detail::trace_buffer& b) {
+      b.tail.store(b.head.load(std::memory_order_acquire),
+                   std::memory_order_relaxed);
+    });
+}
+
+} // namespace spawn
@@ -0,0 +1,216 @@
+//
+// impl/virtual_time.hpp
+// ~~~~~~~~~~~~~~~~~~~~~
+//
+// Copyright (c) 2019 Casey Bodley (cbodley at redhat dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#pragma once
+
+#include <algorithm>
+#include <type_traits>
+#include <utility>
+
+#include <boost/asio/associated_executor.hpp>
+#include <boost/asio/error.hpp>
+#include <boost/asio/post.hpp>
+
+namespace spawn {
+namespace detail {
+
+  template <typename Function>
+  struct virtual_function_op : virtual_op
+  {
+    Function function_;
+
+    template <typename F>
+    explicit virtual_function_op(F&& f) : function_(std::forward<F>(f)) {}
+
+    void invoke() override { function_(); }
+  };
+
+  template <typename Handler>
+  struct virtual_wait_binder
+  {
+    Handler handler_;
+    boost::system::error_code ec_;
+
+    void operator()() { handler_(ec_); }
+  };
+
+  template <typename Handler>
+  struct virtual_wait_handler_op : virtual_wait_op
+  {
+    Handler handler_;
+    virtual_time_context::executor_type ex_;
+
+    virtual_wait_handler_op(Handler&& handler,
+                            const virtual_time_context::executor_type& ex)
+      : handler_(std::move(handler)), ex_(ex)
+    {
+    }
+
+    void complete(const boost::system::error_code& ec) override
+    {
+      auto ex = boost::asio::get_associated_executor(handler_, ex_);
+      boost::asio::post(ex, virtual_wait_binder<Handler>{std::move(handler_), ec});
+    }
+  };
+
+} // namespace detail
+
+inline virtual_time_context::virtual_time_context(std::uint64_t seed)
+  : seed_(seed), rng_(seed)
+{
+}
+
+inline virtual_time_context::~virtual_time_context()
+{
+  // handlers may own coroutines, and unwinding a coroutine can submit more
+  // work or cancel timers, so drain the queues until they stay empty
+  shutdown();
+  while (!ready_.empty() || !timers_.empty())
+  {
+    decltype(ready_) ready;
+    decltype(timers_) timers;
+    ready.swap(ready_);
+    timers.swap(timers_);
+  }
+  destroy();
+}
+
+inline auto virtual_time_context::get_executor() noexcept -> executor_type
+{
+  return executor_type(*this);
+}
+
+inline std::size_t virtual_time_context::run()
+{
+  return do_run(time_point::max(), true);
+}
+
+inline std::size_t virtual_time_context::run_until(time_point t)
+{
+  std::size_t count = do_run(t, true);
+  if (!stopped_ && now_ < t)
+    now_ = t;
+  return count;
+}
+
+inline std::size_t virtual_time_context::poll()
+{
+  return do_run(now_, false);
+}
+
+template <typename Function>
+void virtual_time_context::post(Function&& function)
+{
+  using op_type = detail::virtual_function_op<typename std::decay<Function>::type>;
+  ready_.emplace_back(new op_type(std::forward<Function>(function)));
+}
+
+inline std::size_t virtual_time_context::do_run(time_point limit, bool advance)
+{
+  std::size_t count = 0;
+  while (!stopped_)
+  {
+    expire_timers();
+    if (ready_.empty())
+    {
+      if (!advance || timers_.empty())
+        break;
+      const time_point next(timers_.begin()->first.expiry);
+      if (next > limit)
+        break;
+      now_ = next;
+      continue;
+    }
+    std::unique_ptr<detail::virtual_op> op = next_ready();
+    ++count;
+    op->invoke();
+  }
+  return count;
+}
+
+inline void virtual_time_context::expire_timers()
+{
+  while (!timers_.empty() &&
+         time_point(timers_.begin()->first.expiry) <= now_)
+  {
+    auto i = timers_.begin();
+    std::unique_ptr<detail::virtual_wait_op> op = std::move(i->second);
+    auto& pending = op->owner->pending_;
+    pending.erase(std::find_if(pending.begin(), pending.end(),
+        [&i] (const detail::virtual_timer_key& key) {
+          return key.sequence == i->first.sequence;
+        }));
+    timers_.erase(i);
+    op->complete(boost::system::error_code());
+  }
+}
+
+inline std::unique_ptr<detail::virtual_op> virtual_time_context::next_ready()
+{
+  // take the result modulo the size rather than through a distribution,
+  // whose algorithm the standard leaves to the implementation
+  if (seed_ != 0 && ready_.size() > 1)
+    std::swap(ready_.front(), ready_[rng_() % ready_.size()]);
+  std::unique_ptr<detail::virtual_op> op = std::move(ready_.front());
+  ready_.pop_front();
+  return op;
+}
+
+inline void virtual_time_context::schedule(
+    virtual_timer& timer, std::unique_ptr<detail::virtual_wait_op> op)
+{
+  const detail::virtual_timer_key key{timer.expiry_.time_since_epoch(),
+                                      sequence_++};
+  op->owner = &timer;
+  timer.pending_.push_back(key);
+  try
+  {
+    timers_.emplace(key, std::move(op));
+  }
+  catch (...)
+  {
+    timer.pending_.pop_back();
+    throw;
+  }
+}
+
+inline std::size_t virtual_time_context::cancel(virtual_timer& timer)
+{
+  std::vector<detail::virtual_timer_key> pending;
+  pending.swap(timer.pending_);
+  std::size_t count = 0;
+  for (const auto& key : pending)
+  {
+    auto i = timers_.find(key);
+    if (i == timers_.end())
+      continue;
+    std::unique_ptr<detail::virtual_wait_op> op = std::move(i->second);
+    timers_.erase(i);
+    op->complete(boost::asio::error::operation_aborted);
+    ++count;
+  }
+  return count;
+}
+
+template <typename WaitHandler>
+BOOST_ASIO_INITFN_RESULT_TYPE(WaitHandler, void(boost::system::error_code))
+virtual_timer::async_wait(WaitHandler&& handler)
+{
+  boost::asio::async_completion<WaitHandler,
+      void(boost::system::error_code)> init(handler);
+  using handler_type = typename std::decay<
+      decltype(init.completion_handler)>::type;
+  using op_type = detail::virtual_wait_handler_op<handler_type>;
+  ex_.context().schedule(*this, std::unique_ptr<detail::virtual_wait_op>(
+          new op_type(std::move(init.completion_handler), ex_)));
+  return init.result.get();
+}
+
+} // namespace spawn
@@ -0,0 +1,379 @@
+//
+// impl/wait.hpp
+// ~~~~~~~~~~~~~
+//
+// Copyright (c) 2019 Casey Bodley (cbodley at redhat dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#pragma once
+
+#include <atomic>
+#include <limits>
+#include <type_traits>
+
+#include <boost/mp11/integer_sequence.hpp>
+
+namespace spawn {
+namespace detail {
+
+  // The spawn::result type reported for a completion with the given values.
+  template <typename ...Ts>
+  struct values_result { using type = result<std::tuple<Ts...>>; };
+
+  template <typename T>
+  struct values_result<T> { using type = result<T>; };
+
+  template <>
+  struct values_result<void> { using type = result<void>; };
+
+  // Returned by operations started with a basic_wait_token, so that
+  // wait_op_result can recover their completion signature.
+  template <typename ...Ts>
+  struct wait_signature
+  {
+    using result_type = typename values_result<Ts...>::type;
+  };
+
+  template <typename Handler, typename Op>
+  struct wait_op_result
+  {
+    using signature = decltype(std::declval<typename std::decay<Op>::type&>()(
+          std::declval<basic_wait_token<Handler>&>()));
+    static_assert(!std::is_void<signature>::value,
+                  "wait operation must return the result of its initiating function");
+    using type = typename signature::result_type;
+  };
+
+  // Holds the result of one operation. The completion handler and the
+  // resumed coroutine race to claim it, so a late completion from wait_any()
+  // can never write into a slot that the coroutine is reading.
+  template <typename R>
+  class wait_slot
+  {
+    enum { pending, writing, ready, closed };
+    std::atomic<int> state_;
+    boost::optional<R> value_;
+
+  public:
+    wait_slot() : state_(pending) {}
+
+    template <typename ...Args>
+    void set(Args&&... args)
+    {
+      int expected = pending;
+      if (state_.compare_exchange_strong(expected, writing))
+      {
+        value_.emplace(std::forward<Args>(args)...);
+        state_.store(ready, std::memory_order_release);
+      }
+    }
+
+    boost::optional<R> take()
+    {
+      int expected = pending;
+      if (state_.compare_exchange_strong(expected, closed))
+        return boost::none;
+      while (state_.load(std::memory_order_acquire) == writing)
+        ; // the handler is storing its value
+      return std::move(value_);
+    }
+  };
+
+  class wait_state_base
+  {
+  public:
+    static constexpr std::size_t npos = std::numeric_limits<std::size_t>::max();
+
+    wait_state_base(long ready, bool any)
+      : ready_(ready),
+        any_(any),
+        first_(npos)
+    {
+    }
+
+    // Returns true if the calling handler should resume the coroutine.
+    bool complete(std::size_t index)
+    {
+      if (any_)
+      {
+        std::size_t expected = npos;
+        if (!first_.compare_exchange_strong(expected, index))
+          return false;
+      }
+      return --ready_ == 0;
+    }
+
+    // Suspend the coroutine unless the handlers have already finished.
+    template <typename Handler>
+    void suspend(basic_yield_context<Handler>& yield)
+    {
+      continuation_context* self = current_continuation();
+      self->begin_switch();
+      if (--ready_ != 0)
+      {
+        SPAWN_PROBE_TAG(suspend, self, yield.tag_);
+        SPAWN_TRACE_SUSPEND(self, yield.tag_ ? yield.tag_ : "wait", nullptr);
+        yield.caller_.resume(); // suspend caller
+        SPAWN_PROBE_TAG(resume, self, yield.tag_);
+        SPAWN_TRACE(resume, self);
+      }
+      else
+      {
+        self->cancel_switch();
+      }
+    }
+
+    std::size_t first() const
+    {
+      return first_.load();
+    }
+
+  private:
+    std::atomic<long> ready_;
+    const bool any_;
+    std::atomic<std::size_t> first_;
+  };
+
+  template <typename ...Rs>
+  class wait_state : public wait_state_base
+  {
+  public:
+    wait_state(long ready, bool any)
+      : wait_state_base(ready, any)
+    {
+    }
+
+    std::tuple<wait_slot<Rs>...> slots_;
+  };
+
+  template <typename Handler, typename ...Ts>
+  class wait_handler_base
+  {
+  public:
+    wait_handler_base(basic_wait_token<Handler> token)
+      : callee_(token.yield_.callee_.lock()),
+        handler_(token.yield_.handler_),
+        state_(std::move(token.state_)),
+        slot_(static_cast<wait_slot<typename values_result<Ts...>::type>*>(token.slot_)),
+        index_(token.index_)
+    {
+    }
+
+    template <typename ...Args>
+    void complete(Args&&... args)
+    {
+      slot_->set(std::forward<Args>(args)...);
+      if (state_->complete(index_))
+        callee_->resume();
+    }
+
+  //private:
+    std::shared_ptr<continuation_context> callee_;
+    Handler handler_;
+    std::shared_ptr<wait_state_base> state_;
+    wait_slot<typename values_result<Ts...>::type>* slot_;
+    std::size_t index_;
+  };
+
+  template <typename Handler, typename ...Ts>
+  class wait_handler : public wait_handler_base<Handler, Ts...>
+  {
+  public:
+    using wait_handler_base<Handler, Ts...>::wait_handler_base;
+
+    void operator()(Ts... values)
+    {
+      this->complete(boost::system::error_code(),
+                     std::make_tuple(std::move(values)...));
+    }
+
+    void operator()(boost::system::error_code ec, Ts... values)
+    {
+      this->complete(ec, std::make_tuple(std::move(values)...));
+    }
+  };
+
+  template <typename Handler, typename T>
+  class wait_handler<Handler, T> : public wait_handler_base<Handler, T>
+  {
+  public:
+    using wait_handler_base<Handler, T>::wait_handler_base;
+
+    void operator()(T value)
+    {
+      this->complete(boost::system::error_code(), std::move(value));
+    }
+
+    void operator()(boost::system::error_code ec, T value)
+    {
+      this->complete(ec, std::move(value));
+    }
+  };
+
+  template <typename Handler>
+  class wait_handler<Handler, void> : public wait_handler_base<Handler, void>
+  {
+  public:
+    using wait_handler_base<Handler, void>::wait_handler_base;
+
+    void operator()()
+    {
+      this->complete(boost::system::error_code());
+    }
+
+    void operator()(boost::system::error_code ec)
+    {
+      this->complete(ec);
+    }
+  };
+
+  template <typename Handler, typename ...Ts>
+  class wait_async_result
+  {
+  public:
+    using completion_handler_type = wait_handler<Handler, Ts...>;
+    using return_type = wait_signature<Ts...>;
+
+    explicit wait_async_result(completion_handler_type& h)
+      : handler_(h)
+    {
+    }
+
+    return_type get()
+    {
+      // Must not hold shared_ptr while suspended.
+      handler_.callee_.reset();
+      return return_type();
+    }
+
+  private:
+    completion_handler_type& handler_;
+  };
+
+  template <typename Handler, typename ...Ops, std::size_t ...I>
+  void wait_initiate(basic_yield_context<Handler>& yield,
+                     const std::shared_ptr<wait_state<
+                       typename wait_op_result<Handler, Ops>::type...>>& state,
+                     boost::mp11::index_sequence<I...>, Ops&... ops)
+  {
+    const int expand[] = {0, (ops(basic_wait_token<Handler>(
+            yield, state, &std::get<I>(state->slots_), I)), 0)...};
+    (void)expand;
+  }
+
+  template <typename ...Rs, std::size_t ...I>
+  std::tuple<Rs...> wait_take_all(wait_state<Rs...>& state,
+                                  boost::mp11::index_sequence<I...>)
+  {
+    return std::tuple<Rs...>(std::move(*std::get<I>(state.slots_).take())...);
+  }
+
+  template <typename ...Rs, std::size_t ...I>
+  std::tuple<boost::optional<Rs>...> wait_take_any(wait_state<Rs...>& state,
+                                                   boost::mp11::index_sequence<I...>)
+  {
+    return std::tuple<boost::optional<Rs>...>(std::get<I>(state.slots_).take()...);
+  }
+
+} // namespace detail
+
+template <typename Handler, typename ...Ops>
+auto wait_all(basic_yield_context<Handler> yield, Ops&&... ops)
+  -> std::tuple<typename detail::wait_op_result<Handler, Ops>::type...>
+{
+  static_assert(sizeof...(Ops) > 0, "wait_all requires at least one operation");
+  using state_type = detail::wait_state<
+      typename detail::wait_op_result<Handler, Ops>::type...>;
+
+  auto state = std::make_shared<state_type>(sizeof...(Ops) + 1, false);
+  detail::wait_initiate(yield, state,
+                        boost::mp11::index_sequence_for<Ops...>(), ops...);
+  state->suspend(yield);
+  return detail::wait_take_all(*state, boost::mp11::index_sequence_for<Ops...>());
+}
+
+template <typename Handler, typename ...Ops>
+auto wait_any(basic_yield_context<Handler> yield, Ops&&... ops)
+  -> std::pair<std::size_t, std::tuple<boost::optional<
+       typename detail::wait_op_result<Handler, Ops>::type>...>>
+{
+  static_assert(sizeof...(Ops) > 0, "wait_any requires at least one operation");
+  using state_type = detail::wait_state<
+      typename detail::wait_op_result<Handler, Ops>::type...>;
+
+  auto state = std::make_shared<state_type>(2, true);
+  detail::wait_initiate(yield, state,
+                        boost::mp11::index_sequence_for<Ops...>(), ops...);
+  state->suspend(yield);
+  return std::make_pair(state->first(), detail::wait_take_any(*state,
+          boost::mp11::index_sequence_for<Ops...>()));
+}
+
+} // namespace spawn
+
+#if !defined(GENERATING_DOCUMENTATION)
+
+template <typename Handler, typename ReturnType>
+class SPAWN_NET_NAMESPACE::async_result<spawn::basic_wait_token<Handler>, ReturnType()>
+  : public spawn::detail::wait_async_result<Handler, void>
+{
+public:
+  using spawn::detail::wait_async_result<Handler, void>::wait_async_result;
+};
+
+template <typename Handler, typename ReturnType, typename ...Args>
+class SPAWN_NET_NAMESPACE::async_result<spawn::basic_wait_token<Handler>, ReturnType(Args...)>
+  : public spawn::detail::wait_async_result<Handler, typename std::decay<Args>::type...>
+{
+public:
+  using spawn::detail::wait_async_result<Handler,
+      typename std::decay<Args>::type...>::wait_async_result;
+};
+
+template <typename Handler, typename ReturnType>
+class SPAWN_NET_NAMESPACE::async_result<spawn::basic_wait_token<Handler>,
+    ReturnType(boost::system::error_code)>
+  : public spawn::detail::wait_async_result<Handler, void>
+{
+public:
+  using spawn::detail::wait_async_result<Handler, void>::wait_async_result;
+};
+
+template <typename Handler, typename ReturnType, typename ...Args>
+class SPAWN_NET_NAMESPACE::async_result<spawn::basic_wait_token<Handler>,
+    ReturnType(boost::system::error_code, Args...)>
+  : public spawn::detail::wait_async_result<Handler, typename std::decay<Args>::type...>
+{
+public:
+  using spawn::detail::wait_async_result<Handler,
+      typename std::decay<Args>::type...>::wait_async_result;
+};
+
+template <typename Handler, typename Allocator, typename ...Ts>
+struct SPAWN_NET_NAMESPACE::associated_allocator<spawn::detail::wait_handler<Handler, Ts...>, Allocator>
+{
+  using type = associated_allocator_t<Handler, Allocator>;
+
+  static type get(const spawn::detail::wait_handler<Handler, Ts...>& h,
+      const Allocator& a = Allocator()) noexcept
+  {
+    return associated_allocator<Handler, Allocator>::get(h.handler_, a);
+  }
+};
+
+template <typename Handler, typename Executor, typename ...Ts>
+struct SPAWN_NET_NAMESPACE::associated_executor<spawn::detail::wait_handler<Handler, Ts...>, Executor>
+{
+  using type = associated_executor_t<Handler, Executor>;
+
+  static type get(const spawn::detail::wait_handler<Handler, Ts...>& h,
+      const Executor& ex = Executor()) noexcept
+  {
+    return associated_executor<Handler, Executor>::get(h.handler_, ex);
+  }
+};
+
+#endif // !defined(GENERATING_DOCUMENTATION)
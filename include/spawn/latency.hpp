@@ -0,0 +1,111 @@
+//
+// latency.hpp
+// ~~~~~~~~~~~
+//
+// Copyright (c) 2019 Casey Bodley (cbodley at redhat dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <string>
+
+namespace spawn {
+
+/// A log-linear histogram of latencies in nanoseconds.
+/**
+ * Values are grouped into buckets in the style of HdrHistogram: each power of
+ * two is split into 16 linear sub-buckets, so any recorded value is reported
+ * with a relative error below 1/16.
+ *
+ * A histogram may be recorded by a single thread while other threads read or
+ * merge it. Counters are updated with relaxed atomic loads and stores, so
+ * readers see a consistent but possibly slightly stale view.
+ */
+class latency_histogram
+{
+public:
+  static constexpr unsigned sub_bucket_bits = 4;
+  static constexpr std::size_t sub_bucket_count = std::size_t(1) << sub_bucket_bits;
+  static constexpr std::size_t bucket_count = (65 - sub_bucket_bits) * sub_bucket_count;
+
+  latency_histogram() noexcept;
+  latency_histogram(const latency_histogram& other) noexcept;
+  latency_histogram& operator=(const latency_histogram& other) noexcept;
+
+  /// Record a single value. Must only be called by the owning thread.
+  void record(std::uint64_t ns) noexcept;
+
+  /// Add the counts of another histogram to this one.
+  void merge(const latency_histogram& other) noexcept;
+
+  /// Discard all recorded values.
+  void reset() noexcept;
+
+  /// Return the number of recorded values.
+  std::uint64_t count() const noexcept;
+
+  /// Return the smallest recorded value, or 0 if empty.
+  std::uint64_t min() const noexcept;
+
+  /// Return the largest recorded value, or 0 if empty.
+  std::uint64_t max() const noexcept;
+
+  /// Return the mean of the recorded values, or 0 if empty.
+  double mean() const noexcept;
+
+  /// Return the value below which the given percentage of values fall.
+  /**
+   * The result is the highest value equivalent to the bucket that contains
+   * the requested percentile, so it never underestimates.
+   */
+  std::uint64_t percentile(double p) const noexcept;
+
+  /// Return the index of the bucket that holds the given value.
+  static std::size_t bucket_index(std::uint64_t ns) noexcept;
+
+  /// Return the highest value that maps to the given bucket.
+  static std::uint64_t bucket_upper_bound(std::size_t index) noexcept;
+
+private:
+  std::atomic<std::uint64_t> counts_[bucket_count];
+  std::atomic<std::uint64_t> total_;
+  std::atomic<std::uint64_t> sum_;
+  std::atomic<std::uint64_t> min_;
+  std::atomic<std::uint64_t> max_;
+};
+
+/// The latency breakdown of asynchronous operations awaited with a yield context.
+struct latency_stats
+{
+  /// Time from initiating the operation until its handler was invoked.
+  latency_histogram operation;
+
+  /// Time from the handler's invocation until the coroutine resumed from
+  /// get(). This measures scheduler queueing rather than the operation itself.
+  latency_histogram resume;
+};
+
+/// Return the latency statistics recorded by all threads.
+/**
+ * Statistics are only recorded when the library is built with the
+ * SPAWN_LATENCY_HISTOGRAMS macro defined. Each thread records into its own
+ * histograms without locking; this function merges them on demand.
+ *
+ * Results are keyed by the tag given to basic_yield_context::tag(), or by the
+ * name of the operation's completion signature when untagged.
+ */
+std::map<std::string, latency_stats> latency_snapshot();
+
+/// Discard the latency statistics recorded by all threads.
+void latency_reset();
+
+} // namespace spawn
+
+#include <spawn/impl/latency.hpp>
@@ -0,0 +1,124 @@
+//
+// limiter.hpp
+// ~~~~~~~~~~~
+//
+// Copyright (c) 2019 Casey Bodley (cbodley at redhat dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+#include <spawn/spawn.hpp>
+
+namespace spawn {
+namespace detail {
+
+  class limiter_state;
+
+} // namespace detail
+
+/// Caps the number of coroutines that are alive at once.
+/**
+ * Every coroutine pins a whole stack for as long as it lives, so spawning
+ * without limit during a traffic spike can exhaust memory. A limiter admits
+ * at most max_live coroutines at a time. Further spawn requests either fail
+ * immediately or wait in a bounded FIFO that holds only their function object
+ * and arguments, and no stack, until a running coroutine returns:
+ *
+ * @code spawn::limiter limit(1000, 10000);
+ * if (!limit.spawn(ioc, handle_request))
+ * {
+ *   // shed load
+ * } @endcode
+ *
+ * A slot is released when the coroutine's function returns or throws, or
+ * when the coroutine is destroyed without running. The next queued request
+ * is then posted to its own executor, rather than started on the stack of
+ * the coroutine that released the slot.
+ */
+class limiter
+{
+public:
+  /// What to do with a spawn request when max_live coroutines are running.
+  enum class overflow_policy
+  {
+    /// Refuse the request.
+    reject,
+    /// Queue the request, unless the queue already holds max_queue requests.
+    wait,
+  };
+
+  /// A snapshot of the limiter's counters.
+  struct stats
+  {
+    /// The number of coroutines admitted and not yet finished.
+    std::size_t live;
+    /// The number of requests waiting for a slot.
+    std::size_t queued;
+    /// The most requests that have waited at once.
+    std::size_t max_queued;
+    /// The total number of coroutines admitted.
+    std::uint64_t spawned;
+    /// The number of admitted coroutines that had to wait in the queue.
+    std::uint64_t waited;
+    /// The number of requests refused.
+    std::uint64_t rejected;
+    /// The time spent in the queue by all admitted requests.
+    std::chrono::nanoseconds total_wait;
+    /// The longest time any admitted request spent in the queue.
+    std::chrono::nanoseconds max_wait;
+  };
+
+  /// Construct a limiter.
+  /**
+   * @param max_live The maximum number of coroutines alive at once.
+   *
+   * @param max_queue The maximum number of requests that may wait for a slot.
+   *
+   * @param policy What to do when no slot is free.
+   */
+  explicit limiter(std::size_t max_live, std::size_t max_queue = 0,
+                   overflow_policy policy = overflow_policy::wait);
+
+  limiter(const limiter&) = delete;
+  limiter& operator=(const limiter&) = delete;
+
+  /// Discards any queued requests. Running coroutines are unaffected.
+  ~limiter();
+
+  /// Start a new coroutine with spawn::spawn() once a slot is free.
+  /**
+   * @param target The first argument to spawn::spawn(): a completion handler,
+   * an executor, a strand, an execution context or a basic_yield_context.
+   *
+   * @param function The coroutine function, as for spawn::spawn().
+   *
+   * @param salloc The stack allocator, as for spawn::spawn().
+   *
+   * @returns true if the coroutine was started or queued, or false if the
+   * request was rejected.
+   */
+  template <typename Target, typename Function,
+            typename StackAllocator = boost::context::default_stack>
+  auto spawn(Target&& target, Function&& function,
+             StackAllocator&& salloc = StackAllocator())
+    -> typename std::enable_if<detail::is_stack_allocator<
+         typename std::decay<StackAllocator>::type>::value, bool>::type;
+
+  /// Return a snapshot of the limiter's counters.
+  stats get_stats() const;
+
+private:
+  std::shared_ptr<detail::limiter_state> state_;
+};
+
+} // namespace spawn
+
+#include <spawn/impl/limiter.hpp>
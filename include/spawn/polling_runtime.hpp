@@ -0,0 +1,234 @@
+//
+// polling_runtime.hpp
+// ~~~~~~~~~~~~~~~~~~~
+//
+// Copyright (c) 2019 Casey Bodley (cbodley at redhat dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#if defined(__linux__)
+#include <sys/socket.h>
+#endif
+
+#include <boost/asio/executor_work_guard.hpp>
+#include <boost/asio/io_context.hpp>
+
+#include <spawn/spawn.hpp>
+
+namespace spawn {
+
+/// Options for a polling_runtime.
+struct polling_options
+{
+  /// The number of shards, each with its own io_context and thread.
+  std::size_t shards = 1;
+
+  /// The CPUs to pin the shards' threads to. Shard i runs on
+  /// cpus[i % cpus.size()]. If empty, the threads are not pinned.
+  std::vector<int> cpus;
+
+  /// How long a shard keeps polling after its last handler before it
+  /// blocks in the reactor until more work arrives.
+  std::chrono::nanoseconds spin_duration = std::chrono::microseconds(100);
+};
+
+/// Runs coroutines on threads that busy-poll their reactor.
+/**
+ * An io_context::run() thread that runs out of handlers blocks in
+ * epoll_wait(), and a completion that arrives then has to wake it up again,
+ * which adds several microseconds to its latency. Each shard of a
+ * polling_runtime instead has its own io_context and thread, which calls
+ * io_context::poll() in a loop so that its reactor is checked with a zero
+ * timeout. Only once the shard has been idle for spin_duration does it fall
+ * back to blocking in run_one(), and it returns to polling as soon as a
+ * handler runs. A busy shard costs a whole CPU, so the threads are usually
+ * pinned to dedicated ones:
+ *
+ * @code spawn::polling_options options;
+ * options.shards = 2;
+ * options.cpus = {2, 3};
+ * spawn::polling_runtime runtime(options);
+ * spawn::spawn(runtime, [&] (spawn::yield_context yield) {
+ *     tcp::socket socket(yield.handler_.get_executor());
+ *     socket.async_connect(endpoint, yield);
+ *     socket.set_option(spawn::polling_runtime::busy_poll(50));
+ *     // ...
+ *   }); @endcode
+ *
+ * spawn(runtime, ...) picks the shards in turn. Since each shard has a
+ * single thread, its coroutines need no strand; spawn() on a shard's
+ * io_context or executor still gives them one, as it would anywhere else.
+ * A coroutine that runs on the runtime can start another on its own shard
+ * with spawn(yield, ...), which inherits its executor and so also runs
+ * without a strand.
+ *
+ * As with boost::asio::thread_pool, an exception that escapes a handler
+ * terminates the program, and that includes exceptions thrown by a
+ * coroutine spawned without a completion handler.
+ */
+class polling_runtime
+{
+public:
+  using executor_type = boost::asio::io_context::executor_type;
+
+#if defined(SO_BUSY_POLL) || defined(GENERATING_DOCUMENTATION)
+  /// The SO_BUSY_POLL socket option, in microseconds.
+  /**
+   * On Linux, a socket with this option polls its device queue for up to
+   * the given time on a blocking or zero-timeout receive, rather than
+   * waiting for an interrupt. Setting it higher than the default of
+   * net.core.busy_read requires CAP_NET_ADMIN.
+   *
+   * @code socket.set_option(spawn::polling_runtime::busy_poll(50)); @endcode
+   */
+  class busy_poll
+  {
+  public:
+    busy_poll() noexcept : value_(0) {}
+    explicit busy_poll(int microseconds) noexcept : value_(microseconds) {}
+
+    int value() const noexcept { return value_; }
+
+    template <typename Protocol>
+    int level(const Protocol&) const noexcept { return SOL_SOCKET; }
+
+    template <typename Protocol>
+    int name(const Protocol&) const noexcept { return SO_BUSY_POLL; }
+
+    template <typename Protocol>
+    int* data(const Protocol&) noexcept { return &value_; }
+
+    template <typename Protocol>
+    const int* data(const Protocol&) const noexcept { return &value_; }
+
+    template <typename Protocol>
+    std::size_t size(const Protocol&) const noexcept { return sizeof(value_); }
+
+    template <typename Protocol>
+    void resize(const Protocol&, std::size_t size)
+    {
+      if (size != sizeof(value_))
+        throw std::length_error("busy_poll socket option resize");
+    }
+
+  private:
+    int value_;
+  };
+#endif
+
+  /// Start a thread for each shard.
+  /**
+   * @throws std::system_error if a thread could not be pinned to its CPU.
+   */
+  explicit polling_runtime(const polling_options& options = polling_options());
+
+  polling_runtime(const polling_runtime&) = delete;
+  polling_runtime& operator=(const polling_runtime&) = delete;
+
+  /// Stop the shards and wait for their threads to exit.
+  ~polling_runtime();
+
+  /// Return the number of shards.
+  std::size_t size() const noexcept { return shards_.size(); }
+
+  /// Return the io_context of the given shard.
+  boost::asio::io_context& shard(std::size_t i) noexcept
+  {
+    return shards_[i]->context;
+  }
+
+  /// Return the executor of the next shard in turn.
+  executor_type get_executor() noexcept { return next_shard().get_executor(); }
+
+  /// Return the number of times that the shards have stopped polling to
+  /// block in the reactor.
+  std::uint64_t sleeps() const noexcept;
+
+  /// Stop the shards as soon as possible, without waiting for their work.
+  void stop();
+
+  /// Wait for the shards to run out of work, and for their threads to exit.
+  /**
+   * Each shard's thread exits once its io_context has no more handlers or
+   * outstanding operations, so work must not be submitted to a shard after
+   * its own coroutines have finished.
+   */
+  void join();
+
+private:
+  struct shard_state
+  {
+    boost::asio::io_context context{1};
+    boost::asio::executor_work_guard<executor_type> work =
+        boost::asio::make_work_guard(context);
+    std::atomic<std::uint64_t> sleeps{0};
+    std::thread thread;
+  };
+
+  boost::asio::io_context& next_shard() noexcept;
+  static void poll(shard_state& shard, std::chrono::nanoseconds spin_duration);
+
+  std::vector<std::unique_ptr<shard_state>> shards_;
+  std::atomic<std::size_t> next_{0};
+};
+
+/// Start a new execution context (with new stack) on the next shard of a
+/// polling_runtime.
+/**
+ * The coroutine runs on the shard's io_context without a strand.
+ *
+ * @param runtime The runtime that will run the continuation.
+ *
+ * @param function The continuation function. The function must have the signature:
+ * @code void function(yield_context yield); @endcode
+ *
+ * @param salloc Boost.Context uses stack allocators to create stacks.
+ */
+template <typename Function,
+          typename StackAllocator = boost::context::default_stack>
+auto spawn(polling_runtime& runtime, Function&& function,
+           StackAllocator&& salloc = StackAllocator())
+  -> typename std::enable_if<detail::is_stack_allocator<
+       typename std::decay<StackAllocator>::type>::value>::type;
+
+/// Start a new execution context (with new stack) on the next shard of a
+/// polling_runtime, calling the specified handler when it completes.
+/**
+ * The coroutine runs on the shard's io_context without a strand, and the
+ * handler is called there too, in place of its own associated executor.
+ *
+ * @param runtime The runtime that will run the continuation.
+ *
+ * @param handler A handler to be called when the continuation exits. The
+ * handler must have the signature:
+ * @code void handler(); @endcode
+ *
+ * @param function The continuation function. The function must have the signature:
+ * @code void function(basic_yield_context<Handler> yield); @endcode
+ *
+ * @param salloc Boost.Context uses stack allocators to create stacks.
+ */
+template <typename Handler, typename Function,
+          typename StackAllocator = boost::context::default_stack>
+auto spawn(polling_runtime& runtime, Handler&& handler, Function&& function,
+           StackAllocator&& salloc = StackAllocator())
+  -> typename std::enable_if<
+       !detail::is_stack_allocator<typename std::decay<Function>::type>::value &&
+       detail::is_stack_allocator<typename std::decay<StackAllocator>::type>::value>::type;
+
+} // namespace spawn
+
+#include <spawn/impl/polling_runtime.hpp>
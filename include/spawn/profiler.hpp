@@ -0,0 +1,133 @@
+//
+// profiler.hpp
+// ~~~~~~~~~~~~
+//
+// Copyright (c) 2019 Casey Bodley (cbodley at redhat dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#pragma once
+
+#if !defined(SPAWN_PROFILER)
+#error "spawn/profiler.hpp requires SPAWN_PROFILER to be defined wherever spawn/spawn.hpp is included"
+#endif
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <ostream>
+
+#include <spawn/spawn.hpp>
+
+// the most frames recorded for each sample
+#if !defined(SPAWN_PROFILER_MAX_DEPTH)
+#define SPAWN_PROFILER_MAX_DEPTH 32
+#endif
+
+namespace spawn {
+namespace detail {
+
+  struct profiler_sample
+  {
+    std::atomic<bool> ready{false};
+    bool coroutine;
+    const char* label;
+    unsigned depth;
+    const void* frames[SPAWN_PROFILER_MAX_DEPTH];
+  };
+
+} // namespace detail
+
+/// A sampling profiler that attributes each sample to its coroutine.
+/**
+ * A profiler like perf sees a coroutine's frames on top of whichever thread
+ * happens to run it, joined to that thread's stack by Boost.Context
+ * trampolines, with nothing to say which coroutine it was. While started,
+ * sampling_profiler takes a SIGPROF sample at the given rate of CPU time.
+ * If the interrupted thread was running a coroutine, the sample records the
+ * coroutine's label, which is the name of its function's type, and walks the
+ * frame pointers from the interrupted frame up to the top of the coroutine's
+ * stack, and no further. Other samples record only the interrupted
+ * instruction, under "[no coroutine]".
+ *
+ * write_collapsed() writes the samples in the collapsed stack format that
+ * flame graph tools read, with the coroutine's label as the root frame:
+ *
+ * @code spawn::sampling_profiler profiler;
+ * profiler.start(99);
+ * // ...
+ * profiler.stop();
+ * std::ofstream out("spawn.folded");
+ * profiler.write_collapsed(out); @endcode
+ *
+ * and then, for example, `flamegraph.pl spawn.folded > spawn.svg`.
+ *
+ * Every translation unit that includes spawn/spawn.hpp must be built with
+ * SPAWN_PROFILER defined, so that coroutines keep their labels and stack
+ * bounds, and with -fno-omit-frame-pointer, so that their stacks can be
+ * walked. Frames are named with dladdr(), which only sees the symbols that a
+ * program exports, so link it with -rdynamic; frames without a symbol are
+ * written as module+offset.
+ *
+ * Samples go into a buffer of fixed capacity that is allocated up front, so
+ * the signal handler neither allocates nor locks. Once the buffer is full,
+ * further samples are counted by dropped(). At 99Hz, each sample costs a
+ * signal and a walk of at most SPAWN_PROFILER_MAX_DEPTH frames.
+ *
+ * Only one profiler may be started at a time. It replaces any other SIGPROF
+ * handler, and leaves its own installed after stop(), where it does nothing,
+ * so that a signal that was already pending cannot terminate the program.
+ * Frames can only be read on x86-64 and AArch64 Linux; elsewhere samples
+ * only carry their labels.
+ */
+class sampling_profiler
+{
+public:
+  /// Construct a profiler with room for the given number of samples.
+  explicit sampling_profiler(std::size_t capacity = 16384);
+
+  /// Stop the profiler if it was started.
+  ~sampling_profiler();
+
+  sampling_profiler(const sampling_profiler&) = delete;
+  sampling_profiler& operator=(const sampling_profiler&) = delete;
+
+  /// Start taking samples at the given frequency of the process's CPU time.
+  /**
+   * @throws std::system_error if another profiler was started, or if the
+   * signal handler or timer could not be set up.
+   */
+  void start(unsigned hz = 99);
+
+  /// Stop taking samples, and wait for any signal handler that is recording
+  /// one.
+  void stop();
+
+  /// Return the number of samples recorded.
+  std::size_t samples() const noexcept;
+
+  /// Return the number of samples that did not fit in the buffer.
+  std::size_t dropped() const noexcept;
+
+  /// Discard the recorded samples. The profiler must be stopped.
+  void clear() noexcept;
+
+  /// Write each distinct stack with its number of samples, one per line.
+  void write_collapsed(std::ostream& out) const;
+
+#if !defined(GENERATING_DOCUMENTATION)
+  void record(void* ucontext) noexcept;
+#endif
+
+private:
+  const std::size_t capacity_;
+  std::unique_ptr<detail::profiler_sample[]> samples_;
+  std::atomic<std::size_t> next_{0};
+  bool started_ = false;
+};
+
+} // namespace spawn
+
+#include <spawn/impl/profiler.hpp>
@@ -0,0 +1,119 @@
+//
+// result.hpp
+// ~~~~~~~~~~
+//
+// Copyright (c) 2019 Casey Bodley (cbodley at redhat dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#pragma once
+
+#include <utility>
+
+#include <boost/system/system_error.hpp>
+
+namespace spawn {
+
+/// The outcome of an asynchronous operation awaited with yield.as_result().
+/**
+ * A result carries the operation's error_code along with its value. Unlike
+ * std::expected, the value is kept even on failure, because operations like
+ * async_read() report partial progress alongside an error. For example:
+ *
+ * @code auto n = boost::asio::async_read(sock, buffer, yield.as_result());
+ * if (!n)
+ * {
+ *   if (n.error() != boost::asio::error::eof)
+ *     return; // An error occurred.
+ * }
+ * consume(*n); // bytes transferred, even on eof @endcode
+ *
+ * Only value() throws, and only when called on a failed result.
+ */
+template <typename T>
+class result
+{
+public:
+  using value_type = T;
+
+  /// Construct a result from an operation's error_code and value.
+  result(const boost::system::error_code& ec, T value)
+    : ec_(ec),
+      value_(std::move(value))
+  {
+  }
+
+  /// Return true if the operation succeeded.
+  bool has_value() const noexcept { return !ec_; }
+
+  /// Return true if the operation succeeded.
+  explicit operator bool() const noexcept { return has_value(); }
+
+  /// Return the operation's error_code.
+  const boost::system::error_code& error() const noexcept { return ec_; }
+
+  /// Return the value, or throw system_error if the operation failed.
+  T& value() &
+  {
+    if (ec_) throw boost::system::system_error(ec_);
+    return value_;
+  }
+  const T& value() const &
+  {
+    if (ec_) throw boost::system::system_error(ec_);
+    return value_;
+  }
+  T&& value() &&
+  {
+    if (ec_) throw boost::system::system_error(ec_);
+    return std::move(value_);
+  }
+
+  /// Return the value without checking for an error.
+  T& operator*() & noexcept { return value_; }
+  const T& operator*() const & noexcept { return value_; }
+  T&& operator*() && noexcept { return std::move(value_); }
+
+  T* operator->() noexcept { return &value_; }
+  const T* operator->() const noexcept { return &value_; }
+
+private:
+  boost::system::error_code ec_;
+  T value_;
+};
+
+/// The outcome of an asynchronous operation that produces no value.
+template <>
+class result<void>
+{
+public:
+  using value_type = void;
+
+  /// Construct a result from an operation's error_code.
+  explicit result(const boost::system::error_code& ec = {})
+    : ec_(ec)
+  {
+  }
+
+  /// Return true if the operation succeeded.
+  bool has_value() const noexcept { return !ec_; }
+
+  /// Return true if the operation succeeded.
+  explicit operator bool() const noexcept { return has_value(); }
+
+  /// Return the operation's error_code.
+  const boost::system::error_code& error() const noexcept { return ec_; }
+
+  /// Throw system_error if the operation failed.
+  void value() const
+  {
+    if (ec_) throw boost::system::system_error(ec_);
+  }
+
+private:
+  boost::system::error_code ec_;
+};
+
+} // namespace spawn
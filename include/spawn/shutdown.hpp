@@ -0,0 +1,159 @@
+//
+// shutdown.hpp
+// ~~~~~~~~~~~~
+//
+// Copyright (c) 2019 Casey Bodley (cbodley at redhat dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <memory>
+
+#include <spawn/spawn.hpp>
+
+namespace spawn {
+namespace detail {
+
+  class shutdown_state;
+  class shutdown_member;
+
+  template <typename Function>
+  struct shutdown_function;
+
+} // namespace detail
+
+/// Lets a coroutine in a shutdown_group react to a shutdown request.
+/**
+ * A coroutine that waits on asynchronous operations registers a hook that
+ * cancels them, so that they complete with operation_aborted and the
+ * coroutine can return normally:
+ *
+ * @code void session(spawn::yield_context yield, spawn::shutdown_signal& sig)
+ * {
+ *   sig.on_shutdown([&] { socket.cancel(); });
+ *   while (!sig.requested())
+ *   {
+ *     boost::system::error_code ec;
+ *     socket.async_read_some(buffer, yield[ec]);
+ *     if (ec) break;
+ *     // ...
+ *   }
+ * } @endcode
+ */
+class shutdown_signal
+{
+public:
+  /// Return true once the group has been asked to shut down.
+  bool requested() const;
+
+  /// Set the function to call when the group is asked to shut down.
+  /**
+   * The hook replaces any previous one and is called at most once, from the
+   * coroutine's executor. If shutdown was already requested, the hook is
+   * called before on_shutdown() returns. Pass nullptr to remove the hook.
+   *
+   * A hook cannot cancel an operation that has not started yet, so check
+   * requested() before starting each operation.
+   */
+  void on_shutdown(std::function<void()> hook);
+
+private:
+  template <typename> friend struct detail::shutdown_function;
+  explicit shutdown_signal(detail::shutdown_member& member) : member_(member) {}
+  detail::shutdown_member& member_;
+};
+
+/// Tracks a set of coroutines so that they can all be shut down at once.
+/**
+ * Destroying an execution context that still owns suspended coroutines
+ * unwinds each of their stacks with a forced_unwind exception, one at a time,
+ * from the thread that destroys it. A shutdown_group instead asks its
+ * coroutines to return on their own: async_shutdown() sets every coroutine's
+ * shutdown_signal and calls its hook on the coroutine's own executor, so
+ * their pending operations complete with operation_aborted and the
+ * coroutines return through the executor's worker threads in parallel.
+ *
+ * @code spawn::shutdown_group group(ioc.get_executor());
+ * group.spawn(ioc, session);
+ * // ...
+ * group.async_shutdown([&] { ioc.stop(); }); @endcode
+ *
+ * Hooks are requested in batches of batch_size, each batch posted as a
+ * separate handler, so that a large shutdown does not flood the executor's
+ * queue and coroutines that were already cancelled can return in between.
+ */
+class shutdown_group
+{
+public:
+  using executor_type = detail::net::any_io_executor;
+
+  /// Construct a group.
+  /**
+   * @param ex The executor that runs the shutdown batches and the
+   * async_shutdown() completion, unless its handler has an associated
+   * executor of its own.
+   *
+   * @param batch_size The number of coroutines to signal per handler during
+   * shutdown.
+   */
+  explicit shutdown_group(const executor_type& ex,
+                          std::size_t batch_size = 1024);
+
+  shutdown_group(const shutdown_group&) = delete;
+  shutdown_group& operator=(const shutdown_group&) = delete;
+
+  /// Start a new coroutine in the group with spawn::spawn().
+  /**
+   * @param target The first argument to spawn::spawn(): a completion handler,
+   * an executor, a strand, an execution context or a basic_yield_context.
+   *
+   * @param function The coroutine function. The function must have the
+   * signature:
+   * @code void function(basic_yield_context<Handler> yield,
+   *                     shutdown_signal& signal); @endcode
+   *
+   * @param salloc The stack allocator, as for spawn::spawn().
+   *
+   * A coroutine spawned after shutdown was requested starts with its signal
+   * already set.
+   */
+  template <typename Target, typename Function,
+            typename StackAllocator = boost::context::default_stack>
+  auto spawn(Target&& target, Function&& function,
+             StackAllocator&& salloc = StackAllocator())
+    -> typename std::enable_if<detail::is_stack_allocator<
+         typename std::decay<StackAllocator>::type>::value>::type;
+
+  /// Request shutdown and wait for every coroutine in the group to return.
+  /**
+   * @param token The completion token. The completion handler must have the
+   * signature:
+   * @code void handler(); @endcode
+   * The shutdown batches are posted to the handler's associated executor,
+   * which defaults to the group's executor.
+   * The handler is invoked once no coroutine in the group is left, including
+   * coroutines that were spawned but never started.
+   */
+  template <typename CompletionToken>
+  auto async_shutdown(CompletionToken&& token)
+    -> BOOST_ASIO_INITFN_RESULT_TYPE(CompletionToken, void());
+
+  /// Return the number of coroutines in the group.
+  std::size_t size() const;
+
+  /// Return the group's executor.
+  executor_type get_executor() const;
+
+private:
+  std::shared_ptr<detail::shutdown_state> state_;
+};
+
+} // namespace spawn
+
+#include <spawn/impl/shutdown.hpp>
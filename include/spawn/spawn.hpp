@@ -18,8 +18,10 @@
 #include <boost/context/segmented_stack.hpp>
 #include <boost/system/system_error.hpp>
 
+#include <spawn/arena.hpp>
 #include <spawn/detail/net.hpp>
 #include <spawn/detail/is_stack_allocator.hpp>
+#include <spawn/result.hpp>
 
 namespace spawn {
 namespace detail {
@@ -28,6 +30,9 @@ namespace detail {
 
 } // namespace detail
 
+template <typename Handler>
+class as_result_t;
+
 /// Context object represents the current execution context.
 /**
  * The basic_yield_context class is used to represent the current execution
@@ -63,7 +68,10 @@ public:
     : callee_(callee),
       caller_(caller),
       handler_(handler),
-      ec_(0)
+      ec_(0),
+      tag_(0),
+      arena_(0),
+      spin_(false)
   {
   }
 
@@ -76,7 +84,10 @@ public:
     : callee_(other.callee_),
       caller_(other.caller_),
       handler_(other.handler_),
-      ec_(other.ec_)
+      ec_(other.ec_),
+      tag_(other.tag_),
+      arena_(other.arena_),
+      spin_(other.spin_)
   {
   }
 
@@ -106,6 +117,87 @@ public:
     return tmp;
   }
 
+  /// Return a completion token that returns errors instead of throwing them.
+  /**
+   * When this token is used with an asynchronous operation, the initiating
+   * function returns a spawn::result holding the operation's error_code and
+   * value. No exception is thrown on failure, and no error_code needs to be
+   * passed by reference. For example:
+   *
+   * @code template <typename Handler>
+   * void my_continuation(basic_yield_context<Handler> yield)
+   * {
+   *   ...
+   *   spawn::result<std::size_t> n =
+   *     my_socket.async_read_some(buffer, yield.as_result());
+   *   if (!n)
+   *   {
+   *     // An error occurred, see n.error().
+   *   }
+   *   ...
+   * } @endcode
+   */
+  as_result_t<Handler> as_result() const
+  {
+    return as_result_t<Handler>(*this);
+  }
+
+  /// Return a yield context that labels its operations with the given tag.
+  /**
+   * When built with SPAWN_LATENCY_HISTOGRAMS, the latency of each asynchronous
+   * operation is recorded under this tag instead of under the operation's
+   * completion signature. See spawn::latency_snapshot(). The tag must have
+   * static storage duration. For example:
+   *
+   * @code std::size_t n = my_socket.async_read_some(buffer, yield.tag("read")); @endcode
+   */
+  basic_yield_context tag(const char* tag) const
+  {
+    basic_yield_context tmp(*this);
+    tmp.tag_ = tag;
+    return tmp;
+  }
+
+  /// Return a yield context whose operations may spin before suspending.
+  /**
+   * An operation that completes on another thread within microseconds
+   * costs less if the coroutine is still running when it does. Operations
+   * started with this yield context first spin for a while on the
+   * completion, then suspend as usual if it has not arrived. The coroutine
+   * keeps an average of its recent completion latencies, and spins for up
+   * to twice that long, so a coroutine whose operations take longer than
+   * about SPAWN_SPIN_LIMIT_NS / 2 nanoseconds (10us by default) stops
+   * spinning on its own.
+   *
+   * Spinning only helps when the completion can run on another thread in
+   * the meantime, so it is skipped for coroutines that run on a strand or
+   * on a polling_runtime shard, where the completion would queue behind the
+   * spinning coroutine, and on machines with a single CPU. For example:
+   *
+   * @code spawn::spawn(bind_executor(ioc.get_executor(), [] {}),
+   *     [&] (spawn::yield_context yield) {
+   *       for (;;) {
+   *         auto ack = replica.async_append(entry, yield.adaptive_spin());
+   *         // ...
+   *       }
+   *     }); @endcode
+   */
+  basic_yield_context adaptive_spin() const
+  {
+    basic_yield_context tmp(*this);
+    tmp.spin_ = true;
+    return tmp;
+  }
+
+  /// Return the coroutine's monotonic_arena.
+  /**
+   * Returns nullptr unless the coroutine was started with spawn::with_arena().
+   */
+  monotonic_arena* arena() const
+  {
+    return arena_;
+  }
+
 #if defined(GENERATING_DOCUMENTATION)
 private:
 #endif // defined(GENERATING_DOCUMENTATION)
@@ -113,6 +205,30 @@ private:
   detail::continuation_context& caller_;
   Handler handler_;
   boost::system::error_code* ec_;
+  const char* tag_;
+  monotonic_arena* arena_;
+  bool spin_;
+};
+
+/// Completion token returned by basic_yield_context::as_result().
+/**
+ * An asynchronous operation given this token suspends the current execution
+ * context like basic_yield_context, but returns spawn::result<T> rather than
+ * T. For operations with several values, T is a std::tuple of them.
+ */
+template <typename Handler>
+class as_result_t
+{
+public:
+  explicit as_result_t(const basic_yield_context<Handler>& yield)
+    : yield_(yield)
+  {
+  }
+
+#if defined(GENERATING_DOCUMENTATION)
+private:
+#endif // defined(GENERATING_DOCUMENTATION)
+  basic_yield_context<Handler> yield_;
 };
 
 #if defined(GENERATING_DOCUMENTATION)
@@ -0,0 +1,50 @@
+//
+// trace.hpp
+// ~~~~~~~~~
+//
+// Copyright (c) 2019 Casey Bodley (cbodley at redhat dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#pragma once
+
+#include <ostream>
+
+#include <spawn/detail/trace.hpp>
+
+namespace spawn {
+
+/// Write the recent scheduling events of every thread as a Chrome trace.
+/**
+ * Events are only recorded when the library is built with the
+ * SPAWN_TRACING macro defined. Each thread then keeps its last
+ * SPAWN_TRACE_EVENTS events in a ring buffer of its own, and records each
+ * one without locking: when a coroutine is spawned, each time it starts or
+ * resumes running, each time it suspends on an asynchronous operation, and
+ * when it finishes.
+ *
+ * The output is in the JSON trace event format that Perfetto and
+ * chrome://tracing load. Each thread that ran coroutines gets a track, on
+ * which every stretch of a coroutine's execution is a slice named after its
+ * function's type. The slice ends with the operation it suspended on,
+ * labelled with its basic_yield_context::tag() or else its completion
+ * signature, so that coroutines which hold a strand or a thread while others
+ * queue behind them stand out. Spawns are instant events.
+ *
+ * @code std::ofstream out("spawn.json");
+ * spawn::write_chrome_trace(out); @endcode
+ *
+ * It may be called while other threads record events. Times are read from
+ * the time stamp counter on x86, and converted to microseconds against
+ * steady_clock.
+ */
+void write_chrome_trace(std::ostream& out);
+
+/// Discard the events recorded by all threads so far.
+void trace_reset();
+
+} // namespace spawn
+
+#include <spawn/impl/trace.hpp>
@@ -0,0 +1,337 @@
+//
+// virtual_time.hpp
+// ~~~~~~~~~~~~~~~~
+//
+// Copyright (c) 2019 Casey Bodley (cbodley at redhat dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <memory>
+#include <random>
+#include <ratio>
+#include <vector>
+
+#include <boost/asio/async_result.hpp>
+#include <boost/asio/execution.hpp>
+#include <boost/asio/execution_context.hpp>
+#include <boost/system/error_code.hpp>
+
+namespace spawn {
+
+class virtual_timer;
+
+namespace detail {
+
+  struct virtual_op
+  {
+    virtual ~virtual_op() {}
+    virtual void invoke() = 0;
+  };
+
+  struct virtual_wait_op
+  {
+    virtual_timer* owner = nullptr;
+
+    virtual ~virtual_wait_op() {}
+    virtual void complete(const boost::system::error_code& ec) = 0;
+  };
+
+  struct virtual_timer_key
+  {
+    std::chrono::nanoseconds expiry;
+    std::uint64_t sequence;
+
+    friend bool operator<(const virtual_timer_key& lhs,
+                          const virtual_timer_key& rhs) noexcept
+    {
+      return lhs.expiry < rhs.expiry ||
+          (lhs.expiry == rhs.expiry && lhs.sequence < rhs.sequence);
+    }
+  };
+
+} // namespace detail
+
+/// A single-threaded execution context that runs on a virtual clock.
+/**
+ * Handlers run one at a time from run(), in an order that depends only on
+ * the seed. Timers expire in virtual time: whenever no handler is ready to
+ * run, the clock jumps straight to the next timer's expiry. A program that
+ * sleeps for an hour of virtual time finishes as soon as it runs out of
+ * handlers, and two runs with the same seed schedule every handler the same
+ * way.
+ *
+ * That makes it useful for replaying a recorded workload and comparing its
+ * scheduling between builds:
+ *
+ * @code spawn::virtual_time_context ctx(42);
+ * for (auto& r : trace)
+ *   spawn::spawn(ctx, [&ctx, r] (spawn::yield_context yield) {
+ *       spawn::virtual_timer timer(ctx);
+ *       timer.expires_after(r.arrival);
+ *       timer.async_wait(yield);
+ *       auto start = ctx.now();
+ *       // ...
+ *       latency.record((ctx.now() - start).count());
+ *     });
+ * ctx.run(); @endcode
+ *
+ * With a seed of 0, ready handlers run in the order they were submitted.
+ * Any other seed picks the next handler at random from the ready queue, so
+ * that a test can explore different interleavings of the same program. The
+ * choice uses std::mt19937_64, whose output the standard specifies, so a
+ * seed reproduces the same schedule on every platform.
+ *
+ * The context is not thread-safe. Its handlers, and anything that submits
+ * work to it, must run on the thread that calls run(). Operations that
+ * depend on a real clock or on I/O, such as sockets on an io_context, do not
+ * belong on it; wait on a virtual_timer instead.
+ */
+class virtual_time_context : public boost::asio::execution_context
+{
+public:
+  /// The virtual clock. It has no static now(); use the context's now().
+  struct clock
+  {
+    using duration = std::chrono::nanoseconds;
+    using rep = duration::rep;
+    using period = duration::period;
+    using time_point = std::chrono::time_point<clock>;
+    static constexpr bool is_steady = true;
+  };
+
+  using duration = clock::duration;
+  using time_point = clock::time_point;
+
+  class executor_type;
+
+  /// Construct a context whose clock starts at zero.
+  explicit virtual_time_context(std::uint64_t seed = 0);
+
+  /// Destroy all handlers that have not run, and shut down the services.
+  ~virtual_time_context();
+
+  virtual_time_context(const virtual_time_context&) = delete;
+  virtual_time_context& operator=(const virtual_time_context&) = delete;
+
+  /// Return an executor that submits work to this context.
+  executor_type get_executor() noexcept;
+
+  /// Return the current virtual time.
+  time_point now() const noexcept { return now_; }
+
+  /// Return the seed that orders ready handlers.
+  std::uint64_t seed() const noexcept { return seed_; }
+
+  /// Run handlers until there are no ready handlers or pending timers.
+  /**
+   * @returns The number of handlers that were run.
+   */
+  std::size_t run();
+
+  /// Run handlers until the virtual clock reaches the given time.
+  /**
+   * Timers that expire after t stay pending. If the context runs out of
+   * work earlier, the clock still advances to t.
+   *
+   * @returns The number of handlers that were run.
+   */
+  std::size_t run_until(time_point t);
+
+  /// Run handlers for the given duration of virtual time.
+  std::size_t run_for(duration d) { return run_until(now_ + d); }
+
+  /// Run the handlers that are ready, without advancing the clock.
+  std::size_t poll();
+
+  /// Make run() and poll() return as soon as the current handler does.
+  void stop() noexcept { stopped_ = true; }
+
+  /// Return true if stop() was called since the last restart().
+  bool stopped() const noexcept { return stopped_; }
+
+  /// Allow run() and poll() to run handlers again after stop().
+  void restart() noexcept { stopped_ = false; }
+
+private:
+  friend class executor_type;
+  friend class virtual_timer;
+
+  template <typename Function>
+  void post(Function&& function);
+
+  std::size_t do_run(time_point limit, bool advance);
+  void expire_timers();
+  std::unique_ptr<detail::virtual_op> next_ready();
+
+  void schedule(virtual_timer& timer,
+                std::unique_ptr<detail::virtual_wait_op> op);
+  std::size_t cancel(virtual_timer& timer);
+
+  const std::uint64_t seed_;
+  std::mt19937_64 rng_;
+  time_point now_;
+  std::uint64_t sequence_ = 0;
+  bool stopped_ = false;
+  std::deque<std::unique_ptr<detail::virtual_op>> ready_;
+  std::map<detail::virtual_timer_key,
+           std::unique_ptr<detail::virtual_wait_op>> timers_;
+};
+
+/// Submits function objects to a virtual_time_context.
+/**
+ * Functions are always queued, never run inside execute(), so the executor
+ * reports blocking.never.
+ */
+class virtual_time_context::executor_type
+{
+public:
+  /// Return the context that this executor submits to.
+  virtual_time_context& context() const noexcept { return *ctx_; }
+
+  virtual_time_context& query(boost::asio::execution::context_t) const noexcept
+  {
+    return *ctx_;
+  }
+
+  static constexpr boost::asio::execution::blocking_t
+  query(boost::asio::execution::blocking_t) noexcept
+  {
+    return boost::asio::execution::blocking.never;
+  }
+
+  executor_type require(boost::asio::execution::blocking_t::never_t) const noexcept
+  {
+    return *this;
+  }
+
+  /// Queue the function to run from the context's run() or poll().
+  template <typename Function>
+  void execute(Function&& function) const
+  {
+    ctx_->post(std::forward<Function>(function));
+  }
+
+  friend bool operator==(const executor_type& lhs,
+                         const executor_type& rhs) noexcept
+  {
+    return lhs.ctx_ == rhs.ctx_;
+  }
+
+  friend bool operator!=(const executor_type& lhs,
+                         const executor_type& rhs) noexcept
+  {
+    return lhs.ctx_ != rhs.ctx_;
+  }
+
+private:
+  friend class virtual_time_context;
+
+  explicit executor_type(virtual_time_context& ctx) noexcept : ctx_(&ctx) {}
+
+  virtual_time_context* ctx_;
+};
+
+/// A timer that expires in the virtual time of a virtual_time_context.
+/**
+ * The interface follows boost::asio::steady_timer, so code written against
+ * a template parameter for its timer type can be tested with either. A
+ * wait completes with operation_aborted if the timer is cancelled, its
+ * expiry changes or it is destroyed. The timer must be destroyed before its
+ * context.
+ */
+class virtual_timer
+{
+public:
+  using executor_type = virtual_time_context::executor_type;
+  using clock_type = virtual_time_context::clock;
+  using duration = clock_type::duration;
+  using time_point = clock_type::time_point;
+
+  /// Construct a timer that has already expired.
+  explicit virtual_timer(const executor_type& ex) noexcept
+    : ex_(ex)
+  {
+  }
+
+  explicit virtual_timer(virtual_time_context& ctx) noexcept
+    : ex_(ctx.get_executor())
+  {
+  }
+
+  /// Construct a timer that expires at the given time.
+  virtual_timer(virtual_time_context& ctx, time_point expiry) noexcept
+    : ex_(ctx.get_executor()), expiry_(expiry)
+  {
+  }
+
+  /// Construct a timer that expires after the given duration.
+  virtual_timer(virtual_time_context& ctx, duration d) noexcept
+    : ex_(ctx.get_executor()), expiry_(ctx.now() + d)
+  {
+  }
+
+  /// Cancel any pending waits.
+  ~virtual_timer() { cancel(); }
+
+  virtual_timer(const virtual_timer&) = delete;
+  virtual_timer& operator=(const virtual_timer&) = delete;
+
+  executor_type get_executor() const noexcept { return ex_; }
+
+  /// Return the time at which the timer expires.
+  time_point expiry() const noexcept { return expiry_; }
+
+  /// Set the expiry time, cancelling any pending waits.
+  /**
+   * @returns The number of waits that were cancelled.
+   */
+  std::size_t expires_at(time_point expiry)
+  {
+    std::size_t count = cancel();
+    expiry_ = expiry;
+    return count;
+  }
+
+  /// Set the expiry relative to the context's current time.
+  std::size_t expires_after(duration d)
+  {
+    return expires_at(ex_.context().now() + d);
+  }
+
+  /// Cancel any pending waits.
+  /**
+   * @returns The number of waits that were cancelled.
+   */
+  std::size_t cancel() { return ex_.context().cancel(*this); }
+
+  /// Wait for the timer to expire.
+  /**
+   * The handler is posted to its associated executor, with the timer's
+   * executor as the default, once the virtual clock reaches the expiry. It
+   * must have the signature:
+   * @code void handler(boost::system::error_code ec); @endcode
+   */
+  template <typename WaitHandler>
+  BOOST_ASIO_INITFN_RESULT_TYPE(WaitHandler, void(boost::system::error_code))
+  async_wait(WaitHandler&& handler);
+
+private:
+  friend class virtual_time_context;
+
+  executor_type ex_;
+  time_point expiry_;
+  std::vector<detail::virtual_timer_key> pending_;
+};
+
+} // namespace spawn
+
+#include <spawn/impl/virtual_time.hpp>
@@ -0,0 +1,139 @@
+//
+// wait.hpp
+// ~~~~~~~~
+//
+// Copyright (c) 2019 Casey Bodley (cbodley at redhat dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <tuple>
+#include <utility>
+
+#include <boost/optional.hpp>
+
+#include <spawn/spawn.hpp>
+
+namespace spawn {
+namespace detail {
+
+  class wait_state_base;
+
+} // namespace detail
+
+/// Completion token passed to the operations started by wait_all() and wait_any().
+/**
+ * Each operation function receives one of these tokens and must return the
+ * result of the asynchronous operation it initiates with it. For example:
+ *
+ * @code [&] (spawn::wait_token token) {
+ *   return my_socket.async_read_some(buffer, token);
+ * } @endcode
+ *
+ * The return value only carries the operation's completion signature, which
+ * wait_all() and wait_any() use to size their results. A function object
+ * that isn't a lambda can spell its return type with decltype:
+ *
+ * @code struct timer_op {
+ *   boost::asio::steady_timer& timer;
+ *   auto operator()(spawn::wait_token token)
+ *     -> decltype(timer.async_wait(token))
+ *   {
+ *     return timer.async_wait(token);
+ *   }
+ * }; @endcode
+ *
+ * The token must be used with exactly one asynchronous operation.
+ */
+template <typename Handler>
+class basic_wait_token
+{
+public:
+  basic_wait_token(const basic_yield_context<Handler>& yield,
+                   const std::shared_ptr<detail::wait_state_base>& state,
+                   void* slot, std::size_t index)
+    : yield_(yield),
+      state_(state),
+      slot_(slot),
+      index_(index)
+  {
+  }
+
+#if defined(GENERATING_DOCUMENTATION)
+private:
+#endif // defined(GENERATING_DOCUMENTATION)
+  basic_yield_context<Handler> yield_;
+  std::shared_ptr<detail::wait_state_base> state_;
+  void* slot_;
+  std::size_t index_;
+};
+
+#if defined(GENERATING_DOCUMENTATION)
+/// Completion token for operations awaited with a yield_context.
+using wait_token = basic_wait_token<unspecified>;
+#else // defined(GENERATING_DOCUMENTATION)
+using wait_token = basic_wait_token<
+  detail::net::executor_binder<void(*)(), detail::net::any_io_executor>>;
+#endif // defined(GENERATING_DOCUMENTATION)
+
+namespace detail {
+
+  template <typename Handler, typename Op>
+  struct wait_op_result;
+
+} // namespace detail
+
+/**
+ * @defgroup wait spawn::wait_all, spawn::wait_any
+ *
+ * @brief Await several asynchronous operations with a single suspension.
+ *
+ * Each argument after the yield context is a function that initiates one
+ * asynchronous operation with the basic_wait_token it is given. All of the
+ * operations are started in order before the coroutine suspends, and the
+ * coroutine is resumed only once, rather than once per operation:
+ *
+ * @code auto results = spawn::wait_all(yield,
+ *     [&] (spawn::wait_token t) { return sock.async_read_some(rbuf, t); },
+ *     [&] (spawn::wait_token t) { return boost::asio::async_write(sock, wbuf, t); },
+ *     [&] (spawn::wait_token t) { return timer.async_wait(t); });
+ * spawn::result<std::size_t>& bytes_read = std::get<0>(results); @endcode
+ *
+ * Each operation's outcome is reported as a spawn::result, as with
+ * basic_yield_context::as_result(), so a failed operation never throws.
+ * Completion handlers run on the executor associated with the yield context.
+ */
+/*@{*/
+
+/// Suspend until all of the given operations complete.
+/**
+ * @returns A std::tuple with the spawn::result of each operation, in order.
+ */
+template <typename Handler, typename ...Ops>
+auto wait_all(basic_yield_context<Handler> yield, Ops&&... ops)
+  -> std::tuple<typename detail::wait_op_result<Handler, Ops>::type...>;
+
+/// Suspend until any one of the given operations completes.
+/**
+ * The remaining operations are not cancelled; their completions are
+ * discarded when they arrive.
+ *
+ * @returns A std::pair with the index of the first operation to complete, and
+ * a std::tuple of optional spawn::results for each operation. Every operation
+ * that completed before the coroutine resumed has its result set.
+ */
+template <typename Handler, typename ...Ops>
+auto wait_any(basic_yield_context<Handler> yield, Ops&&... ops)
+  -> std::pair<std::size_t, std::tuple<boost::optional<
+       typename detail::wait_op_result<Handler, Ops>::type>...>>;
+
+/*@}*/
+
+} // namespace spawn
+
+#include <spawn/impl/wait.hpp>
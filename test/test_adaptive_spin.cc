@@ -0,0 +1,118 @@
+//
+// test_adaptive_spin.cc
+// ~~~~~~~~~~~~~~~~~~~~~
+//
+// Copyright (c) 2020 Casey Bodley (cbodley at redhat dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#include <spawn/spawn.hpp>
+
+#include <thread>
+
+#include <boost/asio/bind_executor.hpp>
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/post.hpp>
+#include <gtest/gtest.h>
+
+using error_code = boost::system::error_code;
+
+// complete with the given values through the handler's executor
+struct post_op {
+  error_code ec;
+  int value;
+  template <typename CompletionToken>
+  auto operator()(CompletionToken&& token)
+    -> BOOST_ASIO_INITFN_RESULT_TYPE(CompletionToken, void(error_code, int))
+  {
+    boost::asio::async_completion<CompletionToken, void(error_code, int)> init(token);
+    auto ex = boost::asio::get_associated_executor(init.completion_handler);
+    boost::asio::post(ex, std::bind(std::move(init.completion_handler), ec, value));
+    return init.result.get();
+  }
+};
+
+TEST(AdaptiveSpin, Budget)
+{
+  spawn::detail::adaptive_spin spin;
+  for (int i = 0; i < 100; i++) {
+    spin.record(1000);
+  }
+  EXPECT_NEAR(1000, spin.average_ns(), 100);
+  if (spawn::detail::spin_possible()) {
+    EXPECT_EQ(2 * spin.average_ns(), spin.budget_ns());
+  } else {
+    EXPECT_EQ(0, spin.budget_ns());
+  }
+  // operations that take longer than the limit stop the spinning
+  for (int i = 0; i < 100; i++) {
+    spin.record(SPAWN_SPIN_LIMIT_NS * 10);
+  }
+  EXPECT_EQ(0, spin.budget_ns());
+}
+
+TEST(AdaptiveSpin, StrandExecutor)
+{
+  boost::asio::io_context ioc;
+  auto strand = boost::asio::make_strand(ioc);
+  EXPECT_TRUE(spawn::detail::is_strand_executor(strand));
+  EXPECT_TRUE(spawn::detail::is_strand_executor(
+          spawn::detail::net::any_io_executor(strand)));
+  EXPECT_FALSE(spawn::detail::is_strand_executor(ioc.get_executor()));
+  EXPECT_FALSE(spawn::detail::is_strand_executor(
+          spawn::detail::net::any_io_executor(ioc.get_executor())));
+}
+
+TEST(AdaptiveSpin, Results)
+{
+  boost::asio::io_context ioc;
+  int value = 0;
+  error_code ec;
+  bool thrown = false;
+  spawn::spawn(boost::asio::bind_executor(ioc.get_executor(), [] {}),
+      [&] (spawn::yield_context yield) {
+        value = post_op{{}, 42}(yield.adaptive_spin());
+        post_op{boost::asio::error::eof, 0}(yield[ec].adaptive_spin());
+        try {
+          post_op{boost::asio::error::eof, 0}(yield.adaptive_spin());
+        } catch (const boost::system::system_error&) {
+          thrown = true;
+        }
+      });
+  ioc.run();
+  EXPECT_EQ(42, value);
+  EXPECT_EQ(boost::asio::error::eof, ec);
+  EXPECT_TRUE(thrown);
+}
+
+TEST(AdaptiveSpin, CompleteOnOtherThread)
+{
+  constexpr int operations = 2000;
+  boost::asio::io_context ioc;
+  int sum = 0;
+  spawn::spawn(boost::asio::bind_executor(ioc.get_executor(), [] {}),
+      [&] (spawn::yield_context yield) {
+        for (int i = 0; i < operations; i++) {
+          sum += post_op{{}, 1}(yield.adaptive_spin());
+        }
+      });
+  std::thread other([&ioc] { ioc.run(); });
+  ioc.run();
+  other.join();
+  EXPECT_EQ(operations, sum);
+}
+
+TEST(AdaptiveSpin, Strand)
+{
+  boost::asio::io_context ioc;
+  int sum = 0;
+  spawn::spawn(ioc, [&] (spawn::yield_context yield) {
+      for (int i = 0; i < 100; i++) {
+        sum += post_op{{}, 1}(yield.adaptive_spin());
+      }
+    });
+  ioc.run();
+  EXPECT_EQ(100, sum);
+}
@@ -0,0 +1,110 @@
+//
+// test_allocation.cc
+// ~~~~~~~~~~~~~~~~~~
+//
+// Copyright (c) 2020 Casey Bodley (cbodley at redhat dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#include <spawn/spawn.hpp>
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/post.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <gtest/gtest.h>
+
+// count every heap allocation made by this process
+static std::atomic<std::size_t> allocations{0};
+
+void* operator new(std::size_t size)
+{
+  ++allocations;
+  if (void* p = std::malloc(size ? size : 1)) {
+    return p;
+  }
+  throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept
+{
+  std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept
+{
+  std::free(p);
+}
+
+template <typename CompletionToken>
+auto async_yield(CompletionToken&& token)
+  -> BOOST_ASIO_INITFN_RESULT_TYPE(CompletionToken, void())
+{
+  boost::asio::async_completion<CompletionToken, void()> init(token);
+  boost::asio::post(std::move(init.completion_handler));
+  return init.result.get();
+}
+
+struct timer_loop {
+  std::size_t& steady_state;
+  template <typename T>
+  void operator()(spawn::basic_yield_context<T> y) {
+    // a type-erased any_io_executor would allocate to track work on the
+    // strand, so use the io_context's executor type directly
+    using timer_type = boost::asio::basic_waitable_timer<
+        std::chrono::steady_clock,
+        boost::asio::wait_traits<std::chrono::steady_clock>,
+        boost::asio::io_context::executor_type>;
+    timer_type timer(y.handler_.get_executor().get_inner_executor());
+    auto wait = [&] {
+      timer.expires_after(std::chrono::seconds(0));
+      timer.async_wait(y);
+    };
+    for (int i = 0; i < 10; i++) {
+      wait();
+    }
+    const std::size_t before = allocations;
+    for (int i = 0; i < 100; i++) {
+      wait();
+    }
+    steady_state = allocations - before;
+  }
+};
+
+TEST(Allocation, TimerWait)
+{
+  boost::asio::io_context ioc;
+  std::size_t steady_state = 1;
+  spawn::spawn(ioc, timer_loop{steady_state});
+  ioc.run();
+  EXPECT_EQ(0u, steady_state);
+}
+
+struct post_loop {
+  std::size_t& steady_state;
+  template <typename T>
+  void operator()(spawn::basic_yield_context<T> y) {
+    for (int i = 0; i < 10; i++) {
+      async_yield(y);
+    }
+    const std::size_t before = allocations;
+    for (int i = 0; i < 100; i++) {
+      async_yield(y);
+    }
+    steady_state = allocations - before;
+  }
+};
+
+TEST(Allocation, Post)
+{
+  boost::asio::io_context ioc;
+  std::size_t steady_state = 1;
+  spawn::spawn(ioc, post_loop{steady_state});
+  ioc.run();
+  EXPECT_EQ(0u, steady_state);
+}
@@ -0,0 +1,148 @@
+//
+// test_arena.cc
+// ~~~~~~~~~~~~~
+//
+// Copyright (c) 2020 Casey Bodley (cbodley at redhat dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#include <spawn/spawn.hpp>
+
+#include <cstdint>
+#include <vector>
+
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/post.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <gtest/gtest.h>
+
+
+using handler_type = boost::asio::async_result<spawn::yield_context,
+    void()>::completion_handler_type;
+static_assert(std::is_same<boost::asio::associated_allocator_t<handler_type>,
+                           spawn::arena_allocator<void>>::value, "");
+
+bool aligned(const void* p, std::size_t alignment)
+{
+  return reinterpret_cast<std::uintptr_t>(p) % alignment == 0;
+}
+
+TEST(Arena, NoArena)
+{
+  boost::asio::io_context ioc;
+  bool called = false;
+  spawn::spawn(ioc, [&called] (spawn::yield_context y) {
+      EXPECT_EQ(nullptr, y.arena());
+      called = true;
+    });
+  ioc.run();
+  EXPECT_TRUE(called);
+}
+
+TEST(Arena, Allocate)
+{
+  boost::asio::io_context ioc;
+  bool called = false;
+  spawn::spawn(ioc, spawn::with_arena([&called] (spawn::yield_context y) {
+      spawn::monotonic_arena* arena = y.arena();
+      ASSERT_NE(nullptr, arena);
+      boost::system::error_code ec;
+      EXPECT_EQ(arena, y[ec].arena());
+
+      void* a = arena->allocate(1, 1);
+      void* b = arena->allocate(8, 64);
+      EXPECT_NE(a, b);
+      EXPECT_TRUE(aligned(b, 64));
+      EXPECT_EQ(9u, arena->bytes_allocated());
+      EXPECT_EQ(1u, arena->chunk_count());
+
+      // larger than a chunk
+      void* big = arena->allocate(4 * SPAWN_ARENA_CHUNK_SIZE, 16);
+      EXPECT_TRUE(aligned(big, 16));
+      EXPECT_EQ(1u, arena->chunk_count());
+
+      // spill into a second chunk
+      for (int i = 0; i < 4; i++) {
+        EXPECT_NE(nullptr, arena->allocate(SPAWN_ARENA_CHUNK_SIZE / 4, 8));
+      }
+      EXPECT_EQ(2u, arena->chunk_count());
+      called = true;
+    }));
+  ioc.run();
+  EXPECT_TRUE(called);
+}
+
+#if defined(SPAWN_HAS_MEMORY_RESOURCE)
+TEST(Arena, MemoryResource)
+{
+  boost::asio::io_context ioc;
+  bool called = false;
+  spawn::spawn(ioc, spawn::with_arena([&called] (spawn::yield_context y) {
+      std::pmr::vector<int> values(y.arena());
+      for (int i = 0; i < 100; i++) {
+        values.push_back(i);
+      }
+      EXPECT_EQ(99, values.back());
+      EXPECT_LE(100 * sizeof(int), y.arena()->bytes_allocated());
+      called = true;
+    }));
+  ioc.run();
+  EXPECT_TRUE(called);
+}
+#endif
+
+TEST(Arena, AssociatedAllocator)
+{
+  boost::asio::io_context ioc;
+  bool called = false;
+  spawn::spawn(ioc, spawn::with_arena([&called] (spawn::yield_context y) {
+      {
+        spawn::yield_context token = y; // async_completion moves from it
+        boost::asio::async_completion<spawn::yield_context, void()> init(token);
+        auto alloc = boost::asio::get_associated_allocator(
+            init.completion_handler);
+        // operation state comes from the slot, not the arena
+        EXPECT_EQ(nullptr, alloc.arena());
+        EXPECT_NE(nullptr, alloc.slot());
+        boost::asio::post(std::move(init.completion_handler));
+        init.result.get();
+      }
+      // so a long-lived coroutine's arena doesn't grow with each operation
+      const auto before = y.arena()->bytes_allocated();
+      boost::asio::steady_timer timer(y.handler_.get_executor());
+      for (int i = 0; i < 100; i++) {
+        timer.expires_after(std::chrono::microseconds(1));
+        timer.async_wait(y);
+      }
+      EXPECT_EQ(before, y.arena()->bytes_allocated());
+      called = true;
+    }));
+  ioc.run();
+  EXPECT_TRUE(called);
+}
+
+TEST(Arena, OutlivesCoroutine)
+{
+  boost::asio::io_context ioc;
+  std::vector<spawn::arena_allocator<int>> allocs;
+  spawn::spawn(ioc, spawn::with_arena([&allocs] (spawn::yield_context y) {
+      allocs.emplace_back(y.arena());
+    }));
+  ioc.run();
+  ASSERT_EQ(1u, allocs.size());
+  int* p = allocs.front().allocate(4);
+  p[3] = 3;
+  allocs.front().deallocate(p, 4);
+  allocs.clear();
+}
+
+TEST(Arena, Fallback)
+{
+  spawn::arena_allocator<int> alloc;
+  int* p = alloc.allocate(2);
+  p[1] = 1;
+  alloc.deallocate(p, 2);
+  EXPECT_TRUE(alloc == spawn::arena_allocator<char>());
+}
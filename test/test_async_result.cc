@@ -46,3 +46,25 @@ static_assert(yield_returns<std::pair<int, std::string>,
 static_assert(yield_returns<std::pair<int, std::string>,
                             void(boost::system::error_code, std::pair<int, std::string>)>::value,
               "wrong return value for void(error_code, std::tuple<int>)");
+
+// yield.as_result() returns the same values wrapped in spawn::result
+using as_result_token = decltype(std::declval<spawn::yield_context>().as_result());
+
+template <typename Sig>
+struct as_result_result : boost::asio::async_result<as_result_token, Sig> {};
+
+template <typename T, typename Sig>
+struct as_result_returns
+    : std::is_same<spawn::result<T>, typename as_result_result<Sig>::return_type> {};
+
+static_assert(as_result_returns<void, void()>::value,
+              "wrong return value for as_result void()");
+static_assert(as_result_returns<void, void(boost::system::error_code)>::value,
+              "wrong return value for as_result void(error_code)");
+static_assert(as_result_returns<int, void(int)>::value,
+              "wrong return value for as_result void(int)");
+static_assert(as_result_returns<int, void(boost::system::error_code, int)>::value,
+              "wrong return value for as_result void(error_code, int)");
+static_assert(as_result_returns<std::tuple<int, std::string>,
+                                void(boost::system::error_code, int, std::string)>::value,
+              "wrong return value for as_result void(error_code, int, string)");
@@ -0,0 +1,200 @@
+//
+// test_awaitable.cc
+// ~~~~~~~~~~~~~~~~~
+//
+// Copyright (c) 2020 Casey Bodley (cbodley at redhat dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#include <spawn/awaitable.hpp>
+
+#include <stdexcept>
+
+#include <boost/asio/co_spawn.hpp>
+#include <boost/asio/detached.hpp>
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/post.hpp>
+#include <boost/asio/use_awaitable.hpp>
+#include <gtest/gtest.h>
+
+#if defined(BOOST_ASIO_HAS_CO_AWAIT)
+
+namespace asio = boost::asio;
+
+asio::awaitable<int> immediate_value(int value)
+{
+  co_return value;
+}
+
+asio::awaitable<int> posted_value(int value)
+{
+  co_await asio::post(co_await asio::this_coro::executor, asio::use_awaitable);
+  co_return value;
+}
+
+asio::awaitable<int> throwing_value()
+{
+  co_await asio::post(co_await asio::this_coro::executor, asio::use_awaitable);
+  throw std::runtime_error("awaitable");
+}
+
+asio::awaitable<void> posted_void(int& count)
+{
+  co_await asio::post(co_await asio::this_coro::executor, asio::use_awaitable);
+  ++count;
+}
+
+#if defined(SPAWN_AWAIT_INLINE_LAUNCH) // otherwise await() posts first
+TEST(Awaitable, AwaitImmediate)
+{
+  asio::io_context ioc;
+  int result = 0;
+  spawn::spawn(ioc, [&] (spawn::yield_context yield) {
+      result = spawn::await(immediate_value(42), yield);
+    });
+  // the awaitable completes without going through the executor
+  EXPECT_EQ(1u, ioc.run_one());
+  EXPECT_EQ(42, result);
+}
+#endif
+
+TEST(Awaitable, AwaitPosted)
+{
+  asio::io_context ioc;
+  int result = 0;
+  spawn::spawn(ioc, [&] (spawn::yield_context yield) {
+      result = spawn::await(posted_value(42), yield);
+    });
+  ioc.run();
+  EXPECT_EQ(42, result);
+}
+
+#if defined(SPAWN_AWAIT_INLINE_LAUNCH)
+TEST(Awaitable, AwaitHops)
+{
+  // spawn(), the awaitable's post() and nothing else
+  asio::io_context ioc;
+  int result = 0;
+  spawn::spawn(ioc, [&] (spawn::yield_context yield) {
+      result = spawn::await(posted_value(42), yield);
+    });
+  EXPECT_EQ(2u, ioc.run());
+  EXPECT_EQ(42, result);
+}
+#endif
+
+TEST(Awaitable, AwaitVoid)
+{
+  asio::io_context ioc;
+  int count = 0;
+  spawn::spawn(ioc, [&] (spawn::yield_context yield) {
+      spawn::await(posted_void(count), yield);
+      spawn::await(posted_void(count), yield);
+    });
+  ioc.run();
+  EXPECT_EQ(2, count);
+}
+
+TEST(Awaitable, AwaitException)
+{
+  asio::io_context ioc;
+  bool caught = false;
+  spawn::spawn(ioc, [&] (spawn::yield_context yield) {
+      try {
+        spawn::await(throwing_value(), yield);
+      } catch (const std::runtime_error&) {
+        caught = true;
+      }
+    });
+  ioc.run();
+  EXPECT_TRUE(caught);
+}
+
+TEST(Awaitable, AsyncSpawn)
+{
+  asio::io_context ioc;
+  int result = 0;
+  asio::co_spawn(ioc, [&] () -> asio::awaitable<void> {
+      auto ex = co_await asio::this_coro::executor;
+      result = co_await spawn::async_spawn(ex,
+          [] (spawn::yield_context yield) {
+            asio::post(yield);
+            return 42;
+          }, asio::use_awaitable);
+    }, asio::detached);
+  ioc.run();
+  EXPECT_EQ(42, result);
+}
+
+TEST(Awaitable, AsyncSpawnVoid)
+{
+  asio::io_context ioc;
+  int count = 0;
+  asio::co_spawn(ioc, [&] () -> asio::awaitable<void> {
+      auto ex = co_await asio::this_coro::executor;
+      co_await spawn::async_spawn(ex,
+          [&] (spawn::yield_context yield) {
+            asio::post(yield);
+            ++count;
+          }, asio::use_awaitable);
+      ++count;
+    }, asio::detached);
+  ioc.run();
+  EXPECT_EQ(2, count);
+}
+
+TEST(Awaitable, AsyncSpawnException)
+{
+  asio::io_context ioc;
+  bool caught = false;
+  asio::co_spawn(ioc, [&] () -> asio::awaitable<void> {
+      auto ex = co_await asio::this_coro::executor;
+      try {
+        co_await spawn::async_spawn(ex,
+            [] (spawn::yield_context) -> int {
+              throw std::runtime_error("coroutine");
+            }, asio::use_awaitable);
+      } catch (const std::runtime_error&) {
+        caught = true;
+      }
+    }, asio::detached);
+  ioc.run();
+  EXPECT_TRUE(caught);
+}
+
+TEST(Awaitable, AsyncSpawnCallback)
+{
+  asio::io_context ioc;
+  int result = 0;
+  spawn::async_spawn(ioc.get_executor(),
+      [] (spawn::yield_context yield) {
+        asio::post(yield);
+        return 42;
+      },
+      [&] (std::exception_ptr e, int value) {
+        EXPECT_FALSE(e);
+        result = value;
+      });
+  ioc.run();
+  EXPECT_EQ(42, result);
+}
+
+TEST(Awaitable, RoundTrip)
+{
+  // an awaitable awaits a stackful coroutine that awaits an awaitable
+  asio::io_context ioc;
+  int result = 0;
+  asio::co_spawn(ioc, [&] () -> asio::awaitable<void> {
+      auto ex = co_await asio::this_coro::executor;
+      result = co_await spawn::async_spawn(ex,
+          [] (spawn::yield_context yield) {
+            return spawn::await(posted_value(21), yield) * 2;
+          }, asio::use_awaitable);
+    }, asio::detached);
+  ioc.run();
+  EXPECT_EQ(42, result);
+}
+
+#endif // defined(BOOST_ASIO_HAS_CO_AWAIT)
@@ -0,0 +1,207 @@
+//
+// test_batch.cc
+// ~~~~~~~~~~~~~
+//
+// Copyright (c) 2020 Casey Bodley (cbodley at redhat dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#include <spawn/batch.hpp>
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/post.hpp>
+#include <boost/asio/strand.hpp>
+#include <boost/context/protected_fixedsize_stack.hpp>
+#include <gtest/gtest.h>
+
+
+TEST(Batch, SpawnN)
+{
+  boost::asio::io_context ioc;
+  int started = 0;
+  int finished = 0;
+  bool joined = false;
+  spawn::spawn_n(ioc.get_executor(), 10,
+      [&] (spawn::basic_yield_context<boost::asio::executor_binder<void(*)(),
+               boost::asio::strand<boost::asio::io_context::executor_type>>> y) {
+        ++started;
+        boost::asio::post(y);
+        ++finished;
+      },
+      [&] { joined = true; });
+
+  // a single handler enters every coroutine
+  EXPECT_EQ(1u, ioc.run_one());
+  EXPECT_EQ(10, started);
+  EXPECT_EQ(0, finished);
+
+  ioc.run();
+  EXPECT_EQ(10, finished);
+  EXPECT_TRUE(joined);
+}
+
+TEST(Batch, SpawnMany)
+{
+  boost::asio::io_context ioc;
+  std::vector<int> results(4, 0);
+  std::vector<std::function<void(spawn::yield_context)>> functions;
+  for (int i = 0; i < 4; i++) {
+    functions.emplace_back([&results, i] (spawn::yield_context y) {
+        boost::asio::post(y);
+        results[i] = i + 1;
+      });
+  }
+  bool joined = false;
+  spawn::spawn_many(boost::asio::any_io_executor(ioc.get_executor()),
+                    functions, [&] { joined = true; });
+  EXPECT_EQ(4u, functions.size());
+  ioc.run();
+  EXPECT_TRUE(joined);
+  EXPECT_EQ(std::vector<int>({1, 2, 3, 4}), results);
+}
+
+struct move_only {
+  std::unique_ptr<int> value;
+  int& total;
+  template <typename T>
+  void operator()(spawn::basic_yield_context<T>) { total += *value; }
+};
+
+TEST(Batch, MoveRange)
+{
+  boost::asio::io_context ioc;
+  int total = 0;
+  std::vector<move_only> functions;
+  functions.push_back(move_only{std::unique_ptr<int>(new int(1)), total});
+  functions.push_back(move_only{std::unique_ptr<int>(new int(2)), total});
+  bool joined = false;
+  spawn::spawn_many(ioc.get_executor(), std::move(functions),
+                    [&] { joined = true; });
+  ioc.run();
+  EXPECT_TRUE(joined);
+  EXPECT_EQ(3, total);
+}
+
+TEST(Batch, Empty)
+{
+  boost::asio::io_context ioc;
+  bool joined = false;
+  spawn::spawn_n(ioc.get_executor(), 0, [] (spawn::yield_context) {},
+                 [&] { joined = true; });
+  EXPECT_FALSE(joined);
+  ioc.run();
+  EXPECT_TRUE(joined);
+}
+
+TEST(Batch, NoJoin)
+{
+  boost::asio::io_context ioc;
+  int count = 0;
+  spawn::spawn_n(ioc.get_executor(), 3, [&] (spawn::yield_context) { ++count; },
+                 boost::context::protected_fixedsize_stack(65536));
+  ioc.run();
+  EXPECT_EQ(3, count);
+}
+
+TEST(Batch, SharedStrand)
+{
+  boost::asio::io_context ioc;
+  auto strand = boost::asio::make_strand(ioc);
+  std::atomic<int> running{0};
+  std::atomic<int> overlapped{0};
+  std::atomic<int> finished{0};
+  spawn::spawn_n(strand, 8,
+      [&] (spawn::yield_context y) {
+        for (int i = 0; i < 100; i++) {
+          if (++running > 1) {
+            ++overlapped;
+          }
+          --running;
+          boost::asio::post(y);
+        }
+        ++finished;
+      });
+
+  std::vector<std::thread> threads;
+  for (int i = 0; i < 4; i++) {
+    threads.emplace_back([&ioc] { ioc.run(); });
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+  EXPECT_EQ(8, finished);
+  EXPECT_EQ(0, overlapped);
+}
+
+TEST(Batch, StrandPerCoroutine)
+{
+  boost::asio::io_context ioc;
+  using strand_type = boost::asio::strand<boost::asio::io_context::executor_type>;
+  std::vector<strand_type> strands;
+  std::atomic<int> finished{0};
+  spawn::spawn_n(ioc.get_executor(), 8,
+      [&] (spawn::basic_yield_context<
+               boost::asio::executor_binder<void(*)(), strand_type>> y) {
+        strands.push_back(y.handler_.get_executor()); // before any thread
+        for (int i = 0; i < 100; i++) {
+          boost::asio::post(y);
+        }
+        ++finished;
+      });
+  ioc.run_one();
+  ASSERT_EQ(8u, strands.size());
+  EXPECT_NE(strands[0], strands[1]);
+
+  std::vector<std::thread> threads;
+  for (int i = 0; i < 4; i++) {
+    threads.emplace_back([&ioc] { ioc.run(); });
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+  EXPECT_EQ(8, finished);
+}
+
+struct batch_error {};
+
+TEST(Batch, JoinAfterException)
+{
+  boost::asio::io_context ioc;
+  int finished = 0;
+  bool joined = false;
+  spawn::spawn_n(ioc.get_executor(), 3,
+      [&] (spawn::yield_context y) {
+        boost::asio::post(y);
+        if (++finished == 2) {
+          throw batch_error{};
+        }
+      },
+      [&] { joined = true; });
+  EXPECT_THROW(ioc.run(), batch_error);
+  ioc.restart();
+  ioc.run();
+  EXPECT_EQ(3, finished);
+  EXPECT_TRUE(joined);
+}
+
+TEST(Batch, Unstarted)
+{
+  std::weak_ptr<int> weak;
+  {
+    boost::asio::io_context ioc;
+    auto shared = std::make_shared<int>(0);
+    weak = shared;
+    spawn::spawn_n(ioc.get_executor(), 5,
+                   [shared] (spawn::yield_context) {});
+  }
+  // the functions are destroyed with the unstarted batch
+  EXPECT_TRUE(weak.expired());
+}
@@ -0,0 +1,163 @@
+//
+// test_buffer_pool.cc
+// ~~~~~~~~~~~~~~~~~~~
+//
+// Copyright (c) 2020 Casey Bodley (cbodley at redhat dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#include <spawn/buffer_pool.hpp>
+
+#include <string>
+
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/local/connect_pair.hpp>
+#include <boost/asio/local/stream_protocol.hpp>
+#include <boost/asio/post.hpp>
+#include <boost/asio/write.hpp>
+#include <gtest/gtest.h>
+
+using stream_protocol = boost::asio::local::stream_protocol;
+
+TEST(BufferPool, SizeClasses)
+{
+  spawn::buffer_pool pool(500, 60000);
+  EXPECT_EQ(512u, pool.min_size());
+  EXPECT_EQ(65536u, pool.max_size());
+  EXPECT_EQ(512u, pool.allocate(0).capacity());
+  EXPECT_EQ(512u, pool.allocate(512).capacity());
+  EXPECT_EQ(1024u, pool.allocate(513).capacity());
+  EXPECT_EQ(65536u, pool.allocate(1 << 20).capacity());
+}
+
+TEST(BufferPool, Reuse)
+{
+  spawn::buffer_pool pool(512, 4096, 2048);
+  char* data = nullptr;
+  {
+    spawn::pooled_buffer b = pool.allocate(1000);
+    EXPECT_EQ(1024u, pool.bytes_in_use());
+    EXPECT_EQ(0u, b.size());
+    data = b.data();
+  }
+  EXPECT_EQ(0u, pool.bytes_in_use());
+  EXPECT_EQ(1024u, pool.bytes_cached());
+  spawn::pooled_buffer b1 = pool.allocate(1000);
+  EXPECT_EQ(data, b1.data());
+  EXPECT_EQ(0u, pool.bytes_cached());
+
+  // each size class caches up to max_cached bytes
+  spawn::pooled_buffer b2 = pool.allocate(1000);
+  spawn::pooled_buffer b3 = pool.allocate(1000);
+  b1.reset();
+  b2.reset();
+  b3.reset();
+  EXPECT_EQ(2048u, pool.bytes_cached());
+}
+
+TEST(BufferPool, Move)
+{
+  spawn::buffer_pool pool;
+  spawn::pooled_buffer b1 = pool.allocate(100);
+  spawn::pooled_buffer b2 = std::move(b1);
+  EXPECT_EQ(nullptr, b1.data());
+  EXPECT_EQ(512u, b2.capacity());
+  b1 = std::move(b2);
+  EXPECT_EQ(512u, b1.capacity());
+  EXPECT_EQ(512u, pool.bytes_in_use());
+}
+
+TEST(ReadSomePooled, Read)
+{
+  boost::asio::io_context ioc;
+  stream_protocol::socket a(ioc), b(ioc);
+  boost::asio::local::connect_pair(a, b);
+  spawn::buffer_pool pool(64, 1024);
+
+  std::string received;
+  std::size_t in_use_while_waiting = 1;
+  spawn::spawn(ioc, [&] (spawn::yield_context yield) {
+      boost::system::error_code ec;
+      for (;;) {
+        spawn::pooled_buffer buffer = spawn::read_some_pooled(b, pool, yield[ec]);
+        if (ec) {
+          EXPECT_EQ(boost::asio::error::eof, ec);
+          EXPECT_EQ(0u, buffer.capacity());
+          break;
+        }
+        EXPECT_LE(buffer.size(), pool.max_size());
+        received.append(buffer.data(), buffer.size());
+      }
+    });
+  spawn::spawn(ioc, [&] (spawn::yield_context yield) {
+      // the reader is suspended, and holds no buffer
+      boost::asio::post(yield);
+      in_use_while_waiting = pool.bytes_in_use();
+      boost::asio::async_write(a, boost::asio::buffer("hello", 5), yield);
+      boost::asio::post(yield);
+      const std::string large(3000, 'x');
+      boost::asio::async_write(a, boost::asio::buffer(large), yield);
+      a.close();
+    });
+  ioc.run();
+  EXPECT_EQ(0u, in_use_while_waiting);
+  EXPECT_EQ("hello" + std::string(3000, 'x'), received);
+  EXPECT_EQ(0u, pool.bytes_in_use());
+}
+
+TEST(ReadSomePooled, SizedToAvailable)
+{
+  boost::asio::io_context ioc;
+  stream_protocol::socket a(ioc), b(ioc);
+  boost::asio::local::connect_pair(a, b);
+  boost::asio::write(a, boost::asio::buffer(std::string(700, 'x')));
+  spawn::buffer_pool pool(64, 65536);
+  std::size_t capacity = 0, size = 0;
+  spawn::spawn(ioc, [&] (spawn::yield_context yield) {
+      spawn::pooled_buffer buffer = spawn::read_some_pooled(b, pool, yield);
+      capacity = buffer.capacity();
+      size = buffer.size();
+    });
+  ioc.run();
+  EXPECT_EQ(1024u, capacity);
+  EXPECT_EQ(700u, size);
+}
+
+TEST(ReadSomePooled, NonBlockingSocket)
+{
+  boost::asio::io_context ioc;
+  stream_protocol::socket a(ioc), b(ioc);
+  boost::asio::local::connect_pair(a, b);
+  b.non_blocking(true);
+  boost::asio::write(a, boost::asio::buffer("hello", 5));
+  spawn::buffer_pool pool;
+  std::string received;
+  spawn::spawn(ioc, [&] (spawn::yield_context yield) {
+      spawn::pooled_buffer buffer = spawn::read_some_pooled(b, pool, yield);
+      received.assign(buffer.data(), buffer.size());
+    });
+  ioc.run();
+  EXPECT_EQ("hello", received);
+  EXPECT_TRUE(b.non_blocking());
+}
+
+TEST(ReadSomePooled, Throw)
+{
+  boost::asio::io_context ioc;
+  stream_protocol::socket a(ioc), b(ioc);
+  boost::asio::local::connect_pair(a, b);
+  a.close();
+  spawn::buffer_pool pool;
+  bool thrown = false;
+  spawn::spawn(ioc, [&] (spawn::yield_context yield) {
+      try {
+        spawn::read_some_pooled(b, pool, yield);
+      } catch (const boost::system::system_error& e) {
+        thrown = e.code() == boost::asio::error::eof;
+      }
+    });
+  ioc.run();
+  EXPECT_TRUE(thrown);
+}
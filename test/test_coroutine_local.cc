@@ -0,0 +1,178 @@
+//
+// test_coroutine_local.cc
+// ~~~~~~~~~~~~~~~~~~~~~~~
+//
+// Copyright (c) 2020 Casey Bodley (cbodley at redhat dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#include <spawn/coroutine_local.hpp>
+
+#include <atomic>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/post.hpp>
+#include <gtest/gtest.h>
+
+static spawn::coroutine_local<std::string> name;
+static spawn::coroutine_local<int> number;
+
+TEST(CoroutineLocal, OutsideCoroutine)
+{
+  EXPECT_EQ(nullptr, name.get_if());
+  EXPECT_THROW(name.get(), std::logic_error);
+  name.reset(); // no effect
+}
+
+TEST(CoroutineLocal, SeparateValues)
+{
+  boost::asio::io_context ioc;
+  std::vector<std::string> results;
+  for (int i = 0; i < 3; i++) {
+    spawn::spawn(ioc, [&results, i] (spawn::yield_context yield) {
+        EXPECT_EQ(nullptr, name.get_if());
+        EXPECT_EQ("", name.get());
+        *name = "coro" + std::to_string(i);
+        boost::asio::post(yield);
+        name->append("!");
+        boost::asio::post(yield);
+        results.push_back(*name);
+      });
+  }
+  ioc.run();
+  EXPECT_EQ((std::vector<std::string>{"coro0!", "coro1!", "coro2!"}), results);
+}
+
+struct counted
+{
+  static std::atomic<int> live;
+  static std::vector<int> destroyed;
+  int id = 0;
+  counted() { ++live; }
+  ~counted() { --live; destroyed.push_back(id); }
+};
+std::atomic<int> counted::live{0};
+std::vector<int> counted::destroyed;
+
+TEST(CoroutineLocal, LazyAndDestroyedOnReturn)
+{
+  static spawn::coroutine_local<counted> first;
+  static spawn::coroutine_local<counted> second;
+  counted::destroyed.clear();
+
+  boost::asio::io_context ioc;
+  int live_before_return = -1;
+  spawn::spawn(ioc, [&] (spawn::yield_context yield) {
+      boost::asio::post(yield);
+      EXPECT_EQ(0, counted::live);
+      first->id = 1;
+      second->id = 2;
+      EXPECT_EQ(2, counted::live);
+      boost::asio::post(yield);
+      live_before_return = counted::live;
+    });
+  ioc.run();
+  EXPECT_EQ(2, live_before_return);
+  EXPECT_EQ(0, counted::live);
+  EXPECT_EQ((std::vector<int>{2, 1}), counted::destroyed);
+}
+
+TEST(CoroutineLocal, Reset)
+{
+  static spawn::coroutine_local<counted> value;
+  boost::asio::io_context ioc;
+  spawn::spawn(ioc, [&] (spawn::yield_context yield) {
+      value->id = 5;
+      EXPECT_EQ(1, counted::live);
+      value.reset();
+      EXPECT_EQ(0, counted::live);
+      EXPECT_EQ(nullptr, value.get_if());
+      boost::asio::post(yield);
+      EXPECT_EQ(0, value->id);
+    });
+  ioc.run();
+  EXPECT_EQ(0, counted::live);
+}
+
+TEST(CoroutineLocal, RecycledIndex)
+{
+  boost::asio::io_context ioc;
+  spawn::spawn(ioc, [&] (spawn::yield_context yield) {
+      std::unique_ptr<spawn::coroutine_local<counted>> first(
+          new spawn::coroutine_local<counted>);
+      (*first)->id = 7;
+      first.reset();
+      // the old value outlives its coroutine_local
+      EXPECT_EQ(1, counted::live);
+
+      // a new coroutine_local takes over the index, but not the old value
+      spawn::coroutine_local<counted> second;
+      EXPECT_EQ(nullptr, second.get_if());
+      second.reset(); // no effect
+      EXPECT_EQ(1, counted::live);
+      EXPECT_EQ(0, second->id);
+      EXPECT_EQ(1, counted::live);
+      boost::asio::post(yield);
+      EXPECT_EQ(0, second->id);
+    });
+  ioc.run();
+  EXPECT_EQ(0, counted::live);
+}
+
+TEST(CoroutineLocal, NestedSpawn)
+{
+  boost::asio::io_context ioc;
+  int parent_value = 0, child_value = 0;
+  spawn::spawn(ioc, [&] (spawn::yield_context yield) {
+      *number = 1;
+      // the child is entered inline, then suspends back into the parent
+      spawn::spawn(yield, [&] (spawn::yield_context yield) {
+          *number = 2;
+          boost::asio::post(yield);
+          child_value = *number;
+        });
+      EXPECT_EQ(1, *number);
+      boost::asio::post(yield);
+      boost::asio::post(yield);
+      parent_value = *number;
+    });
+  EXPECT_EQ(nullptr, number.get_if());
+  ioc.run();
+  EXPECT_EQ(1, parent_value);
+  EXPECT_EQ(2, child_value);
+}
+
+TEST(CoroutineLocal, MigrateBetweenThreads)
+{
+  constexpr int coroutines = 16;
+  constexpr int threads = 4;
+  boost::asio::io_context ioc;
+  std::atomic<int> mismatches{0};
+  for (int i = 0; i < coroutines; i++) {
+    spawn::spawn(ioc, [&, i] (spawn::yield_context yield) {
+        *number = i;
+        for (int j = 0; j < 200; j++) {
+          boost::asio::post(yield);
+          if (*number != i) {
+            ++mismatches;
+          }
+        }
+      });
+  }
+  std::vector<std::thread> workers;
+  for (int i = 0; i < threads; i++) {
+    workers.emplace_back([&ioc] { ioc.run(); });
+  }
+  for (auto& t : workers) {
+    t.join();
+  }
+  EXPECT_EQ(0, mismatches);
+  EXPECT_EQ(nullptr, number.get_if());
+}
@@ -0,0 +1,143 @@
+//
+// test_coroutine_pool.cc
+// ~~~~~~~~~~~~~~~~~~~~~~
+//
+// Copyright (c) 2020 Casey Bodley (cbodley at redhat dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#include <spawn/coroutine_pool.hpp>
+
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/post.hpp>
+#include <boost/context/protected_fixedsize_stack.hpp>
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <thread>
+
+
+template <typename CompletionToken>
+auto async_yield(CompletionToken&& token)
+  -> BOOST_ASIO_INITFN_RESULT_TYPE(CompletionToken, void())
+{
+  boost::asio::async_completion<CompletionToken, void()> init(token);
+  boost::asio::post(std::move(init.completion_handler));
+  return init.result.get();
+}
+
+TEST(CoroutinePool, RunTasks)
+{
+  boost::asio::io_context ioc;
+  spawn::coroutine_pool pool(ioc.get_executor());
+  int called = 0;
+  for (int i = 0; i < 10; i++) {
+    pool.submit([&called] (spawn::yield_context y) {
+        async_yield(y);
+        ++called;
+      });
+  }
+  EXPECT_EQ(10u, pool.size());
+  ioc.run_for(std::chrono::milliseconds(100));
+  EXPECT_EQ(10, called);
+  EXPECT_EQ(10u, pool.idle());
+}
+
+TEST(CoroutinePool, ReuseIdle)
+{
+  boost::asio::io_context ioc;
+  spawn::coroutine_pool pool(ioc.get_executor());
+  int called = 0;
+  auto task = [&called] (spawn::yield_context) { ++called; };
+  pool.submit(task);
+  ioc.poll();
+  ASSERT_EQ(1u, pool.idle());
+  for (int i = 0; i < 100; i++) {
+    pool.submit(task);
+    ioc.restart(); // idle coroutines don't count as work
+    ioc.poll();
+  }
+  EXPECT_EQ(101, called);
+  EXPECT_EQ(1u, pool.size());
+}
+
+TEST(CoroutinePool, SubmitFromCoroutine)
+{
+  boost::asio::io_context ioc;
+  spawn::coroutine_pool pool(ioc.get_executor());
+  int called = 0;
+  auto task = [&called] (spawn::yield_context) { ++called; };
+  pool.submit(task);
+  ioc.poll();
+  ASSERT_EQ(1u, pool.idle());
+  ioc.restart();
+  spawn::spawn(ioc, [&] (spawn::yield_context) {
+      pool.submit(task); // resumes the idle coroutine inline
+      EXPECT_EQ(2, called);
+    });
+  ioc.poll();
+  EXPECT_EQ(2, called);
+}
+
+TEST(CoroutinePool, MaxSize)
+{
+  boost::asio::io_context ioc;
+  spawn::coroutine_pool pool(ioc.get_executor(), 1, 2,
+                             boost::context::protected_fixedsize_stack(65536));
+  int called = 0;
+  for (int i = 0; i < 5; i++) {
+    pool.submit([&called] (spawn::yield_context y) {
+        async_yield(y);
+        ++called;
+      });
+  }
+  EXPECT_EQ(2u, pool.size());
+  EXPECT_EQ(3u, pool.queued());
+  ioc.poll();
+  EXPECT_EQ(5, called);
+  // one coroutine stays parked, the other returned
+  EXPECT_EQ(1u, pool.size());
+  EXPECT_EQ(1u, pool.idle());
+}
+
+TEST(CoroutinePool, DestroyWakesIdle)
+{
+  boost::asio::io_context ioc;
+  {
+    spawn::coroutine_pool pool(ioc.get_executor());
+    pool.submit([] (spawn::yield_context) {});
+    ioc.poll();
+    ASSERT_EQ(1u, pool.idle());
+  }
+  ioc.restart();
+  ioc.poll();
+  EXPECT_TRUE(ioc.stopped());
+}
+
+TEST(CoroutinePool, MultipleThreads)
+{
+  // tasks submit more tasks, so idle coroutines are woken from either thread
+  constexpr int tasks = 5000;
+  boost::asio::io_context ioc;
+  spawn::coroutine_pool pool(ioc.get_executor(), 4, 4);
+  std::atomic<int> submitted{0};
+  std::atomic<int> called{0};
+  std::function<void(spawn::yield_context)> task =
+    [&] (spawn::yield_context y) {
+      async_yield(y);
+      ++called;
+      if (++submitted <= tasks) {
+        pool.submit(task);
+      }
+    };
+  for (int i = 0; i < 4; i++) {
+    ++submitted;
+    pool.submit(task);
+  }
+  std::thread other([&ioc] { ioc.run(); });
+  ioc.run();
+  other.join();
+  EXPECT_EQ(tasks, called.load());
+}
@@ -0,0 +1,93 @@
+//
+// test_fast_context.cc
+// ~~~~~~~~~~~~~~~~~~~~
+//
+// Copyright (c) 2020 Casey Bodley (cbodley at redhat dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#if !defined(SPAWN_FAST_CONTEXT_SWITCH)
+#define SPAWN_FAST_CONTEXT_SWITCH
+#endif
+#include <spawn/spawn.hpp>
+
+#include <memory>
+#include <stdexcept>
+
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/post.hpp>
+#include <gtest/gtest.h>
+
+#if defined(__x86_64__) && defined(__linux__)
+TEST(FastContext, Enabled)
+{
+#if !defined(SPAWN_HAS_FAST_CONTEXT_SWITCH)
+  FAIL() << "SPAWN_FAST_CONTEXT_SWITCH has no effect on x86-64 linux";
+#endif
+}
+#endif
+
+TEST(FastContext, Resume)
+{
+  boost::asio::io_context ioc;
+  int count = 0;
+  double product = 1.0;
+  spawn::spawn(ioc, [&] (spawn::yield_context y) {
+      for (int i = 1; i <= 10; i++) {
+        product *= 1.5; // floating-point state survives the switches
+        boost::asio::post(y);
+        ++count;
+      }
+    });
+  ioc.run();
+  EXPECT_EQ(10, count);
+  EXPECT_DOUBLE_EQ(57.6650390625, product);
+}
+
+TEST(FastContext, Nested)
+{
+  boost::asio::io_context ioc;
+  int count = 0;
+  spawn::spawn(ioc, [&] (spawn::yield_context y) {
+      spawn::spawn(y, [&] (spawn::yield_context y) {
+          boost::asio::post(y);
+          ++count;
+        });
+      boost::asio::post(y);
+      ++count;
+    });
+  ioc.run();
+  EXPECT_EQ(2, count);
+}
+
+TEST(FastContext, Exception)
+{
+  boost::asio::io_context ioc;
+  spawn::spawn(ioc, [] (spawn::yield_context y) {
+      boost::asio::post(y);
+      throw std::runtime_error("");
+    });
+  EXPECT_THROW(ioc.run(), std::runtime_error);
+}
+
+TEST(FastContext, Unwind)
+{
+  auto counter = std::make_shared<int>(0);
+  std::weak_ptr<int> weak = counter;
+  {
+    boost::asio::io_context ioc;
+    spawn::spawn(ioc, [counter] (spawn::yield_context y) {
+        std::shared_ptr<int> local = counter;
+        for (;;) {
+          boost::asio::post(y);
+        }
+      });
+    counter.reset();
+    ioc.run_one();
+    ioc.run_one();
+    EXPECT_FALSE(weak.expired());
+  } // destroying the suspended coroutine unwinds its stack
+  EXPECT_TRUE(weak.expired());
+}
@@ -0,0 +1,182 @@
+//
+// test_file_ring.cc
+// ~~~~~~~~~~~~~~~~~
+//
+// Copyright (c) 2020 Casey Bodley (cbodley at redhat dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#include <spawn/file_ring.hpp>
+#include <spawn/spawn.hpp>
+
+#if defined(SPAWN_HAS_FILE_RING)
+
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <boost/asio/io_context.hpp>
+#include <gtest/gtest.h>
+
+// an unlinked temporary file
+struct temp_file
+{
+  int fd;
+  temp_file()
+  {
+    char path[] = "/tmp/test_file_ring.XXXXXX";
+    fd = ::mkstemp(path);
+    ::unlink(path);
+  }
+  ~temp_file() { ::close(fd); }
+};
+
+// create a ring, or skip the test where io_uring isn't allowed
+#define MAKE_RING(ring, ...) \
+  std::unique_ptr<spawn::file_ring> ring; \
+  try { \
+    ring.reset(new spawn::file_ring(__VA_ARGS__)); \
+  } catch (const std::system_error& e) { \
+    GTEST_SKIP() << e.what(); \
+  }
+
+TEST(FileRing, WriteFsyncRead)
+{
+  boost::asio::io_context ioc;
+  MAKE_RING(ring, ioc);
+  temp_file file;
+  ASSERT_LE(0, file.fd);
+
+  std::string result;
+  spawn::spawn(ioc, [&] (spawn::yield_context yield) {
+      const std::string data = "hello world";
+      std::size_t n = ring->async_write_some_at(file.fd, 4,
+          boost::asio::buffer(data), yield);
+      EXPECT_EQ(data.size(), n);
+      ring->async_fsync(file.fd, yield);
+
+      char buf[64] = {};
+      n = ring->async_read_some_at(file.fd, 4, boost::asio::buffer(buf), yield);
+      result.assign(buf, n);
+    });
+  ioc.run();
+  EXPECT_EQ("hello world", result);
+}
+
+TEST(FileRing, Eof)
+{
+  boost::asio::io_context ioc;
+  MAKE_RING(ring, ioc);
+  temp_file file;
+  ASSERT_LE(0, file.fd);
+
+  boost::system::error_code ec;
+  spawn::spawn(ioc, [&] (spawn::yield_context yield) {
+      char buf[16];
+      ring->async_read_some_at(file.fd, 0, boost::asio::buffer(buf), yield[ec]);
+    });
+  ioc.run();
+  EXPECT_EQ(boost::asio::error::eof, ec);
+}
+
+TEST(FileRing, BadDescriptor)
+{
+  boost::asio::io_context ioc;
+  MAKE_RING(ring, ioc);
+
+  boost::system::error_code ec;
+  spawn::spawn(ioc, [&] (spawn::yield_context yield) {
+      ring->async_fsync(-1, yield[ec]);
+    });
+  ioc.run();
+  EXPECT_EQ(boost::system::errc::bad_file_descriptor, ec);
+}
+
+TEST(FileRing, FixedBuffers)
+{
+  boost::asio::io_context ioc;
+  MAKE_RING(ring, ioc, 16, 2, 4096);
+  temp_file file;
+  ASSERT_LE(0, file.fd);
+
+  auto b1 = ring->acquire_buffer();
+  auto b2 = ring->acquire_buffer();
+  EXPECT_TRUE(b1);
+  EXPECT_TRUE(b2);
+  EXPECT_EQ(4096u, b1.size());
+  EXPECT_FALSE(ring->acquire_buffer());
+  b2 = spawn::file_ring::fixed_buffer();
+  b2 = ring->acquire_buffer();
+  EXPECT_TRUE(b2);
+
+  std::memset(b1.data(), 'x', b1.size());
+  std::size_t written = 0, read = 0;
+  spawn::spawn(ioc, [&] (spawn::yield_context yield) {
+      written = ring->async_write_some_at(file.fd, 0, b1, 1000, yield);
+      read = ring->async_read_some_at(file.fd, 0, b2, b2.size(), yield);
+    });
+  ioc.run();
+  EXPECT_EQ(1000u, written);
+  EXPECT_EQ(1000u, read);
+  EXPECT_EQ(0, std::memcmp(b1.data(), b2.data(), 1000));
+}
+
+TEST(FileRing, BatchedSubmission)
+{
+  constexpr int count = 32;
+  boost::asio::io_context ioc;
+  MAKE_RING(ring, ioc);
+  temp_file file;
+  ASSERT_LE(0, file.fd);
+  std::vector<char> data(count * 512);
+  for (std::size_t i = 0; i < data.size(); i++) {
+    data[i] = static_cast<char>(i / 512);
+  }
+  ASSERT_EQ(static_cast<ssize_t>(data.size()),
+            ::pwrite(file.fd, data.data(), data.size(), 0));
+
+  int matched = 0;
+  for (int i = 0; i < count; i++) {
+    spawn::spawn(ioc, [&, i] (spawn::yield_context yield) {
+        char buf[512];
+        ring->async_read_some_at(file.fd, i * 512, boost::asio::buffer(buf), yield);
+        if (buf[0] == static_cast<char>(i) && buf[511] == static_cast<char>(i)) {
+          ++matched;
+        }
+      });
+  }
+  ioc.run();
+  EXPECT_EQ(count, matched);
+  EXPECT_EQ(1u, ring->submit_calls());
+}
+
+TEST(FileRing, Backlog)
+{
+  // more operations than the cq has room for
+  constexpr int count = 100;
+  boost::asio::io_context ioc;
+  MAKE_RING(ring, ioc, 4);
+  temp_file file;
+  ASSERT_LE(0, file.fd);
+
+  int completed = 0;
+  for (int i = 0; i < count; i++) {
+    spawn::spawn(ioc, [&, i] (spawn::yield_context yield) {
+        char c = static_cast<char>(i);
+        ring->async_write_some_at(file.fd, i, boost::asio::buffer(&c, 1), yield);
+        ++completed;
+      });
+  }
+  ioc.run();
+  EXPECT_EQ(count, completed);
+  EXPECT_EQ(count, ::lseek(file.fd, 0, SEEK_END));
+}
+
+#endif // defined(SPAWN_HAS_FILE_RING)
@@ -0,0 +1,176 @@
+//
+// test_generator.cc
+// ~~~~~~~~~~~~~~~~~
+//
+// Copyright (c) 2020 Casey Bodley (cbodley at redhat dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#include <spawn/generator.hpp>
+#include <spawn/spawn.hpp>
+
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/post.hpp>
+#include <boost/context/protected_fixedsize_stack.hpp>
+#include <gtest/gtest.h>
+
+#include <vector>
+
+
+struct counting_producer {
+  int count;
+  void operator()(spawn::generator<int>::push_type& push) {
+    for (int i = 0; i < count; i++) {
+      push(i);
+    }
+  }
+};
+
+TEST(Generator, Values)
+{
+  spawn::generator<int> gen(counting_producer{3});
+  std::vector<int> values;
+  for (int& i : gen) {
+    values.push_back(i);
+  }
+  EXPECT_EQ((std::vector<int>{0, 1, 2}), values);
+  EXPECT_EQ(nullptr, gen.next());
+}
+
+TEST(Generator, StackAllocator)
+{
+  spawn::generator<int> gen(counting_producer{2},
+                            boost::context::protected_fixedsize_stack(65536));
+  ASSERT_NE(nullptr, gen.next());
+  ASSERT_NE(nullptr, gen.next());
+  EXPECT_EQ(nullptr, gen.next());
+}
+
+struct no_copy {
+  int value = 0;
+  no_copy() = default;
+  no_copy(const no_copy&) = delete;
+  no_copy& operator=(const no_copy&) = delete;
+};
+
+struct reference_producer {
+  no_copy& source;
+  void operator()(spawn::generator<no_copy>::push_type& push) {
+    push(source);
+    push(no_copy{}); // temporaries live until the next value
+  }
+};
+
+TEST(Generator, YieldByReference)
+{
+  no_copy source;
+  spawn::generator<no_copy> gen(reference_producer{source});
+  no_copy* value = gen.next();
+  EXPECT_EQ(&source, value);
+  value = gen.next();
+  ASSERT_NE(nullptr, value);
+  EXPECT_NE(&source, value);
+  EXPECT_EQ(nullptr, gen.next());
+}
+
+struct lazy_producer {
+  bool& started;
+  void operator()(spawn::generator<int>::push_type& push) {
+    started = true;
+    int i = 0;
+    push(i);
+  }
+};
+
+TEST(Generator, Lazy)
+{
+  bool started = false;
+  spawn::generator<int> gen(lazy_producer{started});
+  EXPECT_FALSE(started);
+  EXPECT_NE(nullptr, gen.next());
+  EXPECT_TRUE(started);
+}
+
+struct throwing_producer {
+  void operator()(spawn::generator<int>::push_type& push) {
+    int i = 0;
+    push(i);
+    throw std::runtime_error("");
+  }
+};
+
+TEST(Generator, Exception)
+{
+  spawn::generator<int> gen(throwing_producer{});
+  EXPECT_NE(nullptr, gen.next());
+  EXPECT_THROW(gen.next(), std::runtime_error);
+  EXPECT_EQ(nullptr, gen.next());
+}
+
+struct unwind_guard {
+  bool& unwound;
+  ~unwind_guard() { unwound = true; }
+};
+
+struct endless_producer {
+  bool& unwound;
+  void operator()(spawn::generator<int>::push_type& push) {
+    unwind_guard guard{unwound};
+    for (int i = 0;; i++) {
+      push(i);
+    }
+  }
+};
+
+TEST(Generator, DestroyUnwindsProducer)
+{
+  bool unwound = false;
+  {
+    spawn::generator<int> gen(endless_producer{unwound});
+    EXPECT_EQ(0, *gen.next());
+    EXPECT_EQ(1, *gen.next());
+    EXPECT_FALSE(unwound);
+  }
+  EXPECT_TRUE(unwound);
+}
+
+template <typename CompletionToken>
+auto async_yield(CompletionToken&& token)
+  -> BOOST_ASIO_INITFN_RESULT_TYPE(CompletionToken, void())
+{
+  boost::asio::async_completion<CompletionToken, void()> init(token);
+  boost::asio::post(std::move(init.completion_handler));
+  return init.result.get();
+}
+
+struct async_producer {
+  spawn::yield_context yield;
+  void operator()(spawn::generator<int>::push_type& push) {
+    for (int i = 0; i < 3; i++) {
+      async_yield(yield); // suspend the consumer's coroutine
+      push(i);
+    }
+  }
+};
+
+struct async_consumer {
+  std::vector<int>& values;
+  void operator()(spawn::yield_context yield) {
+    spawn::generator<int> gen(async_producer{yield});
+    for (int& i : gen) {
+      values.push_back(i);
+      async_yield(yield);
+    }
+  }
+};
+
+TEST(Generator, AsyncProducer)
+{
+  boost::asio::io_context ioc;
+  std::vector<int> values;
+  spawn::spawn(ioc, async_consumer{values});
+  ioc.run();
+  EXPECT_EQ((std::vector<int>{0, 1, 2}), values);
+}
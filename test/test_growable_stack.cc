@@ -0,0 +1,101 @@
+//
+// test_growable_stack.cc
+// ~~~~~~~~~~~~~~~~~~~~~~
+//
+// Copyright (c) 2020 Casey Bodley (cbodley at redhat dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#include <spawn/growable_stack.hpp>
+#include <spawn/spawn.hpp>
+
+#include <cstring>
+#include <vector>
+
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/post.hpp>
+#if defined(BOOST_USE_SEGMENTED_STACKS)
+#include <boost/context/segmented_stack.hpp>
+#endif
+#include <gtest/gtest.h>
+
+static_assert(spawn::detail::is_stack_allocator<spawn::growable_stack>::value,
+              "growable_stack is a stack allocator");
+#if defined(BOOST_USE_SEGMENTED_STACKS)
+static_assert(spawn::detail::is_stack_allocator<
+                  boost::context::segmented_stack>::value,
+              "segmented_stack is a stack allocator");
+#endif
+
+// count the pages of [p, p + size) that are backed by memory
+static std::size_t resident_pages(void* p, std::size_t size)
+{
+  const std::size_t page = boost::context::stack_traits::page_size();
+  std::vector<unsigned char> vec((size + page - 1) / page);
+  EXPECT_EQ(0, ::mincore(p, size, vec.data()));
+  std::size_t count = 0;
+  for (auto v : vec) {
+    count += v & 1;
+  }
+  return count;
+}
+
+TEST(GrowableStack, Size)
+{
+  const std::size_t page = boost::context::stack_traits::page_size();
+  spawn::growable_stack salloc(1024 * 1024 + 1);
+  EXPECT_EQ(1024 * 1024 + page, salloc.max_size());
+
+  auto sctx = salloc.allocate();
+  EXPECT_EQ(salloc.max_size() + page, sctx.size); // with guard page
+  salloc.deallocate(sctx);
+
+  spawn::growable_stack unguarded(1024 * 1024, false);
+  sctx = unguarded.allocate();
+  EXPECT_EQ(1024 * 1024u, sctx.size);
+  unguarded.deallocate(sctx);
+}
+
+TEST(GrowableStack, TouchedPagesOnly)
+{
+  const std::size_t page = boost::context::stack_traits::page_size();
+  spawn::growable_stack salloc(8 * 1024 * 1024);
+  auto sctx = salloc.allocate();
+  char* top = static_cast<char*>(sctx.sp);
+  char* bottom = top - sctx.size;
+  EXPECT_EQ(0u, resident_pages(bottom, sctx.size));
+
+  std::memset(top - 3 * page, 0, 3 * page);
+  EXPECT_EQ(3u, resident_pages(bottom, sctx.size));
+  salloc.deallocate(sctx);
+}
+
+static int recurse(int depth)
+{
+  volatile char buffer[1024];
+  buffer[0] = static_cast<char>(depth);
+  if (depth == 0) {
+    return buffer[0];
+  }
+  return recurse(depth - 1) + buffer[0];
+}
+
+TEST(GrowableStack, Spawn)
+{
+  boost::asio::io_context ioc;
+  int shallow = -1;
+  int deep = -1;
+  spawn::spawn(ioc, [&] (spawn::yield_context yield) {
+      boost::asio::post(yield);
+      shallow = recurse(1);
+    }, spawn::growable_stack(4 * 1024 * 1024));
+  spawn::spawn(ioc, [&] (spawn::yield_context yield) {
+      boost::asio::post(yield);
+      deep = recurse(1024); // about 1MB of stack
+    }, spawn::growable_stack(4 * 1024 * 1024));
+  ioc.run();
+  EXPECT_EQ(1, shallow);
+  EXPECT_EQ(recurse(1024), deep);
+}
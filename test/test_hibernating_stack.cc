@@ -0,0 +1,231 @@
+//
+// test_hibernating_stack.cc
+// ~~~~~~~~~~~~~~~~~~~~~~~~~
+//
+// Copyright (c) 2020 Casey Bodley (cbodley at redhat dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#include <spawn/hibernating_stack.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/post.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <gtest/gtest.h>
+
+static_assert(spawn::detail::is_stack_allocator<spawn::hibernating_stack>::value,
+              "hibernating_stack is a stack allocator");
+
+static bool resident(const void* p)
+{
+  const std::size_t page = boost::context::stack_traits::page_size();
+  void* aligned = reinterpret_cast<void*>(
+      reinterpret_cast<std::uintptr_t>(p) & ~(page - 1));
+  unsigned char vec = 0;
+  EXPECT_EQ(0, ::mincore(aligned, page, &vec));
+  return vec & 1;
+}
+
+// wait on a timer that lives outside of the coroutine's stack
+static void wait(boost::asio::steady_timer& timer, spawn::yield_context yield)
+{
+  boost::system::error_code ec;
+  timer.async_wait(yield[ec]);
+}
+
+TEST(HibernatingStack, RestoreBeforeResume)
+{
+  boost::asio::io_context ioc;
+  boost::asio::steady_timer timer(ioc, std::chrono::hours(1));
+  spawn::hibernating_stack stacks;
+  int intact = 0;
+  for (int i = 0; i < 3; i++) {
+    spawn::spawn(ioc, [&, i] (spawn::yield_context yield) {
+        char buffer[2048];
+        std::memset(buffer, 'a' + i, sizeof(buffer));
+        wait(timer, yield);
+        for (char c : buffer) {
+          if (c != 'a' + i) {
+            return;
+          }
+        }
+        ++intact;
+      }, stacks);
+  }
+  ioc.poll();
+  EXPECT_EQ(0u, stacks.hibernated());
+  EXPECT_EQ(3u, stacks.hibernate_idle(std::chrono::seconds(0)));
+  EXPECT_EQ(3u, stacks.hibernated());
+  EXPECT_EQ(0u, stacks.hibernate_idle(std::chrono::seconds(0)));
+
+  timer.cancel();
+  ioc.run();
+  EXPECT_EQ(3, intact);
+  EXPECT_EQ(0u, stacks.hibernated());
+}
+
+TEST(HibernatingStack, IdleThreshold)
+{
+  boost::asio::io_context ioc;
+  boost::asio::steady_timer timer(ioc, std::chrono::hours(1));
+  spawn::hibernating_stack stacks;
+  spawn::spawn(ioc, [&] (spawn::yield_context yield) {
+      wait(timer, yield);
+    }, stacks);
+  ioc.poll();
+  EXPECT_EQ(0u, stacks.hibernate_idle(std::chrono::hours(1)));
+  EXPECT_EQ(0u, stacks.hibernated());
+  timer.cancel();
+  ioc.run();
+}
+
+// the address of a page that the coroutine touched, deeper than it waits
+static std::uintptr_t deep_page = 0;
+
+BOOST_NOINLINE static void touch_deep_stack()
+{
+  volatile char buffer[64 * 1024];
+  for (std::size_t i = 0; i < sizeof(buffer); i += 1024) {
+    buffer[i] = 1;
+  }
+  deep_page = reinterpret_cast<std::uintptr_t>(&buffer[0]);
+}
+
+TEST(HibernatingStack, ReleasePages)
+{
+  boost::asio::io_context ioc;
+  boost::asio::steady_timer timer(ioc, std::chrono::hours(1));
+  spawn::hibernating_stack stacks;
+  bool deep_resident_after_resume = true;
+  spawn::spawn(ioc, [&] (spawn::yield_context yield) {
+      touch_deep_stack();
+      wait(timer, yield);
+      // only the part of the stack in use was copied back
+      deep_resident_after_resume = resident(reinterpret_cast<const void*>(deep_page));
+    }, stacks);
+  ioc.poll();
+  ASSERT_TRUE(deep_page);
+  EXPECT_TRUE(resident(reinterpret_cast<const void*>(deep_page)));
+  EXPECT_EQ(1u, stacks.hibernate_idle(std::chrono::seconds(0)));
+  EXPECT_FALSE(resident(reinterpret_cast<const void*>(deep_page)));
+  timer.cancel();
+  ioc.run();
+  EXPECT_FALSE(deep_resident_after_resume);
+}
+
+TEST(HibernatingStack, NestedSpawn)
+{
+  boost::asio::io_context ioc;
+  boost::asio::steady_timer timer(ioc, std::chrono::hours(1));
+  spawn::hibernating_stack stacks;
+  int parent = 0, child = 0;
+  spawn::spawn(ioc, [&] (spawn::yield_context yield) {
+      int value = 1;
+      spawn::spawn(yield, [&] (spawn::yield_context yield) {
+          int value = 2;
+          wait(timer, yield);
+          child = value;
+        }, stacks);
+      wait(timer, yield);
+      parent = value;
+    }, stacks);
+  ioc.poll();
+  EXPECT_EQ(2u, stacks.hibernate_idle(std::chrono::seconds(0)));
+  timer.cancel();
+  ioc.run();
+  EXPECT_EQ(1, parent);
+  EXPECT_EQ(2, child);
+}
+
+TEST(HibernatingStack, MigrateBetweenThreads)
+{
+  constexpr int coroutines = 16;
+  constexpr int threads = 4;
+  boost::asio::io_context ioc;
+  spawn::hibernating_stack stacks;
+  std::atomic<int> mismatches{0};
+  std::atomic<int> running{coroutines};
+  for (int i = 0; i < coroutines; i++) {
+    spawn::spawn(ioc, [&, i] (spawn::yield_context yield) {
+        char buffer[512];
+        std::memset(buffer, i, sizeof(buffer));
+        for (int j = 0; j < 500; j++) {
+          boost::asio::post(yield);
+          if (buffer[j % sizeof(buffer)] != i) {
+            ++mismatches;
+          }
+        }
+        --running;
+      }, stacks);
+  }
+  std::vector<std::thread> workers;
+  for (int i = 0; i < threads; i++) {
+    workers.emplace_back([&ioc] { ioc.run(); });
+  }
+  while (running) {
+    stacks.hibernate_idle(std::chrono::seconds(0));
+    std::this_thread::yield();
+  }
+  for (auto& t : workers) {
+    t.join();
+  }
+  EXPECT_EQ(0, mismatches);
+}
+
+#if !defined(__SANITIZE_ADDRESS__) // forced unwind on a coroutine stack
+struct on_destroy
+{
+  int value = 42;
+  int* result;
+  ~on_destroy() { *result = value; }
+};
+
+TEST(HibernatingStack, DestroyHibernated)
+{
+  int result = 0;
+  spawn::hibernating_stack stacks;
+  {
+    boost::asio::io_context ioc;
+    boost::asio::steady_timer timer(ioc, std::chrono::hours(1));
+    spawn::spawn(ioc, [&] (spawn::yield_context yield) {
+        on_destroy guard;
+        guard.result = &result;
+        wait(timer, yield);
+      }, stacks);
+    ioc.poll();
+    EXPECT_EQ(1u, stacks.hibernate_idle(std::chrono::seconds(0)));
+  }
+  // the stack was restored before it was unwound
+  EXPECT_EQ(42, result);
+  EXPECT_EQ(0u, stacks.hibernated());
+}
+#endif
+
+#if defined(SPAWN_HIBERNATION_CHECKS)
+TEST(HibernatingStackDeathTest, AccessHibernated)
+{
+  boost::asio::io_context ioc;
+  boost::asio::steady_timer timer(ioc, std::chrono::hours(1));
+  spawn::hibernating_stack stacks;
+  volatile int* local = nullptr;
+  spawn::spawn(ioc, [&] (spawn::yield_context yield) {
+      volatile int value = 1;
+      local = &value;
+      wait(timer, yield);
+    }, stacks);
+  ioc.poll();
+  EXPECT_EQ(1u, stacks.hibernate_idle(std::chrono::seconds(0)));
+  EXPECT_DEATH(*local = 2, "");
+  timer.cancel();
+  ioc.run();
+}
+#endif
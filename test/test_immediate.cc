@@ -0,0 +1,103 @@
+//
+// test_immediate.cc
+// ~~~~~~~~~~~~~~~~~
+//
+// Copyright (c) 2020 Casey Bodley (cbodley at redhat dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#include <spawn/immediate.hpp>
+
+#include <boost/asio/io_context.hpp>
+#include <gtest/gtest.h>
+
+
+template <typename CompletionToken>
+auto async_ready(CompletionToken&& token)
+  -> BOOST_ASIO_INITFN_RESULT_TYPE(CompletionToken, void())
+{
+  boost::asio::async_completion<CompletionToken, void()> init(token);
+  spawn::complete_immediately(std::move(init.completion_handler));
+  return init.result.get();
+}
+
+template <typename CompletionToken>
+auto async_value(boost::system::error_code ec, int value,
+                 CompletionToken&& token)
+  -> BOOST_ASIO_INITFN_RESULT_TYPE(CompletionToken,
+                                   void(boost::system::error_code, int))
+{
+  boost::asio::async_completion<CompletionToken,
+      void(boost::system::error_code, int)> init(token);
+  spawn::complete_immediately(std::move(init.completion_handler), ec, value);
+  return init.result.get();
+}
+
+template <typename Function>
+void spawn_unstranded(boost::asio::io_context& ioc, Function&& f)
+{
+  spawn::spawn(bind_executor(ioc.get_executor(), [] {}),
+               std::forward<Function>(f));
+}
+
+TEST(Immediate, NoSuspend)
+{
+  boost::asio::io_context ioc;
+  bool done = false;
+  spawn_unstranded(ioc, [&done] (spawn::yield_context y) {
+      for (int i = 0; i < 10; i++) {
+        async_ready(y);
+      }
+      done = true;
+    });
+  EXPECT_EQ(1u, ioc.run_one());
+  EXPECT_TRUE(done);
+}
+
+TEST(Immediate, Values)
+{
+  boost::asio::io_context ioc;
+  bool done = false;
+  spawn_unstranded(ioc, [&done] (spawn::yield_context y) {
+      EXPECT_EQ(42, async_value({}, 42, y));
+
+      boost::system::error_code ec;
+      EXPECT_EQ(7, async_value(boost::asio::error::eof, 7, y[ec]));
+      EXPECT_EQ(boost::asio::error::eof, ec);
+
+      EXPECT_THROW(async_value(boost::asio::error::eof, 0, y),
+                   boost::system::system_error);
+
+      auto r = async_value(boost::asio::error::eof, 3, y.as_result());
+      EXPECT_EQ(boost::asio::error::eof, r.error());
+      EXPECT_EQ(3, *r);
+      done = true;
+    });
+  EXPECT_EQ(1u, ioc.run_one());
+  EXPECT_TRUE(done);
+}
+
+TEST(Immediate, Limit)
+{
+  boost::asio::io_context ioc;
+  spawn_unstranded(ioc, [] (spawn::yield_context y) {
+      for (int i = 0; i < 200; i++) {
+        async_ready(y);
+      }
+    });
+  // every 65th completion is posted
+  EXPECT_EQ(4u, ioc.run());
+}
+
+TEST(Immediate, OtherHandler)
+{
+  boost::asio::io_context ioc;
+  int value = 0;
+  async_value({}, 42, bind_executor(ioc,
+      [&value] (boost::system::error_code, int v) { value = v; }));
+  EXPECT_EQ(0, value);
+  ioc.run();
+  EXPECT_EQ(42, value);
+}
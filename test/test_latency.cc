@@ -0,0 +1,101 @@
+//
+// test_latency.cc
+// ~~~~~~~~~~~~~~~
+//
+// Copyright (c) 2020 Casey Bodley (cbodley at redhat dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef SPAWN_LATENCY_HISTOGRAMS
+#define SPAWN_LATENCY_HISTOGRAMS
+#endif
+#include <spawn/spawn.hpp>
+
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/post.hpp>
+#include <gtest/gtest.h>
+
+
+TEST(LatencyHistogram, BucketBounds)
+{
+  using h = spawn::latency_histogram;
+  for (std::uint64_t v : {0ull, 1ull, 15ull, 16ull, 17ull, 31ull, 32ull, 33ull,
+                          1000ull, 123456789ull, ~0ull}) {
+    const std::size_t i = h::bucket_index(v);
+    EXPECT_LE(v, h::bucket_upper_bound(i));
+    if (i > 0) {
+      EXPECT_GT(v, h::bucket_upper_bound(i - 1));
+    }
+  }
+  EXPECT_EQ(h::bucket_index(~0ull), std::size_t(h::bucket_count) - 1);
+}
+
+TEST(LatencyHistogram, Percentiles)
+{
+  spawn::latency_histogram h;
+  EXPECT_EQ(0u, h.percentile(50));
+  for (std::uint64_t v = 1; v <= 1000; v++) {
+    h.record(v);
+  }
+  EXPECT_EQ(1000u, h.count());
+  EXPECT_EQ(1u, h.min());
+  EXPECT_EQ(1000u, h.max());
+  EXPECT_DOUBLE_EQ(500.5, h.mean());
+  // within the 1/16 relative error of a bucket
+  EXPECT_GE(h.percentile(50), 500u);
+  EXPECT_LE(h.percentile(50), 532u);
+  EXPECT_GE(h.percentile(99), 990u);
+  EXPECT_EQ(1000u, h.percentile(100));
+
+  spawn::latency_histogram merged;
+  merged.merge(h);
+  merged.merge(h);
+  EXPECT_EQ(2000u, merged.count());
+  EXPECT_EQ(h.percentile(50), merged.percentile(50));
+}
+
+template <typename CompletionToken>
+auto async_yield(CompletionToken&& token)
+  -> BOOST_ASIO_INITFN_RESULT_TYPE(CompletionToken, void())
+{
+  boost::asio::async_completion<CompletionToken, void()> init(token);
+  boost::asio::post(std::move(init.completion_handler));
+  return init.result.get();
+}
+
+struct tagged_yield_handler {
+  int count;
+  void operator()(spawn::yield_context y) {
+    for (int i = 0; i < count; i++) {
+      async_yield(y.tag("test.yield"));
+    }
+    async_yield(y);
+  }
+};
+
+TEST(Latency, RecordTaggedOperations)
+{
+  spawn::latency_reset();
+  boost::asio::io_context ioc;
+  spawn::spawn(ioc, tagged_yield_handler{10});
+  ioc.run();
+
+  auto stats = spawn::latency_snapshot();
+  ASSERT_EQ(1u, stats.count("test.yield"));
+  EXPECT_EQ(10u, stats["test.yield"].operation.count());
+  EXPECT_EQ(10u, stats["test.yield"].resume.count());
+
+  // the untagged operation is keyed by its completion signature
+  std::uint64_t untagged = 0;
+  for (auto& s : stats) {
+    if (s.first != "test.yield") {
+      untagged += s.second.resume.count();
+    }
+  }
+  EXPECT_EQ(1u, untagged);
+
+  spawn::latency_reset();
+  EXPECT_EQ(0u, spawn::latency_snapshot()["test.yield"].resume.count());
+}
@@ -0,0 +1,140 @@
+//
+// test_limiter.cc
+// ~~~~~~~~~~~~~~~
+//
+// Copyright (c) 2020 Casey Bodley (cbodley at redhat dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#include <spawn/limiter.hpp>
+
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/post.hpp>
+#include <boost/context/protected_fixedsize_stack.hpp>
+#include <gtest/gtest.h>
+
+
+template <typename CompletionToken>
+auto async_yield(CompletionToken&& token)
+  -> BOOST_ASIO_INITFN_RESULT_TYPE(CompletionToken, void())
+{
+  boost::asio::async_completion<CompletionToken, void()> init(token);
+  boost::asio::post(std::move(init.completion_handler));
+  return init.result.get();
+}
+
+struct live_checker {
+  spawn::limiter& limit;
+  std::size_t max_live;
+  int& called;
+  template <typename T>
+  void operator()(spawn::basic_yield_context<T> y) {
+    EXPECT_LE(limit.get_stats().live, max_live);
+    async_yield(y);
+    EXPECT_LE(limit.get_stats().live, max_live);
+    ++called;
+  }
+};
+
+TEST(Limiter, Wait)
+{
+  boost::asio::io_context ioc;
+  spawn::limiter limit(2, 10);
+  int called = 0;
+  for (int i = 0; i < 5; i++) {
+    EXPECT_TRUE(limit.spawn(ioc, live_checker{limit, 2, called}));
+  }
+  auto stats = limit.get_stats();
+  EXPECT_EQ(2u, stats.live);
+  EXPECT_EQ(3u, stats.queued);
+  EXPECT_EQ(3u, stats.max_queued);
+
+  ioc.run();
+  EXPECT_EQ(5, called);
+  stats = limit.get_stats();
+  EXPECT_EQ(0u, stats.live);
+  EXPECT_EQ(0u, stats.queued);
+  EXPECT_EQ(5u, stats.spawned);
+  EXPECT_EQ(3u, stats.waited);
+  EXPECT_EQ(0u, stats.rejected);
+  EXPECT_GE(stats.total_wait, stats.max_wait);
+}
+
+TEST(Limiter, QueueFull)
+{
+  boost::asio::io_context ioc;
+  spawn::limiter limit(1, 1);
+  int called = 0;
+  EXPECT_TRUE(limit.spawn(ioc.get_executor(), live_checker{limit, 1, called},
+                          boost::context::protected_fixedsize_stack(65536)));
+  EXPECT_TRUE(limit.spawn(ioc.get_executor(), live_checker{limit, 1, called}));
+  EXPECT_FALSE(limit.spawn(ioc.get_executor(), live_checker{limit, 1, called}));
+  ioc.run();
+  EXPECT_EQ(2, called);
+  EXPECT_EQ(1u, limit.get_stats().rejected);
+}
+
+TEST(Limiter, Reject)
+{
+  boost::asio::io_context ioc;
+  spawn::limiter limit(1, 10, spawn::limiter::overflow_policy::reject);
+  int called = 0;
+  EXPECT_TRUE(limit.spawn(ioc, live_checker{limit, 1, called}));
+  EXPECT_FALSE(limit.spawn(ioc, live_checker{limit, 1, called}));
+  EXPECT_EQ(0u, limit.get_stats().queued);
+  ioc.run();
+  EXPECT_EQ(1, called);
+  // the slot is free again
+  EXPECT_TRUE(limit.spawn(ioc, live_checker{limit, 1, called}));
+}
+
+struct throwing_handler {
+  template <typename T>
+  void operator()(spawn::basic_yield_context<T>) {
+    throw std::runtime_error("");
+  }
+};
+
+TEST(Limiter, ReleaseOnException)
+{
+  boost::asio::io_context ioc;
+  spawn::limiter limit(1);
+  EXPECT_TRUE(limit.spawn(ioc, throwing_handler{}));
+  EXPECT_THROW(ioc.run_one(), std::runtime_error);
+  EXPECT_EQ(0u, limit.get_stats().live);
+}
+
+TEST(Limiter, ReleaseUnstarted)
+{
+  spawn::limiter limit(1, 1);
+  int called = 0;
+  {
+    boost::asio::io_context ioc;
+    EXPECT_TRUE(limit.spawn(ioc, live_checker{limit, 1, called}));
+    EXPECT_TRUE(limit.spawn(ioc, live_checker{limit, 1, called}));
+  } // destroy without running
+  EXPECT_EQ(0, called);
+  EXPECT_EQ(0u, limit.get_stats().live);
+  EXPECT_EQ(0u, limit.get_stats().queued);
+}
+
+struct nested_spawner {
+  spawn::limiter& limit;
+  int& called;
+  void operator()(spawn::yield_context y) {
+    EXPECT_FALSE(limit.spawn(y, live_checker{limit, 1, called}));
+  }
+};
+
+TEST(Limiter, SpawnYieldContext)
+{
+  boost::asio::io_context ioc;
+  spawn::limiter limit(1, 0);
+  int called = 0;
+  EXPECT_TRUE(limit.spawn(ioc, nested_spawner{limit, called}));
+  ioc.run();
+  EXPECT_EQ(0, called);
+  EXPECT_EQ(1u, limit.get_stats().rejected);
+}
@@ -0,0 +1,225 @@
+//
+// test_polling_runtime.cc
+// ~~~~~~~~~~~~~~~~~~~~~~~
+//
+// Copyright (c) 2020 Casey Bodley (cbodley at redhat dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#include <spawn/polling_runtime.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <set>
+#include <thread>
+
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/asio/post.hpp>
+#include <boost/asio/read.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <boost/asio/write.hpp>
+#include <gtest/gtest.h>
+
+using tcp = boost::asio::ip::tcp;
+
+TEST(PollingRuntime, SpawnShards)
+{
+  spawn::polling_options options;
+  options.shards = 3;
+  spawn::polling_runtime runtime(options);
+  EXPECT_EQ(3u, runtime.size());
+
+  std::atomic<int> count{0};
+  std::thread::id ids[6];
+  for (int i = 0; i < 6; i++) {
+    spawn::spawn(runtime, [&, i] (spawn::yield_context yield) {
+        boost::asio::post(yield);
+        ids[i] = std::this_thread::get_id();
+        ++count;
+      });
+  }
+  runtime.join();
+  EXPECT_EQ(6, count);
+  // spawn() picks the shards in turn
+  EXPECT_EQ(3u, std::set<std::thread::id>(ids, ids + 6).size());
+  EXPECT_EQ(ids[0], ids[3]);
+}
+
+TEST(PollingRuntime, SpawnExecutor)
+{
+  spawn::polling_runtime runtime;
+  bool finished = false;
+  spawn::spawn(runtime.get_executor(), [&] (spawn::yield_context yield) {
+      boost::asio::steady_timer timer(yield.handler_.get_executor(),
+                                      std::chrono::milliseconds(1));
+      timer.async_wait(yield);
+      finished = true;
+    });
+  runtime.join();
+  EXPECT_TRUE(finished);
+}
+
+struct child_task {
+  std::thread::id& thread;
+  bool& strand;
+  template <typename Handler>
+  void operator()(spawn::basic_yield_context<Handler> yield) {
+    boost::asio::post(yield);
+    thread = std::this_thread::get_id();
+    strand = spawn::detail::is_strand_executor(
+        boost::asio::get_associated_executor(yield.handler_));
+  }
+};
+
+struct parent_task {
+  std::thread::id& thread;
+  child_task child;
+  template <typename Handler>
+  void operator()(spawn::basic_yield_context<Handler> yield) {
+    thread = std::this_thread::get_id();
+    // the child inherits the shard's executor
+    spawn::spawn(yield, child);
+  }
+};
+
+TEST(PollingRuntime, SpawnHandler)
+{
+  spawn::polling_runtime runtime;
+  std::thread::id coroutine_thread, child_thread, handler_thread;
+  bool strand = true;
+  spawn::spawn(runtime, [&] { handler_thread = std::this_thread::get_id(); },
+               parent_task{coroutine_thread, {child_thread, strand}});
+  runtime.join();
+  EXPECT_NE(std::thread::id(), coroutine_thread);
+  EXPECT_NE(std::this_thread::get_id(), coroutine_thread);
+  EXPECT_EQ(coroutine_thread, child_thread);
+  EXPECT_EQ(coroutine_thread, handler_thread);
+  EXPECT_FALSE(strand);
+}
+
+TEST(PollingRuntime, NoAdaptiveSpin)
+{
+  spawn::polling_runtime runtime;
+  bool serial = false, shard_serial = false, may_spin = true;
+  spawn::detail::net::any_io_executor ex;
+  spawn::spawn(runtime, [&] (spawn::yield_context yield) {
+      ex = boost::asio::get_associated_executor(yield.handler_);
+      serial = spawn::detail::runs_serially(ex);
+      shard_serial = spawn::detail::runs_serially(runtime.shard(0).get_executor());
+      may_spin = spawn::detail::may_spin(ex);
+    });
+  runtime.join();
+  EXPECT_TRUE(serial);
+  EXPECT_TRUE(shard_serial);
+  EXPECT_FALSE(may_spin);
+  // other threads don't run the shard
+  EXPECT_FALSE(spawn::detail::runs_serially(ex));
+}
+
+TEST(PollingRuntime, SleepWhenIdle)
+{
+  spawn::polling_options options;
+  options.spin_duration = std::chrono::microseconds(10);
+  spawn::polling_runtime runtime(options);
+
+  // a timer that expires after the shard went to sleep still wakes it
+  std::atomic<bool> finished{false};
+  spawn::spawn(runtime, [&] (spawn::yield_context yield) {
+      boost::asio::steady_timer timer(yield.handler_.get_executor(),
+                                      std::chrono::milliseconds(20));
+      timer.async_wait(yield);
+      finished = true;
+    });
+  runtime.join();
+  EXPECT_TRUE(finished);
+  EXPECT_LT(0u, runtime.sleeps());
+}
+
+TEST(PollingRuntime, PostWhileAsleep)
+{
+  spawn::polling_options options;
+  options.spin_duration = std::chrono::nanoseconds(0);
+  spawn::polling_runtime runtime(options);
+  while (runtime.sleeps() == 0) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  std::atomic<bool> posted{false};
+  boost::asio::post(runtime.shard(0), [&] { posted = true; });
+  runtime.join();
+  EXPECT_TRUE(posted);
+}
+
+TEST(PollingRuntime, Loopback)
+{
+  spawn::polling_runtime runtime;
+  tcp::acceptor acceptor(runtime.shard(0),
+                         {boost::asio::ip::address_v4::loopback(), 0});
+  const auto endpoint = acceptor.local_endpoint();
+  int replies = 0;
+
+  spawn::spawn(runtime, [&] (spawn::yield_context yield) {
+      tcp::socket socket(yield.handler_.get_executor());
+      acceptor.async_accept(socket, yield);
+      acceptor.close();
+      char c;
+      boost::system::error_code ec;
+      while (boost::asio::async_read(socket, boost::asio::buffer(&c, 1),
+                                     yield[ec])) {
+        boost::asio::async_write(socket, boost::asio::buffer(&c, 1), yield);
+      }
+    });
+  spawn::spawn(runtime, [&] (spawn::yield_context yield) {
+      tcp::socket socket(yield.handler_.get_executor());
+      socket.async_connect(endpoint, yield);
+#if defined(SO_BUSY_POLL)
+      boost::system::error_code ec;
+      // raising it above net.core.busy_read needs CAP_NET_ADMIN
+      socket.set_option(spawn::polling_runtime::busy_poll(0), ec);
+      spawn::polling_runtime::busy_poll option(-1);
+      socket.get_option(option, ec);
+      EXPECT_FALSE(ec);
+      EXPECT_LE(0, option.value());
+#endif
+      for (int i = 0; i < 100; i++) {
+        char c = 'x';
+        boost::asio::async_write(socket, boost::asio::buffer(&c, 1), yield);
+        boost::asio::async_read(socket, boost::asio::buffer(&c, 1), yield);
+        replies += c == 'x';
+      }
+    });
+  runtime.join();
+  EXPECT_EQ(100, replies);
+}
+
+TEST(PollingRuntime, Stop)
+{
+  spawn::polling_runtime runtime;
+  std::atomic<bool> started{false};
+  spawn::spawn(runtime, [&] (spawn::yield_context yield) {
+      boost::asio::steady_timer timer(yield.handler_.get_executor(),
+                                      std::chrono::hours(1));
+      started = true;
+      timer.async_wait(yield);
+    });
+  while (!started) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  runtime.stop();
+  runtime.join();
+}
+
+TEST(PollingRuntime, PinThreads)
+{
+  spawn::polling_options options;
+  options.cpus = {0};
+  spawn::polling_runtime runtime(options);
+  std::atomic<bool> finished{false};
+  spawn::spawn(runtime, [&] (spawn::yield_context yield) {
+      boost::asio::post(yield);
+      finished = true;
+    });
+  runtime.join();
+  EXPECT_TRUE(finished);
+}
@@ -0,0 +1,70 @@
+//
+// test_probes.cc
+// ~~~~~~~~~~~~~~
+//
+// Copyright (c) 2020 Casey Bodley (cbodley at redhat dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#include <spawn/spawn.hpp>
+#include <spawn/wait.hpp>
+
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/post.hpp>
+#include <gtest/gtest.h>
+
+struct void_op {
+  template <typename CompletionToken>
+  auto operator()(CompletionToken&& token)
+    -> BOOST_ASIO_INITFN_RESULT_TYPE(CompletionToken, void())
+  {
+    boost::asio::async_completion<CompletionToken, void()> init(token);
+    boost::asio::post(std::move(init.completion_handler));
+    return init.result.get();
+  }
+};
+
+// pass through every probe site, whether or not the probes are compiled in
+TEST(Probes, Lifecycle)
+{
+  boost::asio::io_context ioc;
+  bool finished = false;
+  spawn::spawn(ioc, [&] (spawn::yield_context yield) {
+      boost::asio::post(yield.tag("post"));
+      spawn::wait_all(yield, void_op{}, void_op{});
+      finished = true;
+    });
+  spawn::spawn(ioc, [] (spawn::yield_context yield) {
+      boost::asio::post(yield);
+      throw std::runtime_error("oops");
+    });
+  EXPECT_THROW(ioc.run(), std::runtime_error);
+  ioc.restart();
+  ioc.run();
+  EXPECT_TRUE(finished);
+}
+
+TEST(Probes, Notes)
+{
+#if defined(SPAWN_HAS_PROBES)
+  // each probe leaves an SDT note with its provider and name
+  std::ifstream exe("/proc/self/exe", std::ios::binary);
+  ASSERT_TRUE(exe.good());
+  const std::string image{std::istreambuf_iterator<char>(exe),
+                          std::istreambuf_iterator<char>()};
+  for (const char* name : {"create", "start", "suspend", "resume",
+                           "exception", "finish"}) {
+    const std::string note = std::string("spawn") + '\0' + name + '\0';
+    EXPECT_NE(std::string::npos, image.find(note)) << name;
+  }
+#else
+  GTEST_SKIP() << "built without <sys/sdt.h>";
+#endif
+}
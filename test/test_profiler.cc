@@ -0,0 +1,111 @@
+//
+// test_profiler.cc
+// ~~~~~~~~~~~~~~~~
+//
+// Copyright (c) 2020 Casey Bodley (cbodley at redhat dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef SPAWN_PROFILER
+#define SPAWN_PROFILER
+#endif
+#include <spawn/profiler.hpp>
+
+#include <chrono>
+#include <sstream>
+#include <string>
+#include <system_error>
+
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/post.hpp>
+#include <gtest/gtest.h>
+
+// burn cpu in a frame of its own, so that it shows up in the stacks, until
+// the profiler takes the given number of samples. the timer counts cpu time,
+// so a wall-clock duration gets fewer samples on a loaded machine
+BOOST_NOINLINE void profiler_busy_loop(const spawn::sampling_profiler& profiler,
+                                       std::size_t count)
+{
+  const std::size_t target = profiler.samples() + profiler.dropped() + count;
+  const auto timeout = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+  volatile unsigned long n = 0;
+  while (profiler.samples() + profiler.dropped() < target &&
+         std::chrono::steady_clock::now() < timeout) {
+    n = n + 1;
+  }
+}
+
+struct busy_task
+{
+  const spawn::sampling_profiler* profiler;
+
+  template <typename Handler>
+  void operator()(spawn::basic_yield_context<Handler> yield)
+  {
+    for (int i = 0; i < 10; i++) {
+      profiler_busy_loop(*profiler, 2);
+      boost::asio::post(yield);
+    }
+  }
+};
+
+TEST(Profiler, Attribution)
+{
+  spawn::sampling_profiler profiler;
+  profiler.start(1000);
+  boost::asio::io_context ioc;
+  spawn::spawn(ioc, busy_task{&profiler});
+  ioc.run();
+  profiler_busy_loop(profiler, 5);
+  profiler.stop();
+  ASSERT_LT(0u, profiler.samples());
+  EXPECT_EQ(0u, profiler.dropped());
+
+  std::ostringstream out;
+  profiler.write_collapsed(out);
+  std::istringstream in(out.str());
+  std::size_t coroutine = 0, other = 0, walked = 0;
+  for (std::string line; std::getline(in, line); ) {
+    const std::size_t count = std::stoul(line.substr(line.rfind(' ') + 1));
+    if (line.compare(0, 9, "busy_task") == 0) {
+      coroutine += count;
+      // the walk reaches the coroutine's function through its callers
+      if (line.find("profiler_busy_loop") != std::string::npos &&
+          line.find("busy_task::operator()") != std::string::npos) {
+        walked += count;
+      }
+    } else if (line.compare(0, 14, "[no coroutine]") == 0) {
+      other += count;
+    }
+  }
+  EXPECT_LT(0u, coroutine);
+  EXPECT_LT(0u, walked);
+  EXPECT_LT(0u, other);
+}
+
+TEST(Profiler, Capacity)
+{
+  spawn::sampling_profiler profiler(4);
+  profiler.start(1000);
+  profiler_busy_loop(profiler, 5);
+  profiler.stop();
+  EXPECT_EQ(4u, profiler.samples());
+  EXPECT_LT(0u, profiler.dropped());
+  profiler.clear();
+  EXPECT_EQ(0u, profiler.samples());
+  std::ostringstream out;
+  profiler.write_collapsed(out);
+  EXPECT_EQ("", out.str());
+}
+
+TEST(Profiler, OneAtATime)
+{
+  spawn::sampling_profiler first, second;
+  first.start();
+  EXPECT_THROW(second.start(), std::system_error);
+  first.stop();
+  second.start();
+  second.stop();
+}
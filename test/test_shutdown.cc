@@ -0,0 +1,186 @@
+//
+// test_shutdown.cc
+// ~~~~~~~~~~~~~~~~
+//
+// Copyright (c) 2020 Casey Bodley (cbodley at redhat dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#include <spawn/shutdown.hpp>
+
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <gtest/gtest.h>
+
+
+struct timer_waiter {
+  std::atomic<int>& aborted;
+  template <typename T>
+  void operator()(spawn::basic_yield_context<T> y, spawn::shutdown_signal& sig) {
+    boost::asio::steady_timer timer(get_associated_executor(y.handler_),
+                                    std::chrono::hours(1));
+    sig.on_shutdown([&timer] { timer.cancel(); });
+    boost::system::error_code ec = boost::asio::error::operation_aborted;
+    if (!sig.requested()) {
+      timer.async_wait(y[ec]);
+    }
+    if (ec == boost::asio::error::operation_aborted) {
+      ++aborted;
+    }
+    sig.on_shutdown(nullptr);
+  }
+};
+
+TEST(Shutdown, CancelPending)
+{
+  boost::asio::io_context ioc;
+  spawn::shutdown_group group(ioc.get_executor(), 3); // several batches
+  std::atomic<int> aborted{0};
+  for (int i = 0; i < 10; i++) {
+    group.spawn(ioc, timer_waiter{aborted});
+  }
+  EXPECT_EQ(10u, group.size());
+  ioc.poll();
+  EXPECT_EQ(0, aborted);
+  ioc.restart();
+
+  bool done = false;
+  group.async_shutdown([&] { done = true; });
+  ioc.run();
+  EXPECT_TRUE(done);
+  EXPECT_EQ(10, aborted);
+  EXPECT_EQ(0u, group.size());
+}
+
+TEST(Shutdown, Empty)
+{
+  boost::asio::io_context ioc;
+  spawn::shutdown_group group(ioc.get_executor());
+  bool done = false;
+  group.async_shutdown([&] {
+      // without an associated executor, the handler runs on the group's
+      EXPECT_TRUE(ioc.get_executor().running_in_this_thread());
+      done = true;
+    });
+  EXPECT_FALSE(done);
+  ioc.run();
+  EXPECT_TRUE(done);
+}
+
+TEST(Shutdown, HandlerExecutor)
+{
+  boost::asio::io_context ioc;
+  boost::asio::io_context other;
+  spawn::shutdown_group group(ioc.get_executor());
+  bool done = false;
+  group.async_shutdown(boost::asio::bind_executor(other, [&] { done = true; }));
+  // the handler completes without the group's io_context running
+  other.run();
+  EXPECT_TRUE(done);
+  EXPECT_EQ(0u, ioc.poll());
+}
+
+TEST(Shutdown, Unstarted)
+{
+  boost::asio::io_context ioc;
+  spawn::shutdown_group group(ioc.get_executor());
+  std::atomic<int> aborted{0};
+  group.spawn(ioc, timer_waiter{aborted});
+  bool done = false;
+  group.async_shutdown([&] { done = true; });
+  // the coroutine starts with its signal set
+  ioc.run();
+  EXPECT_TRUE(done);
+  EXPECT_EQ(1, aborted);
+}
+
+struct signal_checker {
+  bool& requested;
+  template <typename T>
+  void operator()(spawn::basic_yield_context<T>, spawn::shutdown_signal& sig) {
+    requested = sig.requested();
+  }
+};
+
+TEST(Shutdown, SpawnAfterShutdown)
+{
+  boost::asio::io_context ioc;
+  spawn::shutdown_group group(ioc.get_executor());
+  group.async_shutdown([] {});
+  bool requested = false;
+  group.spawn(ioc, signal_checker{requested});
+  ioc.run();
+  EXPECT_TRUE(requested);
+}
+
+struct shutdown_caller {
+  spawn::shutdown_group& group;
+  bool& done;
+  void operator()(spawn::yield_context y) {
+    group.async_shutdown(y);
+    done = true;
+  }
+};
+
+TEST(Shutdown, YieldContext)
+{
+  boost::asio::io_context ioc;
+  spawn::shutdown_group group(ioc.get_executor());
+  std::atomic<int> aborted{0};
+  for (int i = 0; i < 4; i++) {
+    group.spawn(ioc, timer_waiter{aborted});
+  }
+  bool done = false;
+  spawn::spawn(ioc, shutdown_caller{group, done});
+  ioc.run();
+  EXPECT_TRUE(done);
+  EXPECT_EQ(4, aborted);
+}
+
+TEST(Shutdown, Destroyed)
+{
+  boost::asio::io_context group_ioc;
+  spawn::shutdown_group group(group_ioc.get_executor());
+  std::atomic<int> aborted{0};
+  {
+    boost::asio::io_context ioc;
+    group.spawn(ioc, timer_waiter{aborted});
+    group.spawn(ioc, timer_waiter{aborted});
+    ioc.poll();
+    EXPECT_EQ(2u, group.size());
+  } // unwinds the suspended coroutines
+  EXPECT_EQ(0u, group.size());
+  EXPECT_EQ(0, aborted);
+}
+
+TEST(Shutdown, MultiThreaded)
+{
+  boost::asio::io_context ioc;
+  spawn::shutdown_group group(ioc.get_executor(), 16);
+  std::atomic<int> aborted{0};
+  constexpr int count = 200;
+  for (int i = 0; i < count; i++) {
+    group.spawn(ioc, timer_waiter{aborted});
+  }
+  ioc.poll();
+  ioc.restart();
+
+  std::atomic<bool> done{false};
+  group.async_shutdown([&] { done = true; });
+  std::vector<std::thread> threads;
+  for (int i = 0; i < 4; i++) {
+    threads.emplace_back([&ioc] { ioc.run(); });
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+  EXPECT_TRUE(done);
+  EXPECT_EQ(count, aborted);
+  EXPECT_EQ(0u, group.size());
+}
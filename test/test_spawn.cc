@@ -380,3 +380,72 @@ TEST(Spawn, ReturnMultipleNonDefaultConstructible)
   ASSERT_EQ(2, ioc.poll());
   ASSERT_TRUE(result);
 }
+
+struct result_handler {
+  boost::optional<spawn::result<int>>& result;
+  void operator()(spawn::yield_context y) {
+    using Signature = void(error_code, int);
+    auto token = y.as_result();
+    boost::asio::async_completion<decltype(token), Signature> init(token);
+    post(init.completion_handler, error_code{}, 42);
+    result = init.result.get();
+  }
+};
+
+TEST(Spawn, ReturnResult)
+{
+  boost::asio::io_context ioc;
+  boost::optional<spawn::result<int>> result;
+  spawn::spawn(ioc, result_handler{result});
+  ASSERT_EQ(2, ioc.poll());
+  ASSERT_TRUE(result);
+  ASSERT_TRUE(result->has_value());
+  EXPECT_EQ(42, result->value());
+}
+
+struct result_error_handler {
+  boost::optional<spawn::result<int>>& result;
+  void operator()(spawn::yield_context y) {
+    using Signature = void(error_code, int);
+    auto token = y.as_result();
+    boost::asio::async_completion<decltype(token), Signature> init(token);
+    post(init.completion_handler,
+         make_error_code(boost::asio::error::eof), 42);
+    result = init.result.get(); // does not throw
+  }
+};
+
+TEST(Spawn, ReturnResultError)
+{
+  boost::asio::io_context ioc;
+  boost::optional<spawn::result<int>> result;
+  spawn::spawn(ioc, result_error_handler{result});
+  ASSERT_EQ(2, ioc.poll());
+  ASSERT_TRUE(result);
+  EXPECT_FALSE(*result);
+  EXPECT_EQ(boost::asio::error::eof, result->error());
+  EXPECT_EQ(42, **result); // partial results are kept
+  EXPECT_THROW(result->value(), boost::system::system_error);
+}
+
+struct void_result_error_handler {
+  error_code& ec;
+  void operator()(spawn::yield_context y) {
+    using Signature = void(error_code);
+    auto token = y.as_result();
+    boost::asio::async_completion<decltype(token), Signature> init(token);
+    post(init.completion_handler,
+         make_error_code(boost::asio::error::operation_aborted));
+    spawn::result<void> r = init.result.get();
+    ec = r.error();
+  }
+};
+
+TEST(Spawn, ReturnVoidResultError)
+{
+  boost::asio::io_context ioc;
+  error_code ec;
+  spawn::spawn(ioc, void_result_error_handler{ec});
+  ASSERT_EQ(2, ioc.poll());
+  EXPECT_EQ(boost::asio::error::operation_aborted, ec);
+}
@@ -0,0 +1,129 @@
+//
+// test_trace.cc
+// ~~~~~~~~~~~~~
+//
+// Copyright (c) 2020 Casey Bodley (cbodley at redhat dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef SPAWN_TRACING
+#define SPAWN_TRACING
+#endif
+#include <spawn/spawn.hpp>
+#include <spawn/trace.hpp>
+#include <spawn/wait.hpp>
+
+#include <sstream>
+#include <string>
+#include <thread>
+
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/post.hpp>
+#include <gtest/gtest.h>
+
+static std::size_t count(const std::string& s, const std::string& what)
+{
+  std::size_t n = 0;
+  for (auto i = s.find(what); i != std::string::npos; i = s.find(what, i + 1)) {
+    ++n;
+  }
+  return n;
+}
+
+static std::string trace()
+{
+  std::ostringstream out;
+  spawn::write_chrome_trace(out);
+  return out.str();
+}
+
+struct void_op {
+  template <typename CompletionToken>
+  auto operator()(CompletionToken&& token)
+    -> BOOST_ASIO_INITFN_RESULT_TYPE(CompletionToken, void())
+  {
+    boost::asio::async_completion<CompletionToken, void()> init(token);
+    boost::asio::post(std::move(init.completion_handler));
+    return init.result.get();
+  }
+};
+
+struct traced_task
+{
+  template <typename Handler>
+  void operator()(spawn::basic_yield_context<Handler> yield)
+  {
+    boost::asio::post(yield);
+    boost::asio::post(yield.tag("tagged"));
+    spawn::wait_all(yield, void_op{}, void_op{});
+  }
+};
+
+TEST(Trace, Events)
+{
+  spawn::trace_reset();
+  boost::asio::io_context ioc;
+  spawn::spawn(ioc, traced_task{});
+  ioc.run();
+
+  const std::string json = trace();
+  EXPECT_EQ(0u, json.find("{\"traceEvents\":["));
+  EXPECT_EQ(1u, count(json, "\"name\":\"thread_name\""));
+  EXPECT_EQ(1u, count(json, "\"name\":\"spawn\""));
+  // started, then resumed after each of three waits
+  EXPECT_EQ(4u, count(json, "\"ph\":\"B\""));
+  EXPECT_EQ(4u, count(json, "\"ph\":\"E\""));
+  EXPECT_EQ(4u, count(json, "\"name\":\"traced_task\""));
+  EXPECT_EQ(1u, count(json, "\"suspend\":\"void ()\""));
+  EXPECT_EQ(1u, count(json, "\"suspend\":\"tagged\""));
+  EXPECT_EQ(1u, count(json, "\"suspend\":\"wait\""));
+  EXPECT_EQ(1u, count(json, "\"finish\":true"));
+}
+
+TEST(Trace, Reset)
+{
+  boost::asio::io_context ioc;
+  spawn::spawn(ioc, traced_task{});
+  ioc.run();
+  spawn::trace_reset();
+  EXPECT_EQ(0u, count(trace(), "\"ph\":"));
+}
+
+TEST(Trace, Threads)
+{
+  spawn::trace_reset();
+  boost::asio::io_context ioc;
+  for (int i = 0; i < 8; i++) {
+    spawn::spawn(ioc, traced_task{});
+  }
+  std::thread other([&ioc] { ioc.run(); });
+  ioc.run();
+  other.join();
+
+  const std::string json = trace();
+  EXPECT_EQ(8u, count(json, "\"name\":\"spawn\""));
+  EXPECT_EQ(8u, count(json, "\"finish\":true"));
+  EXPECT_EQ(count(json, "\"ph\":\"B\""), count(json, "\"ph\":\"E\""));
+}
+
+TEST(Trace, Wraparound)
+{
+  spawn::trace_reset();
+  boost::asio::io_context ioc;
+  spawn::spawn(ioc, [] (spawn::yield_context yield) {
+      for (int i = 0; i < SPAWN_TRACE_EVENTS; i++) {
+        boost::asio::post(yield);
+      }
+    });
+  ioc.run();
+
+  // only the most recent events are kept, and every end has a beginning
+  const std::string json = trace();
+  const std::size_t begins = count(json, "\"ph\":\"B\"");
+  const std::size_t ends = count(json, "\"ph\":\"E\"");
+  EXPECT_GE(begins, ends);
+  EXPECT_LE(begins + ends, std::size_t(SPAWN_TRACE_EVENTS));
+  EXPECT_EQ(1u, count(json, "\"finish\":true"));
+}
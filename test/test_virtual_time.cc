@@ -0,0 +1,167 @@
+//
+// test_virtual_time.cc
+// ~~~~~~~~~~~~~~~~~~~~
+//
+// Copyright (c) 2020 Casey Bodley (cbodley at redhat dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#include <spawn/virtual_time.hpp>
+#include <spawn/spawn.hpp>
+
+#include <chrono>
+#include <random>
+#include <vector>
+
+#include <boost/asio/post.hpp>
+#include <gtest/gtest.h>
+
+static_assert(boost::asio::execution::is_executor<
+                  spawn::virtual_time_context::executor_type>::value,
+              "virtual_time_context::executor_type is an executor");
+
+TEST(VirtualTime, Post)
+{
+  spawn::virtual_time_context ctx;
+  int count = 0;
+  boost::asio::post(ctx, [&] { ++count; });
+  boost::asio::post(ctx.get_executor(), [&] { ++count; });
+  EXPECT_EQ(0, count);
+  EXPECT_EQ(2u, ctx.run());
+  EXPECT_EQ(2, count);
+  EXPECT_EQ(spawn::virtual_time_context::time_point(), ctx.now());
+}
+
+TEST(VirtualTime, TimersFireInVirtualOrder)
+{
+  spawn::virtual_time_context ctx;
+  std::vector<int> order;
+  std::vector<spawn::virtual_time_context::duration> times;
+  for (int seconds : {30, 10, 20}) {
+    spawn::spawn(ctx, [&, seconds] (spawn::yield_context yield) {
+        spawn::virtual_timer timer(ctx, std::chrono::seconds(seconds));
+        timer.async_wait(yield);
+        order.push_back(seconds);
+        times.push_back(ctx.now().time_since_epoch());
+      });
+  }
+  ctx.run();
+  EXPECT_EQ((std::vector<int>{10, 20, 30}), order);
+  ASSERT_EQ(3u, times.size());
+  EXPECT_EQ(std::chrono::nanoseconds(std::chrono::seconds(10)), times[0]);
+  EXPECT_EQ(std::chrono::nanoseconds(std::chrono::seconds(20)), times[1]);
+  EXPECT_EQ(std::chrono::nanoseconds(std::chrono::seconds(30)), times[2]);
+  EXPECT_EQ(std::chrono::nanoseconds(std::chrono::seconds(30)), ctx.now().time_since_epoch());
+}
+
+TEST(VirtualTime, Cancel)
+{
+  spawn::virtual_time_context ctx;
+  boost::system::error_code ec1, ec2;
+  spawn::virtual_timer timer(ctx, std::chrono::hours(1));
+  timer.async_wait([&] (boost::system::error_code ec) { ec1 = ec; });
+  timer.async_wait([&] (boost::system::error_code ec) { ec2 = ec; });
+  EXPECT_EQ(0u, ctx.poll());
+  EXPECT_EQ(2u, timer.cancel());
+  EXPECT_EQ(0u, timer.cancel());
+  EXPECT_EQ(2u, ctx.run());
+  EXPECT_EQ(boost::asio::error::operation_aborted, ec1);
+  EXPECT_EQ(boost::asio::error::operation_aborted, ec2);
+  EXPECT_EQ(spawn::virtual_time_context::time_point(), ctx.now());
+}
+
+TEST(VirtualTime, RunUntil)
+{
+  spawn::virtual_time_context ctx;
+  int fired = 0;
+  spawn::virtual_timer t1(ctx, std::chrono::seconds(5));
+  spawn::virtual_timer t2(ctx, std::chrono::seconds(15));
+  t1.async_wait([&] (boost::system::error_code) { ++fired; });
+  t2.async_wait([&] (boost::system::error_code) { ++fired; });
+  EXPECT_EQ(1u, ctx.run_for(std::chrono::seconds(10)));
+  EXPECT_EQ(1, fired);
+  EXPECT_EQ(std::chrono::nanoseconds(std::chrono::seconds(10)), ctx.now().time_since_epoch());
+  EXPECT_EQ(1u, ctx.run());
+  EXPECT_EQ(2, fired);
+  EXPECT_EQ(std::chrono::nanoseconds(std::chrono::seconds(15)), ctx.now().time_since_epoch());
+}
+
+TEST(VirtualTime, Stop)
+{
+  spawn::virtual_time_context ctx;
+  int count = 0;
+  boost::asio::post(ctx, [&] { ++count; ctx.stop(); });
+  boost::asio::post(ctx, [&] { ++count; });
+  EXPECT_EQ(1u, ctx.run());
+  EXPECT_TRUE(ctx.stopped());
+  EXPECT_EQ(0u, ctx.run());
+  ctx.restart();
+  EXPECT_EQ(1u, ctx.run());
+  EXPECT_EQ(2, count);
+}
+
+// record the order in which coroutines resume from post(yield)
+static std::vector<int> interleave(std::uint64_t seed)
+{
+  spawn::virtual_time_context ctx(seed);
+  std::vector<int> order;
+  for (int i = 0; i < 8; i++) {
+    spawn::spawn(ctx, [&order, i] (spawn::yield_context yield) {
+        for (int j = 0; j < 8; j++) {
+          boost::asio::post(yield);
+          order.push_back(i);
+        }
+      });
+  }
+  ctx.run();
+  return order;
+}
+
+TEST(VirtualTime, FifoWithoutSeed)
+{
+  auto order = interleave(0);
+  ASSERT_EQ(64u, order.size());
+  for (int i = 0; i < 64; i++) {
+    EXPECT_EQ(i % 8, order[i]);
+  }
+}
+
+TEST(VirtualTime, SeedIsReproducible)
+{
+  auto a = interleave(42);
+  auto b = interleave(42);
+  auto c = interleave(43);
+  EXPECT_EQ(64u, a.size());
+  EXPECT_EQ(a, b);
+  EXPECT_NE(a, c);
+  EXPECT_NE(interleave(0), a);
+}
+
+TEST(VirtualTime, ManyCoroutines)
+{
+  constexpr int count = 10000;
+  spawn::virtual_time_context ctx(7);
+  std::mt19937_64 rng(7);
+  std::vector<spawn::virtual_time_context::duration> delays;
+  for (int i = 0; i < count; i++) {
+    delays.emplace_back(std::chrono::milliseconds(rng() % 60000));
+  }
+  int completed = 0;
+  int late = 0;
+  for (auto delay : delays) {
+    spawn::spawn(ctx, [&, delay] (spawn::yield_context yield) {
+        spawn::virtual_timer timer(ctx);
+        timer.expires_after(delay);
+        timer.async_wait(yield);
+        if (ctx.now().time_since_epoch() != delay) {
+          ++late;
+        }
+        ++completed;
+      }, boost::context::fixedsize_stack(16384));
+  }
+  ctx.run();
+  EXPECT_EQ(count, completed);
+  EXPECT_EQ(0, late);
+}
@@ -0,0 +1,149 @@
+//
+// test_wait.cc
+// ~~~~~~~~~~~~
+//
+// Copyright (c) 2020 Casey Bodley (cbodley at redhat dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#include <spawn/wait.hpp>
+
+#include <boost/asio/bind_executor.hpp>
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/post.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <gtest/gtest.h>
+
+#include <thread>
+
+using boost::system::error_code;
+
+// complete with the given values through the handler's executor
+struct post_op {
+  error_code ec;
+  int value;
+  template <typename CompletionToken>
+  auto operator()(CompletionToken&& token)
+    -> BOOST_ASIO_INITFN_RESULT_TYPE(CompletionToken, void(error_code, int))
+  {
+    boost::asio::async_completion<CompletionToken, void(error_code, int)> init(token);
+    auto ex = boost::asio::get_associated_executor(init.completion_handler);
+    boost::asio::post(ex, std::bind(std::move(init.completion_handler), ec, value));
+    return init.result.get();
+  }
+};
+
+struct void_op {
+  template <typename CompletionToken>
+  auto operator()(CompletionToken&& token)
+    -> BOOST_ASIO_INITFN_RESULT_TYPE(CompletionToken, void())
+  {
+    boost::asio::async_completion<CompletionToken, void()> init(token);
+    boost::asio::post(std::move(init.completion_handler));
+    return init.result.get();
+  }
+};
+
+struct timer_op {
+  boost::asio::steady_timer& timer;
+  auto operator()(spawn::wait_token token)
+    -> decltype(timer.async_wait(token))
+  {
+    return timer.async_wait(token);
+  }
+};
+
+using all_results = std::tuple<spawn::result<int>, spawn::result<int>,
+                               spawn::result<void>>;
+
+struct wait_all_handler {
+  boost::optional<all_results>& result;
+  void operator()(spawn::yield_context y) {
+    result = spawn::wait_all(y, post_op{{}, 1},
+                             post_op{boost::asio::error::eof, 2},
+                             void_op{});
+  }
+};
+
+TEST(Wait, WaitAll)
+{
+  boost::asio::io_context ioc;
+  boost::optional<all_results> result;
+  spawn::spawn(ioc, wait_all_handler{result});
+  ioc.run();
+  ASSERT_TRUE(result);
+  EXPECT_TRUE(std::get<0>(*result));
+  EXPECT_EQ(1, *std::get<0>(*result));
+  EXPECT_EQ(boost::asio::error::eof, std::get<1>(*result).error());
+  EXPECT_EQ(2, *std::get<1>(*result));
+  EXPECT_TRUE(std::get<2>(*result));
+}
+
+using any_results = std::pair<std::size_t, std::tuple<
+    boost::optional<spawn::result<void>>, boost::optional<spawn::result<int>>>>;
+
+struct wait_any_handler {
+  boost::asio::steady_timer& timer;
+  any_results& result;
+  void operator()(spawn::yield_context y) {
+    result = spawn::wait_any(y, timer_op{timer}, post_op{{}, 42});
+    timer.cancel();
+  }
+};
+
+TEST(Wait, WaitAny)
+{
+  boost::asio::io_context ioc;
+  boost::asio::steady_timer timer(ioc, std::chrono::hours(1));
+  any_results result;
+  spawn::spawn(ioc, wait_any_handler{timer, result});
+  ioc.run(); // the cancelled timer completion is discarded
+  EXPECT_EQ(1u, result.first);
+  EXPECT_FALSE(std::get<0>(result.second));
+  ASSERT_TRUE(std::get<1>(result.second));
+  EXPECT_EQ(42, **std::get<1>(result.second));
+}
+
+struct wait_all_destruct_handler {
+  boost::asio::steady_timer& timer;
+  bool& resumed;
+  void operator()(spawn::yield_context y) {
+    spawn::wait_all(y, timer_op{timer}, void_op{});
+    resumed = true;
+  }
+};
+
+TEST(Wait, WaitAllDestruct)
+{
+  bool resumed = false;
+  {
+    boost::asio::io_context ioc;
+    boost::asio::steady_timer timer(ioc, std::chrono::hours(1));
+    spawn::spawn(ioc, wait_all_destruct_handler{timer, resumed});
+    ioc.poll();
+    EXPECT_FALSE(ioc.stopped());
+  } // destroy the pending timer and unwind the coroutine
+  EXPECT_FALSE(resumed);
+}
+
+TEST(Wait, CompleteOnOtherThread)
+{
+  // without a strand, the last handler may run on the other thread while
+  // the coroutine is still switching away from this one
+  constexpr int iterations = 2000;
+  boost::asio::io_context ioc;
+  int sum = 0;
+  spawn::spawn(boost::asio::bind_executor(ioc.get_executor(), [] {}),
+      [&] (spawn::yield_context y) {
+        for (int i = 0; i < iterations; i++) {
+          auto r = spawn::wait_all(y, post_op{{}, 1}, post_op{{}, 1});
+          sum += *std::get<0>(r) + *std::get<1>(r);
+        }
+      });
+  std::thread other([&ioc] { ioc.run(); });
+  ioc.run();
+  other.join();
+  EXPECT_EQ(2 * iterations, sum);
+}